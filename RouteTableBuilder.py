@@ -0,0 +1,163 @@
+"""
+Writes include/asset_table.h, the compile time list of the static files in
+data/ with their size and ETag (see include/route_table.h). Builds with
+-DSTATIC_ASSETS_EMBEDDED also get src/asset_blobs.cpp, the stored bytes of
+every asset as a const array that stays in flash. Runs before every
+PlatformIO build as a pre: extra script, or by hand with
+"python3 RouteTableBuilder.py [--embed]". Files are only rewritten when their
+content changed, so an unchanged data/ does not cause a rebuild. Neither file is
+kept in git, like the .gzt pages of TemplateGzipBuilder.py.
+"""
+
+import os
+import re
+import sys
+
+EMBED_FLAG = "STATIC_ASSETS_EMBEDDED"
+
+try:
+    Import("env")  # noqa: F821, defined when PlatformIO runs the script
+    PROJECT_DIR = env.get("PROJECT_DIR")  # noqa: F821
+    EMBED = EMBED_FLAG in str(env.GetProjectOption("build_flags", ""))  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.abspath(__file__))
+    EMBED = "--embed" in sys.argv[1:]
+
+DATA_DIR = os.path.join(PROJECT_DIR, "data")
+OUTPUT = os.path.join(PROJECT_DIR, "include", "asset_table.h")
+BLOBS = os.path.join(PROJECT_DIR, "src", "asset_blobs.cpp")
+ROUTES = os.path.join(PROJECT_DIR, "include", "route_table.h")
+MAX_DEPTH = 3  # directories below data/, as deep as the web server looks
+PATH_LEN = 48  # STATIC_ASSET_PATH_LEN in asset_manifest.h
+
+
+def routed_paths():
+    with open(ROUTES) as routes:
+        return set(re.findall(r'\{"(/[^"]*)", ROUTE_', routes.read()))
+
+
+def fnv1a(data):
+    # the same hash AssetManifest computes for files on the filesystem
+    value = 2166136261
+    for byte in bytearray(data):
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def collect_assets():
+    assets = []
+    pages = []
+    for root, dirs, files in os.walk(DATA_DIR):
+        relative = os.path.relpath(root, DATA_DIR)
+        depth = 0 if relative == "." else relative.count(os.sep) + 1
+        if depth >= MAX_DEPTH:
+            dirs[:] = []
+        for name in files:
+            stored = os.path.join(root, name)
+            path = "/" + os.path.relpath(stored, DATA_DIR).replace(os.sep, "/")
+            gzip = path.endswith(".gz")
+            url = path[:-3] if gzip else path
+            # templates are served by the page routes, compressed ones too (TemplateGzipBuilder.py)
+            if url.endswith(".html"):
+                pages.append(url)
+                continue
+            if url.endswith(".gzt"):
+                continue
+            if len(url) >= PATH_LEN:
+                raise SystemExit("RouteTableBuilder: %s is longer than %d characters" % (url, PATH_LEN - 1))
+            with open(stored, "rb") as data:
+                content = data.read()
+            assets.append({"url": url, "gzip": gzip, "size": len(content), "hash": fnv1a(content),
+                           "content": content})
+    # the same byte order as strcmp
+    assets.sort(key=lambda asset: asset["url"].encode())
+    return assets, pages
+
+
+def render_table(assets):
+    lines = [
+        "#ifndef ASSET_TABLE_H",
+        "#define ASSET_TABLE_H",
+        "",
+        '#include "route_table.h"',
+        "",
+        "/*",
+        "    Generated by RouteTableBuilder.py from data/ before every build, do not",
+        "    edit. Sorted by path for findPath(). */",
+        "",
+        "#define ASSET_TABLE_SIZE %d" % len(assets),
+        "",
+        "#ifdef STATIC_ASSETS_EMBEDDED",
+    ]
+    for index in range(len(assets)):
+        lines.append("extern const uint8_t asset_blob_%d[];" % index)
+    lines += [
+        "#define ASSET_BLOB(index) asset_blob_##index",
+        "#else",
+        "#define ASSET_BLOB(index) nullptr",
+        "#endif",
+        "",
+    ]
+    if assets:
+        lines.append("constexpr asset_entry asset_table[] = {")
+        for index, asset in enumerate(assets):
+            lines.append('    {"%s", mimeType("%s"), %s, %d, "\\"%08x\\"", ASSET_BLOB(%d)},' % (
+                asset["url"], asset["url"], "true" if asset["gzip"] else "false", asset["size"], asset["hash"],
+                index))
+        lines.append("};")
+    else:
+        lines.append('constexpr asset_entry asset_table[1] = {{"", "", false, 0, "", nullptr}};')
+    lines += [
+        'static_assert(assetsSorted(asset_table, ASSET_TABLE_SIZE), "asset_table must be sorted by path");',
+        "",
+        "#endif",
+        "",
+    ]
+    return "\n".join(lines)
+
+
+def render_blobs(assets):
+    lines = [
+        "// Generated by RouteTableBuilder.py from data/ for -DSTATIC_ASSETS_EMBEDDED builds, do not edit",
+        '#include "asset_table.h"',
+        "",
+        "#ifdef STATIC_ASSETS_EMBEDDED",
+    ]
+    for index, asset in enumerate(assets):
+        lines.append("")
+        lines.append("// %s%s" % (asset["url"], ".gz" if asset["gzip"] else ""))
+        lines.append("const uint8_t asset_blob_%d[] PROGMEM = {" % index)
+        content = bytearray(asset["content"])
+        for offset in range(0, len(content), 24):
+            lines.append("    " + ",".join("0x%02x" % byte for byte in content[offset:offset + 24]) + ",")
+        lines.append("};")
+    lines += ["", "#endif", ""]
+    return "\n".join(lines)
+
+
+def write_if_changed(path, text):
+    try:
+        with open(path) as current:
+            if current.read() == text:
+                return False
+    except IOError:
+        pass
+    with open(path, "w") as output:
+        output.write(text)
+    return True
+
+
+def main():
+    assets, pages = collect_assets()
+    routed = routed_paths()
+    for page in pages:
+        if page not in routed:
+            print("RouteTableBuilder: %s has no route in route_table.h" % page)
+    if write_if_changed(OUTPUT, render_table(assets)):
+        print("RouteTableBuilder: %d assets written to %s" % (len(assets), os.path.relpath(OUTPUT, PROJECT_DIR)))
+    if EMBED and write_if_changed(BLOBS, render_blobs(assets)):
+        print("RouteTableBuilder: %d bytes embedded in %s" % (sum(asset["size"] for asset in assets),
+                                                              os.path.relpath(BLOBS, PROJECT_DIR)))
+
+
+main()
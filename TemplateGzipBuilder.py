@@ -0,0 +1,159 @@
+"""
+Writes data/<page>.gzt next to every HTML template in data/: the page split
+the same way PageTemplate::parse() splits it, with the literal text deflated
+at build time and the placeholders left open (see include/gzip_template.h).
+Every literal is compressed up to a full flush, so it ends on a byte boundary
+and never refers back across a placeholder; the server fills the gaps with
+stored deflate blocks and sends a valid gzip stream without a compressor.
+Runs before every PlatformIO build as a pre: extra script, or by hand with
+"python3 TemplateGzipBuilder.py". Files are only rewritten when their
+content changed.
+
+File layout, little endian:
+    "GZT1", uint16 segment count, uint16 0, uint32 literal bytes before compression
+    per segment: uint8 var, uint8 0, uint16 deflated length, uint32 crc32, uint32 x^(8n) mod P
+    the deflated literals one after the other
+"""
+
+import os
+import re
+import struct
+import zlib
+
+try:
+    Import("env")  # noqa: F821, defined when PlatformIO runs the script
+    PROJECT_DIR = env.get("PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.abspath(__file__))
+
+DATA_DIR = os.path.join(PROJECT_DIR, "data")
+TEMPLATE_SOURCE = os.path.join(PROJECT_DIR, "src", "page_template.cpp")
+MAX_SEGMENTS = 64  # TEMPLATE_MAX_SEGMENTS in page_template.h
+LITERAL = 0xFF  # TPL_LITERAL
+CRC_POLY = 0xEDB88320
+
+
+def template_vars():
+    # the placeholder names and TEMPLATE_NAME_MAX, from the parser itself
+    with open(TEMPLATE_SOURCE) as source:
+        text = source.read()
+    table = re.search(r"template_var_names\[TPL_VAR_COUNT\] = \{(.*?)\};", text, re.S).group(1)
+    names = re.findall(r'"([A-Z0-9_]+)"', table)
+    name_max = int(re.search(r"#define TEMPLATE_NAME_MAX (\d+)", text).group(1))
+    return {name.encode(): index for index, name in enumerate(names)}, name_max
+
+
+def split_template(text, names, name_max):
+    # PageTemplate::parse(), returns (var, literal bytes) pairs
+    segments = []
+    literal = bytearray()
+    start = i = 0
+    length = len(text)
+    while i < length:
+        if text[i:i + 1] != b"%":
+            i += 1
+            continue
+        # "%%" is an escaped percent sign
+        if text[i + 1:i + 2] == b"%":
+            literal += text[start:i + 1]
+            i += 2
+            start = i
+            continue
+        end = i + 1
+        while end < length and end - i <= name_max and text[end:end + 1] != b"%":
+            end += 1
+        var = names.get(text[i + 1:end]) if text[end:end + 1] == b"%" else None
+        # unknown names stay in the output untouched
+        if var is None:
+            i += 1
+            continue
+        literal += text[start:i]
+        if literal:
+            segments.append((LITERAL, bytes(literal)))
+        literal = bytearray()
+        segments.append((var, b""))
+        i = end + 1
+        start = i
+    literal += text[start:]
+    # always ends with a literal, it carries the final deflate block
+    segments.append((LITERAL, bytes(literal)))
+    return segments
+
+
+def multmodp(a, b):
+    # a * b modulo the CRC-32 polynomial, bit reflected as in zlib
+    m = 1 << 31
+    p = 0
+    while True:
+        if a & m:
+            p ^= b
+            if a & (m - 1) == 0:
+                break
+        m >>= 1
+        b = (b >> 1) ^ CRC_POLY if b & 1 else b >> 1
+    return p
+
+
+def x8nmodp(n):
+    # x^(8n) modulo P: multiplying a crc by it appends n bytes of zeros, crc32_combine() in zlib
+    p = 1 << 31
+    square = 1 << 23  # x^8
+    while n:
+        if n & 1:
+            p = multmodp(square, p)
+        square = multmodp(square, square)
+        n >>= 1
+    return p
+
+
+def build(text, names, name_max):
+    segments = split_template(text, names, name_max)
+    if len(segments) > MAX_SEGMENTS:
+        raise ValueError("more than %d segments" % MAX_SEGMENTS)
+    deflate = zlib.compressobj(9, zlib.DEFLATED, -15, 9)
+    table = bytearray()
+    blobs = bytearray()
+    plain = 0
+    for index, (var, literal) in enumerate(segments):
+        if var != LITERAL:
+            table += struct.pack("<BBHII", var, 0, 0, 0, 0)
+            continue
+        last = index == len(segments) - 1
+        packed = deflate.compress(literal) + deflate.flush(zlib.Z_FINISH if last else zlib.Z_FULL_FLUSH)
+        if len(packed) > 0xFFFF:
+            raise ValueError("a literal does not fit 64 KiB once deflated")
+        table += struct.pack("<BBHII", LITERAL, 0, len(packed), zlib.crc32(literal) & 0xFFFFFFFF,
+                             x8nmodp(len(literal)))
+        blobs += packed
+        plain += len(literal)
+    return b"GZT1" + struct.pack("<HHI", len(segments), 0, plain) + bytes(table) + bytes(blobs)
+
+
+def write_if_changed(path, content):
+    try:
+        with open(path, "rb") as current:
+            if current.read() == content:
+                return False
+    except IOError:
+        pass
+    with open(path, "wb") as output:
+        output.write(content)
+    return True
+
+
+def main():
+    names, name_max = template_vars()
+    for name in sorted(os.listdir(DATA_DIR)):
+        if not name.endswith(".html"):
+            continue
+        with open(os.path.join(DATA_DIR, name), "rb") as page:
+            text = page.read()
+        try:
+            content = build(text, names, name_max)
+        except ValueError as error:
+            raise SystemExit("TemplateGzipBuilder: %s has %s" % (name, error))
+        if write_if_changed(os.path.join(DATA_DIR, name + ".gzt"), content):
+            print("TemplateGzipBuilder: %s %d -> %d bytes" % (name, len(text), len(content)))
+
+
+main()
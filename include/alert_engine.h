@@ -0,0 +1,82 @@
+#ifndef ALERT_ENGINE_H
+#define ALERT_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct tank_sensor;
+
+/*
+    Threshold alerts of one tank: nearly full, battery low (percentage and
+    voltage) and no reading for too long. The rules are evaluated on the
+    loop task after every reading, the stale rule also once a minute, with
+    fixed state and no allocation; delivery is up to AlertNotifier.
+
+    A rule raises once its condition held for ALERT_DEBOUNCE readings in a
+    row and clears once the value is back past the threshold by the
+    hysteresis for as many, so a level wobbling around the mark does not
+    flap. Notifications are rate limited per rule: a rule that raises again
+    within ALERT_REPEAT_MS of its last notification stays silent (counted
+    as suppressed), and so does the clear that follows. A threshold of 0
+    turns its rule off. */
+
+#define ALERT_DEBOUNCE 2 // readings
+#define ALERT_LEVEL_HYSTERESIS 5 // %
+#define ALERT_BATTERY_HYSTERESIS 5 // %
+#define ALERT_VOLTAGE_HYSTERESIS 100 // mV
+#define ALERT_REPEAT_MS 3600000UL
+
+enum alert_kind
+{
+    ALERT_LEVEL,   // fill percentage at or above the threshold
+    ALERT_BATTERY, // battery percentage below
+    ALERT_VOLTAGE, // battery voltage below
+    ALERT_STALE,   // no reading for the threshold in minutes
+    ALERT_KINDS
+};
+
+// The thresholds, stored as they are in Preferences
+struct alert_rules
+{
+    uint8_t level_perc;
+    uint8_t battery_perc;
+    uint16_t voltage_mv;
+    uint16_t stale_minutes;
+};
+
+struct alert_rule_state
+{
+    bool active;
+    bool notified; // the raise went out, so the clear goes out too
+    bool seen;     // notified_ms is valid
+    uint8_t count; // readings in a row towards the other state
+    uint32_t notified_ms;
+};
+
+struct tank_alerts
+{
+    alert_rules rules;
+    alert_rule_state state[ALERT_KINDS];
+    uint32_t raised;
+    uint32_t cleared;
+    uint32_t suppressed;
+};
+
+struct alert_event
+{
+    uint32_t queued_ms; // millis() when it happened, turned into a time on delivery
+    uint8_t sensor_id;
+    uint8_t kind; // alert_kind
+    bool raised;  // false when cleared
+    float value;
+    float threshold;
+};
+
+// Evaluates the rules after a reading of the sensor, writes up to ALERT_KINDS events, returns their number
+size_t alertReading(tank_sensor &sensor, uint32_t nowMs, alert_event *events);
+// Evaluates the stale rule, the sensor may be silent; writes up to one event
+size_t alertStale(tank_sensor &sensor, unsigned long uptimeMinutes, uint32_t nowMs, alert_event *events);
+// The kind as it appears in notifications
+const char *alertKindName(uint8_t kind);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef ALERT_NOTIFIER_H
+#define ALERT_NOTIFIER_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include "alert_engine.h"
+#include "delivery.h"
+
+/*
+    Delivers alert events to a webhook from a task of its own, so a slow or
+    unreachable receiver never holds up the loop that evaluates the rules.
+    Same shape as the ThingSpeak uploader: the loop hands events over
+    through a lock-free queue and wakes the task, the task keeps them in an
+    outbox (the oldest event is dropped when it overflows) and POSTs them
+    one by one as JSON, oldest first. A failed delivery is retried with
+    exponential backoff from ALERT_RETRY_MS up to ALERT_BACKOFF_MAX_MS, an
+    event the receiver refuses (4xx) is dropped. */
+
+#define ALERT_QUEUE 16 // power of two
+#define ALERT_OUTBOX 32
+#define ALERT_RETRY_MS 5000UL
+#define ALERT_BACKOFF_MAX_MS 300000UL
+#define ALERT_TIMEOUT_MS 5000
+#define ALERT_URL_LEN 128
+#define ALERT_BODY_SIZE 256
+#ifndef ALERT_CORE
+#define ALERT_CORE 1
+#endif
+#define ALERT_STACK 4096
+
+struct notifier_stats
+{
+    uint32_t queued;
+    uint32_t rejected; // the queue to the task was full
+    uint32_t delivered;
+    uint32_t failures;
+    uint32_t dropped; // pushed out of a full outbox or refused by the receiver
+    uint32_t outbox;
+    uint32_t consecutive_failures;
+    uint32_t backoff_ms;
+    uint32_t last_latency_ms; // queued to delivered, of the last event
+    uint32_t last_request_ms;
+};
+
+class AlertNotifier
+{
+public:
+    AlertNotifier();
+
+    // Starts the delivery task
+    bool begin();
+    // Thread safe, an empty URL holds the events in the outbox
+    void configure(const char *url);
+    // Producer side, call from the loop task only. Returns false when the queue is full.
+    bool enqueue(const alert_event &event);
+
+    notifier_stats stats() const;
+    TaskHandle_t task() const { return m_task; }
+
+private:
+    static void taskMain(void *arg);
+    void run();
+    void drainQueue();
+    // HTTP status of the POST, negative when it could not be sent
+    int deliver(const alert_event &event, const char *url);
+
+    SpscQueue<alert_event, ALERT_QUEUE> m_queue;
+    DeliveryBacklog<alert_event, ALERT_OUTBOX> m_outbox;
+    RetryBackoff m_backoff;
+    char m_url[ALERT_URL_LEN];
+    uint32_t m_rejected; // written by the producer only
+    WiFiClient m_client;
+    char m_body[ALERT_BODY_SIZE];
+    notifier_stats m_stats;
+    TaskHandle_t m_task;
+    portMUX_TYPE m_mux; // guards the URL
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef ASSET_MANIFEST_H
+#define ASSET_MANIFEST_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "asset_table.h"
+
+/*
+    Static files (css, js, fonts) never change at runtime. Which ones exist
+    and their MIME types is known at compile time (asset_table.h), at boot
+    the manifest adds the size and content hash of every file found in the
+    filesystem, so looking one up needs no filesystem access. Firmware built
+    with -DSTATIC_ASSETS_EMBEDDED carries the files themselves in flash
+    (src/asset_blobs.cpp) and by default the manifest takes everything from
+    the table, the filesystem is then only needed for the mutable data. Kept
+    apart from the web server handler so the native build can use it too. */
+
+#define STATIC_ASSET_PATH_LEN 48
+
+enum asset_source
+{
+    ASSET_SOURCE_FS,    // the files in data/, uploaded to LittleFS
+    ASSET_SOURCE_FLASH, // the arrays in asset_table, only with STATIC_ASSETS_EMBEDDED
+};
+
+#ifdef STATIC_ASSETS_EMBEDDED
+#define ASSET_SOURCE_DEFAULT ASSET_SOURCE_FLASH
+#else
+#define ASSET_SOURCE_DEFAULT ASSET_SOURCE_FS
+#endif
+
+struct static_asset
+{
+    const char *path; // url, without the .gz suffix
+    const char *mime;
+    uint32_t size;   // bytes stored on flash (compressed size for gzip)
+    uint32_t hash;   // FNV-1a of the stored bytes
+    char etag[11];   // "xxxxxxxx" including the quotes
+    bool gzip;
+    const uint8_t *data; // the stored bytes in flash, nullptr when served from the filesystem
+};
+
+class AssetManifest
+{
+public:
+    explicit AssetManifest(fs::FS &fs);
+
+    // Hashes the files of asset_table, the ones missing from the filesystem are left out.
+    // From flash nothing is read, size and ETag were computed by RouteTableBuilder.py.
+    size_t scan(asset_source source = ASSET_SOURCE_DEFAULT);
+
+    const static_asset *find(const char *path) const;
+    size_t count() const { return m_count; }
+    const static_asset &at(size_t index) const { return m_assets[index]; }
+    // The stored file of an asset, the .gz one for gzip assets
+    File open(const static_asset &asset);
+
+private:
+    bool addFile(const asset_entry &entry);
+    bool addBlob(const asset_entry &entry);
+
+    fs::FS &m_fs;
+    static_asset m_assets[ASSET_TABLE_SIZE > 0 ? ASSET_TABLE_SIZE : 1]; // in asset_table order, sorted
+    size_t m_count;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+#include "page_template.h"
+#include "gzip_template.h"
+#include "dashboard.h"
+#include "asset_manifest.h"
+
+/*
+    Micro benchmarks of the request path that run unchanged on the device
+    (type "bench" or "bench csv" into the serial monitor) and in the native
+    build (env:native_bench). An operation is timed in samples of a batch of
+    calls, and the report gives the per call mean, median, 99th percentile
+    and worst sample, the heap allocations per call where they can be
+    counted (native only, -1 on the device) and the heap left allocated.
+    Cases that keep several responses in flight also report the heap they
+    hold at the peak. Reports are JSON or CSV so runs of different commits
+    can be compared by a script.
+
+    Each path that replaced an older one is measured against it in the same
+    run. The old way of doing it follows as a row of the same name with a
+    "legacy" suffix (decode ascii, render <page>, asset read <path>), or the
+    two ways form a pair: buffered and streamed, route linear and route
+    table. */
+
+#define BENCH_SAMPLES 64
+#define BENCH_NAME_LEN 64
+#define BENCH_CLIENTS 5 // browsers loading a page at the same time
+
+enum bench_format : uint8_t
+{
+    BENCH_JSON,
+    BENCH_CSV
+};
+
+struct bench_result
+{
+    char name[BENCH_NAME_LEN];
+    uint32_t ops;
+    float ops_per_s;
+    float mean_us; // per call
+    float p50_us;
+    float p99_us;
+    float max_us;
+    float allocs;       // per call, -1 when not counted
+    int32_t heap_delta; // bytes still allocated after the run
+    int32_t peak_heap;  // heap held per response in flight at the peak, -1 when not measured
+    uint32_t bytes;     // output per call
+};
+
+// Receives the report piece by piece
+typedef void (*bench_writer)(void *ctx, const char *data, size_t len);
+// The operation to time, returns the bytes it produced
+typedef size_t (*bench_op)(void *ctx);
+
+class BenchReport
+{
+public:
+    BenchReport(bench_format format, bench_writer write, void *ctx);
+
+    void begin(const char *platform);
+    void add(const bench_result &result);
+    void end();
+
+private:
+    void printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    bench_format m_format;
+    bench_writer m_write;
+    void *m_ctx;
+    size_t m_count;
+};
+
+// Runs op in BENCH_SAMPLES samples of batch calls each
+void benchRun(const char *name, bench_op op, void *ctx, uint32_t batch, bench_result &out);
+// Per call figures from latencies measured elsewhere (HTTP clients)
+void benchSummarize(const char *name, uint32_t *latencies_us, size_t count, uint32_t elapsedUs, uint32_t bytes,
+                    bench_result &out);
+
+// Each frame format through decodePacket(), and the ASCII frame as a "legacy" row through the String
+// concatenation and getValue() split the receiver used before
+void benchDecode(BenchReport &report);
+// The page from its parsed segments, then as a "legacy" row the way it was sent before: the text scanned on
+// every request and each placeholder matched by name against the whole list, the value returned as a String
+void benchRender(BenchReport &report, const char *name, const PageTemplate &page, const dashboard_context &ctx);
+// The same page as a gzip response, bytes is what goes over the air
+void benchGzipRender(BenchReport &report, const char *name, const GzipTemplate &page, const dashboard_context &ctx);
+// clients renders in flight at once, each page buffered whole (as before) and streamed by TemplateStream
+void benchConcurrentRender(BenchReport &report, const char *name, const PageTemplate &page,
+                           const dashboard_context &ctx, size_t clients = BENCH_CLIENTS);
+void benchStateJson(BenchReport &report, const SensorRegistry &sensors, const LinkMonitor &links);
+// Matching a URL against route_table and asset_table, and against the same entries one by one
+void benchRoutes(BenchReport &report);
+// Manifest lookup (a 304), the first TCP sized chunk of a 200 (time to first byte) and the whole body
+// (throughput), from the filesystem and, in builds with STATIC_ASSETS_EMBEDDED, from the arrays in flash.
+// The whole body also the way loadFromLittleFS() sent it, as a "legacy" row.
+void benchAssets(BenchReport &report, fs::FS &fs, size_t maxAssets = 4);
+
+#endif
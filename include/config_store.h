@@ -0,0 +1,185 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "alert_engine.h"
+#include "alert_notifier.h"
+#include "http_sink.h"
+#include "mqtt_publisher.h"
+#include "sensor_registry.h"
+#include "thingspeak_uploader.h"
+
+/*
+    All settings of the "jimka" namespace as one record, stored as a single
+    NVS blob and read once at boot into RAM. Every key used to be written on
+    its own, a save of the configuration page rewrote all of them whether
+    they changed or not.
+
+    A change is made on a copy and handed to commit(), which compares it
+    with what is in RAM: an unchanged copy writes nothing, a changed one
+    replaces the RAM copy and the whole record is written by service() from
+    the loop once no other change followed for CONFIG_COALESCE_MS, so a save
+    and the tank it registers cost one write. NVS replaces a blob only once
+    the new one is complete, a power cut keeps the old record or the new
+    one. The blob carries a CRC and a count of the writes it has seen over
+    the life of the device.
+
+    The task that called begin(), the loop, reads the settings in place
+    through get(). It sees a copy of its own that is only refreshed on its
+    task, so a commit from the web server task cannot change the bytes
+    under a reader. Any other task works on a snapshot().
+
+    Fields are only ever appended to jimka_config; a record of an older
+    version is read as far as it goes and the rest keeps its defaults. A
+    device without the blob migrates the per-key layout once and removes
+    the old keys. The Wi-Fi credentials ("wifi_access") are not part of it. */
+
+#define CONFIG_NAMESPACE "jimka"
+#define CONFIG_KEY "config"
+#define CONFIG_MAGIC 0x31474643 // "CFG1"
+#define CONFIG_VERSION 1
+#define CONFIG_COALESCE_MS 2000UL
+#define CONFIG_UPDATE_ATTEMPTS 3
+#define CONFIG_MQTT_PORT 1883
+#define CONFIG_DUCKDNS_LEN 64
+#define CONFIG_INFLUX_TOKEN_LEN (HTTP_SINK_AUTH_LEN - 6) // sent as "Token <token>"
+
+struct tank_config
+{
+    uint8_t id;
+    uint32_t depth;
+    uint32_t inlet;
+    uint32_t emptied_at; // unix time of the last pump-out, 0 when not seen yet
+    alert_rules alerts;
+};
+
+// Append only, see above
+struct jimka_config
+{
+    uint8_t tank_count;
+    tank_config tanks[SENSOR_MAX]; // in the order they were registered
+    char thingspeak_api[THINGSPEAK_KEY_LEN];
+    uint32_t thingspeak_channel;
+    char duckdns_domain[CONFIG_DUCKDNS_LEN];
+    char duckdns_token[CONFIG_DUCKDNS_LEN];
+    char alert_url[ALERT_URL_LEN];
+    char mqtt_host[MQTT_HOST_LEN];
+    uint16_t mqtt_port;
+    char mqtt_user[MQTT_USER_LEN];
+    char mqtt_password[MQTT_PASSWORD_LEN];
+    char influx_url[HTTP_SINK_URL_LEN];
+    char influx_token[CONFIG_INFLUX_TOKEN_LEN];
+    char webhook_url[HTTP_SINK_URL_LEN];
+    uint8_t sinks; // telemetry_slot bits
+};
+
+enum config_source
+{
+    CONFIG_DEFAULTS, // nothing stored yet
+    CONFIG_LOADED,
+    CONFIG_UPGRADED, // a record of an older version
+    CONFIG_MIGRATED, // from the per-key layout
+    CONFIG_RESET     // the stored record was damaged or of another layout
+};
+
+enum config_commit
+{
+    CONFIG_UNCHANGED,
+    CONFIG_CHANGED,
+    CONFIG_CONFLICT // another task committed since the copy was taken
+};
+
+struct config_stats
+{
+    uint32_t lifetime_writes; // stored with the record
+    uint32_t writes;          // since boot
+    uint32_t commits;         // changes taken into RAM
+    uint32_t unchanged;       // commits that changed nothing
+    uint32_t coalesced;       // commits that shared a write with a later one
+    uint32_t failures;        // writes NVS refused, retried
+    uint32_t size;            // of the blob
+    uint8_t source;           // config_source
+    bool dirty;               // a change waits for service()
+};
+
+class ConfigStore
+{
+public:
+    ConfigStore();
+
+    // Reads the record once, migrating the per-key layout when there is none
+    bool begin();
+    // The settings as of the latest commit, from the task that called begin() only
+    const jimka_config &get() const;
+    // Copies the settings and returns the generation to commit the copy against, safe from any task
+    uint32_t snapshot(jimka_config &draft) const;
+    // Takes a changed copy into RAM, the write follows in service()
+    config_commit commit(const jimka_config &draft, uint32_t generation);
+    // Applies change to a copy and commits it, again when another task got in between. True when it changed anything.
+    template <typename Change>
+    bool update(Change change)
+    {
+        jimka_config draft;
+        for (int attempt = 0; attempt < CONFIG_UPDATE_ATTEMPTS; attempt++)
+        {
+            uint32_t generation = snapshot(draft);
+            change(draft);
+            config_commit result = commit(draft, generation);
+            if (result != CONFIG_CONFLICT)
+                return result == CONFIG_CHANGED;
+        }
+        return false;
+    }
+    // Writes a pending change, from the loop only; force skips the wait for more changes
+    void service(bool force = false);
+    config_stats stats() const;
+
+    static void defaults(jimka_config &config);
+    // The entry of a tank, added with the defaults when add is set and there is room
+    static tank_config *tank(jimka_config &config, uint8_t id, bool add = false);
+    static const tank_config *tank(const jimka_config &config, uint8_t id);
+    // Zero-fills the rest of the field, equal settings have to compare equal byte for byte
+    template <size_t N>
+    static void setText(char (&field)[N], const char *value)
+    {
+        strncpy(field, value, N);
+        field[N - 1] = '\0';
+    }
+
+private:
+    struct header
+    {
+        uint32_t magic;
+        uint32_t crc; // of the rest of the header and the body
+        uint16_t version;
+        uint16_t size; // of the body
+        uint8_t tank_slots;
+        uint8_t reserved[3];
+        uint32_t writes;
+    };
+    struct blob
+    {
+        header head;
+        jimka_config body;
+    };
+
+    bool load(Preferences &prefs, size_t length);
+    bool migrate(Preferences &prefs);
+    void removeLegacy(Preferences &prefs, const uint8_t *ids, size_t count);
+    bool write(Preferences &prefs);
+    static uint32_t checksum(const blob &record, size_t size);
+
+    jimka_config m_config;
+    mutable jimka_config m_view; // what get() returns, owner task only
+    mutable uint32_t m_viewGeneration;
+    TaskHandle_t m_owner;
+    blob m_blob; // what service() writes, loop only
+    uint32_t m_generation;
+    uint32_t m_changedMs;
+    bool m_dirty;
+    config_stats m_stats;
+    mutable portMUX_TYPE m_mux; // guards m_config, m_generation and the dirty state
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sensor_registry.h"
+#include "link_monitor.h"
+#include "telemetry_sink.h"
+
+/*
+    What the pages and the state API show: placeholder values and the state
+    document, generated from the sensor registry and the link statistics.
+    Nothing here touches the web server, so the device and the native build
+    render with the same code. */
+
+struct dashboard_context
+{
+    const tank_sensor *sensor; // the tank a page is rendered for
+    const LinkMonitor *links;
+    const char *thingspeak_api;
+    uint32_t thingspeak_channel;
+    const char *duckdns_domain;
+    const char *duckdns_token;
+    const char *alert_url;
+    const char *mqtt_host;
+    uint16_t mqtt_port;
+    const char *mqtt_user;
+    uint8_t sinks; // telemetry sinks switched on, bit per telemetry_slot
+    const char *influx_url;
+    const char *influx_token;
+    const char *webhook_url;
+    uint32_t uptime_s;
+};
+
+// Writes the value of a page placeholder into buf, returns the number of bytes used
+size_t dashboardValue(uint8_t var, const dashboard_context &ctx, char *buf, size_t size);
+// The /api/v1/state document of all tanks, returns its length
+size_t writeStateJson(const SensorRegistry &sensors, const LinkMonitor &links, char *json, size_t capacity);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef DELIVERY_H
+#define DELIVERY_H
+
+#include <Arduino.h>
+#include "spsc_queue.h"
+
+/*
+    The parts every sender with a task of its own shares: the alert
+    notifier, the ThingSpeak uploader and the HTTP sinks. The loop hands
+    items over through a lock-free queue, the task moves them into a
+    DeliveryBacklog, a ring that drops the oldest item when it overflows,
+    and sends them oldest first. RetryBackoff paces the attempts: after a
+    failure the next one waits the base delay, doubled with every further
+    failure up to the limit, and an attempt that settles the item clears
+    the wait again. The MQTT publisher paces its connection attempts with
+    it as well. */
+
+enum delivery_result
+{
+    DELIVERY_SENT,
+    DELIVERY_REFUSED, // a receiver that refuses a request will refuse it again, it is dropped
+    DELIVERY_FAILED   // kept and tried again after the backoff
+};
+
+// 2xx is sent, 4xx refused, anything else (5xx, no connection) failed
+delivery_result deliveryResult(int status);
+
+// Touched by the sending task only
+template <typename T, size_t N>
+class DeliveryBacklog
+{
+public:
+    DeliveryBacklog() : m_first(0), m_count(0) {}
+
+    // Moves everything waiting in the queue and returns how many, dropped counts the oldest items pushed out
+    template <size_t Q>
+    uint32_t drain(SpscQueue<T, Q> &queue, uint32_t &dropped)
+    {
+        uint32_t moved = 0;
+        T item;
+        while (queue.pop(item))
+        {
+            if (m_count == N)
+            {
+                m_first = (m_first + 1) % N;
+                m_count--;
+                dropped++;
+            }
+            m_items[(m_first + m_count) % N] = item;
+            m_count++;
+            moved++;
+        }
+        return moved;
+    }
+
+    size_t count() const { return m_count; }
+    // 0 is the oldest
+    const T &at(size_t index) const { return m_items[(m_first + index) % N]; }
+    // The oldest count items, once they are delivered or dropped
+    void remove(size_t count)
+    {
+        if (count > m_count)
+            count = m_count;
+        m_first = (m_first + count) % N;
+        m_count -= count;
+    }
+
+private:
+    T m_items[N];
+    size_t m_first;
+    size_t m_count;
+};
+
+class RetryBackoff
+{
+public:
+    RetryBackoff(uint32_t baseMs, uint32_t maxMs);
+
+    // Whether the wait since the last attempt is over
+    bool due() const { return millis() - m_lastMs >= m_waitMs; }
+    // The attempt settled its items, sent or refused; the next one may follow after pauseMs
+    void clear(uint32_t pauseMs = 0);
+    // The next attempt waits the base delay, or twice the last wait while failures follow each other
+    void failed();
+
+    uint32_t failures() const { return m_failures; }
+    // The wait after the last failure, 0 when the last attempt did not fail
+    uint32_t backoffMs() const { return m_failures > 0 ? m_waitMs : 0; }
+
+private:
+    uint32_t m_baseMs;
+    uint32_t m_maxMs;
+    uint32_t m_lastMs;
+    uint32_t m_waitMs;
+    uint32_t m_failures;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef FIXED_STRING_H
+#define FIXED_STRING_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+    Text with a capacity fixed at compile time, for settings and messages
+    that used to be Arduino Strings. It lives wherever it is declared
+    (stack, global, member), never touches the heap, and truncates instead
+    of growing: whatever does not fit is cut off (at a byte, a multi-byte
+    UTF-8 character may be split) and truncated() reports it. */
+
+template <size_t N>
+class FixedString
+{
+    static_assert(N > 1, "FixedString needs room for at least one character");
+
+public:
+    FixedString() : m_length(0), m_truncated(false) { m_text[0] = '\0'; }
+    FixedString(const char *text) : FixedString() { append(text); }
+
+    FixedString &operator=(const char *text)
+    {
+        clear();
+        append(text);
+        return *this;
+    }
+
+    FixedString &append(const char *text, size_t length)
+    {
+        size_t room = N - 1 - m_length;
+        if (length > room)
+        {
+            length = room;
+            m_truncated = true;
+        }
+        memcpy(m_text + m_length, text, length);
+        m_length += length;
+        m_text[m_length] = '\0';
+        return *this;
+    }
+    FixedString &append(const char *text) { return append(text, text != nullptr ? strlen(text) : 0); }
+    FixedString &operator+=(const char *text) { return append(text); }
+
+    FixedString &appendf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(m_text + m_length, N - m_length, format, args);
+        va_end(args);
+        if (written > 0)
+        {
+            if ((size_t)written >= N - m_length)
+            {
+                written = N - 1 - m_length;
+                m_truncated = true;
+            }
+            m_length += written;
+        }
+        return *this;
+    }
+
+    void clear()
+    {
+        m_length = 0;
+        m_truncated = false;
+        m_text[0] = '\0';
+    }
+
+    const char *c_str() const { return m_text; }
+    operator const char *() const { return m_text; }
+    size_t length() const { return m_length; }
+    bool isEmpty() const { return m_length == 0; }
+    bool truncated() const { return m_truncated; }
+    static constexpr size_t capacity() { return N - 1; }
+
+    bool operator==(const char *text) const { return strcmp(m_text, text != nullptr ? text : "") == 0; }
+    bool operator!=(const char *text) const { return !(*this == text); }
+
+private:
+    char m_text[N];
+    size_t m_length;
+    bool m_truncated;
+};
+
+#endif
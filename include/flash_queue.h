@@ -0,0 +1,71 @@
+#ifndef FLASH_QUEUE_H
+#define FLASH_QUEUE_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+/*
+    A bounded FIFO of small records, for what has to outlive a long network
+    outage or a reboot. Each record is a file of its own in the directory of
+    the queue, named after its slot in a ring, and carries a sequence
+    number; begin() finds the oldest and the newest by scanning the slots,
+    so no header has to be kept up to date. LittleFS copies everything after
+    a write in the middle of a file, which is why nothing is written in
+    place: a push writes one new file, a pop removes one. A power cut loses
+    at most the record being added, its file is shorter than its header
+    says and begin() removes it. When the ring is full the oldest record is
+    dropped. Only one task may use a queue, the files are opened for every
+    operation. */
+
+#define FLASH_QUEUE_MAGIC 0x32515146 // "FQQ2"
+#define FLASH_QUEUE_PATH_LEN 32
+
+struct flash_queue_stats
+{
+    uint32_t pushed;
+    uint32_t popped;
+    uint32_t dropped; // oldest records pushed out of a full ring
+    uint32_t write_errors;
+};
+
+class FlashQueue
+{
+public:
+    FlashQueue(fs::FS &fs, const char *path, uint16_t slotSize, uint16_t slots);
+
+    // Recovers the records of the last run, a damaged or foreign record is removed
+    bool begin();
+    // Appends a record of at most slotSize - 2 bytes
+    bool push(const void *record, size_t length);
+    // Copies the oldest record, returns its length or 0 when empty
+    size_t peek(void *record, size_t capacity);
+    bool pop();
+    size_t count() const { return m_count; }
+    size_t capacity() const { return m_slots; }
+    const flash_queue_stats &stats() const { return m_stats; }
+
+private:
+    struct record_header
+    {
+        uint32_t magic;
+        uint32_t seq;
+        uint16_t length;
+        uint16_t reserved;
+    };
+
+    // False when the directory leaves no room for the name
+    bool slotPath(uint32_t slot, char *path, size_t size) const;
+    // Opens the record in slot and reads its header, the file is left at the data
+    bool openRecord(uint32_t slot, record_header &head, File &file);
+    bool validRecord(uint32_t slot, uint32_t seq);
+
+    fs::FS &m_fs;
+    const char *m_path; // a directory
+    uint16_t m_slotSize;
+    uint16_t m_slots;
+    uint32_t m_first; // sequence number of the oldest record
+    uint32_t m_count;
+    flash_queue_stats m_stats;
+};
+
+#endif
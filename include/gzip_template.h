@@ -0,0 +1,88 @@
+#ifndef GZIP_TEMPLATE_H
+#define GZIP_TEMPLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "page_template.h"
+
+/*
+    A page template compressed at build time (TemplateGzipBuilder.py writes
+    data/<page>.gzt): the literal text of the page as raw deflate data, one
+    piece per literal, each ending on a byte boundary without references
+    into the text before it. A response is the gzip header, the literals as
+    they are with every placeholder value sent between them as a stored
+    (uncompressed) deflate block, and the CRC-32 and length of the whole
+    page. The CRC of a literal was computed by the build together with the
+    factor that shifts a running CRC past it, so the server only checksums
+    the few bytes of the values and never runs a compressor. */
+
+#define GZIP_TEMPLATE_MAGIC "GZT1"
+
+// As stored in the file, little endian like the ESP32
+struct gzip_segment
+{
+    uint8_t var; // template_var or TPL_LITERAL
+    uint8_t reserved;
+    uint16_t length; // deflated bytes of a literal, 0 for placeholders
+    uint32_t crc;    // CRC-32 of the literal before compression
+    uint32_t shift;  // x^(8 * literal length) modulo the CRC polynomial
+};
+static_assert(sizeof(gzip_segment) == 12, "gzip_segment is read straight from the file");
+
+class GzipTemplate
+{
+public:
+    GzipTemplate();
+    ~GzipTemplate();
+
+    // Takes ownership of a malloc()ed buffer holding the whole .gzt file
+    bool parse(uint8_t *data, size_t length);
+    bool loaded() const { return m_data != nullptr; }
+
+    size_t segmentCount() const { return m_count; }
+    const gzip_segment &segment(size_t index) const { return m_segments[index]; }
+    // The deflated literals, in segment order
+    const uint8_t *deflated() const { return m_deflated; }
+    size_t deflatedLength() const { return m_deflatedLength; }
+    uint32_t literalLength() const { return m_literalLength; }
+
+private:
+    uint8_t *m_data;
+    const gzip_segment *m_segments;
+    size_t m_count;
+    const uint8_t *m_deflated;
+    size_t m_deflatedLength;
+    uint32_t m_literalLength;
+};
+
+/*
+    The gzip response of one request, read() works like TemplateStream's.
+    Values are resolved, checksummed and counted when the stream is made. */
+class GzipTemplateStream
+{
+public:
+    GzipTemplateStream(const GzipTemplate &page, template_resolver resolve);
+
+    size_t length() const { return m_length; }
+    // Response filler, returns 0 once everything was written
+    size_t read(uint8_t *buffer, size_t maxLen);
+
+private:
+    // The bytes of piece index: the header, per segment a prefix and a body, the trailer
+    const uint8_t *piece(size_t index, size_t &length);
+
+    const GzipTemplate &m_page;
+    size_t m_length;
+    uint16_t m_piece;
+    uint16_t m_offset;   // bytes of the current piece already written
+    size_t m_deflatedAt; // start of the current literal in the deflated data
+    uint8_t m_block[5];  // stored block header of the current placeholder
+    uint8_t m_trailer[8];
+    uint16_t m_valueOffset[TEMPLATE_MAX_SEGMENTS]; // start of each placeholder value in m_values
+    uint8_t m_valueLength[TEMPLATE_MAX_SEGMENTS];
+    char m_values[TEMPLATE_STREAM_VALUES];
+};
+
+uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t length);
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef HISTORY_ROLLUP_H
+#define HISTORY_ROLLUP_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+/*
+    Coarser copies of the history for long range queries. A tier keeps one
+    min/max/sum/count bucket per bucketSeconds, updated in O(1) per sample.
+    Buckets are stored in a file used as a ring addressed by bucket number
+    (time / bucketSeconds % capacity), so finding the buckets of a time range
+    needs no index and reads them in one contiguous run. */
+
+#define HISTORY_ROLLUP_PENDING 16
+#define HISTORY_PATH_LEN 32
+
+struct history_sample;
+
+struct history_bucket
+{
+    uint32_t start; // unix time of the bucket start
+    uint16_t count; // 0 for a slot that does not hold the requested bucket
+    int16_t level_min;
+    int16_t level_max;
+    int16_t temperature_min;
+    int16_t temperature_max;
+    uint16_t reserved;
+    int32_t level_sum;
+    int32_t temperature_sum;
+    uint32_t humidity_sum;
+    uint32_t batt_sum;
+};
+
+// Buckets merged into one query step, which may span the whole history: a year at a reading a minute is
+// half a million samples, more than the count and the sums of a stored bucket hold
+struct history_span
+{
+    uint32_t start;
+    uint32_t count;
+    int16_t level_min;
+    int16_t level_max;
+    int16_t temperature_min;
+    int16_t temperature_max;
+    int64_t level_sum;
+    int64_t temperature_sum;
+    uint64_t humidity_sum;
+    uint64_t batt_sum;
+};
+
+void bucketInit(history_bucket &bucket, uint32_t start);
+void bucketAdd(history_bucket &bucket, const history_sample &sample);
+void spanInit(history_span &span, uint32_t start);
+void bucketMerge(history_span &into, const history_bucket &from);
+
+class RollupTier
+{
+public:
+    RollupTier(fs::FS &fs, const char *dir, const char *name, uint32_t bucketSeconds, uint32_t capacity);
+
+    // Reopens the bucket holding lastTime so it keeps filling after a restart
+    void begin(uint32_t lastTime);
+    void add(const history_sample &sample);
+    // Writes closed buckets and the open one, returns false on a write error
+    bool flush();
+
+    uint32_t bucketSeconds() const { return m_seconds; }
+    uint32_t capacity() const { return m_capacity; }
+    uint32_t writes() const { return m_writes; }
+
+    // Reads count buckets starting with bucket number first, safe to call from the web server task
+    size_t read(uint32_t first, history_bucket *out, size_t count);
+
+private:
+    size_t readRun(File &file, uint32_t first, history_bucket *out, size_t count);
+    void overlay(uint32_t first, history_bucket *out, size_t count);
+
+    fs::FS &m_fs;
+    char m_path[HISTORY_PATH_LEN];
+    uint32_t m_seconds;
+    uint32_t m_capacity;
+    history_bucket m_open;
+    history_bucket m_pending[HISTORY_ROLLUP_PENDING]; // closed, not written yet
+    uint8_t m_pendingCount;
+    bool m_dirty;
+    uint32_t m_writes;
+    portMUX_TYPE m_mux;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "history_rollup.h"
+#include "request_arena.h"
+
+/*
+    Level history kept on the device. Every reading is packed into a 10 byte
+    record and appended to the head block in RAM. Full blocks are written to
+    LittleFS as one 4 KiB page, a partial head block at most once per
+    HISTORY_CHECKPOINT_MS. The log is split into segment files used as a ring:
+    when the store wraps, the oldest segment is truncated and refilled as a
+    whole, so no page is rewritten more often than once per pass. */
+
+#define HISTORY_BLOCK_SIZE 4096
+#define HISTORY_BLOCKS_PER_SEGMENT 16
+#ifndef HISTORY_SEGMENTS
+#define HISTORY_SEGMENTS 18 // 288 blocks of 407 records, ~400 days of 5 minute readings
+#endif
+#ifndef HISTORY_CHECKPOINT_MS
+#define HISTORY_CHECKPOINT_MS 3600000UL
+#endif
+#define HISTORY_HOUR_BUCKETS 9600 // 400 days
+#define HISTORY_DAY_BUCKETS 800
+// further tanks share what is left of the filesystem: about a month raw, 20 days hourly, a year daily
+#define HISTORY_SECONDARY_SEGMENTS 2
+#define HISTORY_SECONDARY_HOUR_BUCKETS 480
+#define HISTORY_SECONDARY_DAY_BUCKETS 366
+#define HISTORY_TIERS 2
+#define HISTORY_ROLLUP_READ 32 // buckets a query reads at once
+#ifndef HISTORY_DEFAULT_POINTS
+#define HISTORY_DEFAULT_POINTS 720
+#endif
+#define HISTORY_MAGIC 0x31484c57 // "WLH1"
+
+struct history_sample
+{
+    uint32_t time; // unix time
+    int16_t level_mm;
+    int16_t temperature; // centi degrees Celsius
+    uint16_t humidity;   // centi percent
+    uint16_t batt_mv;
+};
+
+struct __attribute__((packed)) history_record
+{
+    uint16_t dt; // seconds since the previous record, since first_time for the first one
+    int16_t level_mm;
+    int16_t temperature;
+    uint16_t humidity;
+    uint16_t batt_mv;
+};
+
+struct history_block_header
+{
+    uint32_t magic;
+    uint32_t seq; // 1, 2, ... the ring slot is (seq - 1) % blocks
+    uint32_t first_time;
+    uint32_t last_time;
+    uint16_t count;
+    uint16_t reserved;
+};
+
+#define HISTORY_RECORDS_PER_BLOCK ((HISTORY_BLOCK_SIZE - sizeof(history_block_header)) / sizeof(history_record))
+
+struct history_block
+{
+    history_block_header header;
+    history_record records[HISTORY_RECORDS_PER_BLOCK];
+    uint8_t padding[HISTORY_BLOCK_SIZE - sizeof(history_block_header) -
+                    HISTORY_RECORDS_PER_BLOCK * sizeof(history_record)];
+};
+
+struct history_block_info
+{
+    uint32_t seq; // 0 for an empty slot
+    uint32_t first_time;
+    uint32_t last_time;
+};
+
+struct history_layout
+{
+    uint16_t segments;
+    uint16_t hour_buckets;
+    uint16_t day_buckets;
+};
+
+#define HISTORY_PRIMARY_LAYOUT {HISTORY_SEGMENTS, HISTORY_HOUR_BUCKETS, HISTORY_DAY_BUCKETS}
+#define HISTORY_SECONDARY_LAYOUT {HISTORY_SECONDARY_SEGMENTS, HISTORY_SECONDARY_HOUR_BUCKETS, HISTORY_SECONDARY_DAY_BUCKETS}
+
+struct history_stats
+{
+    uint32_t appended;
+    uint32_t rejected; // clock not set or older than the last record
+    uint32_t blocks_written;
+    uint32_t checkpoints;
+    uint32_t write_errors;
+    uint32_t rollup_writes;
+    uint32_t queries;
+    uint32_t last_query_ms;
+};
+
+class HistoryStore
+{
+public:
+    HistoryStore(fs::FS &fs, const char *dir = "/history", const history_layout &layout = HISTORY_PRIMARY_LAYOUT);
+    ~HistoryStore();
+
+    // Reads the block headers and reloads the newest block, call once after the filesystem is mounted
+    bool begin();
+    bool append(const history_sample &sample);
+    // Writes the head block when it has unsaved records older than HISTORY_CHECKPOINT_MS, call from loop()
+    void service();
+    bool flush();
+
+    uint32_t headSeq() const { return m_head.header.seq; }
+    uint32_t blocks() const { return m_blocks; }
+    // Coarsest rollup tier whose buckets are not longer than step, nullptr for the raw records
+    RollupTier *tierFor(uint32_t step);
+    history_stats stats() const;
+
+    // Used by HistoryQuery, safe to call from the web server task
+    bool readBlock(uint32_t seq, history_block &block);
+    bool blockInfo(uint32_t seq, history_block_info &info);
+    void queryDone(uint32_t elapsedMs);
+
+private:
+    // False for a segment out of range, or a directory that leaves no room for the file name
+    bool segmentPath(uint32_t segment, char *path, size_t size) const;
+    bool writeBlock(const history_block &block);
+    void startBlock(uint32_t seq);
+    bool flushTiers();
+
+    fs::FS &m_fs;
+    char m_dir[HISTORY_PATH_LEN];
+    uint32_t m_segments;
+    uint32_t m_blocks;
+    history_block m_head;
+    RollupTier m_tiers[HISTORY_TIERS]; // finest first
+    history_block_info *m_index; // one per block, heap
+    bool m_dirty;
+    unsigned long m_dirtySince;
+    history_stats m_stats;
+    portMUX_TYPE m_mux;
+};
+
+/*
+    Writes the history between from and to as JSON. Without a step every raw
+    record is listed, with a step the records (or, when the step allows it,
+    the rollup buckets) falling into each step long interval are merged into
+    one min/max/avg entry. The block or bucket buffer comes from arena when
+    one is given, from the heap otherwise. */
+class HistoryQuery
+{
+public:
+    HistoryQuery(HistoryStore &store, uint32_t from, uint32_t to, uint32_t step, RequestArena *arena = nullptr);
+    ~HistoryQuery();
+
+    bool next(history_span &out);
+    uint32_t resolution() const { return m_tier == nullptr ? 0 : m_tier->bucketSeconds(); }
+    // Chunked response filler, returns 0 once everything was written
+    size_t readJson(uint8_t *buffer, size_t maxLen);
+
+private:
+    bool nextRecord(history_bucket &out);
+    bool nextBucket(history_bucket &out);
+    bool loadNextBlock();
+    void formatNext();
+
+    HistoryStore &m_store;
+    uint32_t m_from;
+    uint32_t m_to;
+    uint32_t m_step;
+    unsigned long m_started;
+
+    RollupTier *m_tier;
+    // arena or heap, too large for the async_tcp stack
+    bool m_ownsBuffers;
+    history_block *m_block;
+    history_bucket *m_buckets;
+    uint32_t m_seq;    // raw block, or the next bucket number to read from the tier
+    uint16_t m_record; // record in the block, or bucket in m_buckets
+    uint16_t m_count;  // buckets in m_buckets
+    uint32_t m_time;
+    bool m_hasPending;
+    history_bucket m_pending;
+    bool m_finished;
+
+    char m_line[224];
+    uint8_t m_lineLength;
+    uint8_t m_lineOffset;
+    uint8_t m_state;
+    bool m_first;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef HTTP_SINK_H
+#define HTTP_SINK_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include "delivery.h"
+#include "telemetry_sink.h"
+
+/*
+    A telemetry sink that POSTs serialized readings to a URL from a task of
+    its own: InfluxDB takes line protocol, a webhook JSON. Same shape as the
+    alert notifier: the loop hands readings over through a lock-free queue,
+    the task keeps them in a backlog (the oldest is dropped when it
+    overflows) and sends them oldest first, up to `batch` of them joined by
+    newlines in one request where the format allows it. A failed request
+    is retried with exponential backoff from HTTP_SINK_RETRY_MS up to
+    HTTP_SINK_BACKOFF_MAX_MS, readings the receiver refuses (4xx) are
+    dropped. */
+
+#define HTTP_SINK_QUEUE 8 // power of two
+#define HTTP_SINK_BACKLOG 32
+#define HTTP_SINK_BATCH 8 // most readings in one request
+#define HTTP_SINK_RETRY_MS 5000UL
+#define HTTP_SINK_BACKOFF_MAX_MS 300000UL
+#define HTTP_SINK_TIMEOUT_MS 5000
+#define HTTP_SINK_URL_LEN 160
+#define HTTP_SINK_AUTH_LEN 112
+#ifndef HTTP_SINK_CORE
+#define HTTP_SINK_CORE 1
+#endif
+#define HTTP_SINK_STACK 4096
+
+struct http_sink_record
+{
+    uint32_t queued_ms;
+    uint16_t length;
+    char text[TELEMETRY_TEXT_LEN];
+};
+
+class HttpSink : public TelemetrySink
+{
+public:
+    // One reading per request unless batch is more than 1, which only line formats allow
+    HttpSink(const char *name, uint8_t format, const char *contentType, size_t batch);
+
+    // Starts the delivery task
+    bool begin();
+    // Thread safe, an empty URL holds the readings back; authorization is sent as the header of that name
+    void configure(const char *url, const char *authorization);
+
+    const char *name() const override { return m_name; }
+    uint8_t format() const override { return m_format; }
+    bool ready() const override { return m_ready; }
+    bool offer(const telemetry_payload &payload) override;
+    sink_stats sinkStats() const override { return m_stats; }
+    TaskHandle_t task() const { return m_task; }
+
+private:
+    static void taskMain(void *arg);
+    void run();
+    void drainQueue();
+    // HTTP status of the POST, negative when it could not be sent
+    int deliver(size_t count, const char *url, const char *authorization);
+
+    const char *m_name;
+    uint8_t m_format;
+    const char *m_contentType;
+    size_t m_batch;
+    SpscQueue<http_sink_record, HTTP_SINK_QUEUE> m_queue;
+    DeliveryBacklog<http_sink_record, HTTP_SINK_BACKLOG> m_backlog;
+    RetryBackoff m_backoff;
+    char m_url[HTTP_SINK_URL_LEN];
+    char m_authorization[HTTP_SINK_AUTH_LEN];
+    volatile bool m_ready;
+    WiFiClient m_client;
+    char m_body[HTTP_SINK_BATCH * TELEMETRY_TEXT_LEN];
+    sink_stats m_stats;
+    TaskHandle_t m_task;
+    portMUX_TYPE m_mux; // guards the URL and the authorization
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef LINK_MONITOR_H
+#define LINK_MONITOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Per-sensor radio link statistics. Frames with a sequence counter reveal
+    lost, duplicated and late (reordered) packets. RH_ASK has no RSSI, so the
+    link quality is the share of expected frames that actually arrived,
+    smoothed over the last ~16 of them. Jitter is the smoothed change of the
+    inter-arrival time, computed like the RTP jitter of RFC 3550.
+
+    A sender that reboots starts counting again, and one that was out of
+    range for long enough may have wrapped its counter; either way its next
+    numbers look old. An old number that does not follow the last frame
+    closely, as a repeat or a late frame would, one more than 31 steps
+    back, or any frame after LINK_RESYNC_SILENCE intervals of silence
+    restarts the count instead of being dropped as a duplicate or a late
+    frame. */
+
+#ifndef LINK_MAX_SENSORS
+#define LINK_MAX_SENSORS 8
+#endif
+#define LINK_RESYNC_SILENCE 8 // intervals without a frame after which any sequence number is taken as it comes
+
+struct link_stats
+{
+    uint8_t sensor_id;
+    bool sequenced; // false for legacy frames, loss is unknown then
+    uint8_t last_seq;
+    uint32_t window; // bit n set when last_seq - n arrived
+    uint32_t received;
+    uint32_t lost;
+    uint32_t duplicates;
+    uint32_t reordered;
+    uint32_t restarts; // the sender's counter started over
+    uint32_t last_arrival_ms;
+    uint32_t interval_ms; // last inter-arrival time per sequence step
+    float jitter_ms;
+    uint8_t quality; // 0-100
+};
+
+enum link_event : uint8_t
+{
+    LINK_NEW,
+    LINK_IN_ORDER,
+    LINK_GAP,
+    LINK_DUPLICATE,
+    LINK_LATE,
+    LINK_RESTART
+};
+
+class LinkMonitor
+{
+public:
+    LinkMonitor();
+
+    // Accounts a received frame, a duplicate or a late one should not be processed further
+    link_event update(uint8_t sensorId, bool hasSeq, uint8_t seq, uint32_t nowMs);
+
+    const link_stats *find(uint8_t sensorId) const;
+    size_t count() const { return m_count; }
+    const link_stats &at(size_t index) const { return m_links[index]; }
+    // Percentage of the expected sequenced frames that did not arrive
+    static float lossPercent(const link_stats &link);
+
+private:
+    link_stats *lookup(uint8_t sensorId);
+    void account(link_stats &link, uint32_t arrived, uint32_t missed);
+
+    link_stats m_links[LINK_MAX_SENSORS];
+    uint16_t m_quality[LINK_MAX_SENSORS]; // fixed point 8.8, 256 = 100 %
+    size_t m_count;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef LIVE_PUSH_H
+#define LIVE_PUSH_H
+
+#include <Arduino.h>
+#include "ESPAsyncWebServer.h"
+#include "snapshot_buffer.h"
+
+/*
+    WebSocket channel pushing the state document to open dashboards after
+    every received packet. Frames are full snapshots, so a client that cannot
+    keep up does not get a queue of old frames: it is marked pending and gets
+    only the newest one once its connection drains (drop oldest). */
+
+#ifndef LIVE_PUSH_MAX_CLIENTS
+#define LIVE_PUSH_MAX_CLIENTS 4
+#endif
+#ifndef LIVE_PUSH_HEARTBEAT_MS
+#define LIVE_PUSH_HEARTBEAT_MS 15000
+#endif
+#define LIVE_PUSH_SLOTS 8
+
+struct live_push_stats
+{
+    uint32_t subscribers;
+    uint32_t frames_sent;
+    uint32_t frames_dropped; // superseded while a client was congested
+    uint32_t rejected;       // connections over the subscriber limit
+};
+
+class LivePush
+{
+public:
+    LivePush(const char *url, const SnapshotBuffer &source, uint8_t maxClients = LIVE_PUSH_MAX_CLIENTS);
+
+    void begin(AsyncWebServer &server);
+    // Sends the current snapshot to every subscriber, call after it changed
+    void publish();
+    // Heartbeat and delivery to clients that were congested, call from loop()
+    void service();
+
+    live_push_stats stats() const;
+
+private:
+    struct subscriber
+    {
+        uint32_t id;
+        bool pending;
+    };
+
+    void onEvent(AsyncWebSocketClient *client, AwsEventType type);
+    bool trySend(AsyncWebSocketClient *client);
+    size_t copyIds(uint32_t *ids, bool pendingOnly);
+    void setPending(uint32_t id, bool pending);
+
+    AsyncWebSocket m_socket;
+    const SnapshotBuffer &m_source;
+    uint8_t m_maxClients;
+    subscriber m_subscribers[LIVE_PUSH_SLOTS];
+    uint8_t m_count;
+    unsigned long m_lastHeartbeat;
+    live_push_stats m_stats;
+    portMUX_TYPE m_mux;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "task_monitor.h"
+
+/*
+    Counters behind /api/v1/metrics, exported in the Prometheus text format.
+    Allocations are counted per subsystem at the places that allocate, and
+    requests per route with a latency histogram from dispatch until the
+    connection is closed. Every counter is a relaxed atomic bumped without a
+    lock, a handful of instructions, so they stay on in production. The
+    heap is sampled once per METRICS_HEAP_SAMPLE_MS to track the smallest
+    largest free block ever seen: free heap that exists only in pieces is
+    how fragmentation shows before an allocation fails. */
+
+#define METRICS_HEAP_SAMPLE_MS 1000
+#define METRICS_LINE_SIZE 224
+
+enum alloc_subsystem : uint8_t
+{
+    ALLOC_TEMPLATES,
+    ALLOC_HISTORY,
+    ALLOC_HTTP,
+    ALLOC_PUSH,
+    ALLOC_SUBSYSTEMS
+};
+
+enum metrics_route : uint8_t
+{
+    ROUTE_INDEX,
+    ROUTE_GRAPHS,
+    ROUTE_CONFIGURATION,
+    ROUTE_SAVE,
+    ROUTE_STATE,
+    ROUTE_STATS,
+    ROUTE_HISTORY,
+    ROUTE_METRICS,
+    ROUTE_ASSET,
+    ROUTE_NOT_FOUND,
+    ROUTE_COUNT
+};
+
+struct alloc_stats
+{
+    uint32_t allocations;
+    uint32_t bytes;
+};
+
+struct route_stats
+{
+    uint32_t requests;
+    uint32_t sum_ms;
+    uint32_t buckets[LATENCY_BUCKETS]; // TaskMonitor buckets
+};
+
+struct heap_stats
+{
+    uint32_t size;
+    uint32_t free;
+    uint32_t min_free;      // lowest free heap since boot, kept by the allocator
+    uint32_t largest_block; // largest single allocation that would succeed now
+    uint32_t min_largest_block; // smallest largest_block sampled since boot
+};
+
+// Values the metrics do not keep themselves, gathered by the endpoint
+struct metrics_snapshot
+{
+    uint32_t uptime_s;
+    uint32_t radio_ok;
+    uint32_t radio_rejected;
+    uint32_t radio_crc_errors;
+    uint32_t radio_overflows;
+    size_t tasks;
+    const char *task_names[TASK_MONITOR_SLOTS];
+    uint32_t task_stack_free[TASK_MONITOR_SLOTS];
+    latency_histogram loop;
+};
+
+void metricsCountAlloc(alloc_subsystem subsystem, size_t bytes);
+alloc_stats metricsAllocStats(alloc_subsystem subsystem);
+const char *allocSubsystemName(uint8_t subsystem);
+
+void metricsRequest(uint8_t route, uint32_t elapsedUs);
+route_stats metricsRouteStats(uint8_t route);
+const char *routeName(uint8_t route);
+
+// Call from loop(), samples at most once per METRICS_HEAP_SAMPLE_MS
+void metricsSampleHeap();
+heap_stats metricsHeapStats();
+
+// Formats the metrics line by line into a chunked response
+class MetricsExport
+{
+public:
+    explicit MetricsExport(const metrics_snapshot &snapshot);
+
+    // Chunked response filler, returns 0 once everything was written
+    size_t readText(uint8_t *buffer, size_t maxLen);
+
+private:
+    void formatNext();
+    bool formatRow(uint8_t family, uint16_t row);
+    void header(const char *name, const char *type, const char *help);
+    void line(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void histogram(const char *name, const char *labels, const uint32_t *buckets, uint32_t count, float sum,
+                   uint16_t row);
+
+    metrics_snapshot m_snapshot;
+    heap_stats m_heap;
+    route_stats m_route;
+    uint8_t m_family;
+    uint16_t m_row;
+    char m_line[METRICS_LINE_SIZE];
+    uint16_t m_lineLength;
+    uint16_t m_lineOffset;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef MQTT_CODEC_H
+#define MQTT_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    The few MQTT 3.1.1 packets a publisher needs, encoded into a caller's
+    buffer, and an incremental parser for what the broker sends back. The
+    encoders return the packet length, 0 when it does not fit. Nothing here
+    does I/O, the device and the native stand-in broker share it. */
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_PINGREQ 0xC0
+#define MQTT_PINGRESP 0xD0
+#define MQTT_DISCONNECT 0xE0
+#define MQTT_PARSER_BODY 8 // bytes of a packet body kept, longer bodies are skipped
+
+struct mqtt_connect_options
+{
+    const char *client_id;
+    const char *user;     // nullptr or empty for none
+    const char *password;
+    const char *will_topic; // nullptr for no last will, retained at QoS 1
+    const char *will_message;
+    uint16_t keep_alive_s;
+    bool clean_session;
+};
+
+size_t mqttConnect(uint8_t *buf, size_t size, const mqtt_connect_options &options);
+size_t mqttPublish(uint8_t *buf, size_t size, const char *topic, const uint8_t *payload, size_t length, uint8_t qos,
+                   bool retain, bool dup, uint16_t packetId);
+// Two byte packets: PINGREQ, DISCONNECT, and PUBACK / CONNACK for the stand-in broker
+size_t mqttPacket(uint8_t *buf, size_t size, uint8_t type);
+size_t mqttAck(uint8_t *buf, size_t size, uint8_t type, uint8_t first, uint8_t second);
+
+struct mqtt_parser
+{
+    uint8_t state;
+    uint8_t header; // first byte of the packet
+    uint32_t length; // remaining length
+    uint32_t multiplier;
+    uint32_t received;
+    uint8_t body[MQTT_PARSER_BODY];
+};
+
+// Feeds one byte, true when it completed a packet; header, length and the first body bytes describe it
+bool mqttParse(mqtt_parser &parser, uint8_t byte);
+// Starts over, after a broken connection
+void mqttParserReset(mqtt_parser &parser);
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef MQTT_PUBLISHER_H
+#define MQTT_PUBLISHER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <WiFiClient.h>
+#include "delivery.h"
+#include "flash_queue.h"
+#include "mqtt_codec.h"
+#include "sensor_registry.h"
+#include "spsc_queue.h"
+#include "telemetry_sink.h"
+
+/*
+    Publishes the readings and alerts to an MQTT broker over one persistent
+    connection, for Home Assistant and anything else listening. A task of
+    its own owns the connection: it connects with a persistent session
+    (clean session off) and a retained last will on MQTT_BASE_TOPIC/status,
+    keeps it alive and reconnects with exponential backoff.
+
+    The loop hands readings (as the JSON telemetry sink) and alert events
+    over through a lock-free queue, the task publishes them at QoS 1, one message in flight at
+    a time so the order is kept. A message leaves its queue only once the
+    broker acknowledged it. While connected the messages wait in RAM; when
+    the connection drops, the unacknowledged ones move to a bounded queue on
+    flash, and everything that arrives while the broker is out goes there
+    too (the oldest is dropped when it is full). That queue is drained
+    first once the broker is back, and it survives a reboot.
+
+    Home Assistant discovery: every tank announces its values as sensors
+    under homeassistant/sensor/, retained, when it is first seen and
+    whenever the broker lost the session. */
+
+#define MQTT_BASE_TOPIC "jimka"
+#define MQTT_DISCOVERY_PREFIX "homeassistant"
+#define MQTT_QUEUE 16 // power of two
+#define MQTT_PENDING 8 // messages in RAM while connected
+#define MQTT_SPOOL_SLOTS 64
+#define MQTT_SPOOL_SLOT_SIZE 512
+#define MQTT_SPOOL_PATH "/mqtt.spool"
+#define MQTT_TOPIC_LEN 80
+#define MQTT_PAYLOAD_LEN 400
+#define MQTT_PACKET_SIZE 512
+#define MQTT_KEEP_ALIVE_S 60
+#define MQTT_TIMEOUT_MS 5000 // for the CONNACK and for every PUBACK
+#define MQTT_RETRY_MS 2000UL
+#define MQTT_BACKOFF_MAX_MS 300000UL
+#define MQTT_HOST_LEN 64
+#define MQTT_USER_LEN 32
+#define MQTT_PASSWORD_LEN 64
+#define MQTT_CLIENT_ID_LEN 32
+#ifndef MQTT_CORE
+#define MQTT_CORE 1
+#endif
+#define MQTT_STACK 6144
+
+// A reading as the telemetry dispatcher serialized it
+struct mqtt_state
+{
+    uint8_t sensor_id;
+    uint16_t length;
+    char json[TELEMETRY_TEXT_LEN];
+};
+
+enum mqtt_item_type
+{
+    MQTT_ITEM_STATE,
+    MQTT_ITEM_ALERT
+};
+
+// What the loop sends
+struct mqtt_item
+{
+    uint8_t type; // mqtt_item_type
+    union
+    {
+        mqtt_state state;
+        alert_event alert;
+    };
+};
+
+struct mqtt_message
+{
+    bool retain;
+    uint16_t length;
+    char topic[MQTT_TOPIC_LEN];
+    char payload[MQTT_PAYLOAD_LEN];
+};
+
+struct mqtt_stats
+{
+    uint32_t queued;
+    uint32_t rejected; // the queue to the task was full
+    uint32_t published;
+    uint32_t acked;
+    uint32_t spooled; // messages written to flash
+    uint32_t spool_dropped;
+    uint32_t spool_depth;
+    uint32_t pending;
+    uint32_t connects;
+    uint32_t connect_failures;
+    uint32_t disconnects;
+    uint32_t ack_timeouts;
+    uint32_t discovery; // discovery messages acknowledged
+    uint32_t backoff_ms;
+    uint32_t last_ack_ms; // publish to PUBACK
+    uint32_t connected;
+};
+
+class MqttPublisher : public TelemetrySink
+{
+public:
+    explicit MqttPublisher(fs::FS &fs);
+
+    // Opens the flash queue and starts the task
+    bool begin();
+    // Thread safe, an empty host disconnects and keeps everything on flash
+    void configure(const char *host, uint16_t port, const char *user, const char *password, const char *clientId);
+    // Producer side, call from the loop task only. Returns false when the queue is full.
+    bool publishAlert(const alert_event &event);
+
+    mqtt_stats stats() const;
+    TaskHandle_t task() const { return m_task; }
+
+    const char *name() const override { return "mqtt"; }
+    uint8_t format() const override { return TELEMETRY_JSON; }
+    bool ready() const override { return m_ready; }
+    bool offer(const telemetry_payload &payload) override;
+    sink_stats sinkStats() const override;
+
+private:
+    enum source
+    {
+        SOURCE_NONE,
+        SOURCE_ONLINE,
+        SOURCE_DISCOVERY,
+        SOURCE_PENDING,
+        SOURCE_SPOOL
+    };
+    struct settings
+    {
+        char host[MQTT_HOST_LEN];
+        uint16_t port;
+        char user[MQTT_USER_LEN];
+        char password[MQTT_PASSWORD_LEN];
+        char client_id[MQTT_CLIENT_ID_LEN];
+        uint32_t version; // bumped by configure(), a change reconnects
+    };
+
+    static void taskMain(void *arg);
+    void run();
+    bool enqueue(const mqtt_item &item);
+    void drainQueue();
+    void format(const mqtt_item &item, mqtt_message &message);
+    void add(const mqtt_message &message);
+    bool spool(const mqtt_message &message);
+    void spoolPending();
+    bool connect(const settings &config);
+    void disconnect();
+    void receive();
+    void acknowledged(uint16_t packetId);
+    bool next(mqtt_message &message);
+    bool discoveryMessage(size_t slot, uint8_t field, mqtt_message &message);
+    bool send(const uint8_t *packet, size_t length);
+
+    FlashQueue m_spool;
+    SpscQueue<mqtt_item, MQTT_QUEUE> m_queue;
+    // touched by the task only
+    mqtt_message m_pending[MQTT_PENDING]; // ring, only used while the flash queue is empty
+    size_t m_first;
+    size_t m_count;
+    uint8_t m_sensors[SENSOR_MAX]; // ids seen, in order
+    uint8_t m_announce[SENSOR_MAX]; // discovery fields still to publish, a bit each
+    size_t m_sensorCount;
+    bool m_online; // the availability message still has to go out
+    mqtt_message m_message;
+    uint8_t m_packet[MQTT_PACKET_SIZE];
+    uint8_t m_inflight; // source, SOURCE_NONE when nothing waits for a PUBACK
+    uint8_t m_inflightField;
+    size_t m_inflightSlot;
+    uint16_t m_packetId;
+    uint32_t m_sentMs;
+    uint32_t m_lastSendMs;
+    bool m_pingPending;
+    mqtt_parser m_parser;
+    WiFiClient m_client;
+    uint32_t m_version; // of the settings connected with
+    settings m_settings;
+    uint32_t m_rejected; // written by the producer only
+    volatile bool m_ready;
+    mqtt_stats m_stats;
+    RetryBackoff m_backoff; // of the connection attempts
+    TaskHandle_t m_task;
+    portMUX_TYPE m_mux; // guards m_settings
+};
+
+#endif
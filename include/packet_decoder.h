@@ -0,0 +1,82 @@
+#ifndef PACKET_DECODER_H
+#define PACKET_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Decodes a sensor packet straight from the RH_ASK receive buffer, in one
+    pass and without touching the heap. Two formats are accepted:
+
+    - ASCII "hum,temp,dist,batt%,battV" as sent by the existing sensor nodes
+    - a compact binary frame starting with PACKET_BINARY_MAGIC and a version
+      byte, little endian fields in fixed-point units. Version 2 adds the
+      sensor ID and a sequence counter so the receiver can detect loss. */
+
+#define PACKET_BINARY_MAGIC 0xA5
+#define PACKET_VERSION_1 1
+#define PACKET_VERSION_2 2
+#define PACKET_LEGACY_SENSOR 0 // sensor ID reported for frames that do not carry one
+#define PACKET_ASCII_FIELDS 5
+
+enum packet_status : uint8_t
+{
+    PACKET_OK,
+    PACKET_EMPTY,
+    PACKET_BAD_FIELD_COUNT,
+    PACKET_BAD_NUMBER,
+    PACKET_OUT_OF_RANGE,
+    PACKET_BAD_LENGTH,
+    PACKET_UNKNOWN_VERSION
+};
+
+enum packet_format : uint8_t
+{
+    PACKET_ASCII,
+    PACKET_BINARY
+};
+
+struct sensor_reading
+{
+    float humidity;    // %
+    float temperature; // degrees Celsius
+    uint32_t distance; // cm from the sensor to the surface
+    int batt_perc;
+    float batt_voltage;
+    uint8_t format; // packet_format it was decoded from
+    uint8_t sensor_id;
+    uint8_t seq;
+    bool has_seq;
+};
+
+struct __attribute__((packed)) packet_frame_v1
+{
+    uint8_t magic;
+    uint8_t version;
+    int16_t temperature; // centi degrees
+    uint16_t humidity;   // centi percent
+    uint16_t distance;   // cm
+    uint8_t batt_perc;
+    uint16_t batt_mv;
+};
+
+struct __attribute__((packed)) packet_frame_v2
+{
+    uint8_t magic;
+    uint8_t version;
+    uint8_t sensor_id;
+    uint8_t seq; // incremented by the sender for every reading, wraps
+    int16_t temperature; // centi degrees
+    uint8_t humidity;    // half percent
+    uint16_t distance;   // cm
+    uint8_t batt_perc;
+    uint16_t batt_mv;
+};
+
+packet_status decodePacket(const uint8_t *buf, size_t len, sensor_reading &out);
+// Fill a binary frame, used by sensor nodes and tests
+size_t encodePacketV1(const sensor_reading &reading, uint8_t *buf, size_t size);
+size_t encodePacketV2(const sensor_reading &reading, uint8_t *buf, size_t size);
+const char *packetStatusName(packet_status status);
+
+#endif
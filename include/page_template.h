@@ -0,0 +1,125 @@
+#ifndef PAGE_TEMPLATE_H
+#define PAGE_TEMPLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Pages in LittleFS are parsed once at boot into a list of segments:
+    literal byte ranges of the file and placeholder IDs. Rendering a page
+    then only walks the list, no string comparisons are done per request. */
+
+enum template_var : uint8_t
+{
+    TPL_NAPUST,
+    TPL_HLOUBKA,
+    TPL_VOLT,
+    TPL_BATTPERCENT,
+    TPL_HLADINA,
+    TPL_PLNOSTPERC,
+    TPL_TEPLOTA,
+    TPL_VLHKOST,
+    TPL_THINGSPEAKAPI,
+    TPL_THINGSPEAKCHANNEL,
+    TPL_LASTMEASUREMENT,
+    TPL_UPTIME,
+    TPL_DUCKDNSDOMAIN,
+    TPL_DUCKDNSTOKEN,
+    TPL_LINKLOSS,
+    TPL_LINKQUALITY,
+    TPL_LINKJITTER,
+    TPL_SENSORID,
+    TPL_FILLRATE,
+    TPL_DAYSTOFULL,
+    TPL_SINCEEMPTIED,
+    TPL_ALARMHLADINA,
+    TPL_ALARMBATERIE,
+    TPL_ALARMNAPETI,
+    TPL_ALARMNEAKTIVITA,
+    TPL_ALARMURL,
+    TPL_MQTTHOST,
+    TPL_MQTTPORT,
+    TPL_MQTTUSER,
+    TPL_SINKTHINGSPEAK,
+    TPL_SINKMQTT,
+    TPL_SINKINFLUX,
+    TPL_SINKWEBHOOK,
+    TPL_INFLUXURL,
+    TPL_INFLUXTOKEN,
+    TPL_WEBHOOKURL,
+    TPL_VAR_COUNT,
+    TPL_LITERAL = 0xFF
+};
+
+struct template_segment
+{
+    uint16_t offset; // literal start in the page text
+    uint16_t length; // literal length, 0 for placeholders
+    uint8_t var;     // template_var or TPL_LITERAL
+};
+
+// Writes the value of a placeholder into buf, returns the number of bytes used
+typedef size_t (*template_resolver)(uint8_t var, char *buf, size_t size);
+// Receives the rendered output piece by piece
+typedef void (*template_writer)(void *ctx, const char *data, size_t len);
+
+#define TEMPLATE_MAX_SEGMENTS 64
+#define TEMPLATE_VALUE_BUFFER 160 // the longest setting, a sink URL
+#define TEMPLATE_STREAM_VALUES 1024 // every placeholder value of one page
+
+class PageTemplate
+{
+public:
+    PageTemplate();
+    ~PageTemplate();
+
+    // Takes ownership of a malloc()ed buffer holding the whole page
+    bool parse(char *text, size_t length);
+    bool loaded() const { return m_text != nullptr; }
+
+    size_t segmentCount() const { return m_count; }
+    const template_segment &segment(size_t index) const { return m_segments[index]; }
+    const char *text() const { return m_text; }
+    size_t textLength() const { return m_length; }
+
+    void render(template_resolver resolve, template_writer write, void *ctx) const;
+
+    static uint8_t lookupVar(const char *name, size_t length);
+    static const char *varName(uint8_t var);
+
+private:
+    bool addSegment(uint16_t offset, uint16_t length, uint8_t var);
+
+    char *m_text;
+    size_t m_length;
+    template_segment m_segments[TEMPLATE_MAX_SEGMENTS];
+    size_t m_count;
+};
+
+/*
+    A page rendered piece by piece into the send buffer of the connection,
+    so the page is never held in RAM as a whole. The placeholder values are
+    resolved once when the stream is made: a reading that arrives while the
+    page is being sent does not change the output half way, and the length
+    of the response is known up front. Each read() copies whatever fits and
+    picks up in the middle of a segment next time. */
+class TemplateStream
+{
+public:
+    TemplateStream(const PageTemplate &page, template_resolver resolve);
+
+    size_t length() const { return m_length; }
+    // Response filler, returns 0 once everything was written
+    size_t read(uint8_t *buffer, size_t maxLen);
+
+private:
+    const PageTemplate &m_page;
+    size_t m_length;
+    uint16_t m_segment;
+    uint16_t m_offset; // bytes of the current segment already written
+    uint16_t m_valueOffset[TEMPLATE_MAX_SEGMENTS]; // start of each placeholder value in m_values
+    uint8_t m_valueLength[TEMPLATE_MAX_SEGMENTS];
+    char m_values[TEMPLATE_STREAM_VALUES];
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef RADIO_RECEIVER_H
+#define RADIO_RECEIVER_H
+
+#include <Arduino.h>
+#include <RH_ASK.h>
+#include "packet_decoder.h"
+#include "spsc_queue.h"
+
+/*
+    Polls RH_ASK from a high priority task of its own, pinned to the core the
+    Arduino loop does not use, so nothing the loop blocks on (Bluetooth
+    provisioning, DNS, HTTP) can make the single packet buffer of the driver
+    overflow. The task only decodes packets and pushes the readings into a
+    lock-free queue, stamped with the time they arrived; the loop drains it. */
+
+#define RADIO_QUEUE 16 // power of two
+#ifndef RADIO_POLL_MS
+#define RADIO_POLL_MS 5 // a 12 byte frame takes ~100 ms on air at 2000 bps
+#endif
+#ifndef RADIO_CORE
+#define RADIO_CORE 0
+#endif
+#define RADIO_PRIORITY 5 // above the Arduino loop, below the Wi-Fi and lwIP tasks
+#define RADIO_STACK 3072
+
+struct radio_packet
+{
+    sensor_reading reading;
+    uint32_t arrival_ms;
+};
+
+struct radio_stats
+{
+    uint32_t packets_ok;
+    uint32_t packets_rejected;
+    uint32_t queue_overflows; // decoded but dropped because the loop fell behind
+    uint32_t max_queued;
+    uint8_t last_reject; // packet_status of the last rejected packet
+};
+
+class RadioReceiver
+{
+public:
+    RadioReceiver(RH_ASK &driver);
+
+    // Starts the task, which initialises the driver so its timer interrupt runs on the radio core
+    bool begin();
+    // Consumer side, call from the loop task only
+    bool pop(radio_packet &packet) { return m_queue.pop(packet); }
+
+    radio_stats stats() const { return m_stats; }
+    TaskHandle_t task() const { return m_task; }
+
+private:
+    static void taskMain(void *arg);
+    void run();
+
+    RH_ASK &m_driver;
+    SpscQueue<radio_packet, RADIO_QUEUE> m_queue;
+    radio_stats m_stats;
+    TaskHandle_t m_task;
+    TaskHandle_t m_starter;
+    volatile bool m_ready;
+};
+
+#endif
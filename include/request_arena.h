@@ -0,0 +1,118 @@
+#ifndef REQUEST_ARENA_H
+#define REQUEST_ARENA_H
+
+#include <Arduino.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+    Scratch memory for responses that outlive their handler. A chunked
+    response keeps its state (a HistoryQuery with a 4 KiB block, a
+    MetricsExport) until the last chunk was sent, which used to be a
+    make_shared plus the buffers the state allocated itself: a handful of
+    differently sized heap blocks per request, freed in whatever order the
+    connections close. Instead the handler leases one of the static arenas,
+    builds everything in it with a bump pointer and captures the lease in
+    the response callback. Pages are streamed by a small object that a
+    handful of browser connections hold at once, so next to the large
+    arenas there are more small ones and a lease takes the smallest free
+    arena that fits. When the response is destroyed the
+    last copy of the lease runs the destructors and resets the arena, so the
+    steady state request path allocates nothing. With every arena busy the
+    lease is empty and the request is answered with a 503, the same as a
+    failed allocation would have ended. */
+
+#define REQUEST_ARENA_SLOTS 2
+#define REQUEST_ARENA_SIZE 6144 // a HistoryQuery with its raw block, the largest tenant
+#define REQUEST_ARENA_SMALL_SLOTS 6
+#define REQUEST_ARENA_SMALL_SIZE 1536 // a TemplateStream or GzipTemplateStream
+#define REQUEST_ARENA_FINALIZERS 4
+
+struct request_arena_stats
+{
+    uint32_t leases;
+    uint32_t exhausted; // leases refused because every arena was busy
+    uint32_t high_water; // most bytes used by one request
+    uint8_t in_use;
+};
+
+class RequestArena
+{
+public:
+    RequestArena(uint8_t *memory, size_t capacity);
+
+    // nullptr once the arena is full
+    void *allocate(size_t size, size_t align = alignof(max_align_t));
+
+    // Constructs a T in the arena, its destructor runs when the arena is reset
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        // the finalizer slot first, a refused object would otherwise keep its bytes until the reset
+        bool finalized = !std::is_trivially_destructible<T>::value;
+        if (finalized && m_finalizerCount == REQUEST_ARENA_FINALIZERS)
+            return nullptr;
+        void *memory = allocate(sizeof(T), alignof(T));
+        if (memory == nullptr)
+            return nullptr;
+        T *object = new (memory) T(std::forward<Args>(args)...);
+        if (finalized)
+            addFinalizer(destroy<T>, object);
+        return object;
+    }
+
+    size_t used() const { return m_used; }
+    size_t capacity() const { return m_capacity; }
+
+private:
+    friend class ArenaLease;
+    typedef void (*finalizer)(void *object);
+
+    template <typename T>
+    static void destroy(void *object)
+    {
+        static_cast<T *>(object)->~T();
+    }
+    // make() checked that there is a free slot
+    void addFinalizer(finalizer fn, void *object);
+    void reset();
+
+    uint8_t *m_memory;
+    size_t m_capacity;
+    size_t m_used;
+    finalizer m_finalizers[REQUEST_ARENA_FINALIZERS];
+    void *m_objects[REQUEST_ARENA_FINALIZERS];
+    uint8_t m_finalizerCount;
+    uint32_t m_refs; // copies of the lease, 0 for a free arena; 32 bits, so it cannot wrap
+};
+
+/*
+    Shared ownership of a leased arena, a single pointer that is cheap to
+    copy into a response callback. Copies are counted under a lock because
+    a lease may be taken from the loop task too (benchmarks), not only from
+    the async_tcp task. */
+class ArenaLease
+{
+public:
+    ArenaLease() : m_arena(nullptr) {}
+    ArenaLease(const ArenaLease &other);
+    ArenaLease &operator=(const ArenaLease &other);
+    ~ArenaLease();
+
+    // An empty lease when no free arena has size bytes
+    static ArenaLease acquire(size_t size = REQUEST_ARENA_SIZE);
+    static request_arena_stats stats();
+
+    explicit operator bool() const { return m_arena != nullptr; }
+    RequestArena *operator->() const { return m_arena; }
+    RequestArena &operator*() const { return *m_arena; }
+
+private:
+    explicit ArenaLease(RequestArena *arena) : m_arena(arena) {}
+    void release();
+
+    RequestArena *m_arena;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef ROUTE_HANDLER_H
+#define ROUTE_HANDLER_H
+
+#include <Arduino.h>
+#include "ESPAsyncWebServer.h"
+#include "route_table.h"
+
+/*
+    One web server handler for every entry of route_table: the request is
+    matched by a binary search over the sorted paths and dispatched to the
+    function registered for its route, which also names the request in the
+    metrics. Takes the place of a server.on() lambda per URL, each of which
+    the server would otherwise try in turn with a string comparison. */
+
+typedef void (*route_function)(AsyncWebServerRequest *request);
+
+class RouteHandler : public AsyncWebHandler
+{
+public:
+    // Indexed by metrics_route, nullptr for the routes served elsewhere (assets, 404)
+    explicit RouteHandler(const route_function *functions) : m_functions(functions) {}
+
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+    // POST bodies carry the form fields
+    bool isRequestHandlerTrivial() override { return false; }
+
+private:
+    const route_entry *match(AsyncWebServerRequest *request) const;
+
+    const route_function *m_functions;
+};
+
+#endif
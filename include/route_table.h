@@ -0,0 +1,147 @@
+#ifndef ROUTE_TABLE_H
+#define ROUTE_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "metrics.h"
+
+/*
+    Every URL the web server answers, fixed at compile time. The pages and
+    API endpoints are listed in route_table below, the static files in
+    asset_table, which RouteTableBuilder.py generates from data/ before each
+    build. Both are sorted by path (checked by static_assert), so a request
+    is matched with a binary search instead of one string comparison per
+    registered handler, and the MIME type of every asset is picked from
+    mime_types by the compiler. The helpers are C++11 constexpr functions,
+    the ESP32 toolchain builds with -std=gnu++11. */
+
+// the bits of ESPAsyncWebServer's HTTP_GET and HTTP_POST
+#define ROUTE_GET 0x01
+#define ROUTE_POST 0x02
+
+struct route_entry
+{
+    const char *path;
+    uint8_t methods;
+    uint8_t route; // metrics_route, selects the handler
+};
+
+struct mime_entry
+{
+    const char *extension;
+    const char *mime;
+};
+
+struct asset_entry
+{
+    const char *path; // url, the stored file has ".gz" appended when gzip is set
+    const char *mime;
+    bool gzip;
+    uint32_t size;       // of the file in data/ when the firmware was built
+    const char *etag;    // its FNV-1a hash, quoted
+    const uint8_t *data; // the bytes in flash, nullptr unless built with STATIC_ASSETS_EMBEDDED
+};
+
+constexpr mime_entry mime_types[] = {
+    {".css", "text/css"},
+    {".js", "text/javascript"},
+    {".woff", "font/woff"},
+    {".woff2", "font/woff2"},
+    {".ttf", "font/ttf"},
+    {".svg", "image/svg+xml"},
+    {".png", "image/png"},
+    {".ico", "image/x-icon"},
+    {".json", "application/json"},
+    {".txt", "text/plain"},
+    {".html", "text/html"},
+};
+#define MIME_TYPES (sizeof(mime_types) / sizeof(mime_types[0]))
+
+constexpr size_t routeLength(const char *text)
+{
+    return *text == '\0' ? 0 : 1 + routeLength(text + 1);
+}
+
+constexpr int routeCompare(const char *a, const char *b)
+{
+    return *a != *b ? ((unsigned char)*a < (unsigned char)*b ? -1 : 1) : *a == '\0' ? 0 : routeCompare(a + 1, b + 1);
+}
+
+constexpr bool routeEndsWith(const char *text, size_t length, const char *suffix, size_t suffixLength)
+{
+    return length >= suffixLength && routeCompare(text + length - suffixLength, suffix) == 0;
+}
+
+constexpr const char *mimeTypeFrom(const char *path, size_t length, size_t i)
+{
+    return i == MIME_TYPES ? "application/octet-stream"
+           : routeEndsWith(path, length, mime_types[i].extension, routeLength(mime_types[i].extension))
+               ? mime_types[i].mime
+               : mimeTypeFrom(path, length, i + 1);
+}
+
+constexpr const char *mimeType(const char *path)
+{
+    return mimeTypeFrom(path, routeLength(path), 0);
+}
+
+// Sorted by path, then by method
+constexpr route_entry route_table[] = {
+    {"/", ROUTE_GET, ROUTE_INDEX},
+    {"/api/v1/history", ROUTE_GET, ROUTE_HISTORY},
+    {"/api/v1/metrics", ROUTE_GET, ROUTE_METRICS},
+    {"/api/v1/state", ROUTE_GET, ROUTE_STATE},
+    {"/api/v1/stats", ROUTE_GET, ROUTE_STATS},
+    {"/configuration.html", ROUTE_GET, ROUTE_CONFIGURATION},
+    {"/configuration.html", ROUTE_POST, ROUTE_SAVE},
+    {"/graphs.html", ROUTE_GET, ROUTE_GRAPHS},
+    {"/index.html", ROUTE_GET, ROUTE_INDEX},
+};
+#define ROUTE_TABLE_SIZE (sizeof(route_table) / sizeof(route_table[0]))
+
+constexpr bool routesSorted(const route_entry *table, size_t count, size_t i = 1)
+{
+    return i >= count || ((routeCompare(table[i - 1].path, table[i].path) < 0 ||
+                           (routeCompare(table[i - 1].path, table[i].path) == 0 &&
+                            table[i - 1].methods < table[i].methods)) &&
+                          routesSorted(table, count, i + 1));
+}
+static_assert(routesSorted(route_table, ROUTE_TABLE_SIZE), "route_table must be sorted by path, then method");
+
+constexpr bool assetsSorted(const asset_entry *table, size_t count, size_t i = 1)
+{
+    return i >= count ||
+           (routeCompare(table[i - 1].path, table[i].path) < 0 && assetsSorted(table, count, i + 1));
+}
+
+// First entry with the path, nullptr when there is none
+template <typename T>
+const T *findPath(const T *table, size_t count, const char *path)
+{
+    size_t low = 0, high = count;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        if (strcmp(table[mid].path, path) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low < count && strcmp(table[low].path, path) == 0 ? &table[low] : nullptr;
+}
+
+// The route for a path and one of the ROUTE_ method bits, nullptr for a 404
+inline const route_entry *findRoute(const char *path, uint8_t method)
+{
+    const route_entry *end = route_table + ROUTE_TABLE_SIZE;
+    for (const route_entry *entry = findPath(route_table, ROUTE_TABLE_SIZE, path);
+         entry != nullptr && entry != end && strcmp(entry->path, path) == 0; entry++)
+    {
+        if (entry->methods & method)
+            return entry;
+    }
+    return nullptr;
+}
+
+#endif
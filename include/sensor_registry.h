@@ -0,0 +1,77 @@
+#ifndef SENSOR_REGISTRY_H
+#define SENSOR_REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "packet_decoder.h"
+#include "signal_filter.h"
+#include "tank_trend.h"
+#include "alert_engine.h"
+
+class HistoryStore;
+
+/*
+    The tanks this server monitors, one entry per radio sensor ID. Entries
+    live in a fixed table in the order the sensors were registered, and a
+    byte map from sensor ID to table slot makes the lookup on the receive
+    path a single array access. Nothing here allocates; the history store
+    of a sensor is created by the caller when the sensor is registered. */
+
+#ifndef SENSOR_MAX
+#define SENSOR_MAX 4
+#endif
+#define SENSOR_NO_SLOT 0xFF
+#define SENSOR_DEFAULT_DEPTH 200 // cm
+
+struct tank_sensor
+{
+    uint8_t id;
+    bool received; // false until the first reading since boot
+    // calibration, cm
+    uint32_t depth; // total depth of the tank
+    uint32_t inlet; // inlet height, subtracted from the level
+    // last reading
+    float humidity;
+    float temperature;
+    uint32_t distance; // raw, as the sensor sent it
+    int batt_perc;
+    float batt_voltage;
+    int level; // cm, from the filtered distance
+    int fill_perc;
+    uint32_t measured_ms;            // millis() of the last reading
+    unsigned long measured_minutes; // uptime minutes of the last reading
+    distance_filter filter;
+    tank_trend trend; // fill rate and pump-outs, updated by the caller with the wall clock
+    tank_alerts alerts; // thresholds and their state, evaluated by the caller
+    HistoryStore *history;
+};
+
+class SensorRegistry
+{
+public:
+    SensorRegistry();
+
+    tank_sensor *find(uint8_t id)
+    {
+        uint8_t slot = m_slots[id];
+        return slot == SENSOR_NO_SLOT ? nullptr : &m_sensors[slot];
+    }
+    // Registers id with the default calibration, returns the existing entry if known, nullptr when full
+    tank_sensor *add(uint8_t id);
+    size_t count() const { return m_count; }
+    tank_sensor &at(size_t slot) { return m_sensors[slot]; }
+    const tank_sensor &at(size_t slot) const { return m_sensors[slot]; }
+    size_t slotOf(const tank_sensor &sensor) const { return &sensor - m_sensors; }
+
+    // Stores a reading in the entry, runs the distance through the filter and recomputes the level
+    static void apply(tank_sensor &sensor, const sensor_reading &reading, uint32_t nowMs, unsigned long uptimeMinutes);
+    // Level and fill percentage from the filtered distance and the calibration
+    static void updateDerived(tank_sensor &sensor);
+
+private:
+    tank_sensor m_sensors[SENSOR_MAX];
+    uint8_t m_slots[256]; // sensor ID -> slot, SENSOR_NO_SLOT when unknown
+    volatile uint8_t m_count;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SIGNAL_FILTER_H
+#define SIGNAL_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Cleans the distance readings of one ultrasonic sensor before they reach
+    the level, the history and ThingSpeak. Foam or condensation in the tank
+    sometimes returns a single echo far off the surface. Three stages, all
+    with fixed state and constant work per reading:
+
+      - the median of the last FILTER_WINDOW raw readings and their median
+        absolute deviation (MAD),
+      - a Hampel test: a reading further than FILTER_HAMPEL_K scaled MADs
+        (at least FILTER_MIN_DEVIATION cm) from the median is an outlier and
+        replaced by the median. The window keeps the raw readings, so a real
+        step, a pump-out, is accepted once it makes up half the window,
+      - a constant velocity Kalman filter of distance and its rate of change,
+        which smooths the echo noise and gives the fill rate. A step that
+        passed the Hampel test but lies far outside the prediction restarts
+        it at the new distance instead of being followed slowly.
+
+    The state is plain data, zeroed it is a filter that has seen nothing. */
+
+#define FILTER_WINDOW 5
+#define FILTER_HAMPEL_K 3.0f
+#define FILTER_MIN_DEVIATION 5.0f // cm, readings are whole cm and the MAD of a calm tank is 0
+#define FILTER_MEASUREMENT_VAR 4.0f // cm^2, echo noise of about 2 cm
+#define FILTER_ACCEL_VAR 400.0f // (cm/day^2)^2 per day, how fast the inflow may change
+#define FILTER_INITIAL_RATE_VAR 2500.0f // (cm/day)^2 before the first rate is known
+#define FILTER_RESET_DISTANCE 10.0f // cm off the prediction that restart the estimate, 5 sigma of the echo noise
+
+struct distance_filter
+{
+    uint16_t window[FILTER_WINDOW]; // raw readings, oldest overwritten first
+    uint8_t next;
+    uint8_t filled;
+    uint32_t last_ms; // arrival of the last reading
+    // estimate, cm and cm per day
+    float distance;
+    float rate;
+    float p00, p01, p11; // covariance, symmetric
+    float median;
+    bool outlier; // the last reading was replaced by the median
+    uint32_t samples;
+    uint32_t outliers;
+    uint32_t resets;
+};
+
+// Feeds one raw reading, returns the filtered distance
+float filterDistance(distance_filter &filter, uint32_t distance, uint32_t nowMs);
+// Fill rate in cm per day, positive while the level rises (the distance shrinks)
+inline float filterFillRate(const distance_filter &filter)
+{
+    return -filter.rate;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef SNAPSHOT_BUFFER_H
+#define SNAPSHOT_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+/*
+    A small document (JSON) that is rebuilt when the data changes and served
+    to every request. Two buffers are used in turns: one task, the writer,
+    builds the next version in the buffer that is not current and publishes
+    it with commit(), which bumps the sequence number. The buffer of version
+    n is written again while version n + 2 is built, so a reader on another
+    task takes a copy with read() and keeps nothing pointing into the
+    buffers; the copy is retried when a commit came in between. */
+
+#define SNAPSHOT_BUFFER_SIZE 2048 // state of SENSOR_MAX tanks
+#define SNAPSHOT_ETAG_LEN 16
+
+class SnapshotBuffer
+{
+public:
+    SnapshotBuffer();
+
+    // Writer side: buffer for the next version, publish it with commit()
+    char *begin() { return m_buffers[(m_sequence.load(std::memory_order_relaxed) + 1) & 1]; }
+    size_t capacity() const { return SNAPSHOT_BUFFER_SIZE; }
+    void commit(size_t length);
+    // Writer side only, the current version in place
+    const char *data() const { return m_buffers[m_sequence.load(std::memory_order_relaxed) & 1]; }
+    size_t length() const { return m_length[m_sequence.load(std::memory_order_acquire) & 1]; }
+
+    // Any task: copies the current version, returns its length or 0 when it does not fit
+    size_t read(char *out, size_t capacity, uint32_t &sequence) const;
+    uint32_t sequence() const { return m_sequence.load(std::memory_order_acquire); }
+    // Quoted, usable as an ETag header value
+    static void etag(uint32_t sequence, char *out, size_t size);
+    bool matches(const char *ifNoneMatch) const;
+
+private:
+    char m_buffers[2][SNAPSHOT_BUFFER_SIZE];
+    size_t m_length[2];
+    std::atomic<uint32_t> m_sequence; // the current buffer is sequence & 1
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+/*
+    Bounded queue between exactly one producer and one consumer task. The
+    producer only writes the head and the consumer only the tail, so no lock
+    is taken and neither side ever waits for the other: a full queue makes
+    push() fail and an empty one makes pop() fail. */
+
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue() : m_head(0), m_tail(0) {}
+
+    // Producer side
+    bool push(const T &item)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == N)
+            return false;
+        m_items[head & (N - 1)] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T &item)
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (m_head.load(std::memory_order_acquire) == tail)
+            return false;
+        item = m_items[tail & (N - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side, may be stale by the time it returns
+    size_t size() const { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T m_items[N];
+    std::atomic<uint32_t> m_head; // free running, wraps
+    std::atomic<uint32_t> m_tail;
+};
+
+#endif
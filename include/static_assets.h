@@ -0,0 +1,40 @@
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "ESPAsyncWebServer.h"
+#include "asset_manifest.h"
+
+/*
+    Serves the static files listed in the asset manifest: one open() for a
+    200, no filesystem access at all for a 304. Assets embedded in flash
+    are sent straight from the memory mapped array, no file is opened. */
+
+struct static_asset_stats
+{
+    uint32_t requests;
+    uint32_t not_modified;
+    uint32_t bytes_served;
+    uint32_t bytes_saved; // body bytes a 304 did not have to send
+};
+
+class StaticAssetHandler : public AsyncWebHandler
+{
+public:
+    explicit StaticAssetHandler(fs::FS &fs);
+
+    size_t scan(asset_source source = ASSET_SOURCE_DEFAULT) { return m_manifest.scan(source); }
+    AssetManifest &manifest() { return m_manifest; }
+    size_t count() const { return m_manifest.count(); }
+    const static_asset_stats &stats() const { return m_stats; }
+
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+
+private:
+    AssetManifest m_manifest;
+    static_asset_stats m_stats;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef TANK_TREND_H
+#define TANK_TREND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    What the level of a tank means over time: how fast it fills, when it
+    will be full and how long ago it was emptied. Updated once per reading
+    in constant time and kept with the sensor, so the state API and the
+    pages only print the cached numbers.
+
+    The readings are averaged into hourly buckets and the last TREND_BUCKETS
+    of them are fitted with a least squares line. The sums of the fit are
+    kept running: a closed bucket is added, the one falling out of the
+    window subtracted. A drop of the level by more than TREND_PUMPOUT_DROP
+    below its peak is a pump-out, it starts a new fit, the old line does not
+    describe the tank any more. Pumping takes a while, drops within
+    TREND_PUMPOUT_HOLDOFF_S of a pump-out belong to it. */
+
+#define TREND_BUCKET_S 3600
+#define TREND_BUCKETS 48 // two days of hourly points
+#define TREND_MIN_BUCKETS 6 // points before a rate is given
+#define TREND_PUMPOUT_DROP 20 // cm
+#define TREND_PUMPOUT_HOLDOFF_S (6 * 3600)
+#define TREND_FULL_PERCENT 90 // of the depth, where the tank counts as full
+#define TREND_MIN_RATE 0.1f // cm/day, slower is not filling
+#define TREND_MAX_DAYS 3650 // forecasts further out are not given
+
+struct tank_trend
+{
+    // fit, times in hours since origin
+    uint32_t origin;
+    float hours[TREND_BUCKETS];
+    float levels[TREND_BUCKETS];
+    uint8_t next;
+    uint8_t filled;
+    double sum_t, sum_y, sum_tt, sum_ty;
+    // the open bucket
+    uint32_t bucket_start;
+    float bucket_hours;
+    float bucket_level;
+    uint16_t bucket_count;
+    // pump-out detection
+    int peak; // highest level since the last pump-out
+    bool started; // the results are valid
+    // results, cached for the API and the pages
+    float rate;         // cm/day, 0 until TREND_MIN_BUCKETS points
+    uint32_t full_at;   // unix time of TREND_FULL_PERCENT, 0 when the tank is not filling
+    float days_to_full; // -1 when the tank is not filling
+    uint32_t emptied_at; // last pump-out, 0 when none was seen
+    float days_since_emptied; // -1 when none was seen
+    uint32_t pumpouts;
+};
+
+// Accounts a reading at unix time now, returns true when it moved emptied_at (worth persisting).
+// Readings before the clock is set are ignored.
+bool trendUpdate(tank_trend &trend, uint32_t now, int level, uint32_t depth);
+
+#endif
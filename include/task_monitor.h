@@ -0,0 +1,51 @@
+#ifndef TASK_MONITOR_H
+#define TASK_MONITOR_H
+
+#include <Arduino.h>
+
+/*
+    Health of the FreeRTOS tasks: the stack high-water mark of every task
+    registered with add(), and a histogram of the time between two runs of
+    the Arduino loop. Bucket n counts gaps shorter than 2^n ms, the last
+    bucket everything longer, so one slow iteration shows up even when the
+    average is fine. */
+
+#define TASK_MONITOR_SLOTS 8
+#define LATENCY_BUCKETS 12 // < 1 ms ... < 1024 ms, >= 1024 ms
+
+struct latency_histogram
+{
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t sum_ms;
+    uint32_t buckets[LATENCY_BUCKETS];
+};
+
+class TaskMonitor
+{
+public:
+    TaskMonitor();
+
+    // A null handle is ignored, so a task that failed to start needs no special case
+    void add(const char *name, TaskHandle_t task);
+    size_t count() const { return m_count; }
+    const char *name(size_t index) const { return m_names[index]; }
+    // Least free stack the task ever had, in bytes
+    uint32_t stackFree(size_t index) const;
+
+    // Call at the start of every loop(), records the time since the previous call
+    void loopTick();
+    latency_histogram loopLatency() const { return m_loop; }
+    // Upper limit of a bucket in ms, 0 for the open-ended last one
+    static uint32_t bucketLimitMs(size_t bucket);
+    static size_t bucketOf(uint32_t us);
+
+private:
+    const char *m_names[TASK_MONITOR_SLOTS];
+    TaskHandle_t m_tasks[TASK_MONITOR_SLOTS];
+    size_t m_count;
+    latency_histogram m_loop;
+    uint32_t m_lastTick;
+};
+
+#endif
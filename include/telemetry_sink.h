@@ -0,0 +1,125 @@
+#ifndef TELEMETRY_SINK_H
+#define TELEMETRY_SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Where the readings go besides the pages. The loop publishes every
+    decoded reading once to the TelemetryDispatcher, which offers it to each
+    enabled sink in the format that sink speaks. A format is serialized at
+    most once per reading and only when a sink that is enabled and ready
+    takes it, so two JSON sinks share one document and a format nobody uses
+    costs nothing.
+
+    A sink owns a bounded queue and a task that delivers with its own retry
+    and backoff; offer() never blocks, a full queue refuses the reading and
+    the dispatcher counts that against the sink. Adding a destination is a
+    TelemetrySink, a slot below and one add() in setup, the receive path
+    stays as it is. */
+
+#define TELEMETRY_TEXT_LEN 224 // a serialized reading
+
+// The sinks of the firmware, bit n of the enable mask is slot n
+enum telemetry_slot
+{
+    SINK_THINGSPEAK,
+    SINK_MQTT,
+    SINK_INFLUX,
+    SINK_WEBHOOK,
+    TELEMETRY_SINKS
+};
+
+#define TELEMETRY_ALL ((1 << TELEMETRY_SINKS) - 1)
+
+enum telemetry_format
+{
+    TELEMETRY_FIELDS, // the reading as it is, the sink maps the values itself
+    TELEMETRY_JSON,   // one JSON object
+    TELEMETRY_LINE,   // one line of InfluxDB line protocol
+    TELEMETRY_FORMATS
+};
+
+struct telemetry_reading
+{
+    uint8_t sensor_id;
+    uint8_t index;      // of the sensor in the registry
+    uint32_t time;      // unix time of the reading, 0 while the clock is not set
+    uint32_t queued_ms; // millis() when it was published
+    int level;
+    int fill_perc;
+    uint32_t distance;
+    float temperature;
+    float humidity;
+    int batt_perc;
+    float batt_voltage;
+    float fill_rate; // cm per day over the trend window, the filter's own rate is not published
+};
+
+// A reading in the format of the sink, text is null for TELEMETRY_FIELDS
+struct telemetry_payload
+{
+    const telemetry_reading *reading;
+    const char *text;
+    size_t length;
+};
+
+struct sink_stats
+{
+    uint32_t offered;  // by the dispatcher
+    uint32_t rejected; // the queue of the sink was full
+    uint32_t delivered;
+    uint32_t failures;
+    uint32_t dropped; // pushed out of a full backlog or refused by the receiver
+    uint32_t backlog;
+    uint32_t backoff_ms;
+    uint32_t last_latency_ms; // published to delivered
+};
+
+class TelemetrySink
+{
+public:
+    virtual ~TelemetrySink() {}
+
+    virtual const char *name() const = 0;
+    virtual uint8_t format() const = 0;
+    // Has a destination, the dispatcher does not offer anything before
+    virtual bool ready() const = 0;
+    // Producer side, call from the loop task only. Must not block, returns false when the queue is full.
+    virtual bool offer(const telemetry_payload &payload) = 0;
+    // Everything but offered and rejected, the dispatcher counts those
+    virtual sink_stats sinkStats() const = 0;
+};
+
+class TelemetryDispatcher
+{
+public:
+    TelemetryDispatcher();
+
+    bool add(uint8_t slot, TelemetrySink &sink);
+    // Thread safe, bit n enables slot n
+    void setEnabled(uint8_t mask) { m_enabled = mask; }
+    uint8_t enabled() const { return m_enabled; }
+    // Producer side, call from the loop task only
+    void publish(const telemetry_reading &reading);
+
+    const TelemetrySink *sink(uint8_t slot) const { return slot < TELEMETRY_SINKS ? m_sinks[slot] : nullptr; }
+    sink_stats stats(uint8_t slot) const;
+    // Readings serialized into the format, to see that sinks share the work
+    uint32_t serialized(uint8_t format) const { return format < TELEMETRY_FORMATS ? m_serialized[format] : 0; }
+
+private:
+    TelemetrySink *m_sinks[TELEMETRY_SINKS];
+    uint32_t m_offered[TELEMETRY_SINKS];
+    uint32_t m_rejected[TELEMETRY_SINKS];
+    uint32_t m_serialized[TELEMETRY_FORMATS];
+    volatile uint8_t m_enabled;
+    char m_text[TELEMETRY_FORMATS][TELEMETRY_TEXT_LEN];
+};
+
+// The wire formats, return the length written or 0 when it did not fit
+size_t telemetryJson(const telemetry_reading &reading, char *buf, size_t size);
+size_t telemetryLine(const telemetry_reading &reading, char *buf, size_t size);
+const char *telemetryFormatName(uint8_t format);
+
+#endif
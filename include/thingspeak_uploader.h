@@ -0,0 +1,109 @@
+#ifndef THINGSPEAK_UPLOADER_H
+#define THINGSPEAK_UPLOADER_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include "delivery.h"
+#include "telemetry_sink.h"
+
+/*
+    Uploads to ThingSpeak from a task of its own, so an HTTP round trip never
+    holds up the loop. It runs on the application core next to the loop; the
+    other core belongs to the radio task and Wi-Fi. The loop hands over
+    updates through a lock-free queue. The task moves them into a backlog
+    that rides out Wi-Fi and server outages (the oldest update is dropped
+    when it overflows), sends one update per THINGSPEAK_INTERVAL_MS to
+    respect the channel rate limit, and switches to the bulk update API once
+    the backlog grows past a single update. Failed requests back off
+    exponentially up to THINGSPEAK_BACKOFF_MAX_MS.
+
+    As a telemetry sink it maps the readings to channel fields on the loop
+    side: the first tank keeps fields 1-4, every further one adds its level
+    in the next field, and each reading sends the latest values of all. */
+
+#define THINGSPEAK_FIELDS 8
+#define THINGSPEAK_QUEUE 16 // power of two
+#ifndef THINGSPEAK_BACKLOG
+#define THINGSPEAK_BACKLOG 96 // 8 hours of 5 minute readings
+#endif
+#define THINGSPEAK_BATCH 16 // updates per bulk request
+#define THINGSPEAK_INTERVAL_MS 15500UL
+#define THINGSPEAK_BACKOFF_MAX_MS 600000UL
+#define THINGSPEAK_TIMEOUT_MS 5000
+#define THINGSPEAK_KEY_LEN 24
+#define THINGSPEAK_BODY_SIZE 3584
+#ifndef THINGSPEAK_CORE
+#define THINGSPEAK_CORE 1
+#endif
+#define THINGSPEAK_STACK 6144
+
+struct thingspeak_update
+{
+    uint32_t queued_ms; // millis() when it was queued, turned into created_at on upload
+    uint8_t mask;       // bit n set when field n + 1 holds a value
+    float fields[THINGSPEAK_FIELDS];
+};
+
+struct uploader_stats
+{
+    uint32_t queued;
+    uint32_t rejected; // the queue to the task was full
+    uint32_t uploaded; // updates accepted by the server
+    uint32_t requests;
+    uint32_t batches; // requests that used the bulk API
+    uint32_t failures;
+    uint32_t dropped; // oldest updates pushed out of a full backlog
+    uint32_t backlog;
+    uint32_t consecutive_failures;
+    uint32_t backoff_ms;
+    uint32_t last_latency_ms; // queued to accepted, of the last uploaded update
+    uint32_t max_latency_ms;
+    uint32_t last_request_ms; // duration of the last HTTP request
+};
+
+class ThingSpeakUploader : public TelemetrySink
+{
+public:
+    ThingSpeakUploader();
+
+    // Starts the upload task
+    bool begin();
+    // Thread safe, an empty key or channel 0 pauses the uploads
+    void configure(uint32_t channel, const char *apiKey);
+    // Producer side, call from the loop task only. Returns false when the queue is full.
+    bool enqueue(const thingspeak_update &update);
+
+    uploader_stats stats() const;
+    TaskHandle_t task() const { return m_task; }
+
+    const char *name() const override { return "thingspeak"; }
+    uint8_t format() const override { return TELEMETRY_FIELDS; }
+    bool ready() const override { return m_ready; }
+    bool offer(const telemetry_payload &payload) override;
+    sink_stats sinkStats() const override;
+
+private:
+    static void taskMain(void *arg);
+    void run();
+    void drainQueue();
+    bool uploadOne(uint32_t channel, const char *apiKey);
+    bool uploadBatch(uint32_t channel, const char *apiKey, size_t count);
+    void accept(size_t count);
+    static bool createdAt(uint32_t queuedMs, char *buf, size_t size);
+
+    SpscQueue<thingspeak_update, THINGSPEAK_QUEUE> m_queue;
+    DeliveryBacklog<thingspeak_update, THINGSPEAK_BACKLOG> m_backlog;
+    RetryBackoff m_backoff;
+    uint32_t m_channel;
+    char m_apiKey[THINGSPEAK_KEY_LEN];
+    uint32_t m_rejected; // written by the producer only
+    thingspeak_update m_latest; // the fields of all tanks, written by the producer only
+    volatile bool m_ready;
+    WiFiClient m_client;
+    char m_body[THINGSPEAK_BODY_SIZE];
+    uploader_stats m_stats;
+    TaskHandle_t m_task;
+    portMUX_TYPE m_mux; // guards the channel and key
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef WALL_CLOCK_H
+#define WALL_CLOCK_H
+
+#include <time.h>
+
+/*
+    The wall clock starts at 1970 after a reset and is only set once NTP
+    answers. Whatever dates readings, history samples or alerts checks it
+    here before it trusts the time. */
+
+#define CLOCK_SET_TIME 1600000000UL // September 2020, anything older means the clock is not set yet
+
+inline bool clockIsSet(time_t now)
+{
+    return now >= (time_t)CLOCK_SET_TIME;
+}
+
+#endif
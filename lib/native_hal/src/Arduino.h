@@ -0,0 +1,115 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <atomic>
+#include "WString.h"
+
+/*
+    Host stand-in for the parts of the Arduino core and of FreeRTOS that the
+    firmware modules use. Tasks are threads, critical sections are spin
+    locks, and the millisecond clock is the real monotonic clock plus an
+    offset the simulation can move forward with nativeAdvanceMillis(). */
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+// Host only: moves millis() and micros() forward without sleeping
+void nativeAdvanceMillis(uint32_t ms);
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+#define PROGMEM
+#define memcpy_P memcpy
+
+// glibc only has strlcpy since 2.38
+size_t nativeStrlcpy(char *dst, const char *src, size_t size);
+#define strlcpy nativeStrlcpy
+
+struct portMUX_TYPE
+{
+    std::atomic<int> locked;
+    portMUX_TYPE(int value = 0) : locked(value) {}
+    portMUX_TYPE(const portMUX_TYPE &) : locked(0) {}
+};
+#define portMUX_INITIALIZER_UNLOCKED 0
+void nativeEnterCritical(portMUX_TYPE *mux);
+void nativeExitCritical(portMUX_TYPE *mux);
+#define portENTER_CRITICAL(mux) nativeEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) nativeExitCritical(mux)
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+// Marks the task deleted, the thread ends when its function returns
+void vTaskDelete(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+#define configASSERT(x) assert(x)
+TaskHandle_t xTaskGetHandle(const char *name);
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait);
+// Threads have no fixed stack to measure, always 0
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+#define NATIVE_HEAP_SIZE 327680 // what the ESP32 offers, the host heap is only counted against it
+
+// Heap of the host process as counted by the malloc wrappers
+class EspClass
+{
+public:
+    uint32_t getHeapSize() { return NATIVE_HEAP_SIZE; }
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap() { return getFreeHeap(); }
+};
+
+extern EspClass ESP;
+// Host only: malloc, calloc and realloc calls since the start
+uint32_t nativeAllocations();
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud) {}
+    size_t write(const uint8_t *data, size_t len) { return fwrite(data, 1, len, stdout); }
+    size_t print(const char *text) { return fputs(text, stdout) < 0 ? 0 : strlen(text); }
+    size_t print(const __FlashStringHelper *text) { return print(reinterpret_cast<const char *>(text)); }
+    size_t print(const String &text) { return print(text.c_str()); }
+    size_t print(char c) { return putchar(c) == EOF ? 0 : 1; }
+    size_t print(int value) { return printf("%d", value); }
+    size_t print(unsigned value) { return printf("%u", value); }
+    size_t print(long value) { return printf("%ld", value); }
+    size_t print(unsigned long value) { return printf("%lu", value); }
+    size_t print(double value) { return printf("%.2f", value); }
+    size_t println() { return print('\n'); }
+    template <typename T>
+    size_t println(T value)
+    {
+        size_t n = print(value);
+        return n + println();
+    }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+    In-memory file system with the subset of the fs::FS / fs::File API the
+    firmware uses. Files are shared byte vectors, so a File stays valid after
+    the name is removed, like an open file on LittleFS. */
+
+namespace fs
+{
+
+class FS;
+
+enum SeekMode
+{
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+// File contents are in flash on the device, they are kept out of the heap counted for ESP
+void *nativeFlashAlloc(size_t size);
+void nativeFlashFree(void *ptr);
+
+template <typename T>
+struct FlashAllocator
+{
+    typedef T value_type;
+    FlashAllocator() = default;
+    template <typename U>
+    FlashAllocator(const FlashAllocator<U> &) {}
+    T *allocate(size_t count)
+    {
+        T *ptr = static_cast<T *>(nativeFlashAlloc(count * sizeof(T)));
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+    void deallocate(T *ptr, size_t) { nativeFlashFree(ptr); }
+    bool operator==(const FlashAllocator &) const { return true; }
+    bool operator!=(const FlashAllocator &) const { return false; }
+};
+
+struct NativeFile
+{
+    std::vector<uint8_t, FlashAllocator<uint8_t>> data;
+    std::mutex lock;
+};
+
+class File
+{
+public:
+    File() : m_pos(0), m_writable(false), m_owner(nullptr) {}
+    File(std::shared_ptr<NativeFile> file, const char *path, bool writable, size_t pos)
+        : m_file(file), m_path(path), m_pos(pos), m_writable(writable), m_owner(nullptr)
+    {
+    }
+    // A directory, lists the given full paths
+    File(FS *owner, const char *path, std::vector<std::string> entries)
+        : m_path(path), m_pos(0), m_writable(false), m_owner(owner), m_entries(entries)
+    {
+    }
+
+    explicit operator bool() const { return m_file != nullptr || m_owner != nullptr; }
+    bool isDirectory() const { return m_owner != nullptr; }
+    File openNextFile(const char *mode = "r");
+    size_t read(uint8_t *buf, size_t size);
+    int read();
+    size_t write(const uint8_t *buf, size_t size);
+    size_t write(uint8_t c) { return write(&c, 1); }
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const { return m_pos; }
+    size_t size() const;
+    int available() const { return size() > m_pos ? size() - m_pos : 0; }
+    void flush() {}
+    void close()
+    {
+        m_file.reset();
+        m_owner = nullptr;
+    }
+    const char *name() const { return m_path.c_str(); }
+
+private:
+    std::shared_ptr<NativeFile> m_file;
+    std::string m_path;
+    size_t m_pos;
+    bool m_writable;
+    FS *m_owner; // set for directories
+    std::vector<std::string> m_entries;
+};
+
+class FS
+{
+public:
+    // Modes "r", "r+", "w", "w+", "a" and "a+" as for fopen()
+    File open(const char *path, const char *mode = "r");
+    bool exists(const char *path);
+    bool mkdir(const char *path);
+    bool remove(const char *path);
+    bool rmdir(const char *path);
+
+    // Host only
+    size_t usedBytes();
+    void format();
+    // Copies a directory tree of the host into dir, returns the number of files
+    size_t nativeImport(const char *hostDir, const char *dir = "/");
+
+private:
+    bool isDirectory(const std::string &path);
+
+    std::mutex m_lock;
+    std::map<std::string, std::shared_ptr<NativeFile>> m_files;
+    std::map<std::string, bool> m_dirs;
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+
+#endif
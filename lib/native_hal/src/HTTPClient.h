@@ -0,0 +1,39 @@
+#ifndef NATIVE_HTTPCLIENT_H
+#define NATIVE_HTTPCLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <atomic>
+#include <string>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+
+/*
+    Records requests instead of sending them. Every POST answers with
+    nativeStatus, so a test can play a server that accepts, throttles or is
+    unreachable. A POST to http://127.0.0.1:port/ really goes out, so a
+    local stand-in server can play the receiver instead. */
+
+class HTTPClient
+{
+public:
+    HTTPClient() : m_timeout(5000) {}
+    bool begin(WiFiClient &client, const char *url);
+    void setTimeout(uint16_t timeout) { m_timeout = timeout; }
+    void addHeader(const String &name, const String &value) {}
+    int POST(uint8_t *payload, size_t size);
+    void end() {}
+
+    // Host only
+    static std::atomic<int> nativeStatus;
+    static std::atomic<uint32_t> nativeRequests;
+    static std::atomic<uint32_t> nativeBytes;
+
+private:
+    int loopbackPost(uint16_t port, const char *path, const uint8_t *payload, size_t size);
+
+    std::string m_url;
+    uint16_t m_timeout;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef NATIVE_LITTLEFS_H
+#define NATIVE_LITTLEFS_H
+
+#include <FS.h>
+
+namespace fs
+{
+
+class LITTLEFSFS : public FS
+{
+public:
+    bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10)
+    {
+        return true;
+    }
+    void end() {}
+    size_t totalBytes() { return 0x270000; }
+};
+
+} // namespace fs
+
+extern fs::LITTLEFSFS LITTLEFS;
+
+#endif
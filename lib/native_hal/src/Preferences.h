@@ -0,0 +1,50 @@
+#ifndef NATIVE_PREFERENCES_H
+#define NATIVE_PREFERENCES_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+    In-memory NVS. Namespaces outlive the Preferences object, like on the
+    chip, so a test can reopen them to check what the firmware stored. */
+
+class Preferences
+{
+public:
+    Preferences() : m_readOnly(false) {}
+
+    bool begin(const char *name, bool readOnly = false, const char *partitionLabel = nullptr);
+    void end() { m_name.clear(); }
+    bool clear();
+    bool remove(const char *key);
+    bool isKey(const char *key);
+
+    size_t putUChar(const char *key, uint8_t value);
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0);
+    size_t putUShort(const char *key, uint16_t value);
+    uint16_t getUShort(const char *key, uint16_t defaultValue = 0);
+    size_t putUInt(const char *key, uint32_t value);
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+    size_t putString(const char *key, const char *value);
+    size_t putString(const char *key, const String &value) { return putString(key, value.c_str()); }
+    String getString(const char *key, const String &defaultValue = String());
+    size_t getString(const char *key, char *value, size_t maxLen);
+    size_t putBytes(const char *key, const void *value, size_t len);
+    size_t getBytes(const char *key, void *buf, size_t maxLen);
+    size_t getBytesLength(const char *key);
+
+    // Host only: drops every namespace
+    static void resetAll();
+    // Host only: values written so far, every put counts as one write to flash
+    static uint32_t writes();
+
+private:
+    std::vector<uint8_t> *find(const char *key);
+
+    std::string m_name;
+    bool m_readOnly;
+};
+
+#endif
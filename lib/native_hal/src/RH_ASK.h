@@ -0,0 +1,41 @@
+#ifndef NATIVE_RH_ASK_H
+#define NATIVE_RH_ASK_H
+
+#include <Arduino.h>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#define RH_ASK_MAX_MESSAGE_LEN 60
+
+/*
+    Radio stand-in. Messages handed to inject() are received in order;
+    a message that does not fit the caller's buffer is truncated, as the
+    RadioHead driver does. */
+
+class RH_ASK
+{
+public:
+    RH_ASK(uint16_t speed = 2000, uint8_t rxPin = 11, uint8_t txPin = 12, uint8_t pttPin = 10, bool pttInverted = false)
+        : m_rxBad(0), m_initOk(true)
+    {
+    }
+
+    bool init() { return m_initOk; }
+    bool available();
+    bool recv(uint8_t *buf, uint8_t *len);
+    uint16_t rxBad() const { return m_rxBad; }
+
+    // Host only
+    void inject(const uint8_t *buf, size_t len);
+    void injectBad() { m_rxBad++; }
+    void failInit() { m_initOk = false; }
+
+private:
+    std::mutex m_lock;
+    std::deque<std::vector<uint8_t>> m_messages;
+    uint16_t m_rxBad;
+    bool m_initOk;
+};
+
+#endif
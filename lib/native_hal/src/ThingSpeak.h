@@ -0,0 +1,31 @@
+#ifndef NATIVE_THINGSPEAK_H
+#define NATIVE_THINGSPEAK_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <atomic>
+
+#define TS_OK_SUCCESS 200
+#define TS_ERR_TIMEOUT (-304)
+
+// Counts writes and answers with nativeStatus, nothing leaves the host
+class ThingSpeakClass
+{
+public:
+    ThingSpeakClass() : m_fields(0) {}
+    bool begin(WiFiClient &client) { return true; }
+    int setField(unsigned int field, float value);
+    int setCreatedAt(const char *createdAt) { return TS_OK_SUCCESS; }
+    int writeFields(unsigned long channelNumber, const char *writeAPIKey);
+
+    // Host only
+    std::atomic<int> nativeStatus{TS_OK_SUCCESS};
+    std::atomic<uint32_t> nativeWrites{0};
+
+private:
+    uint8_t m_fields; // fields set since the last write
+};
+
+extern ThingSpeakClass ThingSpeak;
+
+#endif
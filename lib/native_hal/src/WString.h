@@ -0,0 +1,46 @@
+#ifndef NATIVE_WSTRING_H
+#define NATIVE_WSTRING_H
+
+#include <stdlib.h>
+#include <string>
+
+class __FlashStringHelper;
+
+// Just enough of the Arduino String for the stand-in libraries and the baseline rows of the benchmarks
+class String
+{
+public:
+    String(const char *text = "") : m_text(text != nullptr ? text : "") {}
+    String(const __FlashStringHelper *text) : m_text(reinterpret_cast<const char *>(text)) {}
+    String(const std::string &text) : m_text(text) {}
+
+    const char *c_str() const { return m_text.c_str(); }
+    unsigned int length() const { return m_text.length(); }
+    char charAt(unsigned int index) const { return index < m_text.length() ? m_text[index] : '\0'; }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        return from < to && from < m_text.length() ? String(m_text.substr(from, to - from)) : String();
+    }
+    long toInt() const { return atol(m_text.c_str()); }
+    float toFloat() const { return (float)atof(m_text.c_str()); }
+    bool operator==(const String &other) const { return m_text == other.m_text; }
+    bool operator==(const char *other) const { return m_text == other; }
+    bool operator!=(const String &other) const { return m_text != other.m_text; }
+    bool operator!=(const char *other) const { return m_text != other; }
+    String &operator+=(const String &other)
+    {
+        m_text += other.m_text;
+        return *this;
+    }
+    friend String operator+(const String &lhs, char c)
+    {
+        String sum(lhs);
+        sum.m_text += c;
+        return sum;
+    }
+
+private:
+    std::string m_text;
+};
+
+#endif
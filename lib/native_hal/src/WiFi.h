@@ -0,0 +1,31 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include <Arduino.h>
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+// Host only: the status is whatever the test sets
+class WiFiClass
+{
+public:
+    WiFiClass() : m_status(WL_CONNECTED) {}
+    wl_status_t status() const { return m_status; }
+    int8_t RSSI() const { return -60; }
+    void setStatus(wl_status_t status) { m_status = status; }
+
+private:
+    volatile wl_status_t m_status;
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef NATIVE_WIFICLIENT_H
+#define NATIVE_WIFICLIENT_H
+
+#include <Arduino.h>
+
+// Connects to 127.0.0.1 only, so a local stand-in server can play the remote end; HTTPClient and ThingSpeak answer
+// without it
+class WiFiClient
+{
+public:
+    WiFiClient() : m_fd(-1) {}
+    ~WiFiClient() { stop(); }
+    WiFiClient(const WiFiClient &) = delete;
+    WiFiClient &operator=(const WiFiClient &) = delete;
+
+    int connect(const char *host, uint16_t port, int32_t timeoutMs = 3000);
+    size_t write(const uint8_t *buf, size_t size);
+    int available();
+    int read(uint8_t *buf, size_t size);
+    int read();
+    void setNoDelay(bool noDelay) {}
+    void stop();
+    uint8_t connected();
+
+private:
+    int m_fd;
+};
+
+#endif
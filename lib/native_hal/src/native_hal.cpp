@@ -0,0 +1,779 @@
+#include <Arduino.h>
+#include <FS.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <RH_ASK.h>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <ThingSpeak.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <malloc.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <condition_variable>
+#include <list>
+#include <set>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+fs::LITTLEFSFS LITTLEFS;
+WiFiClass WiFi;
+ThingSpeakClass ThingSpeak;
+
+// --- clock
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+static std::atomic<uint64_t> clockOffsetUs(0);
+
+static uint64_t nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime)
+               .count() +
+           clockOffsetUs.load();
+}
+
+uint32_t millis()
+{
+    return nowUs() / 1000;
+}
+
+uint32_t micros()
+{
+    return nowUs();
+}
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void nativeAdvanceMillis(uint32_t ms)
+{
+    clockOffsetUs += (uint64_t)ms * 1000;
+}
+
+size_t nativeStrlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size > 0)
+    {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+size_t HardwareSerial::printf(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int n = vprintf(format, args);
+    va_end(args);
+    return n < 0 ? 0 : n;
+}
+
+// --- heap
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static std::atomic<uint32_t> heapAllocations(0);
+static std::atomic<int64_t> heapInUse(0);
+static std::atomic<int64_t> heapPeak(0);
+
+static void *counted(void *ptr)
+{
+    if (ptr == nullptr)
+        return ptr;
+    heapAllocations++;
+    int64_t used = heapInUse += malloc_usable_size(ptr);
+    int64_t peak = heapPeak.load();
+    while (used > peak && !heapPeak.compare_exchange_weak(peak, used))
+        ;
+    return ptr;
+}
+
+extern "C" void *malloc(size_t size)
+{
+    return counted(__libc_malloc(size));
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    return counted(__libc_calloc(count, size));
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    size_t old = ptr != nullptr ? malloc_usable_size(ptr) : 0;
+    void *moved = __libc_realloc(ptr, size);
+    // a failed realloc keeps the old block
+    if (moved != nullptr || size == 0)
+        heapInUse -= old;
+    return counted(moved);
+}
+
+extern "C" void free(void *ptr)
+{
+    if (ptr != nullptr)
+        heapInUse -= malloc_usable_size(ptr);
+    __libc_free(ptr);
+}
+
+void *fs::nativeFlashAlloc(size_t size)
+{
+    return __libc_malloc(size);
+}
+
+void fs::nativeFlashFree(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+uint32_t nativeAllocations()
+{
+    return heapAllocations;
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    int64_t used = heapInUse;
+    return used < NATIVE_HEAP_SIZE ? NATIVE_HEAP_SIZE - used : 0;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+    int64_t peak = heapPeak;
+    return peak < NATIVE_HEAP_SIZE ? NATIVE_HEAP_SIZE - peak : 0;
+}
+
+// --- FreeRTOS
+
+void nativeEnterCritical(portMUX_TYPE *mux)
+{
+    int unlocked = 0;
+    while (!mux->locked.compare_exchange_weak(unlocked, 1, std::memory_order_acquire))
+    {
+        unlocked = 0;
+        std::this_thread::yield();
+    }
+}
+
+void nativeExitCritical(portMUX_TYPE *mux)
+{
+    mux->locked.store(0, std::memory_order_release);
+}
+
+struct native_task
+{
+    char name[16];
+    std::mutex lock;
+    std::condition_variable notified;
+    uint32_t notifications;
+    bool deleted;
+};
+
+static std::mutex taskLock;
+static std::list<native_task> taskList; // stable addresses, tasks are never freed
+static thread_local native_task *currentTask = nullptr;
+
+static native_task *newTask(const char *name)
+{
+    std::lock_guard<std::mutex> guard(taskLock);
+    taskList.emplace_back();
+    native_task *task = &taskList.back();
+    strlcpy(task->name, name, sizeof(task->name));
+    task->notifications = 0;
+    task->deleted = false;
+    return task;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core)
+{
+    native_task *task = newTask(name);
+    if (created != nullptr)
+        *created = task;
+    std::thread([task, code, parameters]() {
+        currentTask = task;
+        code(parameters);
+    }).detach();
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    delay(ticks);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    native_task *target = task != nullptr ? static_cast<native_task *>(task) : currentTask;
+    if (target != nullptr)
+        target->deleted = true;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    if (currentTask == nullptr)
+        currentTask = newTask("main");
+    return currentTask;
+}
+
+TaskHandle_t xTaskGetHandle(const char *name)
+{
+    std::lock_guard<std::mutex> guard(taskLock);
+    for (native_task &task : taskList)
+    {
+        if (!task.deleted && strcmp(task.name, name) == 0)
+            return &task;
+    }
+    return nullptr;
+}
+
+void xTaskNotifyGive(TaskHandle_t task)
+{
+    native_task *target = static_cast<native_task *>(task);
+    if (target == nullptr)
+        return;
+    std::lock_guard<std::mutex> guard(target->lock);
+    target->notifications++;
+    target->notified.notify_all();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait)
+{
+    native_task *task = static_cast<native_task *>(xTaskGetCurrentTaskHandle());
+    std::unique_lock<std::mutex> guard(task->lock);
+    auto given = [task]() { return task->notifications > 0; };
+    if (ticksToWait == portMAX_DELAY)
+        task->notified.wait(guard, given);
+    else
+        task->notified.wait_for(guard, std::chrono::milliseconds(ticksToWait), given);
+    uint32_t value = task->notifications;
+    if (value > 0)
+        task->notifications = clearOnExit ? 0 : value - 1;
+    return value;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return 0;
+}
+
+// --- file system
+
+namespace fs
+{
+
+size_t File::read(uint8_t *buf, size_t size)
+{
+    if (!m_file)
+        return 0;
+    std::lock_guard<std::mutex> guard(m_file->lock);
+    size_t length = m_file->data.size();
+    if (m_pos >= length)
+        return 0;
+    size_t n = length - m_pos < size ? length - m_pos : size;
+    memcpy(buf, m_file->data.data() + m_pos, n);
+    m_pos += n;
+    return n;
+}
+
+int File::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::write(const uint8_t *buf, size_t size)
+{
+    if (!m_file || !m_writable)
+        return 0;
+    std::lock_guard<std::mutex> guard(m_file->lock);
+    if (m_file->data.size() < m_pos + size)
+        m_file->data.resize(m_pos + size);
+    memcpy(m_file->data.data() + m_pos, buf, size);
+    m_pos += size;
+    return size;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+    if (!m_file)
+        return false;
+    size_t base = mode == SeekSet ? 0 : mode == SeekCur ? m_pos : size();
+    size_t target = base + pos;
+    // LittleFS lets a writer seek past the end, the gap reads back as zeros
+    if (target > size() && !m_writable)
+        return false;
+    m_pos = target;
+    return true;
+}
+
+size_t File::size() const
+{
+    if (!m_file)
+        return 0;
+    std::lock_guard<std::mutex> guard(m_file->lock);
+    return m_file->data.size();
+}
+
+File File::openNextFile(const char *mode)
+{
+    if (m_owner == nullptr || m_pos >= m_entries.size())
+        return File();
+    return m_owner->open(m_entries[m_pos++].c_str(), mode);
+}
+
+// Caller holds m_lock
+bool FS::isDirectory(const std::string &path)
+{
+    if (path == "/" || m_dirs.count(path) > 0)
+        return true;
+    auto it = m_files.lower_bound(path + "/");
+    return it != m_files.end() && it->first.compare(0, path.size() + 1, path + "/") == 0;
+}
+
+File FS::open(const char *path, const char *mode)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    auto it = m_files.find(path);
+    bool plus = strchr(mode, '+') != nullptr;
+    if (mode[0] == 'r' && it == m_files.end() && isDirectory(path))
+    {
+        std::string prefix = path;
+        if (prefix.back() != '/')
+            prefix += '/';
+        std::set<std::string> entries;
+        auto addEntry = [&](const std::string &name) {
+            if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0)
+                entries.insert(name.substr(0, name.find('/', prefix.size())));
+        };
+        for (auto &file : m_files)
+            addEntry(file.first);
+        for (auto &dir : m_dirs)
+            addEntry(dir.first);
+        return File(this, path, std::vector<std::string>(entries.begin(), entries.end()));
+    }
+    if (mode[0] == 'r')
+    {
+        if (it == m_files.end())
+            return File();
+        return File(it->second, path, plus, 0);
+    }
+    if (it == m_files.end() || mode[0] == 'w')
+    {
+        std::shared_ptr<NativeFile> file = std::make_shared<NativeFile>();
+        m_files[path] = file;
+        return File(file, path, true, 0);
+    }
+    // append
+    return File(it->second, path, true, it->second->data.size());
+}
+
+bool FS::exists(const char *path)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_files.count(path) > 0 || m_dirs.count(path) > 0;
+}
+
+bool FS::mkdir(const char *path)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_dirs[path] = true;
+    return true;
+}
+
+bool FS::remove(const char *path)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_files.erase(path) > 0;
+}
+
+bool FS::rmdir(const char *path)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_dirs.erase(path) > 0;
+}
+
+size_t FS::usedBytes()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    size_t used = 0;
+    for (auto &entry : m_files)
+        used += entry.second->data.size();
+    return used;
+}
+
+void FS::format()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_files.clear();
+    m_dirs.clear();
+}
+
+size_t FS::nativeImport(const char *hostDir, const char *dir)
+{
+    namespace host = std::filesystem;
+    std::error_code error;
+    size_t imported = 0;
+    for (auto &entry : host::recursive_directory_iterator(hostDir, error))
+    {
+        if (!entry.is_regular_file())
+            continue;
+        std::string path = dir;
+        if (path.back() != '/')
+            path += '/';
+        path += host::relative(entry.path(), hostDir).generic_string();
+
+        std::ifstream in(entry.path(), std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        File file = open(path.c_str(), "w");
+        file.write(data.data(), data.size());
+        imported++;
+    }
+    return imported;
+}
+
+} // namespace fs
+
+// --- preferences
+
+static std::mutex prefsLock;
+static std::map<std::string, std::map<std::string, std::vector<uint8_t>>> prefsStore;
+static uint32_t prefsWrites = 0;
+
+bool Preferences::begin(const char *name, bool readOnly, const char *partitionLabel)
+{
+    std::lock_guard<std::mutex> guard(prefsLock);
+    m_name = name;
+    m_readOnly = readOnly;
+    prefsStore[m_name];
+    return true;
+}
+
+bool Preferences::clear()
+{
+    std::lock_guard<std::mutex> guard(prefsLock);
+    if (m_name.empty() || m_readOnly)
+        return false;
+    prefsStore[m_name].clear();
+    return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+    std::lock_guard<std::mutex> guard(prefsLock);
+    if (m_name.empty() || m_readOnly)
+        return false;
+    return prefsStore[m_name].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    std::lock_guard<std::mutex> guard(prefsLock);
+    return find(key) != nullptr;
+}
+
+void Preferences::resetAll()
+{
+    std::lock_guard<std::mutex> guard(prefsLock);
+    prefsStore.clear();
+}
+
+// Caller holds prefsLock
+std::vector<uint8_t> *Preferences::find(const char *key)
+{
+    if (m_name.empty())
+        return nullptr;
+    auto &space = prefsStore[m_name];
+    auto it = space.find(key);
+    return it == space.end() ? nullptr : &it->second;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len)
+{
+    std::lock_guard<std::mutex> guard(prefsLock);
+    if (m_name.empty() || m_readOnly)
+        return 0;
+    const uint8_t *bytes = static_cast<const uint8_t *>(value);
+    prefsStore[m_name][key].assign(bytes, bytes + len);
+    prefsWrites++;
+    return len;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen)
+{
+    std::lock_guard<std::mutex> guard(prefsLock);
+    std::vector<uint8_t> *value = find(key);
+    if (value == nullptr || value->size() > maxLen)
+        return 0;
+    memcpy(buf, value->data(), value->size());
+    return value->size();
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    std::lock_guard<std::mutex> guard(prefsLock);
+    std::vector<uint8_t> *value = find(key);
+    return value == nullptr ? 0 : value->size();
+}
+
+uint32_t Preferences::writes()
+{
+    std::lock_guard<std::mutex> guard(prefsLock);
+    return prefsWrites;
+}
+
+size_t Preferences::putUChar(const char *key, uint8_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint8_t Preferences::getUChar(const char *key, uint8_t defaultValue)
+{
+    uint8_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putUShort(const char *key, uint16_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint16_t Preferences::getUShort(const char *key, uint16_t defaultValue)
+{
+    uint16_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue)
+{
+    uint32_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putString(const char *key, const char *value)
+{
+    return putBytes(key, value, strlen(value) + 1) > 0 ? strlen(value) : 0;
+}
+
+String Preferences::getString(const char *key, const String &defaultValue)
+{
+    std::lock_guard<std::mutex> guard(prefsLock);
+    std::vector<uint8_t> *value = find(key);
+    if (value == nullptr || value->empty())
+        return defaultValue;
+    return String(reinterpret_cast<const char *>(value->data()));
+}
+
+size_t Preferences::getString(const char *key, char *value, size_t maxLen)
+{
+    size_t length = getBytes(key, value, maxLen);
+    return length > 0 ? length - 1 : 0;
+}
+
+// --- radio
+
+bool RH_ASK::available()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return !m_messages.empty();
+}
+
+bool RH_ASK::recv(uint8_t *buf, uint8_t *len)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (m_messages.empty())
+        return false;
+    std::vector<uint8_t> &message = m_messages.front();
+    if (message.size() < *len)
+        *len = message.size();
+    memcpy(buf, message.data(), *len);
+    m_messages.pop_front();
+    return true;
+}
+
+void RH_ASK::inject(const uint8_t *buf, size_t len)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (len > RH_ASK_MAX_MESSAGE_LEN)
+        len = RH_ASK_MAX_MESSAGE_LEN;
+    m_messages.emplace_back(buf, buf + len);
+}
+
+// --- network
+
+int WiFiClient::connect(const char *host, uint16_t port, int32_t timeoutMs)
+{
+    stop();
+    if (strcmp(host, "127.0.0.1") != 0 || WiFi.status() != WL_CONNECTED)
+        return 0;
+    m_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_fd < 0)
+        return 0;
+    timeval timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+    setsockopt(m_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::connect(m_fd, (const sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        stop();
+        return 0;
+    }
+    return 1;
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t size)
+{
+    if (m_fd < 0)
+        return 0;
+    ssize_t sent = send(m_fd, buf, size, MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+        stop();
+        return 0;
+    }
+    return sent;
+}
+
+int WiFiClient::available()
+{
+    int pending = 0;
+    if (m_fd < 0 || ioctl(m_fd, FIONREAD, &pending) != 0)
+        return 0;
+    return pending;
+}
+
+int WiFiClient::read(uint8_t *buf, size_t size)
+{
+    if (m_fd < 0)
+        return -1;
+    ssize_t received = recv(m_fd, buf, size, MSG_DONTWAIT);
+    if (received == 0)
+        stop();
+    return received > 0 ? received : -1;
+}
+
+int WiFiClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+void WiFiClient::stop()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+    m_fd = -1;
+}
+
+uint8_t WiFiClient::connected()
+{
+    if (m_fd < 0)
+        return 0;
+    // an orderly shutdown by the peer reads as zero bytes
+    uint8_t c;
+    ssize_t peeked = recv(m_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (peeked == 0 || (peeked < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        stop();
+        return 0;
+    }
+    return 1;
+}
+
+// --- HTTP
+
+std::atomic<int> HTTPClient::nativeStatus(202);
+std::atomic<uint32_t> HTTPClient::nativeRequests(0);
+std::atomic<uint32_t> HTTPClient::nativeBytes(0);
+
+bool HTTPClient::begin(WiFiClient &client, const char *url)
+{
+    m_url = url;
+    return WiFi.status() == WL_CONNECTED;
+}
+
+int HTTPClient::POST(uint8_t *payload, size_t size)
+{
+    nativeRequests++;
+    nativeBytes += size;
+    static const char loopback[] = "http://127.0.0.1:";
+    if (m_url.compare(0, sizeof(loopback) - 1, loopback) != 0)
+        return nativeStatus;
+    const char *port = m_url.c_str() + sizeof(loopback) - 1;
+    const char *path = strchr(port, '/');
+    return loopbackPost(atoi(port), path != nullptr ? path : "/", payload, size);
+}
+
+// One request on a new connection, the status of the answer or HTTPC_ERROR_CONNECTION_REFUSED
+int HTTPClient::loopbackPost(uint16_t port, const char *path, const uint8_t *payload, size_t size)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    timeval timeout = {m_timeout / 1000, (m_timeout % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    int status = HTTPC_ERROR_CONNECTION_REFUSED;
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr)) == 0)
+    {
+        std::string request = "POST " + std::string(path) + " HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: " +
+                              std::to_string(size) + "\r\nConnection: close\r\n\r\n";
+        request.append((const char *)payload, size);
+        char answer[64];
+        ssize_t received = 0;
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size())
+            received = recv(fd, answer, sizeof(answer) - 1, 0);
+        if (received > 12 && memcmp(answer, "HTTP/1.", 7) == 0)
+        {
+            answer[received] = '\0';
+            status = atoi(answer + 9);
+        }
+    }
+    close(fd);
+    return status;
+}
+
+int ThingSpeakClass::setField(unsigned int field, float value)
+{
+    if (field < 1 || field > 8)
+        return -101;
+    m_fields |= 1 << (field - 1);
+    return TS_OK_SUCCESS;
+}
+
+int ThingSpeakClass::writeFields(unsigned long channelNumber, const char *writeAPIKey)
+{
+    m_fields = 0;
+    if (WiFi.status() != WL_CONNECTED)
+        return TS_ERR_TIMEOUT;
+    nativeWrites++;
+    return nativeStatus;
+}
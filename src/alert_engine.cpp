@@ -0,0 +1,104 @@
+#include "alert_engine.h"
+#include <math.h>
+#include "sensor_registry.h"
+
+static const char *const alert_kind_names[ALERT_KINDS] = {"level", "battery", "voltage", "stale"};
+
+const char *alertKindName(uint8_t kind)
+{
+    return kind < ALERT_KINDS ? alert_kind_names[kind] : "";
+}
+
+// Moves a rule one evaluation towards its other state, true when that produced an event to send
+static bool advance(tank_sensor &sensor, uint8_t kind, bool enabled, bool tripped, bool released, uint8_t debounce,
+                    float value, float threshold, uint32_t nowMs, alert_event &event)
+{
+    tank_alerts &alerts = sensor.alerts;
+    alert_rule_state &state = alerts.state[kind];
+    bool change;
+    if (!enabled)
+    {
+        // a rule switched off while raised clears
+        change = state.active;
+        state.count = 0;
+    }
+    else
+    {
+        bool towards = state.active ? released : tripped;
+        state.count = towards ? state.count + 1 : 0;
+        change = state.count >= debounce;
+    }
+    if (!change)
+        return false;
+
+    state.count = 0;
+    state.active = !state.active;
+    if (state.active)
+    {
+        alerts.raised++;
+        if (state.seen && nowMs - state.notified_ms < ALERT_REPEAT_MS)
+        {
+            alerts.suppressed++;
+            state.notified = false;
+            return false;
+        }
+        state.seen = true;
+        state.notified = true;
+        state.notified_ms = nowMs;
+    }
+    else
+    {
+        alerts.cleared++;
+        if (!state.notified)
+            return false;
+        state.notified = false;
+    }
+
+    event.queued_ms = nowMs;
+    event.sensor_id = sensor.id;
+    event.kind = kind;
+    event.raised = state.active;
+    event.value = value;
+    event.threshold = threshold;
+    return true;
+}
+
+size_t alertReading(tank_sensor &sensor, uint32_t nowMs, alert_event *events)
+{
+    const alert_rules &rules = sensor.alerts.rules;
+    size_t count = 0;
+    int level = rules.level_perc;
+    if (advance(sensor, ALERT_LEVEL, level > 0, sensor.fill_perc >= level,
+                sensor.fill_perc < level - ALERT_LEVEL_HYSTERESIS, ALERT_DEBOUNCE, sensor.fill_perc, level, nowMs,
+                events[count]))
+        count++;
+
+    int battery = rules.battery_perc;
+    if (advance(sensor, ALERT_BATTERY, battery > 0, sensor.batt_perc < battery,
+                sensor.batt_perc >= battery + ALERT_BATTERY_HYSTERESIS, ALERT_DEBOUNCE, sensor.batt_perc, battery,
+                nowMs, events[count]))
+        count++;
+
+    long voltage = rules.voltage_mv;
+    long mv = lroundf(sensor.batt_voltage * 1000);
+    if (advance(sensor, ALERT_VOLTAGE, voltage > 0, mv < voltage, mv >= voltage + ALERT_VOLTAGE_HYSTERESIS,
+                ALERT_DEBOUNCE, sensor.batt_voltage, voltage / 1000.0f, nowMs, events[count]))
+        count++;
+
+    // the reading itself ends a silence
+    if (advance(sensor, ALERT_STALE, rules.stale_minutes > 0, false, true, 1, 0, rules.stale_minutes, nowMs,
+                events[count]))
+        count++;
+    return count;
+}
+
+size_t alertStale(tank_sensor &sensor, unsigned long uptimeMinutes, uint32_t nowMs, alert_event *events)
+{
+    const alert_rules &rules = sensor.alerts.rules;
+    // a sensor not heard since boot has been silent the whole uptime
+    unsigned long silent = sensor.received ? uptimeMinutes - sensor.measured_minutes : uptimeMinutes;
+    return advance(sensor, ALERT_STALE, rules.stale_minutes > 0, silent >= rules.stale_minutes, false, 1, silent,
+                   rules.stale_minutes, nowMs, events[0])
+               ? 1
+               : 0;
+}
@@ -0,0 +1,141 @@
+#include "alert_notifier.h"
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include "wall_clock.h"
+
+#define ALERT_IDLE_MS 1000
+
+AlertNotifier::AlertNotifier()
+    : m_backoff(ALERT_RETRY_MS, ALERT_BACKOFF_MAX_MS), m_rejected(0), m_task(nullptr),
+      m_mux(portMUX_INITIALIZER_UNLOCKED)
+{
+    m_url[0] = '\0';
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool AlertNotifier::begin()
+{
+    if (m_task != nullptr)
+        return true;
+    return xTaskCreatePinnedToCore(taskMain, "alerts", ALERT_STACK, this, 1, &m_task, ALERT_CORE) == pdPASS;
+}
+
+void AlertNotifier::configure(const char *url)
+{
+    portENTER_CRITICAL(&m_mux);
+    strlcpy(m_url, url, sizeof(m_url));
+    portEXIT_CRITICAL(&m_mux);
+}
+
+bool AlertNotifier::enqueue(const alert_event &event)
+{
+    if (!m_queue.push(event))
+    {
+        m_rejected++;
+        return false;
+    }
+    // an alert should not wait for the idle poll
+    if (m_task != nullptr)
+        xTaskNotifyGive(m_task);
+    return true;
+}
+
+notifier_stats AlertNotifier::stats() const
+{
+    notifier_stats stats = m_stats;
+    stats.rejected = m_rejected;
+    return stats;
+}
+
+void AlertNotifier::taskMain(void *arg)
+{
+    static_cast<AlertNotifier *>(arg)->run();
+}
+
+void AlertNotifier::drainQueue()
+{
+    m_stats.queued += m_outbox.drain(m_queue, m_stats.dropped);
+    m_stats.outbox = m_outbox.count();
+}
+
+void AlertNotifier::run()
+{
+    for (;;)
+    {
+        drainQueue();
+
+        char url[ALERT_URL_LEN];
+        portENTER_CRITICAL(&m_mux);
+        memcpy(url, m_url, sizeof(url));
+        portEXIT_CRITICAL(&m_mux);
+
+        if (m_outbox.count() == 0 || url[0] == '\0' || WiFi.status() != WL_CONNECTED || !m_backoff.due())
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ALERT_IDLE_MS));
+            continue;
+        }
+
+        const alert_event &event = m_outbox.at(0);
+        uint32_t started = millis();
+        delivery_result result = deliveryResult(deliver(event, url));
+        m_stats.last_request_ms = millis() - started;
+
+        if (result == DELIVERY_FAILED)
+        {
+            m_stats.failures++;
+            m_backoff.failed();
+        }
+        else
+        {
+            if (result == DELIVERY_REFUSED)
+            {
+                m_stats.failures++;
+                m_stats.dropped++;
+            }
+            else
+            {
+                m_stats.last_latency_ms = millis() - event.queued_ms;
+                m_stats.delivered++;
+            }
+            m_outbox.remove(1);
+            m_stats.outbox = m_outbox.count();
+            m_backoff.clear();
+        }
+        m_stats.consecutive_failures = m_backoff.failures();
+        m_stats.backoff_ms = m_backoff.backoffMs();
+    }
+}
+
+// {"device":"jimka","sensor":1,"alert":"level","state":"raised","value":91.00,"threshold":90.00,"time":"..."}
+int AlertNotifier::deliver(const alert_event &event, const char *url)
+{
+    size_t length = snprintf(m_body, sizeof(m_body),
+                             "{\"device\":\"jimka\",\"sensor\":%u,\"alert\":\"%s\",\"state\":\"%s\",\"value\":%.2f,"
+                             "\"threshold\":%.2f",
+                             event.sensor_id, alertKindName(event.kind), event.raised ? "raised" : "cleared",
+                             event.value, event.threshold);
+    // the time it happened, when the clock can tell
+    time_t now = time(nullptr);
+    if (clockIsSet(now) && length < sizeof(m_body))
+    {
+        time_t happened = now - (millis() - event.queued_ms) / 1000;
+        struct tm tm;
+        gmtime_r(&happened, &tm);
+        char created[24];
+        if (strftime(created, sizeof(created), "%Y-%m-%dT%H:%M:%SZ", &tm) > 0)
+            length += snprintf(m_body + length, sizeof(m_body) - length, ",\"time\":\"%s\"", created);
+    }
+    if (length < sizeof(m_body))
+        length += snprintf(m_body + length, sizeof(m_body) - length, "}");
+    if (length >= sizeof(m_body))
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+
+    HTTPClient http;
+    http.setTimeout(ALERT_TIMEOUT_MS);
+    if (!http.begin(m_client, url))
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    http.addHeader(F("Content-Type"), F("application/json"));
+    int status = http.POST((uint8_t *)m_body, length);
+    http.end();
+    return status;
+}
@@ -0,0 +1,78 @@
+#include "asset_manifest.h"
+
+AssetManifest::AssetManifest(fs::FS &fs) : m_fs(fs), m_count(0)
+{
+}
+
+size_t AssetManifest::scan(asset_source source)
+{
+    m_count = 0;
+    for (size_t i = 0; i < ASSET_TABLE_SIZE; i++)
+    {
+        if (!(source == ASSET_SOURCE_FLASH ? addBlob(asset_table[i]) : addFile(asset_table[i])))
+        {
+            Serial.print(F("Static asset missing: "));
+            Serial.println(asset_table[i].path);
+        }
+    }
+    return m_count;
+}
+
+bool AssetManifest::addFile(const asset_entry &entry)
+{
+    static_asset &asset = m_assets[m_count];
+    asset.path = entry.path;
+    asset.mime = entry.mime;
+    asset.gzip = entry.gzip;
+    asset.data = nullptr;
+    File file = open(asset);
+    if (!file)
+        return false;
+    asset.size = file.size();
+
+    uint32_t hash = 2166136261u;
+    uint8_t buf[256];
+    size_t read;
+    while ((read = file.read(buf, sizeof(buf))) > 0)
+    {
+        for (size_t i = 0; i < read; i++)
+        {
+            hash ^= buf[i];
+            hash *= 16777619u;
+        }
+    }
+    asset.hash = hash;
+    snprintf(asset.etag, sizeof(asset.etag), "\"%08x\"", hash);
+
+    m_count++;
+    return true;
+}
+
+bool AssetManifest::addBlob(const asset_entry &entry)
+{
+    if (entry.data == nullptr)
+        return false;
+    static_asset &asset = m_assets[m_count];
+    asset.path = entry.path;
+    asset.mime = entry.mime;
+    asset.gzip = entry.gzip;
+    asset.data = entry.data;
+    asset.size = entry.size;
+    asset.hash = strtoul(entry.etag + 1, nullptr, 16);
+    snprintf(asset.etag, sizeof(asset.etag), "%s", entry.etag);
+
+    m_count++;
+    return true;
+}
+
+const static_asset *AssetManifest::find(const char *path) const
+{
+    return findPath(m_assets, m_count, path);
+}
+
+File AssetManifest::open(const static_asset &asset)
+{
+    char fs_path[STATIC_ASSET_PATH_LEN + 3];
+    snprintf(fs_path, sizeof(fs_path), asset.gzip ? "%s.gz" : "%s", asset.path);
+    return m_fs.open(fs_path, "r");
+}
@@ -0,0 +1,678 @@
+#include "bench.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include "packet_decoder.h"
+#include "snapshot_buffer.h"
+#include "request_arena.h"
+#include "route_table.h"
+
+#define BENCH_CHUNK 1436 // what one TCP segment carries
+#define BENCH_MIN_SAMPLE_US 200 // batches are grown until a sample takes at least this long
+#define BENCH_LEGACY_NAME_MAX 32 // TEMPLATE_PARAM_NAME_LENGTH of ESPAsyncWebServer
+
+static uint32_t allocationCount()
+{
+#ifdef ESP32
+    return 0;
+#else
+    return nativeAllocations();
+#endif
+}
+
+static int compareFloat(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static int compareUint(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+BenchReport::BenchReport(bench_format format, bench_writer write, void *ctx)
+    : m_format(format), m_write(write), m_ctx(ctx), m_count(0)
+{
+}
+
+void BenchReport::printf(const char *format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length > 0)
+        m_write(m_ctx, line, (size_t)length < sizeof(line) ? length : sizeof(line) - 1);
+}
+
+void BenchReport::begin(const char *platform)
+{
+    m_count = 0;
+    if (m_format == BENCH_JSON)
+        printf("{\"platform\":\"%s\",\"results\":[\n", platform);
+    else
+        printf("name,ops,ops_per_s,mean_us,p50_us,p99_us,max_us,allocs,heap_delta,peak_heap,bytes\n");
+}
+
+void BenchReport::add(const bench_result &r)
+{
+    if (m_format == BENCH_JSON)
+        printf("%s{\"name\":\"%s\",\"ops\":%u,\"ops_per_s\":%.1f,\"mean_us\":%.3f,\"p50_us\":%.3f,\"p99_us\":%.3f,"
+               "\"max_us\":%.3f,\"allocs\":%.2f,\"heap_delta\":%d,\"peak_heap\":%d,\"bytes\":%u}",
+               m_count == 0 ? "" : ",\n", r.name, (unsigned)r.ops, r.ops_per_s, r.mean_us, r.p50_us, r.p99_us,
+               r.max_us, r.allocs, (int)r.heap_delta, (int)r.peak_heap, (unsigned)r.bytes);
+    else
+        printf("%s,%u,%.1f,%.3f,%.3f,%.3f,%.3f,%.2f,%d,%d,%u\n", r.name, (unsigned)r.ops, r.ops_per_s, r.mean_us,
+               r.p50_us, r.p99_us, r.max_us, r.allocs, (int)r.heap_delta, (int)r.peak_heap, (unsigned)r.bytes);
+    m_count++;
+}
+
+void BenchReport::end()
+{
+    if (m_format == BENCH_JSON)
+        printf("\n]}\n");
+}
+
+void benchRun(const char *name, bench_op op, void *ctx, uint32_t batch, bench_result &out)
+{
+    strlcpy(out.name, name, sizeof(out.name));
+    out.peak_heap = -1;
+    out.bytes = op(ctx); // warm up, and the first call may allocate lazily
+
+    // too short a sample only measures the resolution of micros()
+    uint32_t started = micros();
+    for (uint32_t i = 0; i < batch; i++)
+        op(ctx);
+    uint32_t elapsed = micros() - started;
+    if (elapsed < BENCH_MIN_SAMPLE_US)
+        batch = batch * BENCH_MIN_SAMPLE_US / (elapsed > 0 ? elapsed : 1) + 1;
+
+    float samples[BENCH_SAMPLES];
+    uint32_t freeBefore = ESP.getFreeHeap();
+    uint32_t allocsBefore = allocationCount();
+    uint32_t total = 0;
+    for (size_t s = 0; s < BENCH_SAMPLES; s++)
+    {
+        started = micros();
+        for (uint32_t i = 0; i < batch; i++)
+            op(ctx);
+        elapsed = micros() - started;
+        total += elapsed;
+        samples[s] = (float)elapsed / batch;
+    }
+    uint32_t allocs = allocationCount() - allocsBefore;
+    out.heap_delta = (int32_t)(freeBefore - ESP.getFreeHeap());
+
+    qsort(samples, BENCH_SAMPLES, sizeof(samples[0]), compareFloat);
+    out.ops = batch * BENCH_SAMPLES;
+    out.mean_us = (float)total / out.ops;
+    out.ops_per_s = total > 0 ? out.ops * 1e6f / total : 0;
+    out.p50_us = samples[BENCH_SAMPLES / 2];
+    out.p99_us = samples[BENCH_SAMPLES * 99 / 100];
+    out.max_us = samples[BENCH_SAMPLES - 1];
+#ifdef ESP32
+    out.allocs = -1;
+    (void)allocs;
+#else
+    out.allocs = (float)allocs / out.ops;
+#endif
+}
+
+void benchSummarize(const char *name, uint32_t *latencies_us, size_t count, uint32_t elapsedUs, uint32_t bytes,
+                    bench_result &out)
+{
+    memset(&out, 0, sizeof(out));
+    strlcpy(out.name, name, sizeof(out.name));
+    out.ops = count;
+    out.allocs = -1;
+    out.peak_heap = -1;
+    out.bytes = bytes;
+    if (count == 0)
+        return;
+
+    qsort(latencies_us, count, sizeof(latencies_us[0]), compareUint);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++)
+        sum += latencies_us[i];
+    out.ops_per_s = elapsedUs > 0 ? count * 1e6f / elapsedUs : 0;
+    out.mean_us = (float)sum / count;
+    out.p50_us = latencies_us[count / 2];
+    out.p99_us = latencies_us[count * 99 / 100];
+    out.max_us = latencies_us[count - 1];
+}
+
+// --- packet decoding
+
+struct decode_case
+{
+    uint8_t frame[PACKET_ASCII_FIELDS * 8];
+    size_t length;
+};
+
+static size_t decodeOp(void *ctx)
+{
+    decode_case *c = static_cast<decode_case *>(ctx);
+    sensor_reading reading;
+    return decodePacket(c->frame, c->length, reading) == PACKET_OK ? c->length : 0;
+}
+
+// getValue() of the receiver before the decoder, the data copied in and the field cut out as a new String
+static String legacyField(String data, char separator, int index)
+{
+    int found = 0;
+    int strIndex[] = {0, -1};
+    int maxIndex = data.length() - 1;
+    for (int i = 0; i <= maxIndex && found <= index; i++)
+    {
+        if (data.charAt(i) == separator || i == maxIndex)
+        {
+            found++;
+            strIndex[0] = strIndex[1] + 1;
+            strIndex[1] = (i == maxIndex) ? i + 1 : i;
+        }
+    }
+    return found > index ? data.substring(strIndex[0], strIndex[1]) : "";
+}
+
+// What receive433() did with a frame: the message built a character at a time, then every field parsed
+static size_t legacyDecodeOp(void *ctx)
+{
+    decode_case *c = static_cast<decode_case *>(ctx);
+    String message;
+    for (size_t i = 0; i < c->length; i++)
+        message = message + (char)c->frame[i];
+    sensor_reading reading;
+    reading.humidity = legacyField(message, ',', 0).toFloat();
+    reading.temperature = legacyField(message, ',', 1).toFloat();
+    reading.distance = legacyField(message, ',', 2).toInt();
+    reading.batt_perc = legacyField(message, ',', 3).toInt();
+    reading.batt_voltage = legacyField(message, ',', 4).toFloat();
+    return reading.batt_voltage > 0 ? c->length : 0;
+}
+
+void benchDecode(BenchReport &report)
+{
+    sensor_reading reading;
+    memset(&reading, 0, sizeof(reading));
+    reading.humidity = 55.5f;
+    reading.temperature = 21.3f;
+    reading.distance = 120;
+    reading.batt_perc = 88;
+    reading.batt_voltage = 3.95f;
+    reading.sensor_id = 1;
+    reading.seq = 7;
+
+    decode_case c;
+    bench_result result;
+    c.length = snprintf((char *)c.frame, sizeof(c.frame), "55.50,21.30,120,88,3.95");
+    benchRun("decode ascii", decodeOp, &c, 256, result);
+    report.add(result);
+    benchRun("decode ascii legacy", legacyDecodeOp, &c, 256, result);
+    report.add(result);
+
+    c.length = encodePacketV1(reading, c.frame, sizeof(c.frame));
+    benchRun("decode binary v1", decodeOp, &c, 256, result);
+    report.add(result);
+
+    c.length = encodePacketV2(reading, c.frame, sizeof(c.frame));
+    benchRun("decode binary v2", decodeOp, &c, 256, result);
+    report.add(result);
+}
+
+// --- page rendering
+
+struct render_case
+{
+    const PageTemplate *page;
+    size_t bytes;
+};
+
+// the resolver has no context argument, benchmarks run one at a time
+static const dashboard_context *renderContext;
+
+static size_t resolveBench(uint8_t var, char *buf, size_t size)
+{
+    return dashboardValue(var, *renderContext, buf, size);
+}
+
+static void countBytes(void *ctx, const char *data, size_t len)
+{
+    static_cast<render_case *>(ctx)->bytes += len;
+}
+
+static size_t renderOp(void *ctx)
+{
+    render_case *c = static_cast<render_case *>(ctx);
+    c->bytes = 0;
+    c->page->render(resolveBench, countBytes, c);
+    return c->bytes;
+}
+
+// What processor() was: the name compared with every placeholder in turn, the value handed back as a String
+static String legacyProcessor(const String &var)
+{
+    char value[TEMPLATE_VALUE_BUFFER];
+    for (uint8_t i = 0; i < TPL_VAR_COUNT; i++)
+    {
+        if (var == PageTemplate::varName(i))
+        {
+            value[dashboardValue(i, *renderContext, value, sizeof(value) - 1)] = '\0';
+            return String(value);
+        }
+    }
+    return String();
+}
+
+// The template pass of the file response the pages used to be sent with: the page text is scanned on every
+// request, each placeholder name becomes a String for processor() and its value is copied into the TCP buffer
+static size_t legacyRenderOp(void *ctx)
+{
+    const PageTemplate *page = static_cast<render_case *>(ctx)->page;
+    const char *text = page->text();
+    size_t length = page->textLength();
+    char chunk[BENCH_CHUNK];
+    size_t used = 0, bytes = 0;
+    for (size_t i = 0; i < length;)
+    {
+        const char *value = text + i;
+        size_t valueLength = 1;
+        String resolved;
+        const char *end = text[i] == '%' ? (const char *)memchr(text + i + 1, '%', length - i - 1) : nullptr;
+        size_t nameLength = end != nullptr ? end - (text + i + 1) : 0;
+        if (end != nullptr && nameLength == 0)
+        {
+            // "%%" stands for a percent sign
+            i += 2;
+        }
+        else if (end != nullptr && nameLength <= BENCH_LEGACY_NAME_MAX)
+        {
+            char name[BENCH_LEGACY_NAME_MAX + 1];
+            memcpy(name, text + i + 1, nameLength);
+            name[nameLength] = '\0';
+            resolved = legacyProcessor(String(name));
+            value = resolved.c_str();
+            valueLength = resolved.length();
+            i = end - text + 1;
+        }
+        else
+        {
+            // the text up to the next placeholder
+            const char *next = (const char *)memchr(text + i + 1, '%', length - i - 1);
+            valueLength = next != nullptr ? next - value : length - i;
+            i += valueLength;
+        }
+        while (valueLength > 0)
+        {
+            if (used == sizeof(chunk))
+            {
+                bytes += used;
+                used = 0;
+            }
+            size_t part = valueLength < sizeof(chunk) - used ? valueLength : sizeof(chunk) - used;
+            memcpy(chunk + used, value, part);
+            used += part;
+            value += part;
+            valueLength -= part;
+        }
+    }
+    return bytes + used;
+}
+
+void benchRender(BenchReport &report, const char *name, const PageTemplate &page, const dashboard_context &ctx)
+{
+    if (!page.loaded() || ctx.sensor == nullptr)
+        return;
+    renderContext = &ctx;
+    render_case c = {&page, 0};
+    char label[BENCH_NAME_LEN];
+    snprintf(label, sizeof(label), "render %s", name);
+    bench_result result;
+    benchRun(label, renderOp, &c, 16, result);
+    report.add(result);
+
+    snprintf(label, sizeof(label), "render %s legacy", name);
+    benchRun(label, legacyRenderOp, &c, 16, result);
+    report.add(result);
+}
+
+static size_t gzipRenderOp(void *ctx)
+{
+    uint8_t chunk[BENCH_CHUNK];
+    GzipTemplateStream stream(*static_cast<const GzipTemplate *>(ctx), resolveBench);
+    size_t bytes = 0, length;
+    while ((length = stream.read(chunk, sizeof(chunk))) > 0)
+        bytes += length;
+    return bytes;
+}
+
+void benchGzipRender(BenchReport &report, const char *name, const GzipTemplate &page, const dashboard_context &ctx)
+{
+    if (!page.loaded() || ctx.sensor == nullptr)
+        return;
+    renderContext = &ctx;
+    char label[BENCH_NAME_LEN];
+    snprintf(label, sizeof(label), "render gzip %s", name);
+    bench_result result;
+    benchRun(label, gzipRenderOp, const_cast<GzipTemplate *>(&page), 16, result);
+    report.add(result);
+}
+
+// --- pages in flight on several connections
+
+struct concurrent_case
+{
+    const PageTemplate *page;
+    size_t clients;
+    uint32_t peak; // most heap held while every page was in flight
+};
+
+static void notePeak(concurrent_case *c, uint32_t freeBefore)
+{
+    uint32_t held = freeBefore - ESP.getFreeHeap();
+    if (held > c->peak)
+        c->peak = held;
+}
+
+struct buffered_page
+{
+    char *data;
+    size_t length;
+};
+
+static void appendBuffered(void *ctx, const char *data, size_t len)
+{
+    buffered_page *page = static_cast<buffered_page *>(ctx);
+    memcpy(page->data + page->length, data, len);
+    page->length += len;
+}
+
+// What an AsyncResponseStream did: every page rendered into its own buffer, then sent in TCP sized chunks
+static size_t bufferedOp(void *ctx)
+{
+    concurrent_case *c = static_cast<concurrent_case *>(ctx);
+    uint32_t freeBefore = ESP.getFreeHeap();
+    buffered_page pages[BENCH_CLIENTS];
+    for (size_t i = 0; i < c->clients; i++)
+    {
+        // values are short, the page text and some room is what the stream was sized for
+        pages[i].data = (char *)malloc(c->page->textLength() + 256);
+        pages[i].length = 0;
+        if (pages[i].data != nullptr)
+            c->page->render(resolveBench, appendBuffered, &pages[i]);
+    }
+    notePeak(c, freeBefore);
+
+    char chunk[BENCH_CHUNK];
+    size_t bytes = 0;
+    for (size_t i = 0; i < c->clients; i++)
+    {
+        for (size_t sent = 0; sent < pages[i].length; sent += BENCH_CHUNK)
+        {
+            size_t length = pages[i].length - sent < BENCH_CHUNK ? pages[i].length - sent : BENCH_CHUNK;
+            memcpy(chunk, pages[i].data + sent, length);
+            bytes += length;
+        }
+        free(pages[i].data);
+    }
+    return bytes / c->clients;
+}
+
+// Every page as a TemplateStream in a request arena, the connections drained a chunk at a time in turn
+static size_t streamedOp(void *ctx)
+{
+    concurrent_case *c = static_cast<concurrent_case *>(ctx);
+    uint32_t freeBefore = ESP.getFreeHeap();
+    ArenaLease arenas[BENCH_CLIENTS];
+    TemplateStream *streams[BENCH_CLIENTS];
+    for (size_t i = 0; i < c->clients; i++)
+    {
+        arenas[i] = ArenaLease::acquire(sizeof(TemplateStream));
+        streams[i] = arenas[i] ? arenas[i]->make<TemplateStream>(*c->page, resolveBench) : nullptr;
+    }
+    notePeak(c, freeBefore);
+
+    uint8_t chunk[BENCH_CHUNK];
+    size_t bytes = 0, active = c->clients;
+    while (active > 0)
+    {
+        active = 0;
+        for (size_t i = 0; i < c->clients; i++)
+        {
+            size_t length = streams[i] != nullptr ? streams[i]->read(chunk, sizeof(chunk)) : 0;
+            if (length > 0)
+                active++;
+            bytes += length;
+        }
+    }
+    return bytes / c->clients;
+}
+
+void benchConcurrentRender(BenchReport &report, const char *name, const PageTemplate &page,
+                           const dashboard_context &ctx, size_t clients)
+{
+    if (!page.loaded() || ctx.sensor == nullptr)
+        return;
+    renderContext = &ctx;
+    concurrent_case c = {&page, clients < BENCH_CLIENTS ? clients : BENCH_CLIENTS, 0};
+    char label[BENCH_NAME_LEN];
+    bench_result result;
+
+    snprintf(label, sizeof(label), "render %s buffered x%u", name, (unsigned)c.clients);
+    benchRun(label, bufferedOp, &c, 4, result);
+    result.peak_heap = c.peak / c.clients;
+    report.add(result);
+
+    c.peak = 0;
+    snprintf(label, sizeof(label), "render %s streamed x%u", name, (unsigned)c.clients);
+    benchRun(label, streamedOp, &c, 4, result);
+    result.peak_heap = c.peak / c.clients;
+    report.add(result);
+}
+
+// --- state document
+
+struct state_case
+{
+    const SensorRegistry *sensors;
+    const LinkMonitor *links;
+    char json[SNAPSHOT_BUFFER_SIZE];
+};
+
+static size_t stateOp(void *ctx)
+{
+    state_case *c = static_cast<state_case *>(ctx);
+    return writeStateJson(*c->sensors, *c->links, c->json, sizeof(c->json));
+}
+
+void benchStateJson(BenchReport &report, const SensorRegistry &sensors, const LinkMonitor &links)
+{
+    // too large for the stack of the loop task
+    static state_case c;
+    c.sensors = &sensors;
+    c.links = &links;
+    bench_result result;
+    benchRun("state json", stateOp, &c, 16, result);
+    report.add(result);
+}
+
+// --- request dispatch
+
+struct route_case
+{
+    const char *path;
+    uint8_t method;
+};
+
+// What the web server decides for a URL: a route, else an asset, else a 404
+static size_t tableOp(void *ctx)
+{
+    route_case *c = static_cast<route_case *>(ctx);
+    const route_entry *route = findRoute(c->path, c->method);
+    if (route != nullptr)
+        return route->route;
+    return findPath(asset_table, ASSET_TABLE_SIZE, c->path) != nullptr ? ROUTE_ASSET : ROUTE_NOT_FOUND;
+}
+
+// The same decision the way a list of registered handlers makes it, one comparison per entry in turn
+static size_t linearOp(void *ctx)
+{
+    route_case *c = static_cast<route_case *>(ctx);
+    for (size_t i = 0; i < ASSET_TABLE_SIZE; i++)
+    {
+        if (strcmp(asset_table[i].path, c->path) == 0 && c->method == ROUTE_GET)
+            return ROUTE_ASSET;
+    }
+    for (size_t i = 0; i < ROUTE_TABLE_SIZE; i++)
+    {
+        if ((route_table[i].methods & c->method) && strcmp(route_table[i].path, c->path) == 0)
+            return route_table[i].route;
+    }
+    return ROUTE_NOT_FOUND;
+}
+
+void benchRoutes(BenchReport &report)
+{
+    route_case cases[] = {
+        {"/", ROUTE_GET},
+        {"/api/v1/state", ROUTE_GET},
+        {"/configuration.html", ROUTE_POST},
+        {ASSET_TABLE_SIZE > 0 ? asset_table[ASSET_TABLE_SIZE - 1].path : "/favicon.ico", ROUTE_GET},
+        {"/favicon.ico", ROUTE_GET},
+    };
+    for (route_case &c : cases)
+    {
+        char label[BENCH_NAME_LEN];
+        bench_result result;
+        snprintf(label, sizeof(label), "route table %s %s", c.method == ROUTE_POST ? "POST" : "GET", c.path);
+        benchRun(label, tableOp, &c, 256, result);
+        result.bytes = 0;
+        report.add(result);
+        snprintf(label, sizeof(label), "route linear %s %s", c.method == ROUTE_POST ? "POST" : "GET", c.path);
+        benchRun(label, linearOp, &c, 256, result);
+        result.bytes = 0;
+        report.add(result);
+    }
+}
+
+// --- static assets
+
+struct asset_case
+{
+    AssetManifest *assets;
+    const char *path;
+    size_t limit; // bytes to send, BENCH_CHUNK for the first byte case
+};
+
+static size_t lookupOp(void *ctx)
+{
+    asset_case *c = static_cast<asset_case *>(ctx);
+    c->assets->find(c->path);
+    return 0; // a 304 has no body
+}
+
+// What StaticAssetHandler does for a 200, up to the limit: open the file and read it, or copy from flash
+static size_t readOp(void *ctx)
+{
+    static uint8_t chunk[BENCH_CHUNK];
+    asset_case *c = static_cast<asset_case *>(ctx);
+    const static_asset *asset = c->assets->find(c->path);
+    if (asset == nullptr)
+        return 0;
+    size_t limit = asset->size < c->limit ? asset->size : c->limit;
+    size_t total = 0;
+    if (asset->data != nullptr)
+    {
+        for (; total < limit; total += BENCH_CHUNK)
+            memcpy_P(chunk, asset->data + total, limit - total < BENCH_CHUNK ? limit - total : BENCH_CHUNK);
+        return limit;
+    }
+    File file = c->assets->open(*asset);
+    size_t read;
+    while (total < limit && (read = file.read(chunk, sizeof(chunk))) > 0)
+        total += read;
+    file.close();
+    return total;
+}
+
+struct legacy_asset_case
+{
+    fs::FS *fs;
+    const char *path;
+};
+
+// What loadFromLittleFS() and the file response behind it did for every request: the .gz name built as a String,
+// checked and opened to see that it is there, then looked up and opened again by the response and read whole
+static size_t legacyAssetOp(void *ctx)
+{
+    static uint8_t chunk[BENCH_CHUNK];
+    legacy_asset_case *c = static_cast<legacy_asset_case *>(ctx);
+    String path(c->path);
+    String gzip(c->path);
+    gzip += ".gz";
+    if (!c->fs->exists(gzip.c_str()))
+        return 0;
+    File check = c->fs->open(gzip.c_str(), "r");
+    if (!check)
+        return 0;
+    File file;
+    if (!c->fs->exists(path.c_str()) && c->fs->exists(gzip.c_str()))
+        file = c->fs->open(gzip.c_str(), "r");
+    check.close();
+    size_t total = 0, read;
+    while (file && (read = file.read(chunk, sizeof(chunk))) > 0)
+        total += read;
+    file.close();
+    return total;
+}
+
+static void benchAssetSource(BenchReport &report, AssetManifest &assets, const char *source, size_t maxAssets)
+{
+    for (size_t i = 0; i < assets.count() && i < maxAssets; i++)
+    {
+        asset_case c = {&assets, assets.at(i).path, BENCH_CHUNK};
+        char label[BENCH_NAME_LEN];
+        bench_result result;
+        snprintf(label, sizeof(label), "asset first chunk %s %s", c.path, source);
+        benchRun(label, readOp, &c, 1, result);
+        report.add(result);
+        c.limit = SIZE_MAX;
+        snprintf(label, sizeof(label), "asset read %s %s", c.path, source);
+        benchRun(label, readOp, &c, 1, result);
+        report.add(result);
+    }
+}
+
+void benchAssets(BenchReport &report, fs::FS &fs, size_t maxAssets)
+{
+    AssetManifest files(fs);
+    files.scan(ASSET_SOURCE_FS);
+    for (size_t i = 0; i < files.count() && i < maxAssets; i++)
+    {
+        asset_case c = {&files, files.at(i).path, 0};
+        char label[BENCH_NAME_LEN];
+        bench_result result;
+        snprintf(label, sizeof(label), "asset lookup %s", c.path);
+        benchRun(label, lookupOp, &c, 64, result);
+        report.add(result);
+    }
+    benchAssetSource(report, files, "fs", maxAssets);
+    for (size_t i = 0; i < files.count() && i < maxAssets; i++)
+    {
+        if (!files.at(i).gzip)
+            continue;
+        legacy_asset_case c = {&fs, files.at(i).path};
+        char label[BENCH_NAME_LEN];
+        bench_result result;
+        snprintf(label, sizeof(label), "asset read %s legacy", c.path);
+        benchRun(label, legacyAssetOp, &c, 1, result);
+        report.add(result);
+    }
+
+#ifdef STATIC_ASSETS_EMBEDDED
+    AssetManifest blobs(fs);
+    blobs.scan(ASSET_SOURCE_FLASH);
+    benchAssetSource(report, blobs, "flash", maxAssets);
+#endif
+}
@@ -0,0 +1,323 @@
+#include "config_store.h"
+#include "gzip_template.h"
+#include "packet_decoder.h"
+
+// The keys used before the record, the first tank kept the names from before there was more than one
+static const char *const legacyTankKeys[] = {"hloubka", "napust", "vyprazdneno", "alarm"};
+static const char *const legacyKeys[] = {"sensors", "thingspeakApi", "thingspeakChann", "duckdnsDomain",
+                                         "duckdnsToken", "alarmUrl", "mqttHost", "mqttPort", "mqttUser",
+                                         "mqttPass", "influxUrl", "influxToken", "webhookUrl", "sinks"};
+
+static void legacyTankKey(const char *name, uint8_t id, char *key, size_t size)
+{
+    if (id == PACKET_LEGACY_SENSOR)
+        snprintf(key, size, "%s", name);
+    else
+        snprintf(key, size, "%s%u", name, id);
+}
+
+template <size_t N>
+static void legacyString(Preferences &prefs, const char *key, char (&field)[N])
+{
+    char text[N];
+    if (prefs.getString(key, text, sizeof(text)) == 0)
+        text[0] = '\0';
+    ConfigStore::setText(field, text);
+}
+
+ConfigStore::ConfigStore()
+    : m_viewGeneration(0), m_owner(nullptr), m_generation(0), m_changedMs(0), m_dirty(false),
+      m_mux(portMUX_INITIALIZER_UNLOCKED)
+{
+    defaults(m_config);
+    defaults(m_view);
+    memset(&m_blob, 0, sizeof(m_blob));
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_stats.size = sizeof(m_blob);
+}
+
+void ConfigStore::defaults(jimka_config &config)
+{
+    memset(&config, 0, sizeof(config));
+    config.mqtt_port = CONFIG_MQTT_PORT;
+    config.sinks = TELEMETRY_ALL;
+}
+
+tank_config *ConfigStore::tank(jimka_config &config, uint8_t id, bool add)
+{
+    for (uint8_t i = 0; i < config.tank_count && i < SENSOR_MAX; i++)
+    {
+        if (config.tanks[i].id == id)
+            return &config.tanks[i];
+    }
+    if (!add || config.tank_count >= SENSOR_MAX)
+        return nullptr;
+    tank_config *entry = &config.tanks[config.tank_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->id = id;
+    entry->depth = SENSOR_DEFAULT_DEPTH;
+    return entry;
+}
+
+const tank_config *ConfigStore::tank(const jimka_config &config, uint8_t id)
+{
+    return tank(const_cast<jimka_config &>(config), id, false);
+}
+
+bool ConfigStore::begin()
+{
+    m_owner = xTaskGetCurrentTaskHandle();
+    Preferences prefs;
+    if (!prefs.begin(CONFIG_NAMESPACE, false))
+        return false;
+    size_t length = prefs.getBytesLength(CONFIG_KEY);
+    bool ok = true;
+    if (length > 0)
+    {
+        if (!load(prefs, length))
+        {
+            Serial.println(F("Stored configuration rejected, starting from the defaults"));
+            m_stats.source = CONFIG_RESET;
+        }
+        // a migration cut short by a reset wrote the record but not yet removed every old key
+        uint8_t ids[SENSOR_MAX];
+        for (uint8_t i = 0; i < m_config.tank_count; i++)
+            ids[i] = m_config.tanks[i].id;
+        removeLegacy(prefs, ids, m_config.tank_count);
+    }
+    else if (migrate(prefs))
+    {
+        m_stats.source = CONFIG_MIGRATED;
+        memcpy(&m_blob.body, &m_config, sizeof(m_config));
+        ok = write(prefs);
+        if (ok)
+        {
+            uint8_t ids[SENSOR_MAX];
+            for (uint8_t i = 0; i < m_config.tank_count; i++)
+                ids[i] = m_config.tanks[i].id;
+            removeLegacy(prefs, ids, m_config.tank_count);
+        }
+        else
+        {
+            // the old keys stay, the next boot migrates them again
+            m_dirty = true;
+            m_changedMs = millis();
+        }
+    }
+    prefs.end();
+    m_viewGeneration = snapshot(m_view);
+    return ok;
+}
+
+bool ConfigStore::load(Preferences &prefs, size_t length)
+{
+    blob stored;
+    memset(&stored, 0, sizeof(stored));
+    if (length < sizeof(header) || length > sizeof(stored) || prefs.getBytes(CONFIG_KEY, &stored, length) != length)
+        return false;
+    const header &head = stored.head;
+    if (head.magic != CONFIG_MAGIC || head.tank_slots != SENSOR_MAX || head.size != length - sizeof(header) ||
+        head.crc != checksum(stored, head.size))
+        return false;
+
+    m_stats.lifetime_writes = head.writes;
+    // what an older version did not have yet keeps its default
+    memcpy(&m_config, &stored.body, head.size);
+    if (m_config.tank_count > SENSOR_MAX)
+        m_config.tank_count = SENSOR_MAX;
+    if (head.version == CONFIG_VERSION && head.size == sizeof(jimka_config))
+    {
+        m_stats.source = CONFIG_LOADED;
+        return true;
+    }
+    m_stats.source = CONFIG_UPGRADED;
+    m_dirty = true;
+    m_changedMs = millis();
+    return true;
+}
+
+bool ConfigStore::migrate(Preferences &prefs)
+{
+    bool found = false;
+    for (size_t i = 0; i < sizeof(legacyKeys) / sizeof(legacyKeys[0]); i++)
+        found |= prefs.isKey(legacyKeys[i]);
+
+    uint8_t ids[SENSOR_MAX];
+    size_t count = prefs.getBytes("sensors", ids, sizeof(ids));
+    // before the list, only the legacy sensor had settings
+    if (count == 0)
+        ids[count++] = PACKET_LEGACY_SENSOR;
+    for (size_t i = 0; i < count; i++)
+    {
+        char key[16];
+        for (size_t k = 0; k < sizeof(legacyTankKeys) / sizeof(legacyTankKeys[0]) && !found; k++)
+        {
+            legacyTankKey(legacyTankKeys[k], ids[i], key, sizeof(key));
+            found = prefs.isKey(key);
+        }
+    }
+    if (!found)
+        return false;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        tank_config *entry = tank(m_config, ids[i], true);
+        if (entry == nullptr)
+            break;
+        char key[16];
+        legacyTankKey("hloubka", ids[i], key, sizeof(key));
+        entry->depth = prefs.getUInt(key, SENSOR_DEFAULT_DEPTH);
+        legacyTankKey("napust", ids[i], key, sizeof(key));
+        entry->inlet = prefs.getUInt(key, 0);
+        legacyTankKey("vyprazdneno", ids[i], key, sizeof(key));
+        entry->emptied_at = prefs.getUInt(key, 0);
+        legacyTankKey("alarm", ids[i], key, sizeof(key));
+        if (prefs.getBytesLength(key) == sizeof(alert_rules))
+            prefs.getBytes(key, &entry->alerts, sizeof(alert_rules));
+    }
+    legacyString(prefs, "thingspeakApi", m_config.thingspeak_api);
+    m_config.thingspeak_channel = prefs.getUInt("thingspeakChann", 0);
+    legacyString(prefs, "duckdnsDomain", m_config.duckdns_domain);
+    legacyString(prefs, "duckdnsToken", m_config.duckdns_token);
+    legacyString(prefs, "alarmUrl", m_config.alert_url);
+    legacyString(prefs, "mqttHost", m_config.mqtt_host);
+    m_config.mqtt_port = prefs.getUShort("mqttPort", CONFIG_MQTT_PORT);
+    legacyString(prefs, "mqttUser", m_config.mqtt_user);
+    legacyString(prefs, "mqttPass", m_config.mqtt_password);
+    legacyString(prefs, "influxUrl", m_config.influx_url);
+    legacyString(prefs, "influxToken", m_config.influx_token);
+    legacyString(prefs, "webhookUrl", m_config.webhook_url);
+    m_config.sinks = prefs.getUChar("sinks", TELEMETRY_ALL);
+    return true;
+}
+
+void ConfigStore::removeLegacy(Preferences &prefs, const uint8_t *ids, size_t count)
+{
+    for (size_t i = 0; i < sizeof(legacyKeys) / sizeof(legacyKeys[0]); i++)
+    {
+        if (prefs.isKey(legacyKeys[i]))
+            prefs.remove(legacyKeys[i]);
+    }
+    for (size_t i = 0; i <= count; i++)
+    {
+        // the legacy sensor's keys go whether it is in the list or not
+        uint8_t id = i < count ? ids[i] : PACKET_LEGACY_SENSOR;
+        for (size_t k = 0; k < sizeof(legacyTankKeys) / sizeof(legacyTankKeys[0]); k++)
+        {
+            char key[16];
+            legacyTankKey(legacyTankKeys[k], id, key, sizeof(key));
+            if (prefs.isKey(key))
+                prefs.remove(key);
+        }
+    }
+}
+
+uint32_t ConfigStore::checksum(const blob &record, size_t size)
+{
+    const uint8_t *start = (const uint8_t *)&record.head.crc + sizeof(record.head.crc);
+    return crc32Update(0, start, (const uint8_t *)&record.body + size - start);
+}
+
+// m_blob.body holds the settings to store
+bool ConfigStore::write(Preferences &prefs)
+{
+    header &head = m_blob.head;
+    head.magic = CONFIG_MAGIC;
+    head.version = CONFIG_VERSION;
+    head.size = sizeof(jimka_config);
+    head.tank_slots = SENSOR_MAX;
+    memset(head.reserved, 0, sizeof(head.reserved));
+    head.writes = m_stats.lifetime_writes + 1;
+    head.crc = checksum(m_blob, sizeof(jimka_config));
+    if (prefs.putBytes(CONFIG_KEY, &m_blob, sizeof(m_blob)) != sizeof(m_blob))
+    {
+        m_stats.failures++;
+        return false;
+    }
+    m_stats.lifetime_writes = head.writes;
+    m_stats.writes++;
+    return true;
+}
+
+uint32_t ConfigStore::snapshot(jimka_config &draft) const
+{
+    // copied bytewise, the padding has to match for the comparison in commit()
+    portENTER_CRITICAL(&m_mux);
+    memcpy(&draft, &m_config, sizeof(draft));
+    uint32_t generation = m_generation;
+    portEXIT_CRITICAL(&m_mux);
+    return generation;
+}
+
+const jimka_config &ConfigStore::get() const
+{
+    configASSERT(xTaskGetCurrentTaskHandle() == m_owner);
+    // a single word, a commit that races the read is taken on the next call
+    if (m_viewGeneration != m_generation)
+        m_viewGeneration = snapshot(m_view);
+    return m_view;
+}
+
+config_commit ConfigStore::commit(const jimka_config &draft, uint32_t generation)
+{
+    config_commit result = CONFIG_CHANGED;
+    portENTER_CRITICAL(&m_mux);
+    if (generation != m_generation)
+        result = CONFIG_CONFLICT;
+    else if (memcmp(&draft, &m_config, sizeof(draft)) == 0)
+    {
+        result = CONFIG_UNCHANGED;
+        m_stats.unchanged++;
+    }
+    else
+    {
+        memcpy(&m_config, &draft, sizeof(m_config));
+        m_generation++;
+        m_stats.commits++;
+        if (m_dirty)
+            m_stats.coalesced++;
+        m_dirty = true;
+        m_changedMs = millis();
+    }
+    portEXIT_CRITICAL(&m_mux);
+    return result;
+}
+
+void ConfigStore::service(bool force)
+{
+    portENTER_CRITICAL(&m_mux);
+    bool due = m_dirty && (force || millis() - m_changedMs >= CONFIG_COALESCE_MS);
+    if (due)
+    {
+        memcpy(&m_blob.body, &m_config, sizeof(m_config));
+        m_dirty = false;
+    }
+    portEXIT_CRITICAL(&m_mux);
+    if (!due)
+        return;
+
+    Preferences prefs;
+    if (prefs.begin(CONFIG_NAMESPACE, false) && write(prefs))
+    {
+        prefs.end();
+        return;
+    }
+    prefs.end();
+    // tried again after the next interval, unless a newer change comes first
+    portENTER_CRITICAL(&m_mux);
+    if (!m_dirty)
+    {
+        m_dirty = true;
+        m_changedMs = millis();
+    }
+    portEXIT_CRITICAL(&m_mux);
+}
+
+config_stats ConfigStore::stats() const
+{
+    portENTER_CRITICAL(&m_mux);
+    config_stats stats = m_stats;
+    stats.dirty = m_dirty;
+    portEXIT_CRITICAL(&m_mux);
+    return stats;
+}
@@ -0,0 +1,202 @@
+#include "dashboard.h"
+#include <stdio.h>
+#include "page_template.h"
+
+static size_t clampLength(int written, size_t size)
+{
+    if (written < 0)
+        return 0;
+    return (size_t)written < size ? written : size - 1;
+}
+
+static size_t copyValue(char *buf, size_t size, const char *value)
+{
+    return clampLength(snprintf(buf, size, "%s", value), size);
+}
+
+static size_t noData(char *buf, size_t size, const char *altNoDataText = nullptr)
+{
+    if (altNoDataText == nullptr)
+        altNoDataText = "cekam na data...";
+    return copyValue(buf, size, altNoDataText);
+}
+
+size_t dashboardValue(uint8_t var, const dashboard_context &ctx, char *buf, size_t size)
+{
+    const tank_sensor &sensor = *ctx.sensor;
+    int written = 0;
+    switch (var)
+    {
+    case TPL_SENSORID:
+        written = snprintf(buf, size, "%u", sensor.id);
+        break;
+    case TPL_NAPUST:
+        written = snprintf(buf, size, "%u", (unsigned)sensor.inlet);
+        break;
+    case TPL_HLOUBKA:
+        written = snprintf(buf, size, "%u", (unsigned)sensor.depth);
+        break;
+    case TPL_VOLT:
+        if (!sensor.received)
+            return noData(buf, size);
+        written = snprintf(buf, size, "%.2f", sensor.batt_voltage);
+        break;
+    case TPL_BATTPERCENT:
+        if (!sensor.received)
+            return noData(buf, size, "0");
+        written = snprintf(buf, size, "%d", sensor.batt_perc);
+        break;
+    case TPL_HLADINA:
+        if (!sensor.received)
+            return noData(buf, size);
+        written = snprintf(buf, size, "%d", sensor.level);
+        break;
+    case TPL_PLNOSTPERC:
+        if (!sensor.received)
+            return noData(buf, size, "0");
+        written = snprintf(buf, size, "%d", sensor.fill_perc);
+        break;
+    case TPL_TEPLOTA:
+        if (!sensor.received)
+            return noData(buf, size);
+        written = snprintf(buf, size, "%.2f", sensor.temperature);
+        break;
+    case TPL_VLHKOST:
+        if (!sensor.received)
+            return noData(buf, size);
+        written = snprintf(buf, size, "%.2f", sensor.humidity);
+        break;
+    case TPL_THINGSPEAKAPI:
+        return copyValue(buf, size, ctx.thingspeak_api);
+    case TPL_THINGSPEAKCHANNEL:
+        written = snprintf(buf, size, "%u", (unsigned)ctx.thingspeak_channel);
+        break;
+    case TPL_LASTMEASUREMENT:
+        if (!sensor.received)
+            return noData(buf, size, "-");
+        written = snprintf(buf, size, "%lu", ctx.uptime_s / 60 - sensor.measured_minutes);
+        break;
+    case TPL_UPTIME:
+        written = snprintf(buf, size, "%u days, %u hours, %u minutes, %u seconds", (unsigned)(ctx.uptime_s / 86400),
+                           (unsigned)(ctx.uptime_s / 3600 % 24), (unsigned)(ctx.uptime_s / 60 % 60),
+                           (unsigned)(ctx.uptime_s % 60));
+        break;
+    case TPL_DUCKDNSDOMAIN:
+        return copyValue(buf, size, ctx.duckdns_domain);
+    case TPL_DUCKDNSTOKEN:
+        return copyValue(buf, size, ctx.duckdns_token);
+    case TPL_FILLRATE:
+        if (!sensor.trend.started)
+            return noData(buf, size, "-");
+        written = snprintf(buf, size, "%.1f", sensor.trend.rate);
+        break;
+    case TPL_DAYSTOFULL:
+        if (!sensor.trend.started || sensor.trend.days_to_full < 0)
+            return noData(buf, size, "-");
+        written = snprintf(buf, size, "%.0f", sensor.trend.days_to_full);
+        break;
+    case TPL_SINCEEMPTIED:
+        if (!sensor.trend.started || sensor.trend.days_since_emptied < 0)
+            return noData(buf, size, "-");
+        written = snprintf(buf, size, "%.0f", sensor.trend.days_since_emptied);
+        break;
+    case TPL_ALARMHLADINA:
+        written = snprintf(buf, size, "%u", sensor.alerts.rules.level_perc);
+        break;
+    case TPL_ALARMBATERIE:
+        written = snprintf(buf, size, "%u", sensor.alerts.rules.battery_perc);
+        break;
+    case TPL_ALARMNAPETI:
+        written = snprintf(buf, size, "%.2f", sensor.alerts.rules.voltage_mv / 1000.0f);
+        break;
+    case TPL_ALARMNEAKTIVITA:
+        written = snprintf(buf, size, "%u", sensor.alerts.rules.stale_minutes);
+        break;
+    case TPL_ALARMURL:
+        return copyValue(buf, size, ctx.alert_url);
+    case TPL_MQTTHOST:
+        return copyValue(buf, size, ctx.mqtt_host);
+    case TPL_MQTTPORT:
+        written = snprintf(buf, size, "%u", ctx.mqtt_port);
+        break;
+    case TPL_MQTTUSER:
+        return copyValue(buf, size, ctx.mqtt_user);
+    case TPL_SINKTHINGSPEAK:
+    case TPL_SINKMQTT:
+    case TPL_SINKINFLUX:
+    case TPL_SINKWEBHOOK:
+        // the checkbox attribute, the placeholders follow the order of the slots
+        return copyValue(buf, size, ctx.sinks & (1 << (SINK_THINGSPEAK + var - TPL_SINKTHINGSPEAK)) ? "checked" : "");
+    case TPL_INFLUXURL:
+        return copyValue(buf, size, ctx.influx_url);
+    case TPL_INFLUXTOKEN:
+        return copyValue(buf, size, ctx.influx_token);
+    case TPL_WEBHOOKURL:
+        return copyValue(buf, size, ctx.webhook_url);
+    case TPL_LINKLOSS:
+    case TPL_LINKQUALITY:
+    case TPL_LINKJITTER:
+    {
+        const link_stats *link = ctx.links->find(sensor.id);
+        if (link == nullptr || (var != TPL_LINKJITTER && !link->sequenced))
+            return noData(buf, size, "-");
+        if (var == TPL_LINKLOSS)
+            written = snprintf(buf, size, "%.1f", LinkMonitor::lossPercent(*link));
+        else if (var == TPL_LINKQUALITY)
+            written = snprintf(buf, size, "%u", link->quality);
+        else
+            written = snprintf(buf, size, "%u", (unsigned)link->jitter_ms);
+        break;
+    }
+    default:
+        return 0;
+    }
+    return clampLength(written, size);
+}
+
+size_t writeStateJson(const SensorRegistry &sensors, const LinkMonitor &links, char *json, size_t capacity)
+{
+    size_t length = clampLength(snprintf(json, capacity, "{\"sensors\":["), capacity);
+    for (size_t i = 0; i < sensors.count(); i++)
+    {
+        const tank_sensor &sensor = sensors.at(i);
+        const char *separator = i == 0 ? "" : ",";
+        if (sensor.received)
+            length += clampLength(snprintf(json + length, capacity - length,
+                                           "%s{\"id\":%u,\"received\":true,\"humidity\":%.2f,\"temperature\":%.2f,"
+                                           "\"distance\":%u,\"batt_perc\":%d,\"batt_voltage\":%.2f,\"level\":%d,"
+                                           "\"fill_perc\":%d,\"depth\":%u,\"measured_at\":%u,"
+                                           "\"distance_filtered\":%.1f,\"filter_rate\":%.1f,\"outliers\":%u",
+                                           separator, sensor.id, sensor.humidity, sensor.temperature,
+                                           (unsigned)sensor.distance, sensor.batt_perc, sensor.batt_voltage,
+                                           sensor.level, sensor.fill_perc, (unsigned)sensor.depth,
+                                           (unsigned)(sensor.measured_ms / 1000), sensor.filter.distance,
+                                           filterFillRate(sensor.filter), (unsigned)sensor.filter.outliers),
+                                  capacity - length);
+        else
+            length += clampLength(snprintf(json + length, capacity - length,
+                                           "%s{\"id\":%u,\"received\":false,\"depth\":%u", separator, sensor.id,
+                                           (unsigned)sensor.depth),
+                                  capacity - length);
+        if (sensor.trend.started)
+            length += clampLength(snprintf(json + length, capacity - length,
+                                           ",\"trend\":{\"rate\":%.1f,\"full_at\":%u,\"days_to_full\":%.1f,"
+                                           "\"emptied_at\":%u,\"days_since_emptied\":%.1f,\"pumpouts\":%u}",
+                                           sensor.trend.rate, (unsigned)sensor.trend.full_at, sensor.trend.days_to_full,
+                                           (unsigned)sensor.trend.emptied_at, sensor.trend.days_since_emptied,
+                                           (unsigned)sensor.trend.pumpouts),
+                                  capacity - length);
+
+        const link_stats *link = links.find(sensor.id);
+        if (link != nullptr)
+            length += clampLength(snprintf(json + length, capacity - length,
+                                           ",\"link\":{\"sequenced\":%s,\"loss_perc\":%.1f,\"quality\":%u,"
+                                           "\"jitter_ms\":%u}",
+                                           link->sequenced ? "true" : "false", LinkMonitor::lossPercent(*link),
+                                           link->quality, (unsigned)link->jitter_ms),
+                                  capacity - length);
+        length += clampLength(snprintf(json + length, capacity - length, "}"), capacity - length);
+    }
+    length += clampLength(snprintf(json + length, capacity - length, "]}"), capacity - length);
+    return length;
+}
@@ -0,0 +1,29 @@
+#include "delivery.h"
+
+delivery_result deliveryResult(int status)
+{
+    if (status >= 200 && status < 300)
+        return DELIVERY_SENT;
+    if (status >= 400 && status < 500)
+        return DELIVERY_REFUSED;
+    return DELIVERY_FAILED;
+}
+
+RetryBackoff::RetryBackoff(uint32_t baseMs, uint32_t maxMs)
+    : m_baseMs(baseMs), m_maxMs(maxMs), m_lastMs(0), m_waitMs(0), m_failures(0)
+{
+}
+
+void RetryBackoff::clear(uint32_t pauseMs)
+{
+    m_failures = 0;
+    m_lastMs = millis();
+    m_waitMs = pauseMs;
+}
+
+void RetryBackoff::failed()
+{
+    uint32_t wait = m_failures++ == 0 ? m_baseMs : m_waitMs * 2;
+    m_lastMs = millis();
+    m_waitMs = wait < m_maxMs ? wait : m_maxMs;
+}
@@ -0,0 +1,144 @@
+#include "flash_queue.h"
+
+FlashQueue::FlashQueue(fs::FS &fs, const char *path, uint16_t slotSize, uint16_t slots)
+    : m_fs(fs), m_path(path), m_slotSize(slotSize), m_slots(slots), m_first(0), m_count(0)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool FlashQueue::slotPath(uint32_t slot, char *path, size_t size) const
+{
+    int length = snprintf(path, size, "%s/%02u", m_path, (unsigned)slot);
+    return length > 0 && (size_t)length < size;
+}
+
+bool FlashQueue::openRecord(uint32_t slot, record_header &head, File &file)
+{
+    char path[FLASH_QUEUE_PATH_LEN];
+    if (!slotPath(slot, path, sizeof(path)) || !m_fs.exists(path))
+        return false;
+    file = m_fs.open(path, "r");
+    bool valid = file && file.read((uint8_t *)&head, sizeof(head)) == sizeof(head) &&
+                 head.magic == FLASH_QUEUE_MAGIC && head.seq % m_slots == slot && head.length > 0 &&
+                 head.length <= m_slotSize - 2 && file.size() == sizeof(head) + head.length;
+    if (!valid && file)
+        file.close();
+    return valid;
+}
+
+bool FlashQueue::validRecord(uint32_t slot, uint32_t seq)
+{
+    record_header head;
+    File file;
+    if (!openRecord(slot, head, file))
+        return false;
+    file.close();
+    return head.seq == seq;
+}
+
+bool FlashQueue::begin()
+{
+    m_first = 0;
+    m_count = 0;
+    File dir = m_fs.open(m_path, "r");
+    bool isDirectory = dir && dir.isDirectory();
+    if (dir)
+        dir.close();
+    // the single file the queue used to be kept in
+    if (!isDirectory && ((m_fs.exists(m_path) && !m_fs.remove(m_path)) || !m_fs.mkdir(m_path)))
+        return false;
+
+    // the newest record, then the unbroken run of older ones before it
+    bool found = false;
+    uint32_t newest = 0;
+    for (uint32_t slot = 0; slot < m_slots; slot++)
+    {
+        record_header head;
+        File file;
+        if (!openRecord(slot, head, file))
+            continue;
+        file.close();
+        if (!found || (int32_t)(head.seq - newest) > 0)
+            newest = head.seq;
+        found = true;
+    }
+    while (found && m_count < m_slots && validRecord((newest - m_count) % m_slots, newest - m_count))
+        m_count++;
+    if (found)
+        m_first = newest - m_count + 1;
+
+    // whatever is not part of it was consumed, cut short or written by another layout
+    for (uint32_t slot = 0; slot < m_slots; slot++)
+    {
+        char path[FLASH_QUEUE_PATH_LEN];
+        if (!slotPath(slot, path, sizeof(path)))
+            return false;
+        if ((slot + m_slots - m_first % m_slots) % m_slots >= m_count && m_fs.exists(path))
+            m_fs.remove(path);
+    }
+    return true;
+}
+
+bool FlashQueue::push(const void *record, size_t length)
+{
+    if (length == 0 || length > (size_t)m_slotSize - 2)
+        return false;
+
+    // the new record takes the slot of the oldest, which is gone once the file is opened
+    if (m_count == m_slots)
+    {
+        m_first++;
+        m_count--;
+        m_stats.dropped++;
+    }
+    uint32_t seq = m_first + m_count;
+    record_header head = {FLASH_QUEUE_MAGIC, seq, (uint16_t)length, 0};
+    char path[FLASH_QUEUE_PATH_LEN];
+    File file;
+    if (slotPath(seq % m_slots, path, sizeof(path)))
+        file = m_fs.open(path, "w");
+    bool written = file && file.write((const uint8_t *)&head, sizeof(head)) == sizeof(head) &&
+                   file.write((const uint8_t *)record, length) == length;
+    if (file)
+        file.close();
+    if (!written)
+    {
+        if (file)
+            m_fs.remove(path);
+        m_stats.write_errors++;
+        return false;
+    }
+    m_count++;
+    m_stats.pushed++;
+    return true;
+}
+
+size_t FlashQueue::peek(void *record, size_t capacity)
+{
+    if (m_count == 0)
+        return 0;
+    record_header head;
+    File file;
+    if (!openRecord(m_first % m_slots, head, file))
+        return 0;
+    bool read = head.seq == m_first && head.length <= capacity &&
+                file.read((uint8_t *)record, head.length) == head.length;
+    file.close();
+    return read ? head.length : 0;
+}
+
+bool FlashQueue::pop()
+{
+    if (m_count == 0)
+        return false;
+    char path[FLASH_QUEUE_PATH_LEN];
+    if (!slotPath(m_first % m_slots, path, sizeof(path)) || (m_fs.exists(path) && !m_fs.remove(path)))
+    {
+        m_stats.write_errors++;
+        return false;
+    }
+    m_first++;
+    m_count--;
+    m_stats.popped++;
+    return true;
+}
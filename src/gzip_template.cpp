@@ -0,0 +1,193 @@
+#include "gzip_template.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define GZIP_HEADER_SIZE 12 // magic, segment count, reserved, literal length
+#define GZIP_CRC_POLY 0xEDB88320u
+
+// gzip member header: deflate, no name or timestamp, best compression, unknown OS
+static const uint8_t gzip_header[10] = {0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0xff};
+
+// a * b modulo the CRC polynomial, bit reflected (multmodp() in zlib)
+static uint32_t crc32Multiply(uint32_t a, uint32_t b)
+{
+    uint32_t m = 1u << 31, p = 0;
+    for (;;)
+    {
+        if (a & m)
+        {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ GZIP_CRC_POLY : b >> 1;
+    }
+    return p;
+}
+
+uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t length)
+{
+    // bitwise, only placeholder values are checksummed at runtime
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ GZIP_CRC_POLY : crc >> 1;
+    }
+    return ~crc;
+}
+
+static void putLe32(uint8_t *out, uint32_t value)
+{
+    out[0] = value;
+    out[1] = value >> 8;
+    out[2] = value >> 16;
+    out[3] = value >> 24;
+}
+
+GzipTemplate::GzipTemplate()
+    : m_data(nullptr), m_segments(nullptr), m_count(0), m_deflated(nullptr), m_deflatedLength(0), m_literalLength(0)
+{
+}
+
+GzipTemplate::~GzipTemplate()
+{
+    free(m_data);
+}
+
+bool GzipTemplate::parse(uint8_t *data, size_t length)
+{
+    free(m_data);
+    m_data = nullptr;
+    m_segments = nullptr;
+    m_count = 0;
+
+    uint16_t count = 0;
+    if (data != nullptr && length >= GZIP_HEADER_SIZE && memcmp(data, GZIP_TEMPLATE_MAGIC, 4) == 0)
+        memcpy(&count, data + 4, sizeof(count));
+    size_t table = GZIP_HEADER_SIZE + count * sizeof(gzip_segment);
+    if (count == 0 || count > TEMPLATE_MAX_SEGMENTS || table > length)
+    {
+        free(data);
+        return false;
+    }
+
+    // malloc() alignment is enough for the table, it starts at a multiple of 4
+    const gzip_segment *segments = reinterpret_cast<const gzip_segment *>(data + GZIP_HEADER_SIZE);
+    size_t deflated = 0;
+    for (size_t i = 0; i < count; i++)
+        deflated += segments[i].length;
+    if (table + deflated != length || segments[count - 1].var != TPL_LITERAL)
+    {
+        free(data);
+        return false;
+    }
+
+    m_data = data;
+    m_segments = segments;
+    m_count = count;
+    m_deflated = data + table;
+    m_deflatedLength = deflated;
+    memcpy(&m_literalLength, data + 8, sizeof(m_literalLength));
+    return true;
+}
+
+GzipTemplateStream::GzipTemplateStream(const GzipTemplate &page, template_resolver resolve)
+    : m_page(page), m_length(sizeof(gzip_header) + page.deflatedLength() + sizeof(m_trailer)), m_piece(0),
+      m_offset(0), m_deflatedAt(0)
+{
+    uint32_t crc = 0;
+    uint32_t size = page.literalLength();
+    size_t used = 0;
+    for (size_t i = 0; i < page.segmentCount(); i++)
+    {
+        const gzip_segment &seg = page.segment(i);
+        if (seg.var == TPL_LITERAL)
+        {
+            // the same as crc32_combine(crc, seg.crc, literal length)
+            crc = crc32Multiply(seg.shift, crc) ^ seg.crc;
+            continue;
+        }
+        // resolvers write a terminating zero, a value is cut short once the buffer runs out
+        size_t room = sizeof(m_values) - used;
+        if (room > TEMPLATE_VALUE_BUFFER)
+            room = TEMPLATE_VALUE_BUFFER;
+        size_t len = room > 1 ? resolve(seg.var, m_values + used, room) : 0;
+        m_valueOffset[i] = used;
+        m_valueLength[i] = len;
+        crc = crc32Update(crc, (const uint8_t *)m_values + used, len);
+        used += len;
+        size += len;
+        m_length += sizeof(m_block) + len;
+    }
+    putLe32(m_trailer, crc);
+    putLe32(m_trailer + 4, size);
+}
+
+const uint8_t *GzipTemplateStream::piece(size_t index, size_t &length)
+{
+    size_t count = m_page.segmentCount();
+    if (index == 0)
+    {
+        length = sizeof(gzip_header);
+        return gzip_header;
+    }
+    if (index > 2 * count)
+    {
+        length = sizeof(m_trailer);
+        return m_trailer;
+    }
+
+    size_t segment = (index - 1) / 2;
+    bool prefix = (index - 1) % 2 == 0;
+    if (m_page.segment(segment).var == TPL_LITERAL)
+    {
+        length = prefix ? 0 : m_page.segment(segment).length;
+        return m_page.deflated() + m_deflatedAt;
+    }
+    if (!prefix)
+    {
+        length = m_valueLength[segment];
+        return (const uint8_t *)m_values + m_valueOffset[segment];
+    }
+
+    // not the last block, stored, then LEN and its one's complement
+    uint16_t len = m_valueLength[segment];
+    uint16_t nlen = ~len;
+    m_block[0] = 0x00;
+    m_block[1] = len;
+    m_block[2] = len >> 8;
+    m_block[3] = nlen;
+    m_block[4] = nlen >> 8;
+    length = sizeof(m_block);
+    return m_block;
+}
+
+size_t GzipTemplateStream::read(uint8_t *buffer, size_t maxLen)
+{
+    size_t written = 0;
+    size_t last = 2 * m_page.segmentCount() + 1;
+    while (written < maxLen && m_piece <= last)
+    {
+        size_t length;
+        const uint8_t *data = piece(m_piece, length);
+        size_t count = length - m_offset;
+        if (count > maxLen - written)
+            count = maxLen - written;
+        memcpy(buffer + written, data + m_offset, count);
+        written += count;
+        m_offset += count;
+        if (m_offset == length)
+        {
+            // past the body of a literal, the next one starts behind it
+            if (m_piece > 0 && m_piece < last && (m_piece - 1) % 2 == 1 &&
+                m_page.segment((m_piece - 1) / 2).var == TPL_LITERAL)
+                m_deflatedAt += length;
+            m_piece++;
+            m_offset = 0;
+        }
+    }
+    return written;
+}
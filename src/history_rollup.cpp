@@ -0,0 +1,184 @@
+#include "history_rollup.h"
+#include "history_store.h"
+
+static_assert(sizeof(history_bucket) == 32, "history_bucket must stay 32 bytes");
+
+void bucketInit(history_bucket &bucket, uint32_t start)
+{
+    memset(&bucket, 0, sizeof(bucket));
+    bucket.start = start;
+}
+
+void bucketAdd(history_bucket &bucket, const history_sample &sample)
+{
+    if (bucket.count == 0 || sample.level_mm < bucket.level_min)
+        bucket.level_min = sample.level_mm;
+    if (bucket.count == 0 || sample.level_mm > bucket.level_max)
+        bucket.level_max = sample.level_mm;
+    if (bucket.count == 0 || sample.temperature < bucket.temperature_min)
+        bucket.temperature_min = sample.temperature;
+    if (bucket.count == 0 || sample.temperature > bucket.temperature_max)
+        bucket.temperature_max = sample.temperature;
+    bucket.level_sum += sample.level_mm;
+    bucket.temperature_sum += sample.temperature;
+    bucket.humidity_sum += sample.humidity;
+    bucket.batt_sum += sample.batt_mv;
+    bucket.count++;
+}
+
+void spanInit(history_span &span, uint32_t start)
+{
+    memset(&span, 0, sizeof(span));
+    span.start = start;
+}
+
+void bucketMerge(history_span &into, const history_bucket &from)
+{
+    if (from.count == 0)
+        return;
+    if (into.count == 0 || from.level_min < into.level_min)
+        into.level_min = from.level_min;
+    if (into.count == 0 || from.level_max > into.level_max)
+        into.level_max = from.level_max;
+    if (into.count == 0 || from.temperature_min < into.temperature_min)
+        into.temperature_min = from.temperature_min;
+    if (into.count == 0 || from.temperature_max > into.temperature_max)
+        into.temperature_max = from.temperature_max;
+    into.level_sum += from.level_sum;
+    into.temperature_sum += from.temperature_sum;
+    into.humidity_sum += from.humidity_sum;
+    into.batt_sum += from.batt_sum;
+    into.count += from.count;
+}
+
+RollupTier::RollupTier(fs::FS &fs, const char *dir, const char *name, uint32_t bucketSeconds, uint32_t capacity)
+    : m_fs(fs), m_seconds(bucketSeconds), m_capacity(capacity), m_pendingCount(0), m_dirty(false),
+      m_writes(0), m_mux(portMUX_INITIALIZER_UNLOCKED)
+{
+    snprintf(m_path, sizeof(m_path), "%s/%s", dir, name);
+    bucketInit(m_open, 0);
+}
+
+void RollupTier::begin(uint32_t lastTime)
+{
+    bucketInit(m_open, 0);
+    if (lastTime == 0)
+        return;
+
+    uint32_t number = lastTime / m_seconds;
+    history_bucket bucket;
+    if (read(number, &bucket, 1) == 1 && bucket.count > 0)
+        m_open = bucket;
+}
+
+void RollupTier::add(const history_sample &sample)
+{
+    uint32_t start = sample.time - sample.time % m_seconds;
+    if (m_open.count > 0 && m_open.start != start)
+    {
+        if (m_pendingCount == HISTORY_ROLLUP_PENDING && !flush())
+        {
+            // keep the newest buckets when the file cannot be written
+            portENTER_CRITICAL(&m_mux);
+            memmove(m_pending, m_pending + 1, (HISTORY_ROLLUP_PENDING - 1) * sizeof(history_bucket));
+            m_pendingCount--;
+            portEXIT_CRITICAL(&m_mux);
+        }
+        portENTER_CRITICAL(&m_mux);
+        m_pending[m_pendingCount++] = m_open;
+        bucketInit(m_open, start);
+        portEXIT_CRITICAL(&m_mux);
+    }
+
+    portENTER_CRITICAL(&m_mux);
+    if (m_open.count == 0)
+        m_open.start = start;
+    bucketAdd(m_open, sample);
+    portEXIT_CRITICAL(&m_mux);
+    m_dirty = true;
+}
+
+bool RollupTier::flush()
+{
+    if (!m_dirty)
+        return true;
+
+    File file = m_fs.open(m_path, m_fs.exists(m_path) ? "r+" : "w");
+    if (!file)
+        return false;
+
+    bool written = true;
+    for (uint8_t i = 0; i <= m_pendingCount && written; i++)
+    {
+        const history_bucket &bucket = i < m_pendingCount ? m_pending[i] : m_open;
+        if (bucket.count == 0)
+            continue;
+        uint32_t slot = bucket.start / m_seconds % m_capacity;
+        written = file.seek(slot * sizeof(history_bucket)) &&
+                  file.write((const uint8_t *)&bucket, sizeof(bucket)) == sizeof(bucket);
+    }
+    file.close();
+    if (!written)
+        return false;
+
+    portENTER_CRITICAL(&m_mux);
+    m_pendingCount = 0;
+    portEXIT_CRITICAL(&m_mux);
+    m_dirty = false;
+    m_writes++;
+    return true;
+}
+
+size_t RollupTier::readRun(File &file, uint32_t first, history_bucket *out, size_t count)
+{
+    uint32_t slot = first % m_capacity;
+    size_t bytes = 0;
+    if (file && file.seek(slot * sizeof(history_bucket)))
+        bytes = file.read((uint8_t *)out, count * sizeof(history_bucket));
+    // past the end of a file that has not been filled yet
+    memset((uint8_t *)out + bytes, 0, count * sizeof(history_bucket) - bytes);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // the slot still holds a bucket from an earlier pass over the ring
+        if (out[i].start != (first + i) * m_seconds)
+            bucketInit(out[i], (first + i) * m_seconds);
+    }
+    return count;
+}
+
+void RollupTier::overlay(uint32_t first, history_bucket *out, size_t count)
+{
+    portENTER_CRITICAL(&m_mux);
+    for (uint8_t i = 0; i <= m_pendingCount; i++)
+    {
+        const history_bucket &bucket = i < m_pendingCount ? m_pending[i] : m_open;
+        uint32_t number = bucket.start / m_seconds;
+        if (bucket.count > 0 && number >= first && number < first + count)
+            out[number - first] = bucket;
+    }
+    portEXIT_CRITICAL(&m_mux);
+}
+
+size_t RollupTier::read(uint32_t first, history_bucket *out, size_t count)
+{
+    if (count > m_capacity)
+        count = m_capacity;
+
+    File file;
+    if (m_fs.exists(m_path))
+        file = m_fs.open(m_path, "r");
+
+    // a run that crosses the end of the ring is read in two parts
+    size_t head = m_capacity - first % m_capacity;
+    if (head > count)
+        head = count;
+    readRun(file, first, out, head);
+    if (head < count)
+        readRun(file, first + head, out + head, count - head);
+    if (file)
+        file.close();
+
+    overlay(first, out, count);
+    return count;
+}
@@ -0,0 +1,538 @@
+#include "history_store.h"
+#include "metrics.h"
+#include "wall_clock.h"
+
+enum history_query_state : uint8_t
+{
+    HISTORY_QUERY_HEAD,
+    HISTORY_QUERY_SAMPLES,
+    HISTORY_QUERY_DONE
+};
+
+static_assert(sizeof(history_record) == 10, "history_record must stay 10 bytes");
+static_assert(sizeof(history_block) == HISTORY_BLOCK_SIZE, "history_block must fill one page");
+
+HistoryStore::HistoryStore(fs::FS &fs, const char *dir, const history_layout &layout)
+    : m_fs(fs), m_segments(layout.segments < 2 ? 2 : layout.segments),
+      m_blocks(m_segments * HISTORY_BLOCKS_PER_SEGMENT),
+      m_tiers{RollupTier(fs, dir, "hour.log", 3600, layout.hour_buckets),
+              RollupTier(fs, dir, "day.log", 86400, layout.day_buckets)},
+      m_dirty(false), m_dirtySince(0), m_mux(portMUX_INITIALIZER_UNLOCKED)
+{
+    strlcpy(m_dir, dir, sizeof(m_dir));
+    memset(&m_head, 0, sizeof(m_head));
+    m_index = (history_block_info *)calloc(m_blocks, sizeof(history_block_info));
+    metricsCountAlloc(ALLOC_HISTORY, m_blocks * sizeof(history_block_info));
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+HistoryStore::~HistoryStore()
+{
+    free(m_index);
+}
+
+bool HistoryStore::segmentPath(uint32_t segment, char *path, size_t size) const
+{
+    if (segment >= m_segments)
+        return false;
+    int length = snprintf(path, size, "%s/%02u.log", m_dir, (unsigned)segment);
+    return length > 0 && (size_t)length < size;
+}
+
+static bool validHeader(const history_block_header &header, uint32_t slot, uint32_t blocks)
+{
+    return header.magic == HISTORY_MAGIC && header.seq != 0 && (header.seq - 1) % blocks == slot &&
+           header.count > 0 && header.count <= HISTORY_RECORDS_PER_BLOCK;
+}
+
+bool HistoryStore::begin()
+{
+    if (m_index == nullptr || (!m_fs.exists(m_dir) && !m_fs.mkdir(m_dir)))
+        return false;
+
+    uint32_t newest = 0;
+    for (uint32_t segment = 0; segment < m_segments; segment++)
+    {
+        char path[HISTORY_PATH_LEN];
+        if (!segmentPath(segment, path, sizeof(path)))
+            return false;
+        if (!m_fs.exists(path))
+            continue;
+        File file = m_fs.open(path, "r");
+        if (!file)
+            continue;
+
+        for (uint32_t k = 0; k < HISTORY_BLOCKS_PER_SEGMENT; k++)
+        {
+            uint32_t slot = segment * HISTORY_BLOCKS_PER_SEGMENT + k;
+            history_block_header header;
+            if (!file.seek(k * HISTORY_BLOCK_SIZE) ||
+                file.read((uint8_t *)&header, sizeof(header)) != sizeof(header))
+                break;
+            if (!validHeader(header, slot, m_blocks))
+                continue;
+
+            m_index[slot].seq = header.seq;
+            m_index[slot].first_time = header.first_time;
+            m_index[slot].last_time = header.last_time;
+            if (header.seq > m_index[newest].seq)
+                newest = slot;
+        }
+        file.close();
+    }
+
+    if (m_index[newest].seq == 0)
+    {
+        startBlock(1);
+    }
+    else
+    {
+        // continue filling the newest block if it was checkpointed while partial
+        uint32_t seq = m_index[newest].seq;
+        uint32_t lastTime = m_index[newest].last_time;
+        if (!readBlock(seq, m_head) || m_head.header.count == HISTORY_RECORDS_PER_BLOCK)
+            startBlock(seq + 1);
+        for (uint8_t i = 0; i < HISTORY_TIERS; i++)
+            m_tiers[i].begin(lastTime);
+    }
+    return true;
+}
+
+void HistoryStore::startBlock(uint32_t seq)
+{
+    uint32_t slot = (seq - 1) % m_blocks;
+    portENTER_CRITICAL(&m_mux);
+    memset(&m_head, 0, sizeof(m_head));
+    m_head.header.magic = HISTORY_MAGIC;
+    m_head.header.seq = seq;
+    // a new pass over a segment drops everything it held
+    if (slot % HISTORY_BLOCKS_PER_SEGMENT == 0)
+        memset(&m_index[slot], 0, HISTORY_BLOCKS_PER_SEGMENT * sizeof(history_block_info));
+    else
+        m_index[slot].seq = 0;
+    portEXIT_CRITICAL(&m_mux);
+    m_dirty = false;
+}
+
+bool HistoryStore::writeBlock(const history_block &block)
+{
+    uint32_t slot = (block.header.seq - 1) % m_blocks;
+    uint32_t k = slot % HISTORY_BLOCKS_PER_SEGMENT;
+    char path[HISTORY_PATH_LEN];
+    File file;
+    // the first block of a segment truncates what the previous pass left in it
+    if (segmentPath(slot / HISTORY_BLOCKS_PER_SEGMENT, path, sizeof(path)))
+        file = m_fs.open(path, k == 0 || !m_fs.exists(path) ? "w" : "r+");
+    bool written = file && file.seek(k * HISTORY_BLOCK_SIZE) &&
+                   file.write((const uint8_t *)&block, HISTORY_BLOCK_SIZE) == HISTORY_BLOCK_SIZE;
+    if (file)
+        file.close();
+    if (!written)
+    {
+        m_stats.write_errors++;
+        return false;
+    }
+
+    portENTER_CRITICAL(&m_mux);
+    m_index[slot].seq = block.header.seq;
+    m_index[slot].first_time = block.header.first_time;
+    m_index[slot].last_time = block.header.last_time;
+    portEXIT_CRITICAL(&m_mux);
+    m_stats.blocks_written++;
+    return true;
+}
+
+static uint16_t clampU16(uint32_t value)
+{
+    return value > 0xFFFF ? 0xFFFF : value;
+}
+
+bool HistoryStore::append(const history_sample &sample)
+{
+    history_block_header &header = m_head.header;
+    if (!clockIsSet(sample.time) || (header.count > 0 && sample.time < header.last_time))
+    {
+        m_stats.rejected++;
+        return false;
+    }
+
+    // a gap too long for the 16 bit delta closes the block early
+    if (header.count > 0 && sample.time - header.last_time > 0xFFFF)
+    {
+        writeBlock(m_head);
+        flushTiers();
+        startBlock(header.seq + 1);
+    }
+
+    history_record record;
+    record.dt = header.count == 0 ? 0 : sample.time - header.last_time;
+    record.level_mm = sample.level_mm;
+    record.temperature = sample.temperature;
+    record.humidity = clampU16(sample.humidity);
+    record.batt_mv = sample.batt_mv;
+
+    portENTER_CRITICAL(&m_mux);
+    if (header.count == 0)
+        header.first_time = sample.time;
+    m_head.records[header.count++] = record;
+    header.last_time = sample.time;
+    portEXIT_CRITICAL(&m_mux);
+    m_stats.appended++;
+    for (uint8_t i = 0; i < HISTORY_TIERS; i++)
+        m_tiers[i].add(sample);
+
+    if (!m_dirty)
+    {
+        m_dirty = true;
+        m_dirtySince = millis();
+    }
+
+    if (header.count == HISTORY_RECORDS_PER_BLOCK)
+    {
+        writeBlock(m_head);
+        flushTiers();
+        startBlock(header.seq + 1);
+    }
+    return true;
+}
+
+void HistoryStore::service()
+{
+    if (m_dirty && millis() - m_dirtySince >= HISTORY_CHECKPOINT_MS && flush())
+        m_stats.checkpoints++;
+}
+
+bool HistoryStore::flush()
+{
+    if (!m_dirty)
+        return true;
+    if (!writeBlock(m_head) || !flushTiers())
+        return false;
+    m_dirty = false;
+    return true;
+}
+
+bool HistoryStore::flushTiers()
+{
+    bool flushed = true;
+    for (uint8_t i = 0; i < HISTORY_TIERS; i++)
+    {
+        if (!m_tiers[i].flush())
+        {
+            m_stats.write_errors++;
+            flushed = false;
+        }
+    }
+    return flushed;
+}
+
+RollupTier *HistoryStore::tierFor(uint32_t step)
+{
+    RollupTier *tier = nullptr;
+    for (uint8_t i = 0; i < HISTORY_TIERS; i++)
+    {
+        if (m_tiers[i].bucketSeconds() <= step)
+            tier = &m_tiers[i];
+    }
+    return tier;
+}
+
+history_stats HistoryStore::stats() const
+{
+    history_stats stats = m_stats;
+    stats.rollup_writes = 0;
+    for (uint8_t i = 0; i < HISTORY_TIERS; i++)
+        stats.rollup_writes += m_tiers[i].writes();
+    return stats;
+}
+
+bool HistoryStore::blockInfo(uint32_t seq, history_block_info &info)
+{
+    bool found;
+    portENTER_CRITICAL(&m_mux);
+    if (seq == m_head.header.seq)
+    {
+        info.seq = seq;
+        info.first_time = m_head.header.first_time;
+        info.last_time = m_head.header.last_time;
+        found = m_head.header.count > 0;
+    }
+    else
+    {
+        info = m_index[(seq - 1) % m_blocks];
+        found = info.seq == seq;
+    }
+    portEXIT_CRITICAL(&m_mux);
+    return found;
+}
+
+bool HistoryStore::readBlock(uint32_t seq, history_block &block)
+{
+    if (seq == 0)
+        return false;
+
+    bool head = false;
+    portENTER_CRITICAL(&m_mux);
+    if (seq == m_head.header.seq)
+    {
+        memcpy(&block, &m_head, sizeof(block));
+        head = true;
+    }
+    portEXIT_CRITICAL(&m_mux);
+    if (head)
+        return block.header.count > 0;
+
+    uint32_t slot = (seq - 1) % m_blocks;
+    char path[HISTORY_PATH_LEN];
+    if (!segmentPath(slot / HISTORY_BLOCKS_PER_SEGMENT, path, sizeof(path)))
+        return false;
+    File file = m_fs.open(path, "r");
+    if (!file)
+        return false;
+    bool read = file.seek((slot % HISTORY_BLOCKS_PER_SEGMENT) * HISTORY_BLOCK_SIZE) &&
+                file.read((uint8_t *)&block, HISTORY_BLOCK_SIZE) == HISTORY_BLOCK_SIZE;
+    file.close();
+    // the slot may have been reused by a newer pass meanwhile
+    return read && validHeader(block.header, slot, m_blocks) && block.header.seq == seq;
+}
+
+void HistoryStore::queryDone(uint32_t elapsedMs)
+{
+    portENTER_CRITICAL(&m_mux);
+    m_stats.queries++;
+    m_stats.last_query_ms = elapsedMs;
+    portEXIT_CRITICAL(&m_mux);
+}
+
+static void *allocBuffer(RequestArena *arena, size_t size, size_t align)
+{
+    if (arena != nullptr)
+        return arena->allocate(size, align);
+    metricsCountAlloc(ALLOC_HISTORY, size);
+    return malloc(size);
+}
+
+HistoryQuery::HistoryQuery(HistoryStore &store, uint32_t from, uint32_t to, uint32_t step,
+                           RequestArena *arena)
+    : m_store(store), m_from(from), m_to(to), m_step(step), m_started(millis()), m_tier(store.tierFor(step)),
+      m_ownsBuffers(arena == nullptr), m_block(nullptr), m_buckets(nullptr), m_seq(0), m_record(0), m_count(0), m_time(0), m_hasPending(false),
+      m_finished(from > to), m_lineLength(0), m_lineOffset(0), m_state(HISTORY_QUERY_HEAD), m_first(true)
+{
+    if (m_finished)
+        return;
+
+    if (m_tier != nullptr)
+    {
+        m_buckets = (history_bucket *)allocBuffer(arena, HISTORY_ROLLUP_READ * sizeof(history_bucket),
+                                                  alignof(history_bucket));
+        m_finished = m_buckets == nullptr;
+        // nothing older than one pass over the ring can be in the tier
+        uint32_t span = m_tier->capacity() * m_tier->bucketSeconds();
+        uint32_t first = to - from > span ? to - span : from;
+        m_seq = first / m_tier->bucketSeconds();
+        return;
+    }
+
+    m_block = (history_block *)allocBuffer(arena, sizeof(history_block), alignof(history_block));
+    if (m_block == nullptr)
+    {
+        m_finished = true;
+        return;
+    }
+    m_block->header.count = 0;
+
+    // the index is in RAM, so skipping to the first block that reaches from costs no flash reads
+    uint32_t head = m_store.headSeq();
+    uint32_t seq = head > m_store.blocks() ? head - m_store.blocks() + 1 : 1;
+    for (; seq < head; seq++)
+    {
+        history_block_info info;
+        if (m_store.blockInfo(seq, info) && info.last_time >= from)
+            break;
+    }
+    m_seq = seq - 1;
+}
+
+HistoryQuery::~HistoryQuery()
+{
+    if (m_ownsBuffers)
+    {
+        free(m_block);
+        free(m_buckets);
+    }
+    m_store.queryDone(millis() - m_started);
+}
+
+bool HistoryQuery::loadNextBlock()
+{
+    while (++m_seq <= m_store.headSeq())
+    {
+        history_block_info info;
+        if (!m_store.blockInfo(m_seq, info))
+            continue;
+        if (info.first_time > m_to)
+            return false;
+        if (m_store.readBlock(m_seq, *m_block))
+        {
+            m_record = 0;
+            m_time = m_block->header.first_time;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HistoryQuery::nextBucket(history_bucket &out)
+{
+    uint32_t last = m_to / m_tier->bucketSeconds();
+    while (!m_finished)
+    {
+        if (m_record >= m_count)
+        {
+            if (m_seq > last)
+            {
+                m_finished = true;
+                break;
+            }
+            uint32_t count = last - m_seq + 1;
+            if (count > HISTORY_ROLLUP_READ)
+                count = HISTORY_ROLLUP_READ;
+            m_count = m_tier->read(m_seq, m_buckets, count);
+            m_record = 0;
+            m_seq += count;
+            continue;
+        }
+
+        const history_bucket &bucket = m_buckets[m_record++];
+        if (bucket.count > 0)
+        {
+            out = bucket;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HistoryQuery::nextRecord(history_bucket &out)
+{
+    if (m_tier != nullptr)
+        return nextBucket(out);
+
+    while (!m_finished)
+    {
+        if (m_record >= m_block->header.count)
+        {
+            if (!loadNextBlock())
+                m_finished = true;
+            continue;
+        }
+
+        const history_record &record = m_block->records[m_record++];
+        m_time += record.dt;
+        if (m_time < m_from)
+            continue;
+        if (m_time > m_to)
+        {
+            m_finished = true;
+            break;
+        }
+
+        history_sample sample;
+        sample.time = m_time;
+        sample.level_mm = record.level_mm;
+        sample.temperature = record.temperature;
+        sample.humidity = record.humidity;
+        sample.batt_mv = record.batt_mv;
+        bucketInit(out, m_time);
+        bucketAdd(out, sample);
+        return true;
+    }
+    return false;
+}
+
+bool HistoryQuery::next(history_span &out)
+{
+    if (!m_hasPending)
+        m_hasPending = nextRecord(m_pending);
+    if (!m_hasPending)
+        return false;
+
+    if (m_step == 0)
+    {
+        spanInit(out, m_pending.start);
+        bucketMerge(out, m_pending);
+        m_hasPending = false;
+        return true;
+    }
+
+    // intervals are aligned like the tier buckets, so every bucket falls into exactly one of them
+    spanInit(out, m_pending.start - m_pending.start % m_step);
+    while (m_hasPending && m_pending.start - out.start < m_step)
+    {
+        bucketMerge(out, m_pending);
+        m_hasPending = nextRecord(m_pending);
+    }
+    return true;
+}
+
+void HistoryQuery::formatNext()
+{
+    int written = 0;
+    m_lineOffset = 0;
+    switch (m_state)
+    {
+    case HISTORY_QUERY_HEAD:
+        written = snprintf(m_line, sizeof(m_line),
+                           "{\"from\":%lu,\"to\":%lu,\"step\":%lu,\"resolution\":%lu,"
+                           "\"fields\":[\"time\",\"count\",\"level_mm\",\"level_min\",\"level_max\",\"temperature_c\","
+                           "\"temperature_min\",\"temperature_max\",\"humidity\",\"batt_mv\"],\"samples\":[",
+                           (unsigned long)m_from, (unsigned long)m_to, (unsigned long)m_step,
+                           (unsigned long)resolution());
+        m_state = HISTORY_QUERY_SAMPLES;
+        break;
+    case HISTORY_QUERY_SAMPLES:
+        history_span span;
+        if (next(span))
+        {
+            int64_t count = span.count;
+            written = snprintf(m_line, sizeof(m_line), "%s[%lu,%lu,%ld,%d,%d,%.2f,%.2f,%.2f,%.2f,%lu]",
+                               m_first ? "" : ",", (unsigned long)span.start, (unsigned long)span.count,
+                               (long)(span.level_sum / count), span.level_min, span.level_max,
+                               span.temperature_sum / count / 100.0, span.temperature_min / 100.0,
+                               span.temperature_max / 100.0, span.humidity_sum / count / 100.0,
+                               (unsigned long)(span.batt_sum / count));
+            m_first = false;
+        }
+        else
+        {
+            written = snprintf(m_line, sizeof(m_line), "]}");
+            m_state = HISTORY_QUERY_DONE;
+        }
+        break;
+    default:
+        break;
+    }
+    m_lineLength = written > 0 && (size_t)written < sizeof(m_line) ? written : 0;
+}
+size_t HistoryQuery::readJson(uint8_t *buffer, size_t maxLen)
+{
+    size_t length = 0;
+    while (length < maxLen)
+    {
+        if (m_lineOffset >= m_lineLength)
+        {
+            if (m_state == HISTORY_QUERY_DONE)
+                break;
+            formatNext();
+            continue;
+        }
+
+        size_t chunk = m_lineLength - m_lineOffset;
+        if (chunk > maxLen - length)
+            chunk = maxLen - length;
+        memcpy(buffer + length, m_line + m_lineOffset, chunk);
+        m_lineOffset += chunk;
+        length += chunk;
+    }
+    return length;
+}
@@ -0,0 +1,129 @@
+#include "http_sink.h"
+#include <WiFi.h>
+#include <HTTPClient.h>
+
+#define HTTP_SINK_IDLE_MS 1000
+
+HttpSink::HttpSink(const char *name, uint8_t format, const char *contentType, size_t batch)
+    : m_name(name), m_format(format), m_contentType(contentType),
+      m_batch(batch < 1 ? 1 : batch > HTTP_SINK_BATCH ? HTTP_SINK_BATCH : batch),
+      m_backoff(HTTP_SINK_RETRY_MS, HTTP_SINK_BACKOFF_MAX_MS), m_ready(false), m_task(nullptr),
+      m_mux(portMUX_INITIALIZER_UNLOCKED)
+{
+    m_url[0] = '\0';
+    m_authorization[0] = '\0';
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool HttpSink::begin()
+{
+    if (m_task != nullptr)
+        return true;
+    return xTaskCreatePinnedToCore(taskMain, m_name, HTTP_SINK_STACK, this, 1, &m_task, HTTP_SINK_CORE) == pdPASS;
+}
+
+void HttpSink::configure(const char *url, const char *authorization)
+{
+    portENTER_CRITICAL(&m_mux);
+    strlcpy(m_url, url, sizeof(m_url));
+    strlcpy(m_authorization, authorization, sizeof(m_authorization));
+    m_ready = m_url[0] != '\0';
+    portEXIT_CRITICAL(&m_mux);
+}
+
+bool HttpSink::offer(const telemetry_payload &payload)
+{
+    http_sink_record record;
+    if (payload.text == nullptr || payload.length >= sizeof(record.text))
+        return false;
+    record.queued_ms = payload.reading->queued_ms;
+    record.length = payload.length;
+    memcpy(record.text, payload.text, payload.length);
+    if (!m_queue.push(record))
+        return false;
+    if (m_task != nullptr)
+        xTaskNotifyGive(m_task);
+    return true;
+}
+
+void HttpSink::taskMain(void *arg)
+{
+    static_cast<HttpSink *>(arg)->run();
+}
+
+void HttpSink::drainQueue()
+{
+    m_backlog.drain(m_queue, m_stats.dropped);
+    m_stats.backlog = m_backlog.count();
+}
+
+void HttpSink::run()
+{
+    for (;;)
+    {
+        drainQueue();
+
+        char url[HTTP_SINK_URL_LEN];
+        char authorization[HTTP_SINK_AUTH_LEN];
+        portENTER_CRITICAL(&m_mux);
+        memcpy(url, m_url, sizeof(url));
+        memcpy(authorization, m_authorization, sizeof(authorization));
+        portEXIT_CRITICAL(&m_mux);
+
+        if (m_backlog.count() == 0 || url[0] == '\0' || WiFi.status() != WL_CONNECTED || !m_backoff.due())
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HTTP_SINK_IDLE_MS));
+            continue;
+        }
+
+        size_t count = m_backlog.count() < m_batch ? m_backlog.count() : m_batch;
+        delivery_result result = deliveryResult(deliver(count, url, authorization));
+
+        if (result == DELIVERY_FAILED)
+        {
+            m_stats.failures++;
+            m_backoff.failed();
+        }
+        else
+        {
+            if (result == DELIVERY_REFUSED)
+            {
+                m_stats.failures++;
+                m_stats.dropped += count;
+            }
+            else
+            {
+                m_stats.last_latency_ms = millis() - m_backlog.at(count - 1).queued_ms;
+                m_stats.delivered += count;
+            }
+            m_backlog.remove(count);
+            m_stats.backlog = m_backlog.count();
+            m_backoff.clear();
+        }
+        m_stats.backoff_ms = m_backoff.backoffMs();
+    }
+}
+
+int HttpSink::deliver(size_t count, const char *url, const char *authorization)
+{
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const http_sink_record &record = m_backlog.at(i);
+        if (i > 0)
+            m_body[length++] = '\n';
+        memcpy(m_body + length, record.text, record.length);
+        length += record.length;
+    }
+
+    HTTPClient http;
+    http.setTimeout(HTTP_SINK_TIMEOUT_MS);
+    if (!http.begin(m_client, url))
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    http.addHeader(F("Content-Type"), m_contentType);
+    if (authorization[0] != '\0')
+        http.addHeader(F("Authorization"), authorization);
+    int status = http.POST((uint8_t *)m_body, length);
+    http.end();
+    return status;
+}
@@ -0,0 +1,149 @@
+#include "link_monitor.h"
+#include <string.h>
+
+LinkMonitor::LinkMonitor() : m_count(0)
+{
+    memset(m_links, 0, sizeof(m_links));
+    memset(m_quality, 0, sizeof(m_quality));
+}
+
+link_stats *LinkMonitor::lookup(uint8_t sensorId)
+{
+    for (size_t i = 0; i < m_count; i++)
+    {
+        if (m_links[i].sensor_id == sensorId)
+            return &m_links[i];
+    }
+    return nullptr;
+}
+
+const link_stats *LinkMonitor::find(uint8_t sensorId) const
+{
+    return const_cast<LinkMonitor *>(this)->lookup(sensorId);
+}
+
+void LinkMonitor::account(link_stats &link, uint32_t arrived, uint32_t missed)
+{
+    // exponential average with weight 1/16 per expected frame
+    uint16_t &quality = m_quality[&link - m_links];
+    for (uint32_t i = 0; i < missed && quality > 0; i++)
+        quality -= quality >> 4;
+    for (uint32_t i = 0; i < arrived; i++)
+        quality += (256 - quality) >> 4;
+    link.quality = (quality * 100 + 128) >> 8;
+}
+
+link_event LinkMonitor::update(uint8_t sensorId, bool hasSeq, uint8_t seq, uint32_t nowMs)
+{
+    link_stats *link = lookup(sensorId);
+    if (link == nullptr)
+    {
+        // the table is full, the least recently heard sensor makes room
+        size_t slot = m_count;
+        if (m_count == LINK_MAX_SENSORS)
+        {
+            slot = 0;
+            for (size_t i = 1; i < m_count; i++)
+            {
+                if (nowMs - m_links[i].last_arrival_ms > nowMs - m_links[slot].last_arrival_ms)
+                    slot = i;
+            }
+        }
+        else
+        {
+            m_count++;
+        }
+
+        link = &m_links[slot];
+        memset(link, 0, sizeof(*link));
+        link->sensor_id = sensorId;
+        link->sequenced = hasSeq;
+        link->last_seq = seq;
+        link->window = 1;
+        link->received = 1;
+        link->last_arrival_ms = nowMs;
+        m_quality[slot] = 256;
+        link->quality = 100;
+        return LINK_NEW;
+    }
+
+    link_event event = LINK_IN_ORDER;
+    uint8_t distance = 1;
+    if (hasSeq && !link->sequenced)
+    {
+        link->sequenced = true;
+        link->last_seq = seq;
+        link->window = 1;
+    }
+    else if (hasSeq)
+    {
+        // serial number arithmetic, a forward distance above 127 (or none) is an old frame
+        distance = seq - link->last_seq;
+        uint32_t silent = nowMs - link->last_arrival_ms;
+        bool paced = link->received > 1 && link->interval_ms > 0;
+        bool restarted = paced && silent >= link->interval_ms * LINK_RESYNC_SILENCE;
+        if (!restarted && (distance > 127 || distance == 0))
+        {
+            uint8_t back = link->last_seq - seq;
+            bool seen = back < 32 && (link->window & (1UL << back));
+            // a repeat follows its original closely and a late frame the one that overtook it, an old number
+            // later than that is a new count
+            restarted = back >= 32 || (paced && silent >= link->interval_ms / 2);
+            if (seen && !restarted)
+            {
+                link->duplicates++;
+                return LINK_DUPLICATE;
+            }
+        }
+        if (restarted)
+        {
+            // nothing is known about the frames in between, neither lost nor a step of the interval
+            link->restarts++;
+            link->last_seq = seq;
+            link->window = 1;
+            link->last_arrival_ms = nowMs;
+            link->received++;
+            account(*link, 1, 0);
+            return LINK_RESTART;
+        }
+        if (distance > 127)
+        {
+            uint8_t back = link->last_seq - seq;
+            // it was counted as lost when the newer frame came in
+            link->window |= 1UL << back;
+            link->reordered++;
+            if (link->lost > 0)
+                link->lost--;
+            link->received++;
+            account(*link, 1, 0);
+            return LINK_LATE;
+        }
+        if (distance > 1)
+        {
+            link->lost += distance - 1;
+            account(*link, 0, distance - 1);
+            event = LINK_GAP;
+        }
+        link->window = distance < 32 ? (link->window << distance) | 1 : 1;
+        link->last_seq = seq;
+    }
+
+    // per sequence step, so a lost frame does not show up as jitter
+    uint32_t interval = (nowMs - link->last_arrival_ms) / distance;
+    if (link->received > 1)
+    {
+        float change = interval > link->interval_ms ? interval - link->interval_ms : link->interval_ms - interval;
+        link->jitter_ms += (change - link->jitter_ms) / 16;
+    }
+    link->interval_ms = interval;
+    link->last_arrival_ms = nowMs;
+    link->received++;
+    account(*link, 1, 0);
+    return event;
+}
+
+float LinkMonitor::lossPercent(const link_stats &link)
+{
+    uint32_t expected = link.received + link.lost;
+    return expected == 0 ? 0 : link.lost * 100.0f / expected;
+}
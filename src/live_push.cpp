@@ -0,0 +1,149 @@
+#include "live_push.h"
+#include "metrics.h"
+
+#define LIVE_PUSH_TRY_AGAIN_LATER 1013
+
+LivePush::LivePush(const char *url, const SnapshotBuffer &source, uint8_t maxClients)
+    : m_socket(url), m_source(source), m_maxClients(maxClients < LIVE_PUSH_SLOTS ? maxClients : LIVE_PUSH_SLOTS),
+      m_count(0), m_lastHeartbeat(0), m_mux(portMUX_INITIALIZER_UNLOCKED)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void LivePush::begin(AsyncWebServer &server)
+{
+    m_socket.onEvent([this](AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg,
+                            uint8_t *data, size_t len) { onEvent(client, type); });
+    server.addHandler(&m_socket);
+}
+
+// Runs in the async_tcp task
+void LivePush::onEvent(AsyncWebSocketClient *client, AwsEventType type)
+{
+    if (type == WS_EVT_CONNECT)
+    {
+        bool accepted = false;
+        portENTER_CRITICAL(&m_mux);
+        if (m_count < m_maxClients)
+        {
+            m_subscribers[m_count].id = client->id();
+            m_subscribers[m_count].pending = true; // gets the current state on the next service()
+            m_count++;
+            accepted = true;
+        }
+        else
+        {
+            m_stats.rejected++;
+        }
+        portEXIT_CRITICAL(&m_mux);
+
+        if (!accepted)
+            client->close(LIVE_PUSH_TRY_AGAIN_LATER, "Too many clients");
+    }
+    else if (type == WS_EVT_DISCONNECT)
+    {
+        portENTER_CRITICAL(&m_mux);
+        for (uint8_t i = 0; i < m_count; i++)
+        {
+            if (m_subscribers[i].id == client->id())
+            {
+                m_subscribers[i] = m_subscribers[--m_count];
+                break;
+            }
+        }
+        portEXIT_CRITICAL(&m_mux);
+    }
+}
+
+size_t LivePush::copyIds(uint32_t *ids, bool pendingOnly)
+{
+    size_t count = 0;
+    portENTER_CRITICAL(&m_mux);
+    for (uint8_t i = 0; i < m_count; i++)
+    {
+        if (!pendingOnly || m_subscribers[i].pending)
+            ids[count++] = m_subscribers[i].id;
+    }
+    portEXIT_CRITICAL(&m_mux);
+    return count;
+}
+
+void LivePush::setPending(uint32_t id, bool pending)
+{
+    portENTER_CRITICAL(&m_mux);
+    for (uint8_t i = 0; i < m_count; i++)
+    {
+        if (m_subscribers[i].id == id)
+        {
+            m_subscribers[i].pending = pending;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&m_mux);
+}
+
+bool LivePush::trySend(AsyncWebSocketClient *client)
+{
+    size_t length = m_source.length();
+    // a frame still waiting in the socket or tcp queue means the client is slow,
+    // keep nothing queued for it and send the newest state once it catches up
+    if (!client->canSend() || client->client()->space() < length + 8)
+        return false;
+
+    // the library copies the frame into a message buffer of its own
+    metricsCountAlloc(ALLOC_PUSH, length);
+    client->text(m_source.data(), length);
+    return true;
+}
+
+void LivePush::publish()
+{
+    uint32_t ids[LIVE_PUSH_SLOTS];
+    size_t count = copyIds(ids, false);
+    for (size_t i = 0; i < count; i++)
+    {
+        AsyncWebSocketClient *client = m_socket.client(ids[i]);
+        if (client == nullptr)
+            continue;
+
+        bool sent = trySend(client);
+        portENTER_CRITICAL(&m_mux);
+        if (sent)
+            m_stats.frames_sent++;
+        else
+            m_stats.frames_dropped++;
+        portEXIT_CRITICAL(&m_mux);
+        setPending(ids[i], !sent);
+    }
+}
+
+void LivePush::service()
+{
+    uint32_t ids[LIVE_PUSH_SLOTS];
+    size_t count = copyIds(ids, true);
+    for (size_t i = 0; i < count; i++)
+    {
+        AsyncWebSocketClient *client = m_socket.client(ids[i]);
+        if (client != nullptr && trySend(client))
+        {
+            portENTER_CRITICAL(&m_mux);
+            m_stats.frames_sent++;
+            portEXIT_CRITICAL(&m_mux);
+            setPending(ids[i], false);
+        }
+    }
+
+    if (millis() - m_lastHeartbeat >= LIVE_PUSH_HEARTBEAT_MS)
+    {
+        m_lastHeartbeat = millis();
+        m_socket.pingAll();
+        m_socket.cleanupClients(m_maxClients);
+    }
+}
+
+live_push_stats LivePush::stats() const
+{
+    live_push_stats stats = m_stats;
+    stats.subscribers = m_count;
+    return stats;
+}
@@ -0,0 +1,326 @@
+#include "metrics.h"
+#include <stdarg.h>
+
+struct alloc_counters
+{
+    std::atomic<uint32_t> allocations;
+    std::atomic<uint32_t> bytes;
+};
+
+struct route_counters
+{
+    std::atomic<uint32_t> requests;
+    std::atomic<uint32_t> sum_ms;
+    std::atomic<uint32_t> buckets[LATENCY_BUCKETS];
+};
+
+static alloc_counters allocCounters[ALLOC_SUBSYSTEMS];
+static route_counters routeCounters[ROUTE_COUNT];
+
+static const char *const allocNames[ALLOC_SUBSYSTEMS] = {"templates", "history", "http", "push"};
+static const char *const routeNames[ROUTE_COUNT] = {"index", "graphs",  "configuration", "save",   "state",
+                                                    "stats", "history", "metrics",       "asset", "not_found"};
+
+// written by the loop task only
+static uint32_t lastHeapSample;
+static volatile uint32_t minLargestBlock = UINT32_MAX;
+
+void metricsCountAlloc(alloc_subsystem subsystem, size_t bytes)
+{
+    allocCounters[subsystem].allocations.fetch_add(1, std::memory_order_relaxed);
+    allocCounters[subsystem].bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+alloc_stats metricsAllocStats(alloc_subsystem subsystem)
+{
+    alloc_stats stats;
+    stats.allocations = allocCounters[subsystem].allocations.load(std::memory_order_relaxed);
+    stats.bytes = allocCounters[subsystem].bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+const char *allocSubsystemName(uint8_t subsystem)
+{
+    return subsystem < ALLOC_SUBSYSTEMS ? allocNames[subsystem] : "unknown";
+}
+
+void metricsRequest(uint8_t route, uint32_t elapsedUs)
+{
+    if (route >= ROUTE_COUNT)
+        return;
+    route_counters &counters = routeCounters[route];
+    counters.buckets[TaskMonitor::bucketOf(elapsedUs)].fetch_add(1, std::memory_order_relaxed);
+    counters.sum_ms.fetch_add((elapsedUs + 500) / 1000, std::memory_order_relaxed);
+    counters.requests.fetch_add(1, std::memory_order_relaxed);
+}
+
+route_stats metricsRouteStats(uint8_t route)
+{
+    route_stats stats;
+    const route_counters &counters = routeCounters[route];
+    stats.requests = counters.requests.load(std::memory_order_relaxed);
+    stats.sum_ms = counters.sum_ms.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++)
+        stats.buckets[i] = counters.buckets[i].load(std::memory_order_relaxed);
+    return stats;
+}
+
+const char *routeName(uint8_t route)
+{
+    return route < ROUTE_COUNT ? routeNames[route] : "unknown";
+}
+
+void metricsSampleHeap()
+{
+    uint32_t now = millis();
+    if (lastHeapSample != 0 && now - lastHeapSample < METRICS_HEAP_SAMPLE_MS)
+        return;
+    lastHeapSample = now;
+    // walks the free list, hence the sampling
+    uint32_t largest = ESP.getMaxAllocHeap();
+    if (largest < minLargestBlock)
+        minLargestBlock = largest;
+}
+
+heap_stats metricsHeapStats()
+{
+    heap_stats stats;
+    stats.size = ESP.getHeapSize();
+    stats.free = ESP.getFreeHeap();
+    stats.min_free = ESP.getMinFreeHeap();
+    stats.largest_block = ESP.getMaxAllocHeap();
+    stats.min_largest_block = minLargestBlock < stats.largest_block ? minLargestBlock : stats.largest_block;
+    return stats;
+}
+
+enum metrics_family : uint8_t
+{
+    FAMILY_UPTIME,
+    FAMILY_HEAP_SIZE,
+    FAMILY_HEAP_FREE,
+    FAMILY_HEAP_MIN_FREE,
+    FAMILY_HEAP_LARGEST,
+    FAMILY_HEAP_LARGEST_MIN,
+    FAMILY_HEAP_FRAGMENTATION,
+    FAMILY_ALLOCATIONS,
+    FAMILY_ALLOCATED_BYTES,
+    FAMILY_HTTP,
+    FAMILY_RADIO,
+    FAMILY_STACK,
+    FAMILY_LOOP,
+    FAMILY_COUNT
+};
+
+MetricsExport::MetricsExport(const metrics_snapshot &snapshot)
+    : m_snapshot(snapshot), m_heap(metricsHeapStats()), m_family(0), m_row(0), m_lineLength(0), m_lineOffset(0)
+{
+}
+
+size_t MetricsExport::readText(uint8_t *buffer, size_t maxLen)
+{
+    size_t length = 0;
+    while (length < maxLen)
+    {
+        if (m_lineOffset >= m_lineLength)
+        {
+            if (m_family == FAMILY_COUNT)
+                break;
+            formatNext();
+            continue;
+        }
+
+        size_t chunk = m_lineLength - m_lineOffset;
+        if (chunk > maxLen - length)
+            chunk = maxLen - length;
+        memcpy(buffer + length, m_line + m_lineOffset, chunk);
+        m_lineOffset += chunk;
+        length += chunk;
+    }
+    return length;
+}
+
+void MetricsExport::formatNext()
+{
+    m_lineLength = 0;
+    m_lineOffset = 0;
+    while (m_family < FAMILY_COUNT)
+    {
+        if (formatRow(m_family, m_row))
+        {
+            m_row++;
+            return;
+        }
+        m_family++;
+        m_row = 0;
+    }
+}
+
+void MetricsExport::line(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(m_line + m_lineLength, sizeof(m_line) - m_lineLength, format, args);
+    va_end(args);
+    if (written > 0)
+        m_lineLength += (size_t)written < sizeof(m_line) - m_lineLength ? written : sizeof(m_line) - 1 - m_lineLength;
+}
+
+void MetricsExport::header(const char *name, const char *type, const char *help)
+{
+    line("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Row 0 .. LATENCY_BUCKETS - 1 are the cumulative buckets, then the sum and the count
+void MetricsExport::histogram(const char *name, const char *labels, const uint32_t *buckets, uint32_t count, float sum,
+                              uint16_t row)
+{
+    const char *separator = labels[0] == '\0' ? "" : ",";
+    if (row < LATENCY_BUCKETS)
+    {
+        uint32_t cumulative = 0;
+        for (size_t i = 0; i <= row; i++)
+            cumulative += buckets[i];
+        if (row + 1 < LATENCY_BUCKETS)
+            line("%s_bucket{%s%sle=\"%.3f\"} %u\n", name, labels, separator,
+                 TaskMonitor::bucketLimitMs(row) / 1000.0f, (unsigned)cumulative);
+        else
+            line("%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, separator, (unsigned)cumulative);
+    }
+    else
+    {
+        const char *open = labels[0] == '\0' ? "" : "{";
+        const char *close = labels[0] == '\0' ? "" : "}";
+        if (row == LATENCY_BUCKETS)
+            line("%s_sum%s%s%s %.3f\n", name, open, labels, close, sum);
+        else
+            line("%s_count%s%s%s %u\n", name, open, labels, close, (unsigned)count);
+    }
+}
+
+bool MetricsExport::formatRow(uint8_t family, uint16_t row)
+{
+    const uint16_t histogramRows = LATENCY_BUCKETS + 2;
+    switch (family)
+    {
+    case FAMILY_UPTIME:
+        if (row > 0)
+            return false;
+        header("waterlevel_uptime_seconds", "gauge", "Seconds since boot.");
+        line("waterlevel_uptime_seconds %u\n", (unsigned)m_snapshot.uptime_s);
+        return true;
+    case FAMILY_HEAP_SIZE:
+        if (row > 0)
+            return false;
+        header("waterlevel_heap_size_bytes", "gauge", "Size of the heap.");
+        line("waterlevel_heap_size_bytes %u\n", (unsigned)m_heap.size);
+        return true;
+    case FAMILY_HEAP_FREE:
+        if (row > 0)
+            return false;
+        header("waterlevel_heap_free_bytes", "gauge", "Free heap.");
+        line("waterlevel_heap_free_bytes %u\n", (unsigned)m_heap.free);
+        return true;
+    case FAMILY_HEAP_MIN_FREE:
+        if (row > 0)
+            return false;
+        header("waterlevel_heap_min_free_bytes", "gauge", "Lowest free heap since boot.");
+        line("waterlevel_heap_min_free_bytes %u\n", (unsigned)m_heap.min_free);
+        return true;
+    case FAMILY_HEAP_LARGEST:
+        if (row > 0)
+            return false;
+        header("waterlevel_heap_largest_free_block_bytes", "gauge", "Largest block that can be allocated now.");
+        line("waterlevel_heap_largest_free_block_bytes %u\n", (unsigned)m_heap.largest_block);
+        return true;
+    case FAMILY_HEAP_LARGEST_MIN:
+        if (row > 0)
+            return false;
+        header("waterlevel_heap_largest_free_block_min_bytes", "gauge",
+               "Smallest largest free block sampled since boot.");
+        line("waterlevel_heap_largest_free_block_min_bytes %u\n", (unsigned)m_heap.min_largest_block);
+        return true;
+    case FAMILY_HEAP_FRAGMENTATION:
+        if (row > 0)
+            return false;
+        header("waterlevel_heap_fragmentation_ratio", "gauge", "1 - largest free block / free heap.");
+        line("waterlevel_heap_fragmentation_ratio %.3f\n",
+             m_heap.free > 0 ? 1.0f - (float)m_heap.largest_block / m_heap.free : 0.0f);
+        return true;
+    case FAMILY_ALLOCATIONS:
+    case FAMILY_ALLOCATED_BYTES:
+    {
+        const char *name =
+            family == FAMILY_ALLOCATIONS ? "waterlevel_allocations_total" : "waterlevel_allocated_bytes_total";
+        if (row == 0)
+        {
+            header(name, "counter",
+                   family == FAMILY_ALLOCATIONS ? "Heap allocations by subsystem." : "Bytes allocated by subsystem.");
+            return true;
+        }
+        if (row > ALLOC_SUBSYSTEMS)
+            return false;
+        alloc_stats stats = metricsAllocStats((alloc_subsystem)(row - 1));
+        line("%s{subsystem=\"%s\"} %u\n", name, allocSubsystemName(row - 1),
+             (unsigned)(family == FAMILY_ALLOCATIONS ? stats.allocations : stats.bytes));
+        return true;
+    }
+    case FAMILY_HTTP:
+    {
+        if (row == 0)
+        {
+            header("waterlevel_http_request_duration_seconds", "histogram",
+                   "Requests by route, from dispatch until the connection closed.");
+            return true;
+        }
+        if (row > ROUTE_COUNT * histogramRows)
+            return false;
+        uint8_t route = (row - 1) / histogramRows;
+        // one copy per route keeps its buckets, sum and count consistent
+        if ((row - 1) % histogramRows == 0)
+            m_route = metricsRouteStats(route);
+        char labels[32];
+        snprintf(labels, sizeof(labels), "route=\"%s\"", routeName(route));
+        histogram("waterlevel_http_request_duration_seconds", labels, m_route.buckets, m_route.requests,
+                  m_route.sum_ms / 1000.0f, (row - 1) % histogramRows);
+        return true;
+    }
+    case FAMILY_RADIO:
+    {
+        static const char *const results[] = {"ok", "rejected", "crc_error", "overflow"};
+        const uint32_t counts[] = {m_snapshot.radio_ok, m_snapshot.radio_rejected, m_snapshot.radio_crc_errors,
+                                   m_snapshot.radio_overflows};
+        if (row == 0)
+        {
+            header("waterlevel_radio_packets_total", "counter", "Radio packets by result.");
+            return true;
+        }
+        if (row > 4)
+            return false;
+        line("waterlevel_radio_packets_total{result=\"%s\"} %u\n", results[row - 1], (unsigned)counts[row - 1]);
+        return true;
+    }
+    case FAMILY_STACK:
+        if (row == 0)
+        {
+            header("waterlevel_task_stack_free_bytes", "gauge", "Least free stack a task ever had.");
+            return true;
+        }
+        if (row > m_snapshot.tasks)
+            return false;
+        line("waterlevel_task_stack_free_bytes{task=\"%s\"} %u\n", m_snapshot.task_names[row - 1],
+             (unsigned)m_snapshot.task_stack_free[row - 1]);
+        return true;
+    case FAMILY_LOOP:
+        if (row == 0)
+        {
+            header("waterlevel_loop_interval_seconds", "histogram", "Time between two runs of the Arduino loop.");
+            return true;
+        }
+        if (row > histogramRows)
+            return false;
+        histogram("waterlevel_loop_interval_seconds", "", m_snapshot.loop.buckets, m_snapshot.loop.count,
+                  m_snapshot.loop.sum_ms / 1000.0f, row - 1);
+        return true;
+    }
+    return false;
+}
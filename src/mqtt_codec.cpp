@@ -0,0 +1,151 @@
+#include "mqtt_codec.h"
+#include <string.h>
+
+#define MQTT_PARSE_HEADER 0
+#define MQTT_PARSE_LENGTH 1
+#define MQTT_PARSE_BODY 2
+
+// Fixed header with the remaining length, 1 to 4 bytes of 7 bit groups
+static size_t fixedHeader(uint8_t *buf, size_t size, uint8_t type, size_t remaining)
+{
+    if (remaining > 268435455 || size < 2)
+        return 0;
+    size_t n = 0;
+    buf[n++] = type;
+    do
+    {
+        if (n == size)
+            return 0;
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        buf[n++] = remaining > 0 ? digit | 0x80 : digit;
+    } while (remaining > 0);
+    return n;
+}
+
+static size_t putString(uint8_t *buf, const char *text, size_t length)
+{
+    buf[0] = length >> 8;
+    buf[1] = length & 0xFF;
+    memcpy(buf + 2, text, length);
+    return length + 2;
+}
+
+size_t mqttConnect(uint8_t *buf, size_t size, const mqtt_connect_options &options)
+{
+    size_t idLength = strlen(options.client_id);
+    size_t userLength = options.user != nullptr ? strlen(options.user) : 0;
+    size_t passwordLength = userLength > 0 && options.password != nullptr ? strlen(options.password) : 0;
+    bool will = options.will_topic != nullptr;
+    size_t willTopicLength = will ? strlen(options.will_topic) : 0;
+    size_t willLength = will ? strlen(options.will_message) : 0;
+
+    size_t remaining = 10 + 2 + idLength;
+    if (will)
+        remaining += 4 + willTopicLength + willLength;
+    if (userLength > 0)
+        remaining += 2 + userLength + 2 + passwordLength;
+    size_t n = fixedHeader(buf, size, MQTT_CONNECT, remaining);
+    if (n == 0 || n + remaining > size)
+        return 0;
+
+    n += putString(buf + n, "MQTT", 4);
+    buf[n++] = 4; // protocol level 3.1.1
+    uint8_t flags = options.clean_session ? 0x02 : 0;
+    if (will)
+        flags |= 0x04 | 0x08 | 0x20; // will, QoS 1, retained
+    if (userLength > 0)
+        flags |= 0x80 | 0x40;
+    buf[n++] = flags;
+    buf[n++] = options.keep_alive_s >> 8;
+    buf[n++] = options.keep_alive_s & 0xFF;
+    n += putString(buf + n, options.client_id, idLength);
+    if (will)
+    {
+        n += putString(buf + n, options.will_topic, willTopicLength);
+        n += putString(buf + n, options.will_message, willLength);
+    }
+    if (userLength > 0)
+    {
+        n += putString(buf + n, options.user, userLength);
+        n += putString(buf + n, options.password != nullptr ? options.password : "", passwordLength);
+    }
+    return n;
+}
+
+size_t mqttPublish(uint8_t *buf, size_t size, const char *topic, const uint8_t *payload, size_t length, uint8_t qos,
+                   bool retain, bool dup, uint16_t packetId)
+{
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + length;
+    uint8_t type = MQTT_PUBLISH | (qos & 0x03) << 1 | (retain ? 0x01 : 0) | (dup ? 0x08 : 0);
+    size_t n = fixedHeader(buf, size, type, remaining);
+    if (n == 0 || n + remaining > size)
+        return 0;
+    n += putString(buf + n, topic, topicLength);
+    if (qos > 0)
+    {
+        buf[n++] = packetId >> 8;
+        buf[n++] = packetId & 0xFF;
+    }
+    memcpy(buf + n, payload, length);
+    return n + length;
+}
+
+size_t mqttPacket(uint8_t *buf, size_t size, uint8_t type)
+{
+    return fixedHeader(buf, size, type, 0);
+}
+
+size_t mqttAck(uint8_t *buf, size_t size, uint8_t type, uint8_t first, uint8_t second)
+{
+    size_t n = fixedHeader(buf, size, type, 2);
+    if (n == 0 || n + 2 > size)
+        return 0;
+    buf[n++] = first;
+    buf[n++] = second;
+    return n;
+}
+
+void mqttParserReset(mqtt_parser &parser)
+{
+    parser.state = MQTT_PARSE_HEADER;
+}
+
+bool mqttParse(mqtt_parser &parser, uint8_t byte)
+{
+    switch (parser.state)
+    {
+    case MQTT_PARSE_HEADER:
+        parser.header = byte;
+        parser.length = 0;
+        parser.multiplier = 1;
+        parser.received = 0;
+        parser.state = MQTT_PARSE_LENGTH;
+        return false;
+    case MQTT_PARSE_LENGTH:
+        parser.length += (byte & 0x7F) * parser.multiplier;
+        parser.multiplier *= 128;
+        if (byte & 0x80)
+        {
+            // more than four length bytes is a protocol error, resynchronise on the next byte
+            if (parser.multiplier > 128 * 128 * 128)
+                parser.state = MQTT_PARSE_HEADER;
+            return false;
+        }
+        if (parser.length > 0)
+        {
+            parser.state = MQTT_PARSE_BODY;
+            return false;
+        }
+        parser.state = MQTT_PARSE_HEADER;
+        return true;
+    default:
+        if (parser.received < MQTT_PARSER_BODY)
+            parser.body[parser.received] = byte;
+        if (++parser.received < parser.length)
+            return false;
+        parser.state = MQTT_PARSE_HEADER;
+        return true;
+    }
+}
@@ -0,0 +1,511 @@
+#include "mqtt_publisher.h"
+#include <WiFi.h>
+
+#define MQTT_IDLE_MS 1000
+#define MQTT_POLL_MS 20 // while a PUBACK or ping answer is due
+#define MQTT_STATUS_TOPIC MQTT_BASE_TOPIC "/status"
+
+struct discovery_field
+{
+    const char *key; // in the state document
+    const char *name;
+    const char *unit;
+    const char *device_class; // nullptr for none
+};
+
+// The values of the state document, as Home Assistant sensors
+static const discovery_field discovery_fields[] = {
+    {"level", "hladina", "cm", "distance"},
+    {"fill_perc", "plnost", "%", nullptr},
+    {"distance", "vzdalenost", "cm", "distance"},
+    {"temperature", "teplota", "\xc2\xb0" "C", "temperature"}, // degree sign in UTF-8
+    {"humidity", "vlhkost", "%", "humidity"},
+    {"batt_perc", "baterie", "%", "battery"},
+    {"batt_voltage", "napeti", "V", "voltage"},
+    {"fill_rate", "plneni", "cm/d", nullptr},
+};
+#define DISCOVERY_FIELDS (sizeof(discovery_fields) / sizeof(discovery_fields[0]))
+#define DISCOVERY_ALL ((1 << DISCOVERY_FIELDS) - 1)
+
+MqttPublisher::MqttPublisher(fs::FS &fs)
+    : m_spool(fs, MQTT_SPOOL_PATH, MQTT_SPOOL_SLOT_SIZE, MQTT_SPOOL_SLOTS), m_first(0), m_count(0),
+      m_sensorCount(0), m_online(false), m_inflight(SOURCE_NONE), m_inflightField(0), m_inflightSlot(0),
+      m_packetId(0), m_sentMs(0), m_lastSendMs(0), m_pingPending(false), m_version(0), m_rejected(0),
+      m_ready(false), m_backoff(MQTT_RETRY_MS, MQTT_BACKOFF_MAX_MS), m_task(nullptr),
+      m_mux(portMUX_INITIALIZER_UNLOCKED)
+{
+    memset(&m_settings, 0, sizeof(m_settings));
+    memset(&m_stats, 0, sizeof(m_stats));
+    mqttParserReset(m_parser);
+}
+
+bool MqttPublisher::begin()
+{
+    if (m_task != nullptr)
+        return true;
+    if (!m_spool.begin())
+        return false;
+    return xTaskCreatePinnedToCore(taskMain, "mqtt", MQTT_STACK, this, 1, &m_task, MQTT_CORE) == pdPASS;
+}
+
+void MqttPublisher::configure(const char *host, uint16_t port, const char *user, const char *password,
+                              const char *clientId)
+{
+    portENTER_CRITICAL(&m_mux);
+    strlcpy(m_settings.host, host, sizeof(m_settings.host));
+    m_settings.port = port;
+    strlcpy(m_settings.user, user, sizeof(m_settings.user));
+    strlcpy(m_settings.password, password, sizeof(m_settings.password));
+    strlcpy(m_settings.client_id, clientId, sizeof(m_settings.client_id));
+    m_settings.version++;
+    m_ready = m_settings.host[0] != '\0';
+    portEXIT_CRITICAL(&m_mux);
+    if (m_task != nullptr)
+        xTaskNotifyGive(m_task);
+}
+
+bool MqttPublisher::enqueue(const mqtt_item &item)
+{
+    if (!m_queue.push(item))
+    {
+        m_rejected++;
+        return false;
+    }
+    if (m_task != nullptr)
+        xTaskNotifyGive(m_task);
+    return true;
+}
+
+bool MqttPublisher::offer(const telemetry_payload &payload)
+{
+    mqtt_item item;
+    if (payload.text == nullptr || payload.length >= sizeof(item.state.json))
+        return false;
+    item.type = MQTT_ITEM_STATE;
+    item.state.sensor_id = payload.reading->sensor_id;
+    item.state.length = payload.length;
+    memcpy(item.state.json, payload.text, payload.length);
+    return enqueue(item);
+}
+
+bool MqttPublisher::publishAlert(const alert_event &event)
+{
+    mqtt_item item;
+    item.type = MQTT_ITEM_ALERT;
+    item.alert = event;
+    return enqueue(item);
+}
+
+mqtt_stats MqttPublisher::stats() const
+{
+    mqtt_stats stats = m_stats;
+    stats.rejected = m_rejected;
+    return stats;
+}
+
+// Acknowledged counts every message, alerts and discovery too; the backlog is in RAM and on flash
+sink_stats MqttPublisher::sinkStats() const
+{
+    sink_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.delivered = m_stats.acked;
+    stats.failures = m_stats.connect_failures + m_stats.ack_timeouts;
+    stats.dropped = m_stats.spool_dropped;
+    stats.backlog = m_stats.pending + m_stats.spool_depth;
+    stats.backoff_ms = m_stats.backoff_ms;
+    stats.last_latency_ms = m_stats.last_ack_ms;
+    return stats;
+}
+
+void MqttPublisher::taskMain(void *arg)
+{
+    static_cast<MqttPublisher *>(arg)->run();
+}
+
+void MqttPublisher::run()
+{
+    for (;;)
+    {
+        settings config;
+        portENTER_CRITICAL(&m_mux);
+        config = m_settings;
+        portEXIT_CRITICAL(&m_mux);
+
+        // without a broker nothing is kept, the flash queue is for outages of a configured one
+        if (config.host[0] != '\0')
+        {
+            drainQueue();
+        }
+        else
+        {
+            mqtt_item item;
+            while (m_queue.pop(item))
+                ;
+        }
+
+        if (m_stats.connected && (config.version != m_version || !m_client.connected()))
+            disconnect();
+        if (!m_stats.connected)
+        {
+            if (config.host[0] != '\0' && WiFi.status() == WL_CONNECTED && m_backoff.due())
+            {
+                if (connect(config))
+                {
+                    m_backoff.clear();
+                }
+                else
+                {
+                    m_stats.connect_failures++;
+                    m_backoff.failed();
+                }
+                m_stats.backoff_ms = m_backoff.backoffMs();
+            }
+            if (!m_stats.connected)
+            {
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_IDLE_MS));
+                continue;
+            }
+        }
+
+        receive();
+        if (m_inflight != SOURCE_NONE && millis() - m_sentMs > MQTT_TIMEOUT_MS)
+        {
+            m_stats.ack_timeouts++;
+            disconnect();
+            continue;
+        }
+
+        if (m_inflight == SOURCE_NONE)
+        {
+            size_t length = 0;
+            if (next(m_message))
+                length = mqttPublish(m_packet, sizeof(m_packet), m_message.topic, (const uint8_t *)m_message.payload,
+                                     m_message.length, 1, m_message.retain, false, m_packetId);
+            if (length > 0)
+            {
+                if (!send(m_packet, length))
+                {
+                    disconnect();
+                    continue;
+                }
+                m_sentMs = millis();
+                m_stats.published++;
+                continue;
+            }
+            m_inflight = SOURCE_NONE;
+        }
+
+        // the broker drops a client silent for one and a half keep alive periods
+        if (millis() - m_lastSendMs >= MQTT_KEEP_ALIVE_S * 1000UL / 2)
+        {
+            if (m_pingPending)
+            {
+                disconnect();
+                continue;
+            }
+            size_t length = mqttPacket(m_packet, sizeof(m_packet), MQTT_PINGREQ);
+            if (!send(m_packet, length))
+            {
+                disconnect();
+                continue;
+            }
+            m_pingPending = true;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(m_inflight != SOURCE_NONE || m_pingPending ? MQTT_POLL_MS
+                                                                                           : MQTT_IDLE_MS));
+    }
+}
+
+void MqttPublisher::drainQueue()
+{
+    mqtt_item item;
+    while (m_queue.pop(item))
+    {
+        m_stats.queued++;
+        format(item, m_message);
+        add(m_message);
+    }
+    m_stats.pending = m_count;
+    m_stats.spool_depth = m_spool.count();
+}
+
+void MqttPublisher::format(const mqtt_item &item, mqtt_message &message)
+{
+    int length;
+    if (item.type == MQTT_ITEM_STATE)
+    {
+        const mqtt_state &state = item.state;
+        size_t slot = 0;
+        while (slot < m_sensorCount && m_sensors[slot] != state.sensor_id)
+            slot++;
+        if (slot == m_sensorCount && slot < SENSOR_MAX)
+        {
+            m_sensors[m_sensorCount++] = state.sensor_id;
+            m_announce[slot] = DISCOVERY_ALL;
+        }
+        // retained, a subscriber that starts later gets the last reading straight away
+        message.retain = true;
+        snprintf(message.topic, sizeof(message.topic), MQTT_BASE_TOPIC "/%u/state", state.sensor_id);
+        length = state.length < sizeof(message.payload) ? state.length : sizeof(message.payload) - 1;
+        memcpy(message.payload, state.json, length);
+    }
+    else
+    {
+        const alert_event &event = item.alert;
+        message.retain = false;
+        snprintf(message.topic, sizeof(message.topic), MQTT_BASE_TOPIC "/%u/alert", event.sensor_id);
+        length = snprintf(message.payload, sizeof(message.payload),
+                          "{\"alert\":\"%s\",\"state\":\"%s\",\"value\":%.2f,\"threshold\":%.2f}",
+                          alertKindName(event.kind), event.raised ? "raised" : "cleared", event.value,
+                          event.threshold);
+    }
+    message.length = length < 0 ? 0 : (size_t)length < sizeof(message.payload) ? length : sizeof(message.payload) - 1;
+}
+
+// RAM while the broker keeps up, flash otherwise; the RAM ring is only used while the flash queue is empty
+void MqttPublisher::add(const mqtt_message &message)
+{
+    if (m_stats.connected && m_spool.count() == 0 && m_count < MQTT_PENDING)
+    {
+        m_pending[(m_first + m_count) % MQTT_PENDING] = message;
+        m_count++;
+        return;
+    }
+    spoolPending();
+    spool(message);
+}
+
+// Flash record: retain, topic length, topic, payload
+bool MqttPublisher::spool(const mqtt_message &message)
+{
+    size_t topicLength = strlen(message.topic);
+    size_t length = 2 + topicLength + message.length;
+    if (length > sizeof(m_packet))
+        return false;
+    m_packet[0] = message.retain;
+    m_packet[1] = topicLength;
+    memcpy(m_packet + 2, message.topic, topicLength);
+    memcpy(m_packet + 2 + topicLength, message.payload, message.length);
+    bool pushed = m_spool.push(m_packet, length);
+    m_stats.spooled = m_spool.stats().pushed;
+    m_stats.spool_dropped = m_spool.stats().dropped;
+    m_stats.spool_depth = m_spool.count();
+    return pushed;
+}
+
+// Moves the RAM ring to flash, oldest first; its unacknowledged head becomes the head of the flash queue
+void MqttPublisher::spoolPending()
+{
+    if (m_count == 0)
+        return;
+    if (m_inflight == SOURCE_PENDING)
+        m_inflight = SOURCE_SPOOL;
+    for (size_t i = 0; i < m_count; i++)
+        spool(m_pending[(m_first + i) % MQTT_PENDING]);
+    m_first = 0;
+    m_count = 0;
+    m_stats.pending = 0;
+}
+
+bool MqttPublisher::send(const uint8_t *packet, size_t length)
+{
+    if (m_client.write(packet, length) != length)
+        return false;
+    m_lastSendMs = millis();
+    return true;
+}
+
+bool MqttPublisher::connect(const settings &config)
+{
+    if (!m_client.connect(config.host, config.port))
+        return false;
+    m_client.setNoDelay(true);
+
+    mqtt_connect_options options;
+    options.client_id = config.client_id;
+    options.user = config.user;
+    options.password = config.password;
+    options.will_topic = MQTT_STATUS_TOPIC;
+    options.will_message = "offline";
+    options.keep_alive_s = MQTT_KEEP_ALIVE_S;
+    options.clean_session = false;
+    size_t length = mqttConnect(m_packet, sizeof(m_packet), options);
+    mqttParserReset(m_parser);
+    if (length == 0 || !send(m_packet, length))
+    {
+        m_client.stop();
+        return false;
+    }
+
+    uint32_t started = millis();
+    while (millis() - started < MQTT_TIMEOUT_MS && m_client.connected())
+    {
+        int c = m_client.read();
+        if (c < 0)
+        {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+        if (!mqttParse(m_parser, c))
+            continue;
+        if ((m_parser.header & 0xF0) != MQTT_CONNACK || m_parser.length != 2 || m_parser.body[1] != 0)
+            break;
+
+        // a broker that lost the session lost the retained discovery too, or never had it
+        if ((m_parser.body[0] & 0x01) == 0)
+        {
+            for (size_t i = 0; i < m_sensorCount; i++)
+                m_announce[i] = DISCOVERY_ALL;
+        }
+        m_stats.connected = 1;
+        m_stats.connects++;
+        m_version = config.version;
+        m_online = true;
+        m_inflight = SOURCE_NONE;
+        m_pingPending = false;
+        return true;
+    }
+    m_client.stop();
+    return false;
+}
+
+void MqttPublisher::disconnect()
+{
+    m_client.stop();
+    if (m_stats.connected)
+        m_stats.disconnects++;
+    m_stats.connected = 0;
+    // unacknowledged messages go to flash, the rest is regenerated on the next connection
+    spoolPending();
+    m_inflight = SOURCE_NONE;
+    m_pingPending = false;
+    mqttParserReset(m_parser);
+}
+
+void MqttPublisher::receive()
+{
+    while (m_client.available() > 0)
+    {
+        int c = m_client.read();
+        if (c < 0)
+            break;
+        if (!mqttParse(m_parser, c))
+            continue;
+        uint8_t type = m_parser.header & 0xF0;
+        if (type == MQTT_PUBACK && m_parser.length >= 2)
+            acknowledged(m_parser.body[0] << 8 | m_parser.body[1]);
+        else if (type == MQTT_PINGRESP)
+            m_pingPending = false;
+    }
+}
+
+void MqttPublisher::acknowledged(uint16_t packetId)
+{
+    if (m_inflight == SOURCE_NONE || packetId != m_packetId)
+        return;
+    m_stats.acked++;
+    m_stats.last_ack_ms = millis() - m_sentMs;
+    switch (m_inflight)
+    {
+    case SOURCE_ONLINE:
+        m_online = false;
+        break;
+    case SOURCE_DISCOVERY:
+        m_announce[m_inflightSlot] &= ~(1 << m_inflightField);
+        m_stats.discovery++;
+        break;
+    case SOURCE_PENDING:
+        m_first = (m_first + 1) % MQTT_PENDING;
+        m_count--;
+        m_stats.pending = m_count;
+        break;
+    case SOURCE_SPOOL:
+        m_spool.pop();
+        m_stats.spool_depth = m_spool.count();
+        break;
+    }
+    m_inflight = SOURCE_NONE;
+}
+
+// The message to publish next, marks it in flight under a new packet id
+bool MqttPublisher::next(mqtt_message &message)
+{
+    if (++m_packetId == 0)
+        m_packetId = 1;
+
+    if (m_online)
+    {
+        message.retain = true;
+        strlcpy(message.topic, MQTT_STATUS_TOPIC, sizeof(message.topic));
+        message.length = strlcpy(message.payload, "online", sizeof(message.payload));
+        m_inflight = SOURCE_ONLINE;
+        return true;
+    }
+    for (size_t slot = 0; slot < m_sensorCount; slot++)
+    {
+        if (m_announce[slot] == 0)
+            continue;
+        uint8_t field = 0;
+        while ((m_announce[slot] & (1 << field)) == 0)
+            field++;
+        if (!discoveryMessage(slot, field, message))
+        {
+            m_announce[slot] &= ~(1 << field);
+            return false;
+        }
+        m_inflight = SOURCE_DISCOVERY;
+        m_inflightSlot = slot;
+        m_inflightField = field;
+        return true;
+    }
+    if (m_count > 0)
+    {
+        message = m_pending[m_first];
+        m_inflight = SOURCE_PENDING;
+        return true;
+    }
+    while (m_spool.count() > 0)
+    {
+        size_t length = m_spool.peek(m_packet, sizeof(m_packet));
+        size_t topicLength = length >= 2 ? m_packet[1] : 0;
+        // a record that cannot be read back is skipped, it would block the queue for good
+        if (length < 2 || topicLength == 0 || topicLength >= sizeof(message.topic) ||
+            length - 2 - topicLength > sizeof(message.payload))
+        {
+            m_spool.pop();
+            continue;
+        }
+        message.retain = m_packet[0] != 0;
+        memcpy(message.topic, m_packet + 2, topicLength);
+        message.topic[topicLength] = '\0';
+        message.length = length - 2 - topicLength;
+        memcpy(message.payload, m_packet + 2 + topicLength, message.length);
+        m_inflight = SOURCE_SPOOL;
+        return true;
+    }
+    return false;
+}
+
+bool MqttPublisher::discoveryMessage(size_t slot, uint8_t field, mqtt_message &message)
+{
+    if (field >= DISCOVERY_FIELDS)
+        return false;
+    const discovery_field &f = discovery_fields[field];
+    unsigned id = m_sensors[slot];
+    message.retain = true;
+    snprintf(message.topic, sizeof(message.topic), MQTT_DISCOVERY_PREFIX "/sensor/" MQTT_BASE_TOPIC "_%u/%s/config",
+             id, f.key);
+    int length = snprintf(message.payload, sizeof(message.payload),
+                          "{\"name\":\"%s\",\"unique_id\":\"" MQTT_BASE_TOPIC "_%u_%s\",\"state_topic\":\"" MQTT_BASE_TOPIC
+                          "/%u/state\",\"value_template\":\"{{ value_json.%s }}\",\"unit_of_measurement\":\"%s\","
+                          "%s%s%s\"state_class\":\"measurement\",\"availability_topic\":\"" MQTT_STATUS_TOPIC "\","
+                          "\"device\":{\"identifiers\":[\"" MQTT_BASE_TOPIC "_%u\"],\"name\":\"Jimka %u\","
+                          "\"model\":\"433 MHz\"}}",
+                          f.name, id, f.key, id, f.key, f.unit, f.device_class != nullptr ? "\"device_class\":\"" : "",
+                          f.device_class != nullptr ? f.device_class : "", f.device_class != nullptr ? "\"," : "", id,
+                          id);
+    if (length < 0 || (size_t)length >= sizeof(message.payload))
+        return false;
+    message.length = length;
+    return true;
+}
@@ -0,0 +1,316 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unistd.h>
+#include "bench.h"
+#include "packet_decoder.h"
+#include "link_monitor.h"
+#include "sensor_registry.h"
+#include "snapshot_buffer.h"
+#include "http_standin.h"
+#include "route_table.h"
+
+/*
+    Benchmark target of the native build: the suite of bench.cpp against the
+    pages in data/, then request latency of a local stand-in server under
+    concurrent clients. Run with "pio run -e native_bench -t exec" or start
+    .pio/build/native_bench/program directly, options:
+
+      -f json|csv   report format (default json)
+      -o file       write the report to a file instead of stdout
+      -c clients    concurrent clients of the load test (default 8)
+      -n requests   requests per client (default 50)
+      -p dir        directory with the pages and assets (default data)
+      -u host[:port]  only run the load test, against a device */
+
+#define BENCH_SENSORS 3
+
+struct bench_options
+{
+    bench_format format;
+    const char *output;
+    size_t clients;
+    size_t requests;
+    const char *pages;
+    const char *device;
+};
+
+static SensorRegistry sensors;
+static LinkMonitor links;
+static SnapshotBuffer stateJson;
+static AssetManifest assets(LITTLEFS);
+static PageTemplate indexPage;
+static PageTemplate configurationPage;
+static PageTemplate graphsPage;
+static GzipTemplate indexGzip;
+static dashboard_context pageContext;
+
+static void writeFile(void *ctx, const char *data, size_t len)
+{
+    fwrite(data, 1, len, static_cast<FILE *>(ctx));
+}
+
+static bool loadTemplate(PageTemplate &page, const char *path)
+{
+    File file = LITTLEFS.open(path, "r");
+    if (!file)
+        return false;
+    size_t size = file.size();
+    char *text = (char *)malloc(size);
+    if (text == nullptr || file.read((uint8_t *)text, size) != size)
+    {
+        free(text);
+        return false;
+    }
+    return page.parse(text, size);
+}
+
+static bool loadTemplate(GzipTemplate &page, const char *path)
+{
+    File file = LITTLEFS.open(path, "r");
+    if (!file)
+        return false;
+    size_t size = file.size();
+    uint8_t *data = (uint8_t *)malloc(size);
+    if (data == nullptr || file.read(data, size) != size)
+    {
+        free(data);
+        return false;
+    }
+    return page.parse(data, size);
+}
+
+// A few tanks with a reading each, so every placeholder has a value
+static void seedSensors()
+{
+    for (uint8_t id = 0; id < BENCH_SENSORS; id++)
+    {
+        sensor_reading reading;
+        memset(&reading, 0, sizeof(reading));
+        reading.humidity = 55.5f + id;
+        reading.temperature = 21.25f - id;
+        reading.distance = 80 + id * 20;
+        reading.batt_perc = 90 - id;
+        reading.batt_voltage = 4.05f;
+        reading.sensor_id = id;
+        reading.has_seq = true;
+
+        uint8_t frame[sizeof(packet_frame_v2)];
+        size_t length = encodePacketV2(reading, frame, sizeof(frame));
+        decodePacket(frame, length, reading);
+        links.update(reading.sensor_id, reading.has_seq, reading.seq, millis());
+        tank_sensor *sensor = sensors.add(id);
+        sensor->depth = 200;
+        SensorRegistry::apply(*sensor, reading, millis(), 0);
+    }
+    stateJson.commit(writeStateJson(sensors, links, stateJson.begin(), stateJson.capacity()));
+
+    pageContext.sensor = &sensors.at(0);
+    pageContext.links = &links;
+    pageContext.thingspeak_api = "XXXXXXXXXXXXXXXX";
+    pageContext.thingspeak_channel = 123456;
+    pageContext.duckdns_domain = "tank";
+    pageContext.duckdns_token = "token";
+    pageContext.alert_url = "http://192.168.1.10/alert";
+    pageContext.mqtt_host = "192.168.1.10";
+    pageContext.mqtt_port = 1883;
+    pageContext.mqtt_user = "jimka";
+    pageContext.sinks = TELEMETRY_ALL;
+    pageContext.influx_url = "http://192.168.1.10:8086/api/v2/write?org=home&bucket=jimka";
+    pageContext.influx_token = "token";
+    pageContext.webhook_url = "http://192.168.1.10/reading";
+    pageContext.uptime_s = 3600;
+}
+
+static size_t resolvePage(uint8_t var, char *buf, size_t size)
+{
+    return dashboardValue(var, pageContext, buf, size);
+}
+
+// The routes of the device, matched and answered by the same code
+static void handleRequest(const char *path, const char *body, http_response &response)
+{
+    const route_entry *route = findRoute(path, ROUTE_GET);
+    uint8_t id = route != nullptr ? route->route : ROUTE_ASSET;
+    const PageTemplate *page = nullptr;
+    if (id == ROUTE_INDEX)
+        page = &indexPage;
+    else if (id == ROUTE_CONFIGURATION)
+        page = &configurationPage;
+    else if (id == ROUTE_GRAPHS)
+        page = &graphsPage;
+    if (page != nullptr && page->loaded())
+    {
+        TemplateStream stream(*page, resolvePage);
+        response.status = 200;
+        response.mime = "text/html";
+        response.body.resize(stream.length());
+        stream.read((uint8_t *)&response.body[0], stream.length());
+        return;
+    }
+
+    if (id == ROUTE_STATE)
+    {
+        response.status = 200;
+        response.mime = "application/json";
+        // the server thread is not the writer, it takes a copy like sendState() does
+        char json[SNAPSHOT_BUFFER_SIZE];
+        uint32_t sequence;
+        response.body.assign(json, stateJson.read(json, sizeof(json), sequence));
+        return;
+    }
+
+    const static_asset *asset = assets.find(path);
+    if (asset == nullptr)
+        return;
+    response.body.resize(asset->size);
+    if (asset->data != nullptr)
+    {
+        memcpy_P(&response.body[0], asset->data, asset->size);
+    }
+    else
+    {
+        File file = assets.open(*asset);
+        if (file.read((uint8_t *)&response.body[0], asset->size) != asset->size)
+            return;
+    }
+    response.status = 200;
+    response.mime = asset->mime;
+}
+
+static void runLoad(BenchReport &report, const char *host, uint16_t port, const bench_options &options)
+{
+    const char *paths[] = {"/", "/configuration.html", "/api/v1/state", nullptr};
+    if (assets.count() > 0)
+        paths[3] = assets.at(0).path;
+    const size_t clientCounts[] = {1, options.clients};
+
+    for (const char *path : paths)
+    {
+        if (path == nullptr)
+            continue;
+        for (size_t clients : clientCounts)
+        {
+            http_load load;
+            if (!httpLoad(host, port, path, clients, options.requests, load))
+            {
+                fprintf(stderr, "%s could not be resolved\n", host);
+                return;
+            }
+            if (load.failures > 0)
+                fprintf(stderr, "GET %s: %u of %u requests failed\n", path, (unsigned)load.failures,
+                        (unsigned)(clients * options.requests));
+
+            char name[BENCH_NAME_LEN];
+            snprintf(name, sizeof(name), "http GET %s x%u", path, (unsigned)clients);
+            bench_result result;
+            benchSummarize(name, load.latencies_us.data(), load.latencies_us.size(), load.elapsed_us, load.bytes,
+                           result);
+            report.add(result);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bench_options options = {BENCH_JSON, nullptr, 8, 50, "data", nullptr};
+    int opt;
+    while ((opt = getopt(argc, argv, "f:o:c:n:p:u:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            options.format = strcmp(optarg, "csv") == 0 ? BENCH_CSV : BENCH_JSON;
+            break;
+        case 'o':
+            options.output = optarg;
+            break;
+        case 'c':
+            options.clients = strtoul(optarg, nullptr, 10);
+            break;
+        case 'n':
+            options.requests = strtoul(optarg, nullptr, 10);
+            break;
+        case 'p':
+            options.pages = optarg;
+            break;
+        case 'u':
+            options.device = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-f json|csv] [-o file] [-c clients] [-n requests] [-p dir] [-u host[:port]]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (options.clients < 1 || options.requests < 1)
+    {
+        fprintf(stderr, "clients and requests must be at least 1\n");
+        return 2;
+    }
+
+    FILE *out = options.output != nullptr ? fopen(options.output, "w") : stdout;
+    if (out == nullptr)
+    {
+        perror(options.output);
+        return 1;
+    }
+    BenchReport report(options.format, writeFile, out);
+
+    if (options.device != nullptr)
+    {
+        char host[128];
+        strlcpy(host, options.device, sizeof(host));
+        char *colon = strrchr(host, ':');
+        uint16_t port = 80;
+        if (colon != nullptr)
+        {
+            *colon = '\0';
+            port = atoi(colon + 1);
+        }
+        report.begin(host);
+        runLoad(report, host, port, options);
+        report.end();
+        if (out != stdout)
+            fclose(out);
+        return 0;
+    }
+
+    LITTLEFS.begin();
+    if (LITTLEFS.nativeImport(options.pages) == 0)
+    {
+        fprintf(stderr, "no files in %s\n", options.pages);
+        return 1;
+    }
+    loadTemplate(indexPage, "/index.html");
+    loadTemplate(configurationPage, "/configuration.html");
+    loadTemplate(graphsPage, "/graphs.html");
+    loadTemplate(indexGzip, "/index.html.gzt");
+    assets.scan();
+    seedSensors();
+
+    report.begin("native");
+    benchDecode(report);
+    benchRender(report, "index.html", indexPage, pageContext);
+    benchRender(report, "configuration.html", configurationPage, pageContext);
+    benchRender(report, "graphs.html", graphsPage, pageContext);
+    benchGzipRender(report, "index.html", indexGzip, pageContext);
+    benchConcurrentRender(report, "index.html", indexPage, pageContext);
+    benchStateJson(report, sensors, links);
+    benchRoutes(report);
+    benchAssets(report, LITTLEFS);
+
+    HttpStandin server;
+    if (server.start(handleRequest))
+    {
+        runLoad(report, "127.0.0.1", server.port(), options);
+        server.stop();
+    }
+    else
+    {
+        fprintf(stderr, "stand-in server could not listen\n");
+    }
+    report.end();
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
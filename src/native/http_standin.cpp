@@ -0,0 +1,234 @@
+#include "http_standin.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <mutex>
+
+#define HTTP_REQUEST_MAX 2048
+
+static uint32_t nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static bool sendAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+HttpStandin::HttpStandin() : m_handler(nullptr), m_listener(-1), m_port(0), m_running(false), m_served(0)
+{
+}
+
+HttpStandin::~HttpStandin()
+{
+    stop();
+}
+
+bool HttpStandin::start(http_handler handler, uint16_t port)
+{
+    m_handler = handler;
+    m_listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listener < 0)
+        return false;
+    int on = 1;
+    setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    socklen_t length = sizeof(addr);
+    if (bind(m_listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(m_listener, 64) != 0 ||
+        getsockname(m_listener, (sockaddr *)&addr, &length) != 0)
+    {
+        close(m_listener);
+        m_listener = -1;
+        return false;
+    }
+    m_port = ntohs(addr.sin_port);
+    m_running = true;
+    m_thread = std::thread(&HttpStandin::run, this);
+    return true;
+}
+
+void HttpStandin::stop()
+{
+    if (!m_running)
+        return;
+    m_running = false;
+    shutdown(m_listener, SHUT_RDWR);
+    close(m_listener);
+    m_thread.join();
+    m_listener = -1;
+}
+
+void HttpStandin::run()
+{
+    while (m_running)
+    {
+        int client = accept(m_listener, nullptr, nullptr);
+        if (client < 0)
+            continue;
+        serve(client);
+        close(client);
+    }
+}
+
+void HttpStandin::serve(int client)
+{
+    char request[HTTP_REQUEST_MAX];
+    size_t length = 0;
+    char *body = nullptr;
+    while (length < sizeof(request) - 1)
+    {
+        ssize_t received = recv(client, request + length, sizeof(request) - 1 - length, 0);
+        if (received <= 0)
+            return;
+        length += received;
+        request[length] = '\0';
+        if (body == nullptr && (body = strstr(request, "\r\n\r\n")) != nullptr)
+            body += 4;
+        // a POST is complete with its Content-Length, the header name as the clients here send it
+        const char *declared = body != nullptr ? strstr(request, "Content-Length: ") : nullptr;
+        if (body != nullptr && (declared == nullptr || declared > body ||
+                                request + length - body >= atoi(declared + sizeof("Content-Length: ") - 1)))
+            break;
+    }
+
+    http_response response = {404, "text/plain", ""};
+    bool post = strncmp(request, "POST ", 5) == 0;
+    char *path = strchr(request, ' ');
+    char *end = path != nullptr ? strchr(path + 1, ' ') : nullptr;
+    if ((strncmp(request, "GET ", 4) != 0 && !post) || end == nullptr || body == nullptr)
+    {
+        response.status = 400;
+    }
+    else
+    {
+        *end = '\0';
+        m_handler(path + 1, post ? body : "", response);
+    }
+    if (response.status == 404 && response.body.empty())
+        response.body = "Not found";
+
+    char header[160];
+    int headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+                                response.status, response.status == 200 ? "OK" : "Error", response.mime,
+                                (unsigned)response.body.size());
+    if (sendAll(client, header, headerLength))
+        sendAll(client, response.body.data(), response.body.size());
+    m_served++;
+}
+
+static bool resolveHost(const char *host, uint16_t port, sockaddr_storage &addr, socklen_t &length)
+{
+    addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &result) != 0)
+        return false;
+    memcpy(&addr, result->ai_addr, result->ai_addrlen);
+    length = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+// One request on a new connection, returns the bytes received or 0 on failure
+static size_t fetch(const sockaddr_storage &addr, socklen_t addrLength, const char *host, const char *path)
+{
+    int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0)
+        return 0;
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    timeval timeout = {10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (const sockaddr *)&addr, addrLength) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    char request[256];
+    int length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", path,
+                          host);
+    size_t total = 0;
+    if (sendAll(fd, request, length))
+    {
+        char buf[4096];
+        ssize_t received;
+        bool ok = false;
+        while ((received = recv(fd, buf, sizeof(buf), 0)) > 0)
+        {
+            // only a 200 counts as served
+            if (total == 0)
+                ok = received >= 12 && memcmp(buf + 8, " 200", 4) == 0;
+            total += received;
+        }
+        if (!ok || received < 0)
+            total = 0;
+    }
+    close(fd);
+    return total;
+}
+
+bool httpLoad(const char *host, uint16_t port, const char *path, size_t clients, size_t requests, http_load &out)
+{
+    sockaddr_storage addr;
+    socklen_t addrLength;
+    if (!resolveHost(host, port, addr, addrLength))
+        return false;
+
+    out.latencies_us.clear();
+    out.latencies_us.reserve(clients * requests);
+    out.failures = 0;
+    out.bytes = 0;
+    std::mutex lock;
+    std::vector<std::thread> threads;
+    uint32_t started = nowUs();
+    for (size_t c = 0; c < clients; c++)
+    {
+        threads.emplace_back([&]() {
+            for (size_t r = 0; r < requests; r++)
+            {
+                uint32_t sent = nowUs();
+                size_t bytes = fetch(addr, addrLength, host, path);
+                uint32_t latency = nowUs() - sent;
+                std::lock_guard<std::mutex> guard(lock);
+                if (bytes == 0)
+                {
+                    out.failures++;
+                    continue;
+                }
+                out.latencies_us.push_back(latency);
+                out.bytes = bytes;
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    out.elapsed_us = nowUs() - started;
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef HTTP_STANDIN_H
+#define HTTP_STANDIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    A local HTTP server standing in for the async web server of the device,
+    and the load generator that measures request latency against it (or
+    against a real device). Like the async_tcp task, the server handles one
+    request at a time, so concurrent clients queue the same way they do on
+    the device. Every response closes the connection. It also takes POSTs,
+    so it can play the receiver of the device's own requests. */
+
+struct http_response
+{
+    int status;
+    const char *mime;
+    std::string body;
+};
+
+// Fills the response for a GET (body empty) or POST of path (query string included)
+typedef void (*http_handler)(const char *path, const char *body, http_response &response);
+
+class HttpStandin
+{
+public:
+    HttpStandin();
+    ~HttpStandin();
+
+    // Listens on 127.0.0.1, port 0 picks a free one
+    bool start(http_handler handler, uint16_t port = 0);
+    void stop();
+    uint16_t port() const { return m_port; }
+    uint32_t served() const { return m_served; }
+
+private:
+    void run();
+    void serve(int client);
+
+    http_handler m_handler;
+    int m_listener;
+    uint16_t m_port;
+    volatile bool m_running;
+    uint32_t m_served;
+    std::thread m_thread;
+};
+
+struct http_load
+{
+    std::vector<uint32_t> latencies_us; // one per completed request
+    uint32_t elapsed_us;
+    uint32_t failures;
+    uint32_t bytes; // of the last response, headers included
+};
+
+// clients threads GET path requests times each
+bool httpLoad(const char *host, uint16_t port, const char *path, size_t clients, size_t requests, http_load &out);
+
+#endif
@@ -0,0 +1,1088 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <RH_ASK.h>
+#include <chrono>
+#include <unistd.h>
+#include "packet_decoder.h"
+#include "link_monitor.h"
+#include "sensor_registry.h"
+#include "history_store.h"
+#include "page_template.h"
+#include "gzip_template.h"
+#include "dashboard.h"
+#include "snapshot_buffer.h"
+#include "radio_receiver.h"
+#include "request_arena.h"
+#include "metrics.h"
+#include "tank_trend.h"
+#include "alert_notifier.h"
+#include "mqtt_publisher.h"
+#include "thingspeak_uploader.h"
+#include "http_sink.h"
+#include "config_store.h"
+#include "http_standin.h"
+#include "mqtt_standin.h"
+#include <atomic>
+#include <thread>
+
+/*
+    Native replay of the firmware data path: synthetic radio frames of a few
+    tanks over a number of days go through the packet decoder, the link
+    monitor, the sensor registry and the history store on the in-memory
+    LittleFS, then the history is queried, a step of a year too, and the
+    pages are rendered. Some readings are bad echoes, the filtered distance
+    must stay close to the true one and the trend must find every pump-out.
+    The same holds for the trace of a tank in test/traces, whose bad echoes
+    are known. The alerts the readings raise go to a local stand-in webhook,
+    which must receive each of them.
+    Readings are published to a local stand-in MQTT broker that goes away
+    for a while, none may be lost or come out of order. The on-flash spool
+    behind it must come back in order after a restart, without the record
+    a power cut left half written. Then readings fan out to all telemetry
+    sinks at once, each must get every one of them.
+    A sender that reboots, or comes back after a long silence, restarts its
+    sequence counter; its readings must not be taken for duplicates.
+    The settings the tanks left in the per-key layout are migrated into the
+    configuration record, which may only be written when it changed; a
+    save on another task must not change the copy the loop reads.
+    Last the receive and request paths run again in their steady state and
+    must not allocate. The program exits with 1 when a check fails. Runs on the build host with "pio run -e native -t exec" (or the
+    built program), options:
+
+      -s sensors  tanks to simulate, 1 to SENSOR_MAX (default 3)
+      -d days     days of 5 minute readings (default 30)
+      -l percent  frames lost on the air (default 2)
+      -p dir      directory with the pages (default data)
+      -t file     only run a trace through the distance filter: lines of
+                  "seconds,distance_cm[,reference_cm]", printed back with the median,
+                  the filtered distance, the filter's rate and the outlier flag as CSV.
+                  A reading more than REPLAY_TRACE_SPIKE off its reference is a bad
+                  echo; it must be dropped and the filter must stay close to the
+                  reference */
+
+#define REPLAY_START 1700000000UL // unix time of the first reading
+#define REPLAY_INTERVAL_S 300
+#define STEADY_STATE_ROUNDS 200
+#define REPLAY_SPIKE_EVERY 53 // one bad echo in this many readings, and two in a row four times as seldom
+#define REPLAY_MAX_ERROR 3.0f // cm between filtered and true distance
+#define REPLAY_TRACE "test/traces/rain_pumpout.csv"
+#define REPLAY_TRACE_SPIKE 10.0f // cm off the reference that make a reading of a trace a bad echo
+#define REPLAY_TRACE_STEP 1.0f // cm the reference moves between two readings that the filter has to catch up with
+#define REPLAY_PUMPOUT_STEPS (10 * 86400 / REPLAY_INTERVAL_S) // readings between two pump-outs of a synthetic tank
+#define REPLAY_SPOOL_PATH "/replay.spool"
+#define REPLAY_SPOOL_SLOTS 8
+#define REPLAY_ALERT_LEVEL 50 // %, every synthetic tank passes it before it is pumped out
+#define REPLAY_ALERT_BATTERY 80 // %, the synthetic battery loses 1 % a day
+#define REPLAY_DELIVERY_MS 3000 // for the notifier to empty its outbox
+#define REPLAY_MQTT_ONLINE 20 // readings published while the broker is up
+#define REPLAY_MQTT_OUTAGE 30 // and while it is down, fewer than MQTT_SPOOL_SLOTS
+#define REPLAY_FANOUT 40 // readings published to every sink
+
+struct replay_options
+{
+    size_t sensors;
+    uint32_t days;
+    uint32_t loss;
+    const char *pages;
+    const char *trace;
+    bool traceOnly; // print the trace through the filter and run nothing else
+};
+
+static SensorRegistry sensors;
+static LinkMonitor links;
+static SnapshotBuffer stateJson;
+static RH_ASK driver;
+static RadioReceiver radio(driver);
+static AlertNotifier notifier;
+static MqttPublisher mqtt(LITTLEFS);
+static ThingSpeakUploader thingspeak;
+static HttpSink influx("influx", TELEMETRY_LINE, "text/plain; charset=utf-8", HTTP_SINK_BATCH);
+static HttpSink readingHook("webhook", TELEMETRY_JSON, "application/json", 1);
+static TelemetryDispatcher telemetry;
+static std::atomic<uint32_t> influxLines(0), influxRequests(0), hookReadings(0);
+static std::atomic<uint32_t> webhookRaised(0), webhookCleared(0);
+
+static uint64_t elapsedUs(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+static void registerTank(uint8_t id)
+{
+    char depthKey[16];
+    snprintf(depthKey, sizeof(depthKey), id == 0 ? "hloubka" : "hloubka%u", id);
+    Preferences preferences;
+    preferences.begin("jimka", false);
+    preferences.putUInt(depthKey, 180 + id * 20);
+
+    tank_sensor *sensor = sensors.add(id);
+    sensor->depth = preferences.getUInt(depthKey, SENSOR_DEFAULT_DEPTH);
+    preferences.end();
+    sensor->alerts.rules.level_perc = REPLAY_ALERT_LEVEL;
+    sensor->alerts.rules.battery_perc = REPLAY_ALERT_BATTERY;
+    sensor->alerts.rules.stale_minutes = 24 * 60;
+
+    char dir[HISTORY_PATH_LEN];
+    snprintf(dir, sizeof(dir), id == 0 ? "/history" : "/history/s%u", id);
+    if (sensors.slotOf(*sensor) == 0)
+        sensor->history = new HistoryStore(LITTLEFS, dir);
+    else
+        sensor->history = new HistoryStore(LITTLEFS, dir, HISTORY_SECONDARY_LAYOUT);
+    if (!sensor->history->begin())
+        printf("history of sensor %u could not be opened\n", id);
+}
+
+// A tank that fills with rain and is pumped out every ten days
+static sensor_reading syntheticReading(uint8_t id, uint8_t seq, uint32_t step)
+{
+    uint32_t day = step * REPLAY_INTERVAL_S / 86400;
+    uint32_t sinceEmptied = step % REPLAY_PUMPOUT_STEPS;
+    sensor_reading reading;
+    memset(&reading, 0, sizeof(reading));
+    reading.sensor_id = id;
+    reading.seq = seq;
+    reading.has_seq = true;
+    reading.distance = 190 - (sinceEmptied * 120) / REPLAY_PUMPOUT_STEPS + id * 5;
+    reading.temperature = 12.0f + 6.0f * sinf(step * REPLAY_INTERVAL_S * 2 * M_PI / 86400);
+    reading.humidity = 60.0f + (day % 7) * 4.5f;
+    reading.batt_perc = 100 - day % 100;
+    reading.batt_voltage = 3.0f + reading.batt_perc / 100.0f * 1.2f;
+    return reading;
+}
+
+static bool replay(const replay_options &options)
+{
+    uint32_t steps = options.days * 86400 / REPLAY_INTERVAL_S;
+    uint32_t decoded = 0, rejected = 0, duplicates = 0, lost = 0, spikes = 0, passed = 0;
+    float maxError = 0;
+    // good readings since the last pump-out, the filter follows once they are half its window
+    uint32_t settled[SENSOR_MAX] = {0};
+    uint32_t lastTruth[SENSOR_MAX] = {0};
+    uint64_t decodeUs = 0, stateUs = 0, historyUs = 0;
+    uint32_t seed = 1;
+
+    for (uint32_t step = 0; step < steps; step++)
+    {
+        for (size_t s = 0; s < options.sensors; s++)
+        {
+            uint8_t frame[RH_ASK_MAX_MESSAGE_LEN];
+            sensor_reading sent = syntheticReading(s, step, step);
+            uint32_t truth = sent.distance;
+            if (truth > lastTruth[s] + FILTER_RESET_DISTANCE)
+                settled[s] = 0;
+            lastTruth[s] = truth;
+            seed = seed * 1103515245 + 12345;
+            // foam or condensation: an echo well above the surface
+            uint32_t phase = (step + s * 17) % (4 * REPLAY_SPIKE_EVERY);
+            bool spike = step > 0 && (phase % REPLAY_SPIKE_EVERY == 0 || phase == REPLAY_SPIKE_EVERY / 2 ||
+                                      phase == REPLAY_SPIKE_EVERY / 2 + 1);
+            if (spike)
+            {
+                sent.distance = sent.distance / 3;
+                spikes++;
+            }
+            size_t length = encodePacketV2(sent, frame, sizeof(frame));
+            if ((seed >> 16) % 100 < options.loss)
+            {
+                lost++;
+                continue;
+            }
+            // the sensor repeats a frame now and then, the link monitor drops the copy
+            int copies = (seed >> 8) % 97 == 0 ? 2 : 1;
+            for (int copy = 0; copy < copies; copy++)
+            {
+                auto started = std::chrono::steady_clock::now();
+                sensor_reading reading;
+                packet_status status = decodePacket(frame, length, reading);
+                decodeUs += elapsedUs(started);
+                if (status != PACKET_OK)
+                {
+                    rejected++;
+                    continue;
+                }
+                decoded++;
+                uint32_t arrivalMs = step * REPLAY_INTERVAL_S * 1000UL + s * 700;
+                link_event event = links.update(reading.sensor_id, reading.has_seq, reading.seq, arrivalMs);
+                if (event == LINK_DUPLICATE)
+                    duplicates++;
+                if (event == LINK_DUPLICATE || event == LINK_LATE)
+                    continue;
+
+                tank_sensor *sensor = sensors.find(reading.sensor_id);
+                if (sensor == nullptr)
+                {
+                    registerTank(reading.sensor_id);
+                    sensor = sensors.find(reading.sensor_id);
+                }
+                SensorRegistry::apply(*sensor, reading, arrivalMs, step * REPLAY_INTERVAL_S / 60);
+                trendUpdate(sensor->trend, REPLAY_START + step * REPLAY_INTERVAL_S, sensor->level, sensor->depth);
+                alert_event events[ALERT_KINDS];
+                size_t raised = alertReading(*sensor, arrivalMs, events);
+                for (size_t i = 0; i < raised; i++)
+                    notifier.enqueue(events[i]);
+                if (spike && !sensor->filter.outlier)
+                    passed++;
+                if (!spike)
+                    settled[s]++;
+                float error = fabsf(sensor->filter.distance - truth);
+                if (settled[s] > FILTER_WINDOW / 2 && error > maxError)
+                    maxError = error;
+
+                started = std::chrono::steady_clock::now();
+                stateJson.commit(writeStateJson(sensors, links, stateJson.begin(), stateJson.capacity()));
+                stateUs += elapsedUs(started);
+
+                history_sample sample;
+                sample.time = REPLAY_START + step * REPLAY_INTERVAL_S;
+                sample.level_mm = sensor->level * 10;
+                sample.temperature = round(sensor->temperature * 100);
+                sample.humidity = round(sensor->humidity * 100);
+                sample.batt_mv = round(sensor->batt_voltage * 1000);
+                started = std::chrono::steady_clock::now();
+                sensor->history->append(sample);
+                historyUs += elapsedUs(started);
+            }
+        }
+    }
+    for (size_t i = 0; i < sensors.count(); i++)
+        sensors.at(i).history->flush();
+
+    printf("replay: %u steps, %u frames decoded, %u rejected, %u duplicates, %u lost on the air\n", (unsigned)steps,
+           (unsigned)decoded, (unsigned)rejected, (unsigned)duplicates, (unsigned)lost);
+    printf("  decode %.3f us/frame, state json %.3f us/update (%u bytes), history append %.3f us/sample\n",
+           decoded ? (double)decodeUs / decoded : 0.0, decoded ? (double)stateUs / decoded : 0.0,
+           (unsigned)stateJson.length(), decoded ? (double)historyUs / decoded : 0.0);
+    for (size_t i = 0; i < links.count(); i++)
+    {
+        const link_stats &link = links.at(i);
+        printf("  link %u: received %u, lost %u (%.1f %%), duplicates %u, quality %u\n", link.sensor_id,
+               (unsigned)link.received, (unsigned)link.lost, LinkMonitor::lossPercent(link),
+               (unsigned)link.duplicates, link.quality);
+    }
+    uint32_t outliers = 0, resets = 0;
+    for (size_t i = 0; i < sensors.count(); i++)
+    {
+        outliers += sensors.at(i).filter.outliers;
+        resets += sensors.at(i).filter.resets;
+    }
+    printf("  filter: %u bad echoes sent, %u let through, %u outliers, %u restarts, worst error %.2f cm\n",
+           (unsigned)spikes, (unsigned)passed, (unsigned)outliers, (unsigned)resets, maxError);
+    // the synthetic tanks fill 12 cm a day and are pumped out every REPLAY_PUMPOUT_STEPS
+    uint32_t pumpouts = (steps - 1) / REPLAY_PUMPOUT_STEPS;
+    bool trendsFound = true;
+    for (size_t i = 0; i < sensors.count(); i++)
+    {
+        const tank_trend &trend = sensors.at(i).trend;
+        printf("  trend %u: %.2f cm/day, full in %.1f days, emptied %.1f days ago, %u of %u pump-outs\n",
+               sensors.at(i).id, trend.rate, trend.days_to_full, trend.days_since_emptied, (unsigned)trend.pumpouts,
+               (unsigned)pumpouts);
+        trendsFound = trendsFound && trend.pumpouts == pumpouts;
+    }
+    printf("  filesystem: %u bytes used\n", (unsigned)LITTLEFS.usedBytes());
+    return passed == 0 && maxError <= REPLAY_MAX_ERROR && trendsFound;
+}
+
+// A trace through the filter alone, CSV on stdout when print is set
+static bool replayTrace(const char *path, bool print)
+{
+    FILE *file = fopen(path, "r");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "trace %s could not be opened\n", path);
+        return false;
+    }
+    distance_filter filter;
+    memset(&filter, 0, sizeof(filter));
+    if (print)
+        printf("seconds,distance,median,filtered,filter_rate,outlier\n");
+    uint32_t spikes = 0, passed = 0, settled = 0;
+    float lastReference = 0, maxError = 0;
+    char line[64];
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        unsigned long seconds, distance;
+        float reference;
+        int fields = sscanf(line, "%lu,%lu,%f", &seconds, &distance, &reference);
+        if (fields < 2)
+            continue; // header or comment
+        float filtered = filterDistance(filter, distance, seconds * 1000UL);
+        if (print)
+            printf("%lu,%lu,%.1f,%.2f,%.2f,%d\n", seconds, distance, filter.median, filtered,
+                   filterFillRate(filter), filter.outlier ? 1 : 0);
+        if (fields < 3)
+            continue;
+        // good readings since the reference last moved faster than the filter follows
+        if (fabsf(reference - lastReference) > REPLAY_TRACE_STEP)
+            settled = 0;
+        lastReference = reference;
+        bool spike = fabsf(distance - reference) > REPLAY_TRACE_SPIKE;
+        if (spike)
+            spikes++;
+        if (spike && !filter.outlier)
+            passed++;
+        if (!spike)
+            settled++;
+        float error = fabsf(filtered - reference);
+        if (settled > FILTER_WINDOW / 2 && error > maxError)
+            maxError = error;
+    }
+    fclose(file);
+    fprintf(print ? stderr : stdout, "trace %s: %u readings, %u bad echoes, %u let through, %u outliers, "
+            "%u restarts, worst error %.2f cm\n", path, (unsigned)filter.samples, (unsigned)spikes, (unsigned)passed,
+            (unsigned)filter.outliers, (unsigned)filter.resets, maxError);
+    return filter.samples > 0 && passed == 0 && maxError <= REPLAY_MAX_ERROR;
+}
+
+static void queryHistory(const replay_options &options)
+{
+    uint32_t to = REPLAY_START + options.days * 86400;
+    const uint32_t ranges[] = {86400, 7 * 86400, options.days * 86400};
+    for (size_t i = 0; i < sensors.count(); i++)
+    {
+        tank_sensor &sensor = sensors.at(i);
+        history_stats stats = sensor.history->stats();
+        printf("history %u: %u appended, %u rejected, %u blocks written, %u rollup writes\n", sensor.id,
+               (unsigned)stats.appended, (unsigned)stats.rejected, (unsigned)stats.blocks_written,
+               (unsigned)stats.rollup_writes);
+        for (uint32_t range : ranges)
+        {
+            uint32_t step = range / HISTORY_DEFAULT_POINTS;
+            auto started = std::chrono::steady_clock::now();
+            HistoryQuery query(*sensor.history, to - range, to, step);
+            uint8_t chunk[1024];
+            size_t bytes = 0, length;
+            while ((length = query.readJson(chunk, sizeof(chunk))) > 0)
+                bytes += length;
+            printf("  last %3u days, step %5u s: resolution %5u s, %6u bytes in %.2f ms\n",
+                   (unsigned)(range / 86400), (unsigned)step, (unsigned)query.resolution(), (unsigned)bytes,
+                   elapsedUs(started) / 1000.0);
+        }
+    }
+}
+
+// A query step of a year at a reading a minute merges more samples than a stored bucket counts
+static bool longStep()
+{
+    history_sample sample = {REPLAY_START, 1500, 2150, 9500, 4100};
+    history_bucket day;
+    bucketInit(day, REPLAY_START);
+    for (int minute = 0; minute < 1440; minute++)
+        bucketAdd(day, sample);
+    history_span year;
+    spanInit(year, REPLAY_START);
+    for (int i = 0; i < 366; i++)
+        bucketMerge(year, day);
+    bool ok = year.count == 366 * 1440 && year.level_sum / year.count == sample.level_mm &&
+              year.temperature_sum / year.count == sample.temperature &&
+              year.humidity_sum / year.count == sample.humidity && year.batt_sum / year.count == sample.batt_mv;
+    printf("  a year in one step: %u samples, averages %s\n", (unsigned)year.count, ok ? "ok" : "WRONG");
+    return ok;
+}
+
+static bool loadPage(PageTemplate &page, const char *dir, const char *name)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+    fseek(file, 0, SEEK_END);
+    size_t size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = (char *)malloc(size);
+    if (text == nullptr || fread(text, 1, size, file) != size)
+    {
+        free(text);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+    return page.parse(text, size);
+}
+
+static dashboard_context renderContext;
+
+static size_t resolve(uint8_t var, char *buf, size_t size)
+{
+    return dashboardValue(var, renderContext, buf, size);
+}
+
+static void count(void *ctx, const char *data, size_t len)
+{
+    *static_cast<size_t *>(ctx) += len;
+}
+
+static void renderPages(const replay_options &options)
+{
+    static const char *pages[] = {"index.html", "graphs.html", "configuration.html"};
+    renderContext.links = &links;
+    renderContext.thingspeak_api = "XXXXXXXXXXXXXXXX";
+    renderContext.thingspeak_channel = 123456;
+    renderContext.duckdns_domain = "tank";
+    renderContext.duckdns_token = "token";
+    renderContext.alert_url = "http://192.168.1.10/alert";
+    renderContext.mqtt_host = "192.168.1.10";
+    renderContext.mqtt_port = 1883;
+    renderContext.mqtt_user = "jimka";
+    renderContext.sinks = TELEMETRY_ALL;
+    renderContext.influx_url = "http://192.168.1.10:8086/api/v2/write?org=home&bucket=jimka";
+    renderContext.influx_token = "token";
+    renderContext.webhook_url = "http://192.168.1.10/reading";
+    renderContext.uptime_s = options.days * 86400;
+
+    for (const char *name : pages)
+    {
+        PageTemplate page;
+        if (!loadPage(page, options.pages, name))
+        {
+            printf("page %s/%s could not be loaded\n", options.pages, name);
+            continue;
+        }
+        for (size_t i = 0; i < sensors.count(); i++)
+        {
+            renderContext.sensor = &sensors.at(i);
+            const int rounds = 1000;
+            size_t bytes = 0;
+            auto started = std::chrono::steady_clock::now();
+            for (int r = 0; r < rounds; r++)
+                page.render(resolve, count, &bytes);
+            printf("page %s, sensor %u: %u segments, %u bytes, %.2f us/render\n", name, sensors.at(i).id,
+                   (unsigned)page.segmentCount(), (unsigned)(bytes / rounds), (double)elapsedUs(started) / rounds);
+        }
+    }
+}
+
+// Allocations of one receive, a reading whose append wrote to flash is left out (the filesystem allocates)
+static bool receiveAllocations(uint32_t step, size_t s, uint32_t &allocations)
+{
+    uint8_t frame[RH_ASK_MAX_MESSAGE_LEN];
+    size_t length = encodePacketV2(syntheticReading(s, step, step), frame, sizeof(frame));
+    tank_sensor *sensor = sensors.find(s);
+    history_stats before = sensor->history->stats();
+
+    uint32_t started = nativeAllocations();
+    sensor_reading reading;
+    if (decodePacket(frame, length, reading) != PACKET_OK)
+        return false;
+    uint32_t arrivalMs = step * REPLAY_INTERVAL_S * 1000UL + s * 700;
+    links.update(reading.sensor_id, reading.has_seq, reading.seq, arrivalMs);
+    SensorRegistry::apply(*sensor, reading, arrivalMs, step * REPLAY_INTERVAL_S / 60);
+    trendUpdate(sensor->trend, REPLAY_START + step * REPLAY_INTERVAL_S, sensor->level, sensor->depth);
+    alert_event events[ALERT_KINDS];
+    alertReading(*sensor, arrivalMs, events);
+    stateJson.commit(writeStateJson(sensors, links, stateJson.begin(), stateJson.capacity()));
+    history_sample sample;
+    sample.time = REPLAY_START + step * REPLAY_INTERVAL_S;
+    sample.level_mm = sensor->level * 10;
+    sample.temperature = round(sensor->temperature * 100);
+    sample.humidity = round(sensor->humidity * 100);
+    sample.batt_mv = round(sensor->batt_voltage * 1000);
+    sensor->history->append(sample);
+    allocations = nativeAllocations() - started;
+
+    history_stats after = sensor->history->stats();
+    return after.blocks_written == before.blocks_written && after.rollup_writes == before.rollup_writes &&
+           after.checkpoints == before.checkpoints;
+}
+
+static size_t drainHistory(HistoryStore &history, uint32_t from, uint32_t to, uint32_t step)
+{
+    ArenaLease arena = ArenaLease::acquire();
+    HistoryQuery *query = arena ? arena->make<HistoryQuery>(history, from, to, step, &*arena) : nullptr;
+    if (query == nullptr)
+        return 0;
+    uint8_t chunk[1024];
+    size_t bytes = 0, length;
+    while ((length = query->readJson(chunk, sizeof(chunk))) > 0)
+        bytes += length;
+    return bytes;
+}
+
+static size_t drainPage(const PageTemplate &page)
+{
+    ArenaLease arena = ArenaLease::acquire(sizeof(TemplateStream));
+    TemplateStream *stream = arena ? arena->make<TemplateStream>(page, resolve) : nullptr;
+    if (stream == nullptr)
+        return 0;
+    uint8_t chunk[1436];
+    size_t bytes = 0, length;
+    while ((length = stream->read(chunk, sizeof(chunk))) > 0)
+        bytes += length;
+    return bytes;
+}
+
+static size_t drainMetrics()
+{
+    metrics_snapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    ArenaLease arena = ArenaLease::acquire(sizeof(MetricsExport));
+    MetricsExport *metrics = arena ? arena->make<MetricsExport>(snapshot) : nullptr;
+    if (metrics == nullptr)
+        return 0;
+    uint8_t chunk[1024];
+    size_t bytes = 0, length;
+    while ((length = metrics->readText(chunk, sizeof(chunk))) > 0)
+        bytes += length;
+    return bytes;
+}
+
+// The hot paths once everything is set up: no allocation may happen per reading or per request
+static bool steadyState(const replay_options &options)
+{
+    uint32_t firstStep = options.days * 86400 / REPLAY_INTERVAL_S;
+    uint32_t receiveAllocs = 0, measured = 0;
+    for (uint32_t step = firstStep; step < firstStep + STEADY_STATE_ROUNDS; step++)
+    {
+        for (size_t s = 0; s < options.sensors; s++)
+        {
+            uint32_t allocations;
+            if (receiveAllocations(step, s, allocations))
+            {
+                receiveAllocs += allocations;
+                measured++;
+            }
+        }
+    }
+
+    PageTemplate page;
+    bool rendered = loadPage(page, options.pages, "index.html");
+    renderContext.sensor = &sensors.at(0);
+    HistoryStore &history = *sensors.at(0).history;
+    uint32_t to = REPLAY_START + firstStep * REPLAY_INTERVAL_S;
+    uint32_t requestAllocs = 0, fileAllocs = 0;
+    size_t bytes = 0;
+    for (uint32_t r = 0; r < STEADY_STATE_ROUNDS; r++)
+    {
+        uint32_t started = nativeAllocations();
+        if (rendered)
+            bytes += drainPage(page);
+        char json[SNAPSHOT_BUFFER_SIZE];
+        bytes += writeStateJson(sensors, links, json, sizeof(json));
+        // a day of raw records, they are still in the head block
+        bytes += drainHistory(history, to - 86400, to, 0);
+        bytes += drainMetrics();
+        requestAllocs += nativeAllocations() - started;
+
+        // the hourly tier is read from flash, the filesystem allocates for every file it opens
+        started = nativeAllocations();
+        bytes += drainHistory(history, to - options.days * 86400, to, 3600);
+        fileAllocs += nativeAllocations() - started;
+    }
+
+    request_arena_stats arena = ArenaLease::stats();
+    printf("steady state: %u allocations in %u receives, %u allocations in %u requests (%u bytes), arena high "
+           "water %u of %u bytes\n",
+           (unsigned)receiveAllocs, (unsigned)measured, (unsigned)requestAllocs, (unsigned)STEADY_STATE_ROUNDS,
+           (unsigned)bytes, (unsigned)arena.high_water, (unsigned)REQUEST_ARENA_SIZE);
+    printf("  %.1f filesystem allocations per query of the rollup tier\n", (double)fileAllocs / STEADY_STATE_ROUNDS);
+    return receiveAllocs == 0 && requestAllocs == 0 && arena.exhausted == 0;
+}
+
+// The webhook receiver, counts what the notifier delivered
+static void handleWebhook(const char *path, const char *body, http_response &response)
+{
+    // the telemetry sinks post here too: line protocol to /write, readings to /reading
+    if (strcmp(path, "/write") == 0)
+    {
+        influxRequests++;
+        for (const char *line = body; line != nullptr; line = strchr(line + 1, '\n'))
+            influxLines += strncmp(line + (*line == '\n'), "tank,sensor=", 12) == 0;
+        response.status = 204;
+        return;
+    }
+    if (strcmp(path, "/reading") == 0)
+    {
+        hookReadings += strstr(body, "\"distance\":") != nullptr;
+        response.status = 200;
+        return;
+    }
+    if (strcmp(path, "/alert") != 0 || strstr(body, "\"device\":\"jimka\"") == nullptr)
+        return;
+    if (strstr(body, "\"state\":\"raised\"") != nullptr)
+        webhookRaised++;
+    else
+        webhookCleared++;
+    response.status = 200;
+    response.body = "ok";
+}
+
+// Every alert the replay raised or cleared must reach the stand-in, a full tank once per fill
+static bool checkAlerts(uint32_t started)
+{
+    uint32_t raised = 0, cleared = 0, suppressed = 0;
+    bool consistent = true;
+    for (size_t i = 0; i < sensors.count(); i++)
+    {
+        const tank_sensor &sensor = sensors.at(i);
+        uint32_t active = 0;
+        for (size_t kind = 0; kind < ALERT_KINDS; kind++)
+            active += sensor.alerts.state[kind].active;
+        raised += sensor.alerts.raised;
+        cleared += sensor.alerts.cleared;
+        suppressed += sensor.alerts.suppressed;
+        consistent = consistent && sensor.alerts.raised == sensor.alerts.cleared + active;
+    }
+    while (webhookRaised + webhookCleared < raised + cleared - suppressed * 2 &&
+           millis() - started < REPLAY_DELIVERY_MS)
+        delay(10);
+
+    notifier_stats stats = notifier.stats();
+    printf("alerts: %u raised, %u cleared, %u suppressed; webhook got %u raised, %u cleared, %u rejected, %u "
+           "failures\n",
+           (unsigned)raised, (unsigned)cleared, (unsigned)suppressed, (unsigned)webhookRaised.load(),
+           (unsigned)webhookCleared.load(), (unsigned)stats.rejected, (unsigned)stats.failures);
+    return consistent && suppressed == 0 && stats.rejected == 0 && webhookRaised == raised &&
+           webhookCleared == cleared;
+}
+
+// Waits up to REPLAY_DELIVERY_MS for the condition
+template <typename Condition> static bool waitFor(Condition condition)
+{
+    uint32_t started = millis();
+    while (!condition())
+    {
+        if (millis() - started >= REPLAY_DELIVERY_MS)
+            return false;
+        delay(5);
+    }
+    return true;
+}
+
+// Hands a reading of a tank to the publisher, its distance numbers the readings
+static telemetry_reading numberedReading(uint32_t number)
+{
+    size_t index = number % sensors.count();
+    const tank_sensor &sensor = sensors.at(index);
+    telemetry_reading reading;
+    reading.sensor_id = sensor.id;
+    reading.index = index;
+    reading.time = REPLAY_START + number * REPLAY_INTERVAL_S;
+    reading.queued_ms = millis();
+    reading.level = sensor.level;
+    reading.fill_perc = sensor.fill_perc;
+    reading.distance = number;
+    reading.temperature = sensor.temperature;
+    reading.humidity = sensor.humidity;
+    reading.batt_perc = sensor.batt_perc;
+    reading.batt_voltage = sensor.batt_voltage;
+    reading.fill_rate = sensor.trend.rate;
+    return reading;
+}
+
+static bool publishNumbered(uint32_t number)
+{
+    telemetry_reading reading = numberedReading(number);
+    char json[TELEMETRY_TEXT_LEN];
+    telemetry_payload payload = {&reading, json, telemetryJson(reading, json, sizeof(json))};
+    uint32_t queued = mqtt.stats().queued;
+    // paced, the task takes what the loop hands over before the next one comes
+    return mqtt.offer(payload) && waitFor([&] { return mqtt.stats().queued > queued; });
+}
+
+// Readings go out while the broker is up, queue on flash while it is down and follow once it is back:
+// every one arrives once and in order, discovery once per tank since the broker kept the session
+static bool mqttSession()
+{
+    MqttStandin broker;
+    if (!broker.start())
+    {
+        printf("mqtt: stand-in broker could not listen\n");
+        return false;
+    }
+    mqtt.configure("127.0.0.1", broker.port(), "", "", "jimka");
+    bool ok = mqtt.begin() && waitFor([] { return mqtt.stats().connected != 0; });
+
+    uint32_t number = 0;
+    for (; ok && number < REPLAY_MQTT_ONLINE; number++)
+        ok = publishNumbered(number);
+    ok = ok && waitFor([] { return mqtt.stats().acked >= REPLAY_MQTT_ONLINE + 1 + sensors.count() * 8; });
+
+    broker.stop();
+    for (; ok && number < REPLAY_MQTT_ONLINE + REPLAY_MQTT_OUTAGE; number++)
+        ok = publishNumbered(number);
+    alert_event event = {millis(), sensors.at(0).id, ALERT_STALE, true, 1440, 1440};
+    ok = ok && mqtt.publishAlert(event) &&
+         waitFor([] { return mqtt.stats().connected == 0 && mqtt.stats().spool_depth == REPLAY_MQTT_OUTAGE + 1; });
+    // what waits on flash is there for the next boot too
+    FlashQueue spool(LITTLEFS, MQTT_SPOOL_PATH, MQTT_SPOOL_SLOT_SIZE, MQTT_SPOOL_SLOTS);
+    bool persisted = spool.begin() && spool.count() == REPLAY_MQTT_OUTAGE + 1;
+
+    // back on the same port; skip the backoff, the next reading wakes the task
+    ok = ok && broker.start(broker.port());
+    nativeAdvanceMillis(MQTT_BACKOFF_MAX_MS);
+    ok = ok && publishNumbered(number++) && waitFor([&] {
+             mqtt_stats stats = mqtt.stats();
+             return stats.spool_depth == 0 && stats.pending == 0 && stats.acked >= stats.published;
+         });
+
+    uint32_t states = 0, discovery = 0, online = 0, alerts = 0;
+    bool ordered = true;
+    for (const mqtt_received &message : broker.messages())
+    {
+        if (message.topic.compare(0, strlen(MQTT_DISCOVERY_PREFIX "/"), MQTT_DISCOVERY_PREFIX "/") == 0)
+            discovery++;
+        else if (message.topic == MQTT_BASE_TOPIC "/status")
+            online += message.payload == "online";
+        else if (message.topic.find("/alert") != std::string::npos)
+            alerts++;
+        else if (message.topic.find("/state") != std::string::npos)
+        {
+            const char *distance = strstr(message.payload.c_str(), "\"distance\":");
+            ordered = ordered && message.retain && distance != nullptr && strtoul(distance + 11, nullptr, 10) == states;
+            states++;
+        }
+    }
+    broker.stop();
+    mqtt.configure("", 0, "", "", "");
+
+    mqtt_stats stats = mqtt.stats();
+    printf("mqtt: %u of %u readings arrived in order, %u discovery, %u alerts, %u online; %u spooled, %u dropped, "
+           "%u connects (%u resumed), %u rejected\n",
+           (unsigned)states, (unsigned)number, (unsigned)discovery, (unsigned)alerts, (unsigned)online,
+           (unsigned)stats.spooled, (unsigned)stats.spool_dropped, (unsigned)broker.connects(),
+           (unsigned)broker.resumed(), (unsigned)stats.rejected);
+    return ok && persisted && ordered && states == number && discovery == sensors.count() * 8 && alerts == 1 &&
+           online == 2 && broker.resumed() == 1 && stats.spool_dropped == 0 && stats.rejected == 0;
+}
+
+// The spool of an older firmware was a single file; the ring wraps, acknowledged records stay gone across a
+// restart and the record a power cut cut short is removed rather than read back
+static bool spoolRecovery()
+{
+    File old = LITTLEFS.open(REPLAY_SPOOL_PATH, "w");
+    old.write((const uint8_t *)"FQQ1", 4);
+    old.close();
+
+    FlashQueue spool(LITTLEFS, REPLAY_SPOOL_PATH, 64, REPLAY_SPOOL_SLOTS);
+    bool ok = spool.begin() && spool.count() == 0;
+    uint32_t number = 0;
+    for (; ok && number < REPLAY_SPOOL_SLOTS + 3; number++)
+        ok = spool.push(&number, sizeof(number));
+    ok = ok && spool.pop() && spool.pop();
+
+    // the power went while the next record was written, its file has the header but not the data
+    char cut[32];
+    snprintf(cut, sizeof(cut), REPLAY_SPOOL_PATH "/%02u", (unsigned)(number % REPLAY_SPOOL_SLOTS));
+    File file = LITTLEFS.open(cut, "w");
+    ok = ok && file && file.write((const uint8_t *)"FQQ2", 4) == 4;
+    file.close();
+
+    FlashQueue restarted(LITTLEFS, REPLAY_SPOOL_PATH, 64, REPLAY_SPOOL_SLOTS);
+    ok = ok && restarted.begin() && !LITTLEFS.exists(cut);
+    uint32_t expected = 5, back = 0, record;
+    while (ok && restarted.peek(&record, sizeof(record)) == sizeof(record) && record == expected++)
+    {
+        back++;
+        ok = restarted.pop();
+    }
+    printf("spool: %u of %u records back in order after a restart, %u dropped while full\n", (unsigned)back,
+           (unsigned)(number - 5), (unsigned)spool.stats().dropped);
+    return ok && back == number - 5 && restarted.count() == 0 && spool.stats().dropped == 3;
+}
+
+static uint32_t brokerStates(MqttStandin &broker)
+{
+    uint32_t states = 0;
+    for (const mqtt_received &message : broker.messages())
+        states += message.topic.find("/state") != std::string::npos;
+    return states;
+}
+
+// Every reading reaches every enabled sink, each format is serialized once however many sinks take it
+static bool sinkFanOut(uint16_t port)
+{
+    MqttStandin broker;
+    if (!broker.start())
+        return false;
+    mqtt.configure("127.0.0.1", broker.port(), "", "", "jimka");
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/write", port);
+    influx.configure(url, "Token replay");
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/reading", port);
+    readingHook.configure(url, "");
+    thingspeak.configure(123456, "XXXXXXXXXXXXXXXX");
+    telemetry.add(SINK_THINGSPEAK, thingspeak);
+    telemetry.add(SINK_MQTT, mqtt);
+    telemetry.add(SINK_INFLUX, influx);
+    telemetry.add(SINK_WEBHOOK, readingHook);
+    bool ok = thingspeak.begin() && influx.begin() && readingHook.begin() &&
+              waitFor([] { return mqtt.stats().connected != 0; });
+
+    // in bursts the queues of the sinks hold, then every sink catches up
+    uint32_t number = 0;
+    while (ok && number < REPLAY_FANOUT)
+    {
+        for (size_t i = 0; i < HTTP_SINK_QUEUE && number < REPLAY_FANOUT; i++)
+            telemetry.publish(numberedReading(number++));
+        ok = waitFor([&] { return influxLines == number && hookReadings == number && brokerStates(broker) == number; });
+    }
+    // switched off, influx gets nothing more and the line format is not even produced
+    telemetry.setEnabled(TELEMETRY_ALL & ~(1 << SINK_INFLUX));
+    for (size_t i = 0; i < 4; i++)
+        telemetry.publish(numberedReading(number++));
+    ok = ok && waitFor([&] { return hookReadings == number && brokerStates(broker) == number; });
+    telemetry.setEnabled(TELEMETRY_ALL);
+
+    bool complete = true;
+    for (uint8_t slot = 0; slot < TELEMETRY_SINKS; slot++)
+    {
+        sink_stats stats = telemetry.stats(slot);
+        uint32_t expected = slot == SINK_INFLUX ? REPLAY_FANOUT : number;
+        printf("sink %s (%s): %u offered, %u rejected, %u delivered, %u failures, %u backlog\n",
+               telemetry.sink(slot)->name(), telemetryFormatName(telemetry.sink(slot)->format()),
+               (unsigned)stats.offered, (unsigned)stats.rejected, (unsigned)stats.delivered, (unsigned)stats.failures,
+               (unsigned)stats.backlog);
+        // ThingSpeak takes an update per THINGSPEAK_INTERVAL_MS, a burst like this one overflows its queue;
+        // every update holds all tanks, so a rejected one only loses an intermediate state
+        complete = complete && stats.offered == expected && (stats.rejected == 0 || slot == SINK_THINGSPEAK);
+    }
+    printf("sinks: %u json and %u line serializations for %u readings, influx got %u lines in %u requests\n",
+           (unsigned)telemetry.serialized(TELEMETRY_JSON), (unsigned)telemetry.serialized(TELEMETRY_LINE),
+           (unsigned)number, (unsigned)influxLines.load(), (unsigned)influxRequests.load());
+
+    mqtt.configure("", 0, "", "", "");
+    broker.stop();
+    return ok && complete && telemetry.serialized(TELEMETRY_JSON) == number &&
+           telemetry.serialized(TELEMETRY_LINE) == REPLAY_FANOUT && influxLines == REPLAY_FANOUT;
+}
+
+static bool skipped(link_event event)
+{
+    return event == LINK_DUPLICATE || event == LINK_LATE;
+}
+
+// A sensor that reboots counts from 0 again: its next frames are a restart, not repeats or late frames of what
+// came before
+static bool senderReboot()
+{
+    LinkMonitor monitor;
+    const uint32_t interval = REPLAY_INTERVAL_S * 1000UL;
+    uint32_t now = 0, dropped = 0;
+    uint8_t seq = 0;
+    for (; seq <= 50; seq++, now += interval)
+        dropped += skipped(monitor.update(7, true, seq, now));
+    // the sensor repeats its last frame right away, that copy is a duplicate
+    bool repeat = monitor.update(7, true, seq - 1, now - interval + 200) == LINK_DUPLICATE;
+    // the next frame overtakes the one before it on the way, which comes in right behind it and is late
+    dropped += skipped(monitor.update(7, true, seq + 1, now));
+    bool late = monitor.update(7, true, seq, now + 200) == LINK_LATE;
+    now += 2 * interval;
+
+    // rebooted, 52 steps back; then again right after a few frames, within the window of the last ones
+    bool restarted = monitor.update(7, true, 0, now) == LINK_RESTART;
+    for (seq = 1; seq <= 10; seq++)
+        dropped += skipped(monitor.update(7, true, seq, now += interval));
+    restarted = restarted && monitor.update(7, true, 0, now += interval) == LINK_RESTART;
+    dropped += skipped(monitor.update(7, true, 1, now += interval));
+    dropped += skipped(monitor.update(7, true, 3, now += 2 * interval)); // 2 was lost on the way
+    // and again, with 0 and 1 lost: the first frame heard is 2, one step back and never seen, yet not late
+    restarted = restarted && monitor.update(7, true, 2, now += 3 * interval) == LINK_RESTART;
+
+    // out of range for a day, the counter went round meanwhile and comes back where it was
+    now += 86400UL * 1000;
+    restarted = restarted && monitor.update(7, true, 2, now) == LINK_RESTART;
+    dropped += skipped(monitor.update(7, true, 3, now += interval));
+
+    const link_stats &link = *monitor.find(7);
+    printf("link: %u restarts, %u duplicates, %u late, %u readings dropped, %u lost, quality %u\n",
+           (unsigned)link.restarts, (unsigned)link.duplicates, (unsigned)link.reordered, (unsigned)dropped,
+           (unsigned)link.lost, link.quality);
+    return repeat && late && restarted && dropped == 0 && link.restarts == 4 && link.duplicates == 1 &&
+           link.reordered == 1 && link.lost == 1;
+}
+
+// The per-key settings move into the record once; commits that change nothing never reach flash, a burst of
+// changes is one write, and a damaged or older record is caught when it is read back
+static bool configStore()
+{
+    Preferences preferences;
+    preferences.begin(CONFIG_NAMESPACE, false);
+    uint8_t ids[SENSOR_MAX];
+    for (size_t i = 0; i < sensors.count(); i++)
+        ids[i] = sensors.at(i).id;
+    const tank_sensor &last = sensors.at(sensors.count() - 1);
+    char key[16];
+    snprintf(key, sizeof(key), last.id == 0 ? "alarm" : "alarm%u", last.id);
+    alert_rules rules = {60, 25, 3300, 90};
+    preferences.putBytes("sensors", ids, sensors.count());
+    preferences.putBytes(key, &rules, sizeof(rules));
+    preferences.putString("mqttHost", "broker.local");
+    preferences.putUShort("mqttPort", 8883);
+    preferences.putString("influxToken", "replay-token");
+    preferences.putUChar("sinks", 1 << SINK_MQTT);
+    preferences.end();
+
+    ConfigStore store;
+    bool ok = store.begin() && store.stats().source == CONFIG_MIGRATED && store.stats().lifetime_writes == 1;
+    const jimka_config &config = store.get();
+    ok = ok && config.tank_count == sensors.count() && strcmp(config.mqtt_host, "broker.local") == 0 &&
+         config.mqtt_port == 8883 && strcmp(config.influx_token, "replay-token") == 0 &&
+         config.sinks == 1 << SINK_MQTT &&
+         memcmp(&config.tanks[sensors.count() - 1].alerts, &rules, sizeof(rules)) == 0;
+    for (size_t i = 0; ok && i < sensors.count(); i++)
+        ok = config.tanks[i].id == sensors.at(i).id && config.tanks[i].depth == sensors.at(i).depth;
+    preferences.begin(CONFIG_NAMESPACE, true);
+    bool removed = !preferences.isKey("sensors") && !preferences.isKey("hloubka") && !preferences.isKey("mqttHost") &&
+                   !preferences.isKey(key) && preferences.isKey(CONFIG_KEY);
+    preferences.end();
+
+    // a save of the page as it is
+    uint32_t before = Preferences::writes();
+    bool changed = store.update([](jimka_config &draft) { ConfigStore::setText(draft.mqtt_host, "broker.local"); });
+    store.service(true);
+    bool unchanged = !changed && Preferences::writes() == before;
+
+    // a save and the pump-out right after it
+    uint8_t id = sensors.at(0).id;
+    store.update([](jimka_config &draft) { draft.mqtt_port = 1884; });
+    store.update([id](jimka_config &draft) { ConfigStore::tank(draft, id)->emptied_at = REPLAY_START; });
+    store.service();
+    bool waited = Preferences::writes() == before;
+    nativeAdvanceMillis(CONFIG_COALESCE_MS);
+    store.service();
+    config_stats stats = store.stats();
+    bool coalesced = waited && Preferences::writes() == before + 1 && stats.coalesced == 1 && !stats.dirty;
+
+    ConfigStore reloaded;
+    bool persisted = reloaded.begin() && reloaded.stats().source == CONFIG_LOADED &&
+                     reloaded.stats().lifetime_writes == 2 &&
+                     memcmp(&reloaded.get(), &store.get(), sizeof(config)) == 0;
+
+    // a save on the web server task leaves the bytes the loop reads alone until it asks for the settings again
+    std::thread web([&store] { store.update([](jimka_config &draft) { draft.mqtt_port = 1885; }); });
+    web.join();
+    bool isolated = config.mqtt_port == 1884 && store.get().mqtt_port == 1885;
+
+    // the same record as an older firmware with a shorter one would have written it: header, then the body
+    preferences.begin(CONFIG_NAMESPACE, false);
+    std::vector<uint8_t> blob(preferences.getBytesLength(CONFIG_KEY));
+    preferences.getBytes(CONFIG_KEY, blob.data(), blob.size());
+    size_t headerSize = blob.size() - sizeof(jimka_config);
+    uint16_t shorter = offsetof(jimka_config, sinks);
+    uint16_t version = CONFIG_VERSION - 1;
+    memcpy(&blob[8], &version, sizeof(version));
+    memcpy(&blob[10], &shorter, sizeof(shorter));
+    blob.resize(headerSize + shorter);
+    uint32_t crc = crc32Update(0, &blob[8], blob.size() - 8);
+    memcpy(&blob[4], &crc, sizeof(crc));
+    preferences.putBytes(CONFIG_KEY, blob.data(), blob.size());
+    preferences.end();
+    ConfigStore older;
+    bool upgraded = older.begin() && older.stats().source == CONFIG_UPGRADED && older.get().mqtt_port == 1884 &&
+                    older.get().sinks == TELEMETRY_ALL && older.stats().dirty;
+
+    // one bit off and the record is not trusted
+    blob[headerSize] ^= 0x10;
+    preferences.begin(CONFIG_NAMESPACE, false);
+    preferences.putBytes(CONFIG_KEY, blob.data(), blob.size());
+    preferences.end();
+    ConfigStore damaged;
+    damaged.begin();
+    bool rejected = damaged.stats().source == CONFIG_RESET && damaged.get().tank_count == 0 &&
+                    damaged.get().mqtt_port == CONFIG_MQTT_PORT;
+
+    printf("config: %u byte record, migrated %s, legacy keys removed %s, unchanged save written %s, %u writes for "
+           "%u commits, reloaded %s, loop copy kept %s, upgraded %s, damaged record rejected %s\n",
+           (unsigned)stats.size, ok ? "ok" : "FAILED", removed ? "yes" : "no", unchanged ? "no" : "YES",
+           (unsigned)stats.writes, (unsigned)stats.commits, persisted ? "ok" : "FAILED", isolated ? "yes" : "no",
+           upgraded ? "ok" : "FAILED", rejected ? "yes" : "no");
+    return ok && removed && unchanged && coalesced && persisted && isolated && upgraded && rejected;
+}
+
+// The receive task on a thread, fed through the RH_ASK stand-in
+static void radioSmoke()
+{
+    if (!radio.begin())
+    {
+        printf("radio task did not start\n");
+        return;
+    }
+    const uint8_t ascii[] = "55.5,21.3,120,88,3.95";
+    const uint8_t garbage[] = "55.5,21.3";
+    driver.inject(ascii, sizeof(ascii) - 1);
+    driver.inject(garbage, sizeof(garbage) - 1);
+    for (uint8_t seq = 0; seq < 8; seq++)
+    {
+        uint8_t frame[RH_ASK_MAX_MESSAGE_LEN];
+        size_t length = encodePacketV2(syntheticReading(1, seq, seq), frame, sizeof(frame));
+        driver.inject(frame, length);
+    }
+
+    size_t received = 0;
+    radio_packet packet;
+    uint32_t started = millis();
+    while (received < 9 && millis() - started < 1000)
+    {
+        if (radio.pop(packet))
+            received++;
+        else
+            delay(RADIO_POLL_MS);
+    }
+    radio_stats stats = radio.stats();
+    printf("radio: %u packets popped, %u ok, %u rejected (%s), %u overflows\n", (unsigned)received,
+           (unsigned)stats.packets_ok, (unsigned)stats.packets_rejected,
+           packetStatusName((packet_status)stats.last_reject), (unsigned)stats.queue_overflows);
+}
+
+int main(int argc, char **argv)
+{
+    replay_options options = {3, 30, 2, "data", REPLAY_TRACE, false};
+    int opt;
+    while ((opt = getopt(argc, argv, "s:d:l:p:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            options.sensors = strtoul(optarg, nullptr, 10);
+            break;
+        case 'd':
+            options.days = strtoul(optarg, nullptr, 10);
+            break;
+        case 'l':
+            options.loss = strtoul(optarg, nullptr, 10);
+            break;
+        case 'p':
+            options.pages = optarg;
+            break;
+        case 't':
+            options.trace = optarg;
+            options.traceOnly = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s sensors] [-d days] [-l loss%%] [-p pages dir] [-t trace.csv]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (options.sensors < 1 || options.sensors > SENSOR_MAX || options.days < 1)
+    {
+        fprintf(stderr, "sensors must be 1 to %u and days at least 1\n", SENSOR_MAX);
+        return 2;
+    }
+
+    if (options.traceOnly)
+        return replayTrace(options.trace, true) ? 0 : 1;
+
+    LITTLEFS.begin();
+    HttpStandin webhook;
+    if (!webhook.start(handleWebhook))
+    {
+        fprintf(stderr, "stand-in webhook could not listen\n");
+        return 1;
+    }
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/alert", webhook.port());
+    notifier.configure(url);
+    notifier.begin();
+    bool filtered = replay(options) && replayTrace(options.trace, false);
+    bool alerted = checkAlerts(millis());
+    bool published = mqttSession() && spoolRecovery() && sinkFanOut(webhook.port());
+    bool stored = configStore();
+    bool relinked = senderReboot();
+    queryHistory(options);
+    bool merged = longStep();
+    renderPages(options);
+    bool clean = steadyState(options);
+    radioSmoke();
+    return filtered && alerted && published && stored && relinked && merged && clean ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+#include "mqtt_standin.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "mqtt_codec.h"
+
+MqttStandin::MqttStandin() : m_listener(-1), m_client(-1), m_port(0), m_running(false), m_connects(0), m_resumed(0)
+{
+}
+
+MqttStandin::~MqttStandin()
+{
+    stop();
+}
+
+bool MqttStandin::start(uint16_t port)
+{
+    if (port == 0)
+        port = m_port;
+    m_listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listener < 0)
+        return false;
+    int on = 1;
+    setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    socklen_t length = sizeof(addr);
+    if (bind(m_listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(m_listener, 4) != 0 ||
+        getsockname(m_listener, (sockaddr *)&addr, &length) != 0)
+    {
+        close(m_listener);
+        m_listener = -1;
+        return false;
+    }
+    m_port = ntohs(addr.sin_port);
+    m_running = true;
+    m_thread = std::thread(&MqttStandin::run, this);
+    return true;
+}
+
+void MqttStandin::stop()
+{
+    if (!m_running)
+        return;
+    m_running = false;
+    shutdown(m_listener, SHUT_RDWR);
+    close(m_listener);
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_client >= 0)
+            shutdown(m_client, SHUT_RDWR);
+    }
+    m_thread.join();
+    m_listener = -1;
+}
+
+std::vector<mqtt_received> MqttStandin::messages()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_messages;
+}
+
+void MqttStandin::run()
+{
+    while (m_running)
+    {
+        int client = accept(m_listener, nullptr, nullptr);
+        if (client < 0)
+            continue;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_client = client;
+        }
+        serve(client);
+        std::lock_guard<std::mutex> guard(m_lock);
+        close(client);
+        m_client = -1;
+    }
+}
+
+static bool readAll(int fd, uint8_t *buf, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t received = recv(fd, buf, length, 0);
+        if (received <= 0)
+            return false;
+        buf += received;
+        length -= received;
+    }
+    return true;
+}
+
+bool MqttStandin::readPacket(int client, uint8_t &header, std::string &body)
+{
+    if (!readAll(client, &header, 1))
+        return false;
+    size_t length = 0, multiplier = 1;
+    for (int i = 0; i < 4; i++)
+    {
+        uint8_t digit;
+        if (!readAll(client, &digit, 1))
+            return false;
+        length += (digit & 0x7F) * multiplier;
+        multiplier *= 128;
+        if ((digit & 0x80) == 0)
+            break;
+    }
+    body.resize(length);
+    return length == 0 || readAll(client, (uint8_t *)&body[0], length);
+}
+
+static std::string readString(const std::string &body, size_t &pos)
+{
+    if (pos + 2 > body.size())
+        return std::string();
+    size_t length = (uint8_t)body[pos] << 8 | (uint8_t)body[pos + 1];
+    std::string text = body.substr(pos + 2, length);
+    pos += 2 + length;
+    return text;
+}
+
+void MqttStandin::serve(int client)
+{
+    uint8_t header;
+    std::string body;
+    // CONNECT first: "MQTT", level, flags, keep alive, client id
+    if (!readPacket(client, header, body) || (header & 0xF0) != MQTT_CONNECT || body.size() < 12)
+        return;
+    size_t pos = 0;
+    if (readString(body, pos) != "MQTT")
+        return;
+    uint8_t flags = body[pos + 1];
+    pos += 4;
+    std::string clientId = readString(body, pos);
+    bool present;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        bool clean = flags & 0x02;
+        present = !clean && m_sessions.count(clientId) > 0;
+        if (clean)
+            m_sessions.erase(clientId);
+        else
+            m_sessions.insert(clientId);
+        m_connects++;
+        if (present)
+            m_resumed++;
+    }
+    uint8_t packet[8];
+    size_t length = mqttAck(packet, sizeof(packet), MQTT_CONNACK, present ? 1 : 0, 0);
+    if (send(client, packet, length, MSG_NOSIGNAL) != (ssize_t)length)
+        return;
+
+    while (m_running && readPacket(client, header, body))
+    {
+        uint8_t type = header & 0xF0;
+        if (type == MQTT_PUBLISH)
+        {
+            uint8_t qos = (header >> 1) & 0x03;
+            pos = 0;
+            mqtt_received message;
+            message.topic = readString(body, pos);
+            message.retain = header & 0x01;
+            message.dup = header & 0x08;
+            uint8_t id[2] = {0, 0};
+            if (qos > 0 && pos + 2 <= body.size())
+            {
+                id[0] = body[pos];
+                id[1] = body[pos + 1];
+                pos += 2;
+            }
+            message.payload = pos <= body.size() ? body.substr(pos) : std::string();
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                m_messages.push_back(message);
+            }
+            if (qos > 0)
+            {
+                length = mqttAck(packet, sizeof(packet), MQTT_PUBACK, id[0], id[1]);
+                if (send(client, packet, length, MSG_NOSIGNAL) != (ssize_t)length)
+                    return;
+            }
+        }
+        else if (type == MQTT_PINGREQ)
+        {
+            length = mqttPacket(packet, sizeof(packet), MQTT_PINGRESP);
+            if (send(client, packet, length, MSG_NOSIGNAL) != (ssize_t)length)
+                return;
+        }
+        else if (type == MQTT_DISCONNECT)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef MQTT_STANDIN_H
+#define MQTT_STANDIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    A local MQTT broker standing in for mosquitto, as much of it as a
+    publisher needs: CONNECT with persistent sessions, PUBLISH at QoS 0 and
+    1, PINGREQ and DISCONNECT, one client at a time. It records what was
+    published. Stopping it drops the client and closes the port like a
+    broker outage; the sessions survive until the stand-in is destroyed. */
+
+struct mqtt_received
+{
+    std::string topic;
+    std::string payload;
+    bool retain;
+    bool dup;
+};
+
+class MqttStandin
+{
+public:
+    MqttStandin();
+    ~MqttStandin();
+
+    // Listens on 127.0.0.1, port 0 picks a free one; a restart can reuse the previous port
+    bool start(uint16_t port = 0);
+    void stop();
+    uint16_t port() const { return m_port; }
+    std::vector<mqtt_received> messages();
+    uint32_t connects() const { return m_connects; }
+    uint32_t resumed() const { return m_resumed; } // connects that found their session
+
+private:
+    void run();
+    void serve(int client);
+    bool readPacket(int client, uint8_t &header, std::string &body);
+
+    int m_listener;
+    int m_client;
+    uint16_t m_port;
+    volatile bool m_running;
+    uint32_t m_connects;
+    uint32_t m_resumed;
+    std::set<std::string> m_sessions; // client ids that connected without a clean session
+    std::vector<mqtt_received> m_messages;
+    std::mutex m_lock;
+    std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include "packet_decoder.h"
+#include <string.h>
+
+struct packet_field_spec
+{
+    uint8_t decimals; // fixed-point scale the field is parsed with
+    int32_t min;      // limits in that scale
+    int32_t max;
+};
+
+// Indexed by the position in the ASCII payload
+static const packet_field_spec ascii_fields[PACKET_ASCII_FIELDS] = {
+    {2, 0, 10000},     // humidity, centi percent
+    {2, -4000, 8500},  // temperature, centi degrees
+    {0, 0, 1000},      // distance, cm
+    {0, 0, 100},       // battery percentage
+    {3, 0, 10000},     // battery voltage, mV
+};
+
+static bool isSpace(uint8_t c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\0';
+}
+
+// Parses [-]digits[.digits] between p and end, scaled by 10^decimals, extra fraction digits are cut off
+static packet_status parseFixed(const uint8_t *p, const uint8_t *end, uint8_t decimals, int32_t &value)
+{
+    while (p < end && isSpace(*p))
+        p++;
+    while (end > p && isSpace(end[-1]))
+        end--;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    int32_t result = 0;
+    uint8_t digits = 0;
+    uint8_t fraction = 0;
+    bool point = false;
+    for (; p < end; p++)
+    {
+        if (*p == '.' && !point)
+        {
+            point = true;
+            continue;
+        }
+        if (*p < '0' || *p > '9')
+            return PACKET_BAD_NUMBER;
+        digits++;
+        if (point && fraction >= decimals)
+            continue;
+        if (result > 99999999)
+            return PACKET_OUT_OF_RANGE;
+        result = result * 10 + (*p - '0');
+        if (point)
+            fraction++;
+    }
+    if (digits == 0)
+        return PACKET_BAD_NUMBER;
+
+    for (; fraction < decimals; fraction++)
+        result *= 10;
+    value = negative ? -result : result;
+    return PACKET_OK;
+}
+
+static packet_status decodeAscii(const uint8_t *buf, size_t len, sensor_reading &out)
+{
+    int32_t values[PACKET_ASCII_FIELDS];
+    const uint8_t *end = buf + len;
+    const uint8_t *start = buf;
+    uint8_t field = 0;
+
+    for (const uint8_t *p = buf; p <= end; p++)
+    {
+        if (p < end && *p != ',')
+            continue;
+        if (field == PACKET_ASCII_FIELDS)
+            return PACKET_BAD_FIELD_COUNT;
+
+        const packet_field_spec &spec = ascii_fields[field];
+        packet_status status = parseFixed(start, p, spec.decimals, values[field]);
+        if (status != PACKET_OK)
+            return status;
+        if (values[field] < spec.min || values[field] > spec.max)
+            return PACKET_OUT_OF_RANGE;
+        field++;
+        start = p + 1;
+    }
+    if (field != PACKET_ASCII_FIELDS)
+        return PACKET_BAD_FIELD_COUNT;
+
+    out.humidity = values[0] / 100.0f;
+    out.temperature = values[1] / 100.0f;
+    out.distance = values[2];
+    out.batt_perc = values[3];
+    out.batt_voltage = values[4] / 1000.0f;
+    out.format = PACKET_ASCII;
+    out.sensor_id = PACKET_LEGACY_SENSOR;
+    out.seq = 0;
+    out.has_seq = false;
+    return PACKET_OK;
+}
+
+static bool inRange(int32_t temperature, uint32_t humidity, uint32_t distance, uint32_t battPerc, uint32_t battMv)
+{
+    return humidity <= (uint32_t)ascii_fields[0].max && temperature >= ascii_fields[1].min &&
+           temperature <= ascii_fields[1].max && distance <= (uint32_t)ascii_fields[2].max &&
+           battPerc <= (uint32_t)ascii_fields[3].max && battMv <= (uint32_t)ascii_fields[4].max;
+}
+
+static packet_status decodeBinary(const uint8_t *buf, size_t len, sensor_reading &out)
+{
+    if (len < 2)
+        return PACKET_BAD_LENGTH;
+
+    // the buffer has no alignment guarantee, frames are copied before reading the fields
+    if (buf[1] == PACKET_VERSION_1)
+    {
+        if (len != sizeof(packet_frame_v1))
+            return PACKET_BAD_LENGTH;
+        packet_frame_v1 frame;
+        memcpy(&frame, buf, sizeof(frame));
+        if (!inRange(frame.temperature, frame.humidity, frame.distance, frame.batt_perc, frame.batt_mv))
+            return PACKET_OUT_OF_RANGE;
+
+        out.humidity = frame.humidity / 100.0f;
+        out.temperature = frame.temperature / 100.0f;
+        out.distance = frame.distance;
+        out.batt_perc = frame.batt_perc;
+        out.batt_voltage = frame.batt_mv / 1000.0f;
+        out.sensor_id = PACKET_LEGACY_SENSOR;
+        out.seq = 0;
+        out.has_seq = false;
+    }
+    else if (buf[1] == PACKET_VERSION_2)
+    {
+        if (len != sizeof(packet_frame_v2))
+            return PACKET_BAD_LENGTH;
+        packet_frame_v2 frame;
+        memcpy(&frame, buf, sizeof(frame));
+        if (!inRange(frame.temperature, frame.humidity * 50u, frame.distance, frame.batt_perc, frame.batt_mv))
+            return PACKET_OUT_OF_RANGE;
+
+        out.humidity = frame.humidity / 2.0f;
+        out.temperature = frame.temperature / 100.0f;
+        out.distance = frame.distance;
+        out.batt_perc = frame.batt_perc;
+        out.batt_voltage = frame.batt_mv / 1000.0f;
+        out.sensor_id = frame.sensor_id;
+        out.seq = frame.seq;
+        out.has_seq = true;
+    }
+    else
+    {
+        return PACKET_UNKNOWN_VERSION;
+    }
+    out.format = PACKET_BINARY;
+    return PACKET_OK;
+}
+
+packet_status decodePacket(const uint8_t *buf, size_t len, sensor_reading &out)
+{
+    if (buf == nullptr || len == 0)
+        return PACKET_EMPTY;
+    if (buf[0] == PACKET_BINARY_MAGIC)
+        return decodeBinary(buf, len, out);
+    return decodeAscii(buf, len, out);
+}
+
+static int32_t roundScaled(float value, float scale)
+{
+    float scaled = value * scale;
+    return (int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+}
+
+size_t encodePacketV1(const sensor_reading &reading, uint8_t *buf, size_t size)
+{
+    if (size < sizeof(packet_frame_v1))
+        return 0;
+
+    packet_frame_v1 frame;
+    frame.magic = PACKET_BINARY_MAGIC;
+    frame.version = PACKET_VERSION_1;
+    frame.temperature = roundScaled(reading.temperature, 100);
+    frame.humidity = roundScaled(reading.humidity, 100);
+    frame.distance = reading.distance;
+    frame.batt_perc = reading.batt_perc;
+    frame.batt_mv = roundScaled(reading.batt_voltage, 1000);
+    memcpy(buf, &frame, sizeof(frame));
+    return sizeof(frame);
+}
+
+size_t encodePacketV2(const sensor_reading &reading, uint8_t *buf, size_t size)
+{
+    if (size < sizeof(packet_frame_v2))
+        return 0;
+
+    packet_frame_v2 frame;
+    frame.magic = PACKET_BINARY_MAGIC;
+    frame.version = PACKET_VERSION_2;
+    frame.sensor_id = reading.sensor_id;
+    frame.seq = reading.seq;
+    frame.temperature = roundScaled(reading.temperature, 100);
+    frame.humidity = roundScaled(reading.humidity, 2);
+    frame.distance = reading.distance;
+    frame.batt_perc = reading.batt_perc;
+    frame.batt_mv = roundScaled(reading.batt_voltage, 1000);
+    memcpy(buf, &frame, sizeof(frame));
+    return sizeof(frame);
+}
+
+const char *packetStatusName(packet_status status)
+{
+    switch (status)
+    {
+    case PACKET_OK:
+        return "ok";
+    case PACKET_EMPTY:
+        return "empty";
+    case PACKET_BAD_FIELD_COUNT:
+        return "bad field count";
+    case PACKET_BAD_NUMBER:
+        return "bad number";
+    case PACKET_OUT_OF_RANGE:
+        return "out of range";
+    case PACKET_BAD_LENGTH:
+        return "bad length";
+    case PACKET_UNKNOWN_VERSION:
+        return "unknown version";
+    }
+    return "?";
+}
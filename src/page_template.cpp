@@ -0,0 +1,235 @@
+#include "page_template.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TEMPLATE_NAME_MAX 32
+
+// Indexed by template_var
+static const char *const template_var_names[TPL_VAR_COUNT] = {
+    "NAPUST",
+    "HLOUBKA",
+    "VOLT",
+    "BATTPERCENT",
+    "HLADINA",
+    "PLNOSTPERC",
+    "TEPLOTA",
+    "VLHKOST",
+    "THINGSPEAKAPI",
+    "THINGSPEAKCHANNEL",
+    "LASTMEASUREMENT",
+    "UPTIME",
+    "DUCKDNSDOMAIN",
+    "DUCKDNSTOKEN",
+    "LINKLOSS",
+    "LINKQUALITY",
+    "LINKJITTER",
+    "SENSORID",
+    "FILLRATE",
+    "DAYSTOFULL",
+    "SINCEEMPTIED",
+    "ALARMHLADINA",
+    "ALARMBATERIE",
+    "ALARMNAPETI",
+    "ALARMNEAKTIVITA",
+    "ALARMURL",
+    "MQTTHOST",
+    "MQTTPORT",
+    "MQTTUSER",
+    "SINKTHINGSPEAK",
+    "SINKMQTT",
+    "SINKINFLUX",
+    "SINKWEBHOOK",
+    "INFLUXURL",
+    "INFLUXTOKEN",
+    "WEBHOOKURL",
+};
+
+// Shared by all renders, the web server handles one request at a time
+static char template_value_buffer[TEMPLATE_VALUE_BUFFER];
+
+PageTemplate::PageTemplate() : m_text(nullptr), m_length(0), m_count(0)
+{
+}
+
+PageTemplate::~PageTemplate()
+{
+    free(m_text);
+}
+
+uint8_t PageTemplate::lookupVar(const char *name, size_t length)
+{
+    // only runs while parsing at boot
+    for (uint8_t i = 0; i < TPL_VAR_COUNT; i++)
+    {
+        const char *candidate = template_var_names[i];
+        if (strlen(candidate) == length && memcmp(candidate, name, length) == 0)
+            return i;
+    }
+    return TPL_LITERAL;
+}
+
+const char *PageTemplate::varName(uint8_t var)
+{
+    return var < TPL_VAR_COUNT ? template_var_names[var] : "";
+}
+
+bool PageTemplate::addSegment(uint16_t offset, uint16_t length, uint8_t var)
+{
+    if (var == TPL_LITERAL && length == 0)
+        return true;
+
+    // extend the previous literal when the ranges touch
+    if (var == TPL_LITERAL && m_count > 0)
+    {
+        template_segment &last = m_segments[m_count - 1];
+        if (last.var == TPL_LITERAL && last.offset + last.length == offset)
+        {
+            last.length += length;
+            return true;
+        }
+    }
+
+    if (m_count >= TEMPLATE_MAX_SEGMENTS)
+        return false;
+
+    m_segments[m_count].offset = offset;
+    m_segments[m_count].length = length;
+    m_segments[m_count].var = var;
+    m_count++;
+    return true;
+}
+
+bool PageTemplate::parse(char *text, size_t length)
+{
+    free(m_text);
+    m_text = text;
+    m_length = length;
+    m_count = 0;
+
+    if (text == nullptr || length > 0xFFFF)
+    {
+        free(m_text);
+        m_text = nullptr;
+        m_length = 0;
+        return false;
+    }
+
+    size_t literal_start = 0;
+    size_t i = 0;
+    while (i < length)
+    {
+        if (text[i] != '%')
+        {
+            i++;
+            continue;
+        }
+
+        // "%%" is an escaped percent sign, same as in ESPAsyncWebServer templates
+        if (i + 1 < length && text[i + 1] == '%')
+        {
+            if (!addSegment(literal_start, i + 1 - literal_start, TPL_LITERAL))
+                return false;
+            i += 2;
+            literal_start = i;
+            continue;
+        }
+
+        size_t end = i + 1;
+        while (end < length && end - i <= TEMPLATE_NAME_MAX && text[end] != '%')
+            end++;
+
+        uint8_t var = TPL_LITERAL;
+        if (end < length && text[end] == '%')
+            var = lookupVar(text + i + 1, end - i - 1);
+
+        // unknown names (e.g. "%23fff" in urls) stay in the output untouched
+        if (var == TPL_LITERAL)
+        {
+            i++;
+            continue;
+        }
+
+        if (!addSegment(literal_start, i - literal_start, TPL_LITERAL) || !addSegment(i, 0, var))
+            return false;
+        i = end + 1;
+        literal_start = i;
+    }
+
+    return addSegment(literal_start, length - literal_start, TPL_LITERAL);
+}
+
+void PageTemplate::render(template_resolver resolve, template_writer write, void *ctx) const
+{
+    for (size_t i = 0; i < m_count; i++)
+    {
+        const template_segment &seg = m_segments[i];
+        if (seg.var == TPL_LITERAL)
+        {
+            write(ctx, m_text + seg.offset, seg.length);
+        }
+        else
+        {
+            size_t len = resolve(seg.var, template_value_buffer, sizeof(template_value_buffer));
+            if (len > 0)
+                write(ctx, template_value_buffer, len);
+        }
+    }
+}
+
+TemplateStream::TemplateStream(const PageTemplate &page, template_resolver resolve)
+    : m_page(page), m_length(0), m_segment(0), m_offset(0)
+{
+    size_t used = 0;
+    for (size_t i = 0; i < page.segmentCount(); i++)
+    {
+        const template_segment &seg = page.segment(i);
+        if (seg.var == TPL_LITERAL)
+        {
+            m_length += seg.length;
+            continue;
+        }
+        // resolvers write a terminating zero, a value is cut short once the buffer runs out
+        size_t room = sizeof(m_values) - used;
+        if (room > TEMPLATE_VALUE_BUFFER)
+            room = TEMPLATE_VALUE_BUFFER;
+        size_t len = room > 1 ? resolve(seg.var, m_values + used, room) : 0;
+        m_valueOffset[i] = used;
+        m_valueLength[i] = len;
+        used += len;
+        m_length += len;
+    }
+}
+
+size_t TemplateStream::read(uint8_t *buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen && m_segment < m_page.segmentCount())
+    {
+        const template_segment &seg = m_page.segment(m_segment);
+        const char *data;
+        size_t length;
+        if (seg.var == TPL_LITERAL)
+        {
+            data = m_page.text() + seg.offset;
+            length = seg.length;
+        }
+        else
+        {
+            data = m_values + m_valueOffset[m_segment];
+            length = m_valueLength[m_segment];
+        }
+
+        size_t count = length - m_offset;
+        if (count > maxLen - written)
+            count = maxLen - written;
+        memcpy(buffer + written, data + m_offset, count);
+        written += count;
+        m_offset += count;
+        if (m_offset == length)
+        {
+            m_segment++;
+            m_offset = 0;
+        }
+    }
+    return written;
+}
@@ -0,0 +1,67 @@
+#include "radio_receiver.h"
+
+RadioReceiver::RadioReceiver(RH_ASK &driver)
+    : m_driver(driver), m_task(nullptr), m_starter(nullptr), m_ready(false)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool RadioReceiver::begin()
+{
+    if (m_task != nullptr)
+        return m_ready;
+
+    m_starter = xTaskGetCurrentTaskHandle();
+    if (xTaskCreatePinnedToCore(taskMain, "radio", RADIO_STACK, this, RADIO_PRIORITY, &m_task, RADIO_CORE) != pdPASS)
+    {
+        m_task = nullptr;
+        return false;
+    }
+    // wait for the driver to be initialised on the radio core
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    return m_ready;
+}
+
+void RadioReceiver::taskMain(void *arg)
+{
+    static_cast<RadioReceiver *>(arg)->run();
+}
+
+void RadioReceiver::run()
+{
+    m_ready = m_driver.init();
+    xTaskNotifyGive(m_starter);
+    if (!m_ready)
+    {
+        m_task = nullptr;
+        vTaskDelete(nullptr);
+        return;
+    }
+
+    for (;;)
+    {
+        uint8_t buf[RH_ASK_MAX_MESSAGE_LEN];
+        uint8_t buflen = sizeof(buf);
+        if (!m_driver.recv(buf, &buflen))
+        {
+            vTaskDelay(pdMS_TO_TICKS(RADIO_POLL_MS));
+            continue;
+        }
+
+        radio_packet packet;
+        packet.arrival_ms = millis();
+        packet_status status = decodePacket(buf, buflen, packet.reading);
+        if (status != PACKET_OK)
+        {
+            m_stats.packets_rejected++;
+            m_stats.last_reject = status;
+            continue;
+        }
+        m_stats.packets_ok++;
+        if (!m_queue.push(packet))
+            m_stats.queue_overflows++;
+        size_t queued = m_queue.size();
+        if (queued > m_stats.max_queued)
+            m_stats.max_queued = queued;
+    }
+}
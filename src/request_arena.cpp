@@ -0,0 +1,132 @@
+#include "request_arena.h"
+
+alignas(max_align_t) static uint8_t smallMemory[REQUEST_ARENA_SMALL_SLOTS][REQUEST_ARENA_SMALL_SIZE];
+alignas(max_align_t) static uint8_t largeMemory[REQUEST_ARENA_SLOTS][REQUEST_ARENA_SIZE];
+// smallest first, a lease takes the first free one that fits
+static RequestArena arenas[] = {
+    {smallMemory[0], REQUEST_ARENA_SMALL_SIZE}, {smallMemory[1], REQUEST_ARENA_SMALL_SIZE},
+    {smallMemory[2], REQUEST_ARENA_SMALL_SIZE}, {smallMemory[3], REQUEST_ARENA_SMALL_SIZE},
+    {smallMemory[4], REQUEST_ARENA_SMALL_SIZE}, {smallMemory[5], REQUEST_ARENA_SMALL_SIZE},
+    {largeMemory[0], REQUEST_ARENA_SIZE},       {largeMemory[1], REQUEST_ARENA_SIZE},
+};
+static_assert(sizeof(arenas) / sizeof(arenas[0]) == REQUEST_ARENA_SMALL_SLOTS + REQUEST_ARENA_SLOTS,
+              "one arena per slot");
+static request_arena_stats arenaStats;
+static portMUX_TYPE arenaMux = portMUX_INITIALIZER_UNLOCKED;
+
+RequestArena::RequestArena(uint8_t *memory, size_t capacity)
+    : m_memory(memory), m_capacity(capacity), m_used(0), m_finalizerCount(0), m_refs(0)
+{
+}
+
+void *RequestArena::allocate(size_t size, size_t align)
+{
+    size_t start = (m_used + align - 1) & ~(align - 1);
+    if (start + size > m_capacity)
+        return nullptr;
+    m_used = start + size;
+    return m_memory + start;
+}
+
+void RequestArena::addFinalizer(finalizer fn, void *object)
+{
+    m_finalizers[m_finalizerCount] = fn;
+    m_objects[m_finalizerCount] = object;
+    m_finalizerCount++;
+}
+
+void RequestArena::reset()
+{
+    // newest first, a later object may refer to an earlier one
+    while (m_finalizerCount > 0)
+    {
+        m_finalizerCount--;
+        m_finalizers[m_finalizerCount](m_objects[m_finalizerCount]);
+    }
+    m_used = 0;
+}
+
+ArenaLease ArenaLease::acquire(size_t size)
+{
+    RequestArena *arena = nullptr;
+    portENTER_CRITICAL(&arenaMux);
+    for (RequestArena &candidate : arenas)
+    {
+        if (candidate.m_refs == 0 && candidate.m_capacity >= size)
+        {
+            arena = &candidate;
+            arena->m_refs = 1;
+            break;
+        }
+    }
+    if (arena != nullptr)
+    {
+        arenaStats.leases++;
+        arenaStats.in_use++;
+    }
+    else
+    {
+        arenaStats.exhausted++;
+    }
+    portEXIT_CRITICAL(&arenaMux);
+    return ArenaLease(arena);
+}
+
+request_arena_stats ArenaLease::stats()
+{
+    portENTER_CRITICAL(&arenaMux);
+    request_arena_stats copy = arenaStats;
+    portEXIT_CRITICAL(&arenaMux);
+    return copy;
+}
+
+ArenaLease::ArenaLease(const ArenaLease &other) : m_arena(other.m_arena)
+{
+    if (m_arena != nullptr)
+    {
+        portENTER_CRITICAL(&arenaMux);
+        m_arena->m_refs++;
+        portEXIT_CRITICAL(&arenaMux);
+    }
+}
+
+ArenaLease &ArenaLease::operator=(const ArenaLease &other)
+{
+    if (other.m_arena != m_arena)
+    {
+        ArenaLease copy(other);
+        release();
+        m_arena = copy.m_arena;
+        copy.m_arena = nullptr;
+    }
+    return *this;
+}
+
+ArenaLease::~ArenaLease()
+{
+    release();
+}
+
+void ArenaLease::release()
+{
+    if (m_arena == nullptr)
+        return;
+    portENTER_CRITICAL(&arenaMux);
+    bool last = --m_arena->m_refs == 0;
+    if (last)
+        m_arena->m_refs = 1; // still busy until the destructors ran
+    portEXIT_CRITICAL(&arenaMux);
+
+    if (last)
+    {
+        uint32_t used = m_arena->m_used;
+        m_arena->reset();
+        portENTER_CRITICAL(&arenaMux);
+        if (used > arenaStats.high_water)
+            arenaStats.high_water = used;
+        arenaStats.in_use--;
+        m_arena->m_refs = 0;
+        portEXIT_CRITICAL(&arenaMux);
+    }
+    m_arena = nullptr;
+}
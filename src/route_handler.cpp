@@ -0,0 +1,34 @@
+#include "route_handler.h"
+
+const route_entry *RouteHandler::match(AsyncWebServerRequest *request) const
+{
+    uint8_t method = request->method() & (ROUTE_GET | ROUTE_POST);
+    if (method == 0)
+        return nullptr;
+    const route_entry *entry = findRoute(request->url().c_str(), method);
+    return entry != nullptr && m_functions[entry->route] != nullptr ? entry : nullptr;
+}
+
+bool RouteHandler::canHandle(AsyncWebServerRequest *request)
+{
+    if (match(request) == nullptr)
+        return false;
+    request->addInterestingHeader(F("If-None-Match"));
+    request->addInterestingHeader(F("Accept-Encoding"));
+    return true;
+}
+
+void RouteHandler::handleRequest(AsyncWebServerRequest *request)
+{
+    const route_entry *entry = match(request);
+    if (entry == nullptr)
+    {
+        request->send(404);
+        return;
+    }
+    // counted once the connection is closed, the response may still be streaming when the handler returns
+    uint8_t route = entry->route;
+    uint32_t started = micros();
+    request->onDisconnect([route, started]() { metricsRequest(route, micros() - started); });
+    m_functions[route](request);
+}
@@ -0,0 +1,50 @@
+#include "sensor_registry.h"
+#include <math.h>
+#include <string.h>
+
+SensorRegistry::SensorRegistry() : m_count(0)
+{
+    memset(m_sensors, 0, sizeof(m_sensors));
+    memset(m_slots, SENSOR_NO_SLOT, sizeof(m_slots));
+}
+
+tank_sensor *SensorRegistry::add(uint8_t id)
+{
+    tank_sensor *sensor = find(id);
+    if (sensor != nullptr || m_count == SENSOR_MAX)
+        return sensor;
+
+    // the entry is complete before count and the map publish it to the web server task
+    sensor = &m_sensors[m_count];
+    memset(sensor, 0, sizeof(*sensor));
+    sensor->id = id;
+    sensor->depth = SENSOR_DEFAULT_DEPTH;
+    m_slots[id] = m_count;
+    m_count = m_count + 1;
+    return sensor;
+}
+
+void SensorRegistry::apply(tank_sensor &sensor, const sensor_reading &reading, uint32_t nowMs,
+                           unsigned long uptimeMinutes)
+{
+    sensor.humidity = reading.humidity;
+    sensor.temperature = reading.temperature;
+    sensor.distance = reading.distance;
+    filterDistance(sensor.filter, reading.distance, nowMs);
+    sensor.batt_perc = reading.batt_perc;
+    sensor.batt_voltage = reading.batt_voltage;
+    sensor.measured_ms = nowMs;
+    sensor.measured_minutes = uptimeMinutes;
+    sensor.received = true;
+    updateDerived(sensor);
+}
+
+void SensorRegistry::updateDerived(tank_sensor &sensor)
+{
+    int32_t distance = sensor.filter.samples > 0 ? lroundf(sensor.filter.distance) : sensor.distance;
+    sensor.level = sensor.depth - distance - sensor.inlet;
+    if (sensor.depth == 0)
+        sensor.fill_perc = 0;
+    else
+        sensor.fill_perc = round(((float)sensor.level / (float)sensor.depth) * 100.00);
+}
@@ -0,0 +1,92 @@
+#include "signal_filter.h"
+#include <math.h>
+#include <string.h>
+
+#define FILTER_MAD_SCALE 1.4826f // MAD to standard deviation for normally distributed noise
+#define FILTER_MS_PER_DAY 86400000.0f
+
+// Median of a handful of values, sorts them in place
+static float median(float *values, size_t count)
+{
+    for (size_t i = 1; i < count; i++)
+    {
+        float value = values[i];
+        size_t j = i;
+        for (; j > 0 && values[j - 1] > value; j--)
+            values[j] = values[j - 1];
+        values[j] = value;
+    }
+    return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+static void restart(distance_filter &filter, float distance)
+{
+    filter.distance = distance;
+    filter.rate = 0;
+    filter.p00 = FILTER_MEASUREMENT_VAR;
+    filter.p01 = 0;
+    filter.p11 = FILTER_INITIAL_RATE_VAR;
+}
+
+float filterDistance(distance_filter &filter, uint32_t distance, uint32_t nowMs)
+{
+    float raw = distance;
+    filter.window[filter.next] = distance > 0xFFFF ? 0xFFFF : distance;
+    filter.next = (filter.next + 1) % FILTER_WINDOW;
+    if (filter.filled < FILTER_WINDOW)
+        filter.filled++;
+
+    // Hampel test against the median and MAD of the window, the reading included
+    float values[FILTER_WINDOW];
+    for (size_t i = 0; i < filter.filled; i++)
+        values[i] = filter.window[i];
+    float center = median(values, filter.filled);
+    for (size_t i = 0; i < filter.filled; i++)
+        values[i] = fabsf(values[i] - center);
+    float limit = FILTER_HAMPEL_K * FILTER_MAD_SCALE * median(values, filter.filled);
+    if (limit < FILTER_MIN_DEVIATION)
+        limit = FILTER_MIN_DEVIATION;
+    filter.median = center;
+    filter.outlier = fabsf(raw - center) > limit;
+    float measured = filter.outlier ? center : raw;
+    if (filter.outlier)
+        filter.outliers++;
+
+    uint32_t elapsedMs = nowMs - filter.last_ms;
+    filter.last_ms = nowMs;
+    if (filter.samples++ == 0)
+    {
+        restart(filter, measured);
+        return filter.distance;
+    }
+
+    // predict, white noise acceleration
+    float dt = elapsedMs / FILTER_MS_PER_DAY;
+    if (dt > 0)
+    {
+        float dt2 = dt * dt;
+        filter.distance += filter.rate * dt;
+        filter.p00 += dt * (2 * filter.p01 + dt * filter.p11) + FILTER_ACCEL_VAR * dt2 * dt / 3;
+        filter.p01 += dt * filter.p11 + FILTER_ACCEL_VAR * dt2 / 2;
+        filter.p11 += FILTER_ACCEL_VAR * dt;
+    }
+
+    float innovation = measured - filter.distance;
+    if (fabsf(innovation) > FILTER_RESET_DISTANCE)
+    {
+        filter.resets++;
+        restart(filter, measured);
+        return filter.distance;
+    }
+
+    // update
+    float s = filter.p00 + FILTER_MEASUREMENT_VAR;
+    float k0 = filter.p00 / s;
+    float k1 = filter.p01 / s;
+    filter.distance += k0 * innovation;
+    filter.rate += k1 * innovation;
+    filter.p11 -= k1 * filter.p01;
+    filter.p01 -= k0 * filter.p01;
+    filter.p00 -= k0 * filter.p00;
+    return filter.distance;
+}
@@ -0,0 +1,52 @@
+#include "snapshot_buffer.h"
+#include <stdio.h>
+#include <string.h>
+
+SnapshotBuffer::SnapshotBuffer() : m_sequence(0)
+{
+    m_buffers[0][0] = '\0';
+    m_buffers[1][0] = '\0';
+    m_length[0] = 0;
+    m_length[1] = 0;
+}
+
+void SnapshotBuffer::commit(size_t length)
+{
+    uint32_t next = m_sequence.load(std::memory_order_relaxed) + 1;
+    if (length >= SNAPSHOT_BUFFER_SIZE)
+        length = SNAPSHOT_BUFFER_SIZE - 1;
+    m_buffers[next & 1][length] = '\0';
+    m_length[next & 1] = length;
+    m_sequence.store(next, std::memory_order_release);
+}
+
+size_t SnapshotBuffer::read(char *out, size_t capacity, uint32_t &sequence) const
+{
+    // a seqlock: the copy is good when no commit came in between, the next build may have begun in it otherwise
+    for (;;)
+    {
+        uint32_t before = m_sequence.load(std::memory_order_acquire);
+        size_t length = m_length[before & 1];
+        if (length > capacity)
+            return 0;
+        memcpy(out, m_buffers[before & 1], length);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence.load(std::memory_order_relaxed) == before)
+        {
+            sequence = before;
+            return length;
+        }
+    }
+}
+
+void SnapshotBuffer::etag(uint32_t sequence, char *out, size_t size)
+{
+    snprintf(out, size, "\"s%u\"", (unsigned)sequence);
+}
+
+bool SnapshotBuffer::matches(const char *ifNoneMatch) const
+{
+    char tag[SNAPSHOT_ETAG_LEN];
+    etag(sequence(), tag, sizeof(tag));
+    return ifNoneMatch != nullptr && strstr(ifNoneMatch, tag) != nullptr;
+}
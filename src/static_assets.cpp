@@ -0,0 +1,71 @@
+#include "static_assets.h"
+#include "metrics.h"
+
+#define STATIC_ASSET_CACHE_CONTROL "public, max-age=31536000, immutable"
+
+StaticAssetHandler::StaticAssetHandler(fs::FS &fs) : m_manifest(fs)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool StaticAssetHandler::canHandle(AsyncWebServerRequest *request)
+{
+    if (request->method() != HTTP_GET || m_manifest.find(request->url().c_str()) == nullptr)
+        return false;
+
+    request->addInterestingHeader(F("If-None-Match"));
+    return true;
+}
+
+void StaticAssetHandler::handleRequest(AsyncWebServerRequest *request)
+{
+    uint32_t started = micros();
+    request->onDisconnect([started]() { metricsRequest(ROUTE_ASSET, micros() - started); });
+    const static_asset *asset = m_manifest.find(request->url().c_str());
+    if (asset == nullptr)
+    {
+        request->send(404);
+        return;
+    }
+    m_stats.requests++;
+
+    AsyncWebHeader *match = request->getHeader(F("If-None-Match"));
+    if (match != nullptr && strstr(match->value().c_str(), asset->etag) != nullptr)
+    {
+        m_stats.not_modified++;
+        m_stats.bytes_saved += asset->size;
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader(F("ETag"), asset->etag);
+        response->addHeader(F("Cache-Control"), F(STATIC_ASSET_CACHE_CONTROL));
+        request->send(response);
+        return;
+    }
+
+    AsyncWebServerResponse *response;
+    if (asset->data != nullptr)
+    {
+        // copied from the flash mapping into the TCP buffer chunk by chunk, nothing is buffered
+        response = request->beginResponse_P(200, asset->mime, asset->data, asset->size);
+    }
+    else
+    {
+        File file = m_manifest.open(*asset);
+        if (!file)
+        {
+            request->send(404);
+            return;
+        }
+
+        // the file is closed once the response (and with it the lambda) is released
+        response = request->beginResponse(
+            asset->mime, asset->size, [file](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+                return file.read(buffer, maxLen);
+            });
+    }
+    if (asset->gzip)
+        response->addHeader(F("Content-Encoding"), F("gzip"));
+    response->addHeader(F("ETag"), asset->etag);
+    response->addHeader(F("Cache-Control"), F(STATIC_ASSET_CACHE_CONTROL));
+    m_stats.bytes_served += asset->size;
+    request->send(response);
+}
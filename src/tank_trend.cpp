@@ -0,0 +1,104 @@
+#include "tank_trend.h"
+#include "wall_clock.h"
+
+// Forgets the fitted points, the next reading opens the first bucket
+static void restartFit(tank_trend &trend, uint32_t now)
+{
+    trend.origin = now;
+    trend.next = 0;
+    trend.filled = 0;
+    trend.sum_t = trend.sum_y = trend.sum_tt = trend.sum_ty = 0;
+    trend.bucket_start = now;
+    trend.bucket_hours = 0;
+    trend.bucket_level = 0;
+    trend.bucket_count = 0;
+    trend.rate = 0;
+}
+
+static void closeBucket(tank_trend &trend)
+{
+    float t = trend.bucket_hours / trend.bucket_count;
+    float y = trend.bucket_level / trend.bucket_count;
+    if (trend.filled == TREND_BUCKETS)
+    {
+        double oldT = trend.hours[trend.next], oldY = trend.levels[trend.next];
+        trend.sum_t -= oldT;
+        trend.sum_y -= oldY;
+        trend.sum_tt -= oldT * oldT;
+        trend.sum_ty -= oldT * oldY;
+    }
+    else
+    {
+        trend.filled++;
+    }
+    trend.hours[trend.next] = t;
+    trend.levels[trend.next] = y;
+    trend.next = (trend.next + 1) % TREND_BUCKETS;
+    trend.sum_t += t;
+    trend.sum_y += y;
+    trend.sum_tt += (double)t * t;
+    trend.sum_ty += (double)t * y;
+
+    trend.bucket_hours = 0;
+    trend.bucket_level = 0;
+    trend.bucket_count = 0;
+
+    // slope of the least squares line, cm per hour
+    double n = trend.filled;
+    double denominator = n * trend.sum_tt - trend.sum_t * trend.sum_t;
+    if (trend.filled < TREND_MIN_BUCKETS || denominator <= 0)
+        trend.rate = 0;
+    else
+        trend.rate = (n * trend.sum_ty - trend.sum_t * trend.sum_y) / denominator * 24;
+}
+
+bool trendUpdate(tank_trend &trend, uint32_t now, int level, uint32_t depth)
+{
+    if (!clockIsSet(now))
+        return false;
+    bool emptied = false;
+    if (!trend.started)
+    {
+        trend.started = true;
+        trend.peak = level;
+        restartFit(trend, now);
+    }
+    else if (level < trend.peak - TREND_PUMPOUT_DROP)
+    {
+        // the rest of a pumping that was already counted only moves its end
+        if (trend.emptied_at == 0 || now - trend.emptied_at >= TREND_PUMPOUT_HOLDOFF_S)
+            trend.pumpouts++;
+        trend.emptied_at = now;
+        trend.peak = level;
+        emptied = true;
+        restartFit(trend, now);
+    }
+    else if (level > trend.peak)
+    {
+        trend.peak = level;
+    }
+
+    // the clock was set (NTP) or the sensor was silent for longer than the window
+    if (now < trend.bucket_start || now - trend.bucket_start > TREND_BUCKETS * TREND_BUCKET_S)
+        restartFit(trend, now);
+    if (trend.bucket_count > 0 && now - trend.bucket_start >= TREND_BUCKET_S)
+    {
+        closeBucket(trend);
+        trend.bucket_start = now;
+    }
+    trend.bucket_hours += (now - trend.origin) / 3600.0f;
+    trend.bucket_level += level;
+    trend.bucket_count++;
+
+    float target = depth * TREND_FULL_PERCENT / 100.0f;
+    float days = trend.rate >= TREND_MIN_RATE ? (target - level) / trend.rate : -1;
+    if (trend.rate >= TREND_MIN_RATE && days < 0)
+        days = 0; // already above the mark
+    if (days > TREND_MAX_DAYS)
+        days = -1;
+    trend.days_to_full = days;
+    trend.full_at = days >= 0 ? now + (uint32_t)(days * 86400) : 0;
+    trend.days_since_emptied =
+        trend.emptied_at != 0 && now >= trend.emptied_at ? (now - trend.emptied_at) / 86400.0f : -1;
+    return emptied;
+}
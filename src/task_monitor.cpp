@@ -0,0 +1,48 @@
+#include "task_monitor.h"
+
+TaskMonitor::TaskMonitor() : m_count(0), m_lastTick(0)
+{
+    memset(&m_loop, 0, sizeof(m_loop));
+}
+
+void TaskMonitor::add(const char *name, TaskHandle_t task)
+{
+    if (task == nullptr || m_count == TASK_MONITOR_SLOTS)
+        return;
+    m_names[m_count] = name;
+    m_tasks[m_count] = task;
+    m_count++;
+}
+
+uint32_t TaskMonitor::stackFree(size_t index) const
+{
+    // the ESP-IDF port counts the stack in bytes
+    return uxTaskGetStackHighWaterMark(m_tasks[index]);
+}
+
+void TaskMonitor::loopTick()
+{
+    uint32_t now = micros();
+    if (m_lastTick != 0)
+    {
+        uint32_t gap = now - m_lastTick;
+        m_loop.buckets[bucketOf(gap)]++;
+        m_loop.sum_ms += gap / 1000;
+        m_loop.count++;
+        if (gap > m_loop.max_us)
+            m_loop.max_us = gap;
+    }
+    m_lastTick = now;
+}
+
+uint32_t TaskMonitor::bucketLimitMs(size_t bucket)
+{
+    return bucket + 1 < LATENCY_BUCKETS ? 1UL << bucket : 0;
+}
+
+size_t TaskMonitor::bucketOf(uint32_t us)
+{
+    uint32_t ms = us / 1000;
+    size_t bucket = ms == 0 ? 0 : 32 - __builtin_clz(ms);
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
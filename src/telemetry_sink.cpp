@@ -0,0 +1,121 @@
+#include "telemetry_sink.h"
+#include <stdio.h>
+#include <string.h>
+
+TelemetryDispatcher::TelemetryDispatcher() : m_enabled(TELEMETRY_ALL)
+{
+    memset(m_sinks, 0, sizeof(m_sinks));
+    memset(m_offered, 0, sizeof(m_offered));
+    memset(m_rejected, 0, sizeof(m_rejected));
+    memset(m_serialized, 0, sizeof(m_serialized));
+}
+
+bool TelemetryDispatcher::add(uint8_t slot, TelemetrySink &sink)
+{
+    if (slot >= TELEMETRY_SINKS || m_sinks[slot] != nullptr || sink.format() >= TELEMETRY_FORMATS)
+        return false;
+    m_sinks[slot] = &sink;
+    return true;
+}
+
+void TelemetryDispatcher::publish(const telemetry_reading &reading)
+{
+    size_t lengths[TELEMETRY_FORMATS];
+    bool done[TELEMETRY_FORMATS] = {};
+    uint8_t enabled = m_enabled;
+    for (uint8_t slot = 0; slot < TELEMETRY_SINKS; slot++)
+    {
+        TelemetrySink *sink = m_sinks[slot];
+        if (sink == nullptr || (enabled & (1 << slot)) == 0 || !sink->ready())
+            continue;
+
+        // serialized for the first sink that wants the format, the rest get the same text
+        uint8_t format = sink->format();
+        if (!done[format])
+        {
+            if (format == TELEMETRY_JSON)
+                lengths[format] = telemetryJson(reading, m_text[format], sizeof(m_text[format]));
+            else if (format == TELEMETRY_LINE)
+                lengths[format] = telemetryLine(reading, m_text[format], sizeof(m_text[format]));
+            else
+                lengths[format] = 0;
+            if (format != TELEMETRY_FIELDS)
+                m_serialized[format]++;
+            done[format] = true;
+        }
+        telemetry_payload payload;
+        payload.reading = &reading;
+        payload.text = format == TELEMETRY_FIELDS ? nullptr : m_text[format];
+        payload.length = lengths[format];
+        if (format != TELEMETRY_FIELDS && payload.length == 0)
+            continue;
+
+        m_offered[slot]++;
+        if (!sink->offer(payload))
+            m_rejected[slot]++;
+    }
+}
+
+sink_stats TelemetryDispatcher::stats(uint8_t slot) const
+{
+    sink_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (slot >= TELEMETRY_SINKS || m_sinks[slot] == nullptr)
+        return stats;
+    stats = m_sinks[slot]->sinkStats();
+    stats.offered = m_offered[slot];
+    stats.rejected = m_rejected[slot];
+    return stats;
+}
+
+static size_t fitted(int written, size_t size)
+{
+    return written > 0 && (size_t)written < size ? written : 0;
+}
+
+// {"device":"jimka","sensor":1,"time":1700000000,"level":120,...}, the time only once the clock is set
+size_t telemetryJson(const telemetry_reading &reading, char *buf, size_t size)
+{
+    char time[24] = "";
+    if (reading.time != 0)
+        snprintf(time, sizeof(time), "\"time\":%u,", (unsigned)reading.time);
+    return fitted(snprintf(buf, size,
+                           "{\"device\":\"jimka\",\"sensor\":%u,%s\"level\":%d,\"fill_perc\":%d,\"distance\":%u,"
+                           "\"temperature\":%.2f,\"humidity\":%.2f,\"batt_perc\":%d,\"batt_voltage\":%.2f,"
+                           "\"fill_rate\":%.1f}",
+                           reading.sensor_id, time, reading.level, reading.fill_perc, (unsigned)reading.distance,
+                           reading.temperature, reading.humidity, reading.batt_perc, reading.batt_voltage,
+                           reading.fill_rate),
+                  size);
+}
+
+// tank,sensor=1 level=120i,...,fill_rate=12.0 1700000000000000000; in nanoseconds, the default precision,
+// so the write URL needs no parameter for it. Without a clock the server stamps the line.
+size_t telemetryLine(const telemetry_reading &reading, char *buf, size_t size)
+{
+    char time[24] = "";
+    if (reading.time != 0)
+        snprintf(time, sizeof(time), " %u000000000", (unsigned)reading.time);
+    return fitted(snprintf(buf, size,
+                           "tank,sensor=%u level=%di,fill_perc=%di,distance=%ui,temperature=%.2f,humidity=%.2f,"
+                           "batt_perc=%di,batt_voltage=%.2f,fill_rate=%.1f%s",
+                           reading.sensor_id, reading.level, reading.fill_perc, (unsigned)reading.distance,
+                           reading.temperature, reading.humidity, reading.batt_perc, reading.batt_voltage,
+                           reading.fill_rate, time),
+                  size);
+}
+
+const char *telemetryFormatName(uint8_t format)
+{
+    switch (format)
+    {
+    case TELEMETRY_FIELDS:
+        return "fields";
+    case TELEMETRY_JSON:
+        return "json";
+    case TELEMETRY_LINE:
+        return "line";
+    default:
+        return "?";
+    }
+}
@@ -0,0 +1,220 @@
+#include "thingspeak_uploader.h"
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include "ThingSpeak.h"
+#include "wall_clock.h"
+
+#define THINGSPEAK_IDLE_MS 1000
+
+// Failures back off 15.5 s, 31 s, 62 s, ...: the rate limit is the shortest retry
+ThingSpeakUploader::ThingSpeakUploader()
+    : m_backoff(THINGSPEAK_INTERVAL_MS, THINGSPEAK_BACKOFF_MAX_MS), m_channel(0), m_rejected(0), m_ready(false),
+      m_task(nullptr), m_mux(portMUX_INITIALIZER_UNLOCKED)
+{
+    m_apiKey[0] = '\0';
+    memset(&m_latest, 0, sizeof(m_latest));
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool ThingSpeakUploader::begin()
+{
+    if (m_task != nullptr)
+        return true;
+    ThingSpeak.begin(m_client);
+    return xTaskCreatePinnedToCore(taskMain, "thingspeak", THINGSPEAK_STACK, this, 1, &m_task, THINGSPEAK_CORE) ==
+           pdPASS;
+}
+
+void ThingSpeakUploader::configure(uint32_t channel, const char *apiKey)
+{
+    portENTER_CRITICAL(&m_mux);
+    m_channel = channel;
+    strlcpy(m_apiKey, apiKey, sizeof(m_apiKey));
+    m_ready = channel != 0 && m_apiKey[0] != '\0';
+    portEXIT_CRITICAL(&m_mux);
+}
+
+bool ThingSpeakUploader::enqueue(const thingspeak_update &update)
+{
+    if (m_queue.push(update))
+        return true;
+    m_rejected++;
+    return false;
+}
+
+uploader_stats ThingSpeakUploader::stats() const
+{
+    uploader_stats stats = m_stats;
+    stats.rejected = m_rejected;
+    return stats;
+}
+
+bool ThingSpeakUploader::offer(const telemetry_payload &payload)
+{
+    const telemetry_reading &reading = *payload.reading;
+    if (reading.index == 0)
+    {
+        m_latest.fields[0] = reading.humidity;
+        m_latest.fields[1] = reading.temperature;
+        m_latest.fields[2] = reading.level;
+        m_latest.fields[3] = reading.batt_voltage;
+        m_latest.mask |= 0x0F;
+    }
+    else if (reading.index + 4 <= THINGSPEAK_FIELDS)
+    {
+        m_latest.fields[reading.index + 3] = reading.level;
+        m_latest.mask |= 1 << (reading.index + 3);
+    }
+    m_latest.queued_ms = reading.queued_ms;
+    return enqueue(m_latest);
+}
+
+sink_stats ThingSpeakUploader::sinkStats() const
+{
+    sink_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.delivered = m_stats.uploaded;
+    stats.failures = m_stats.failures;
+    stats.dropped = m_stats.dropped;
+    stats.backlog = m_stats.backlog;
+    stats.backoff_ms = m_stats.backoff_ms;
+    stats.last_latency_ms = m_stats.last_latency_ms;
+    return stats;
+}
+
+void ThingSpeakUploader::taskMain(void *arg)
+{
+    static_cast<ThingSpeakUploader *>(arg)->run();
+}
+
+void ThingSpeakUploader::drainQueue()
+{
+    m_stats.queued += m_backlog.drain(m_queue, m_stats.dropped);
+    m_stats.backlog = m_backlog.count();
+}
+
+void ThingSpeakUploader::run()
+{
+    for (;;)
+    {
+        drainQueue();
+
+        uint32_t channel;
+        char apiKey[THINGSPEAK_KEY_LEN];
+        portENTER_CRITICAL(&m_mux);
+        channel = m_channel;
+        memcpy(apiKey, m_apiKey, sizeof(apiKey));
+        portEXIT_CRITICAL(&m_mux);
+
+        // a Wi-Fi outage keeps the backlog, it is sent once the connection is back
+        if (m_backlog.count() == 0 || channel == 0 || apiKey[0] == '\0' || WiFi.status() != WL_CONNECTED ||
+            !m_backoff.due())
+        {
+            vTaskDelay(pdMS_TO_TICKS(THINGSPEAK_IDLE_MS));
+            continue;
+        }
+
+        // without a clock older updates cannot be dated, they go one by one and get the upload time
+        size_t batch = m_backlog.count() < THINGSPEAK_BATCH ? m_backlog.count() : THINGSPEAK_BATCH;
+        if (!clockIsSet(time(nullptr)))
+            batch = 1;
+        uint32_t started = millis();
+        bool sent = batch == 1 ? uploadOne(channel, apiKey) : uploadBatch(channel, apiKey, batch);
+        m_stats.last_request_ms = millis() - started;
+        m_stats.requests++;
+
+        if (sent)
+        {
+            accept(batch);
+            m_backoff.clear(THINGSPEAK_INTERVAL_MS);
+        }
+        else
+        {
+            m_stats.failures++;
+            m_backoff.failed();
+        }
+        m_stats.consecutive_failures = m_backoff.failures();
+        m_stats.backoff_ms = m_backoff.backoffMs();
+    }
+}
+
+void ThingSpeakUploader::accept(size_t count)
+{
+    uint32_t now = millis();
+    m_stats.last_latency_ms = now - m_backlog.at(count - 1).queued_ms;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t latency = now - m_backlog.at(i).queued_ms;
+        if (latency > m_stats.max_latency_ms)
+            m_stats.max_latency_ms = latency;
+    }
+    m_backlog.remove(count);
+    m_stats.uploaded += count;
+    m_stats.backlog = m_backlog.count();
+}
+
+// ISO 8601 UTC time the update was queued at, false while the clock is not set
+bool ThingSpeakUploader::createdAt(uint32_t queuedMs, char *buf, size_t size)
+{
+    time_t now = time(nullptr);
+    if (!clockIsSet(now))
+        return false;
+    time_t created = now - (millis() - queuedMs) / 1000;
+    struct tm tm;
+    gmtime_r(&created, &tm);
+    return strftime(buf, size, "%Y-%m-%dT%H:%M:%SZ", &tm) > 0;
+}
+
+bool ThingSpeakUploader::uploadOne(uint32_t channel, const char *apiKey)
+{
+    const thingspeak_update &update = m_backlog.at(0);
+    for (uint8_t i = 0; i < THINGSPEAK_FIELDS; i++)
+    {
+        if (update.mask & (1 << i))
+            ThingSpeak.setField(i + 1, update.fields[i]);
+    }
+    // an update that waited for the connection keeps the time it was measured at
+    char created[24];
+    if (millis() - update.queued_ms > THINGSPEAK_INTERVAL_MS && createdAt(update.queued_ms, created, sizeof(created)))
+        ThingSpeak.setCreatedAt(created);
+    return ThingSpeak.writeFields(channel, apiKey) == TS_OK_SUCCESS;
+}
+
+// https://www.mathworks.com/help/thingspeak/bulkwritejsondata.html
+bool ThingSpeakUploader::uploadBatch(uint32_t channel, const char *apiKey, size_t count)
+{
+    size_t length = snprintf(m_body, sizeof(m_body), "{\"write_api_key\":\"%s\",\"updates\":[", apiKey);
+    for (size_t i = 0; i < count && length < sizeof(m_body); i++)
+    {
+        const thingspeak_update &update = m_backlog.at(i);
+        char created[24];
+        if (!createdAt(update.queued_ms, created, sizeof(created)))
+            return false;
+        length += snprintf(m_body + length, sizeof(m_body) - length, "%s{\"created_at\":\"%s\"", i == 0 ? "" : ",",
+                           created);
+        for (uint8_t f = 0; f < THINGSPEAK_FIELDS && length < sizeof(m_body); f++)
+        {
+            if (update.mask & (1 << f))
+                length += snprintf(m_body + length, sizeof(m_body) - length, ",\"field%u\":%.2f", f + 1,
+                                   update.fields[f]);
+        }
+        if (length < sizeof(m_body))
+            length += snprintf(m_body + length, sizeof(m_body) - length, "}");
+    }
+    if (length < sizeof(m_body))
+        length += snprintf(m_body + length, sizeof(m_body) - length, "]}");
+    if (length >= sizeof(m_body))
+        return false;
+
+    char url[80];
+    snprintf(url, sizeof(url), "http://api.thingspeak.com/channels/%u/bulk_update.json", (unsigned)channel);
+    HTTPClient http;
+    http.setTimeout(THINGSPEAK_TIMEOUT_MS);
+    if (!http.begin(m_client, url))
+        return false;
+    http.addHeader(F("Content-Type"), F("application/json"));
+    int status = http.POST((uint8_t *)m_body, length);
+    http.end();
+    m_stats.batches++;
+    return status == 202 || status == 200;
+}
@@ -8,19 +8,41 @@
 #include "ESPAsyncWebServer.h"
 #include <ESPmDNS.h>
 #include "LittleFS.h"
-#include "ThingSpeak.h"
 #include "uptime.h"
 #include "uptime_formatter.h"
 #include <EasyDDNS.h>
 #include <math.h>
 #include <RH_ASK.h>
 #include <SPI.h> // Not actually used but needed to compile
+#include "page_template.h"
+#include "gzip_template.h"
+#include "static_assets.h"
+#include "snapshot_buffer.h"
+#include "live_push.h"
+#include "history_store.h"
+#include "packet_decoder.h"
+#include "link_monitor.h"
+#include "sensor_registry.h"
+#include "dashboard.h"
+#include "thingspeak_uploader.h"
+#include "alert_notifier.h"
+#include "mqtt_publisher.h"
+#include "http_sink.h"
+#include "telemetry_sink.h"
+#include "config_store.h"
+#include "radio_receiver.h"
+#include "task_monitor.h"
+#include "bench.h"
+#include "metrics.h"
+#include "route_handler.h"
+#include "request_arena.h"
+#include "fixed_string.h"
+#include "wall_clock.h"
+#include <time.h>
 
 /*
     This code works only with ESP 1.4.0 version */
 
-WiFiClient client; // for thingspeak
-
 String ssids_array[50];
 String network_string;
 String connected_string;
@@ -38,7 +60,7 @@ long start_wifi_millis;
 long wifi_timeout = 10000;
 bool bluetooth_disconnect = false;
 bool clear_preferences_requested = false;
-bool data_received = false;
+volatile bool settingsChanged = false; // set by a save on the web server, the loop applies the settings
 
 enum wifi_setup_stages
 {
@@ -56,20 +78,8 @@ enum wifi_setup_stages wifi_stage = NONE;
 // this will assign the name PushButton to pin numer 4
 const int PushButton = 4;
 
-// form settings
-uint32_t hloubka = 0;
-uint32_t napust = 0;
-String thingspeakApiKey = "";
-uint32_t thingspeakChannel = 0;
-
-float humidity = 0;
-float temperature = 0;
-uint32_t distance = 0;
-int battPerc = 0;
-float battVoltage = 0;
-unsigned long uptime_minutes_received = 0;
-String duckdnsDomain = "";
-String duckdnsToken = "";
+// form settings, the "jimka" namespace
+ConfigStore settings;
 
 AsyncWebServer server(80);
 
@@ -81,162 +91,477 @@ Task t1(1000, 1, &clearPreferences);
 Scheduler runner;
 
 RH_ASK driver(2000, 13); // 200bps
+RadioReceiver radio(driver);
+TaskMonitor tasks;
+
+PageTemplate indexPage;
+PageTemplate graphsPage;
+PageTemplate configurationPage;
+GzipTemplate indexGzip; // the same pages, compressed at build time
+GzipTemplate graphsGzip;
+GzipTemplate configurationGzip;
+StaticAssetHandler staticAssets(LITTLEFS);
+SnapshotBuffer stateJson;
+LivePush livePush("/api/v1/ws", stateJson);
+LinkMonitor links;
+ThingSpeakUploader thingspeak;
+AlertNotifier alertNotifier;
+MqttPublisher mqtt(LITTLEFS);
+HttpSink influx("influx", TELEMETRY_LINE, "text/plain; charset=utf-8", HTTP_SINK_BATCH);
+HttpSink readingHook("webhook", TELEMETRY_JSON, "application/json", 1);
+TelemetryDispatcher telemetry;
+SensorRegistry sensors;
+dashboard_context pageContext; // what the page being rendered shows
+jimka_config pageSettings;      // the copy of the settings pageContext points into, web server task only
 
 void notFound(AsyncWebServerRequest *request);
 void onSave(AsyncWebServerRequest *request);
 void startWebServer();
-void log(String text, bool reset = true);
+void log(const char *text, bool reset = true);
+void log(const __FlashStringHelper *text, bool reset = true);
 void start_mdns_service();
 void add_mdns_services();
 void clearPreferences();
 void getJimkaPreferences();
+void configureInflux();
+void applySettings();
+void applySavedSettings();
+tank_sensor *registerSensor(uint8_t id);
+tank_sensor *requestSensor(AsyncWebServerRequest *request, bool post = false);
 void isr();
-String checkNoData(String string, String altNoDataText = "");
-String processor(const String &var);
-bool init_wifi(String ssid, String pass);
+size_t resolveTemplateVar(uint8_t var, char *buf, size_t size);
+uint8_t *readTemplate(const char *path, size_t &size);
+bool loadTemplate(PageTemplate &page, const char *path);
+bool loadTemplate(GzipTemplate &page, const char *path);
+void fillDashboard(dashboard_context &ctx, const tank_sensor *sensor, const jimka_config &config);
+void sendTemplate(AsyncWebServerRequest *request, const PageTemplate &page, const GzipTemplate &gzipPage);
+void serialCommand();
+void runBenchmarks(bench_format format);
+bool init_wifi(const char *ssid, const char *pass);
 void scan_wifi_networks();
 void callback(esp_spp_cb_event_t event, esp_spp_cb_param_t *param);
 void callback_show_ip(esp_spp_cb_event_t event, esp_spp_cb_param_t *param);
 void disconnect_bluetooth();
 bool receive433();
-void thingspeakSendData();
-String getValue(String data, char separator, int index);
-bool loadFromLittleFS(AsyncWebServerRequest *request, String path, String dataType);
+bool handlePacket(const radio_packet &packet);
+void checkStaleSensors();
+void publishTelemetry(const tank_sensor &sensor, uint32_t arrivalMs);
+void sendStats(AsyncWebServerRequest *request);
+void updateStateJson();
+void sendState(AsyncWebServerRequest *request);
+void recordHistory(tank_sensor &sensor);
+void sendHistory(AsyncWebServerRequest *request);
+void sendMetrics(AsyncWebServerRequest *request);
+void trackRequest(AsyncWebServerRequest *request, uint8_t route);
 
 void notFound(AsyncWebServerRequest *request)
 {
     request->send(404, F("text/plain"), F("Not found"));
 }
 
+// Runs in the async_tcp task, it only changes the settings record
 void onSave(AsyncWebServerRequest *request)
 {
-    preferences.begin("jimka", false);
-    if (request->hasParam(F("hloubka"), true))
-    {
-        hloubka = atoi(request->getParam(F("hloubka"), true)->value().c_str());
-        preferences.putUInt("hloubka", hloubka);
-    }
+    uint8_t id = requestSensor(request, true)->id;
+    // every field goes into one copy of the settings, stored with a single write when anything changed
+    bool changed = settings.update([&](jimka_config &config) {
+        tank_config *tank = ConfigStore::tank(config, id, true);
+        if (tank != nullptr)
+        {
+            if (request->hasParam(F("hloubka"), true))
+                tank->depth = atoi(request->getParam(F("hloubka"), true)->value().c_str());
+            if (request->hasParam(F("napust"), true))
+                tank->inlet = atoi(request->getParam(F("napust"), true)->value().c_str());
+
+            alert_rules &rules = tank->alerts;
+            if (request->hasParam(F("alarmHladina"), true))
+                rules.level_perc = constrain(atoi(request->getParam(F("alarmHladina"), true)->value().c_str()), 0, 100);
+            if (request->hasParam(F("alarmBaterie"), true))
+                rules.battery_perc =
+                    constrain(atoi(request->getParam(F("alarmBaterie"), true)->value().c_str()), 0, 100);
+            if (request->hasParam(F("alarmNapeti"), true))
+                rules.voltage_mv = constrain(
+                    lroundf(atof(request->getParam(F("alarmNapeti"), true)->value().c_str()) * 1000), 0, 0xFFFF);
+            if (request->hasParam(F("alarmNeaktivita"), true))
+                rules.stale_minutes =
+                    constrain(atoi(request->getParam(F("alarmNeaktivita"), true)->value().c_str()), 0, 0xFFFF);
+        }
 
-    if (request->hasParam(F("napust"), true))
-    {
-        napust = atoi(request->getParam(F("napust"), true)->value().c_str());
-        preferences.putUInt("napust", napust);
-    }
+        if (request->hasParam(F("alarmUrl"), true))
+            ConfigStore::setText(config.alert_url, request->getParam(F("alarmUrl"), true)->value().c_str());
+        if (request->hasParam(F("mqttHost"), true))
+            ConfigStore::setText(config.mqtt_host, request->getParam(F("mqttHost"), true)->value().c_str());
+        if (request->hasParam(F("mqttPort"), true))
+            config.mqtt_port = constrain(atoi(request->getParam(F("mqttPort"), true)->value().c_str()), 1, 0xFFFF);
+        if (request->hasParam(F("mqttUser"), true))
+            ConfigStore::setText(config.mqtt_user, request->getParam(F("mqttUser"), true)->value().c_str());
+        // the page does not show the password, an empty field keeps it unless the user is gone too
+        if (request->hasParam(F("mqttPass"), true) &&
+            (!request->getParam(F("mqttPass"), true)->value().isEmpty() || config.mqtt_user[0] == '\0'))
+            ConfigStore::setText(config.mqtt_password, request->getParam(F("mqttPass"), true)->value().c_str());
+        if (request->hasParam(F("influxUrl"), true))
+            ConfigStore::setText(config.influx_url, request->getParam(F("influxUrl"), true)->value().c_str());
+        if (request->hasParam(F("influxToken"), true))
+            ConfigStore::setText(config.influx_token, request->getParam(F("influxToken"), true)->value().c_str());
+        if (request->hasParam(F("webhookUrl"), true))
+            ConfigStore::setText(config.webhook_url, request->getParam(F("webhookUrl"), true)->value().c_str());
+
+        // an unchecked box is not sent at all, the hidden field tells that the boxes were on the form
+        if (request->hasParam(F("sinks"), true))
+        {
+            static const char *const boxes[TELEMETRY_SINKS] = {"sinkThingspeak", "sinkMqtt", "sinkInflux",
+                                                                "sinkWebhook"};
+            config.sinks = 0;
+            for (uint8_t slot = 0; slot < TELEMETRY_SINKS; slot++)
+            {
+                if (request->hasParam(boxes[slot], true))
+                    config.sinks |= 1 << slot;
+            }
+        }
+
+        if (request->hasParam(F("thingspeakApi"), true))
+            ConfigStore::setText(config.thingspeak_api, request->getParam(F("thingspeakApi"), true)->value().c_str());
+        if (request->hasParam(F("thingspeakChannel"), true))
+            config.thingspeak_channel = atol(request->getParam(F("thingspeakChannel"), true)->value().c_str());
+        if (request->hasParam(F("duckdnsDomain"), true))
+            ConfigStore::setText(config.duckdns_domain, request->getParam(F("duckdnsDomain"), true)->value().c_str());
+        if (request->hasParam(F("duckdnsToken"), true))
+            ConfigStore::setText(config.duckdns_token, request->getParam(F("duckdnsToken"), true)->value().c_str());
+    });
+
+    // the loop reads the sensors and hands the settings to the tasks, a save that changed nothing leaves them alone
+    if (changed)
+        settingsChanged = true;
+
+    Serial.println(F("save executed"));
+}
+
+// What answers each route of route_table, indexed by metrics_route
+static const route_function routeFunctions[ROUTE_COUNT] = {
+    [](AsyncWebServerRequest *request) { sendTemplate(request, indexPage, indexGzip); },   // ROUTE_INDEX
+    [](AsyncWebServerRequest *request) { sendTemplate(request, graphsPage, graphsGzip); }, // ROUTE_GRAPHS
+    [](AsyncWebServerRequest *request) {                                              // ROUTE_CONFIGURATION
+        sendTemplate(request, configurationPage, configurationGzip);
+    },
+    [](AsyncWebServerRequest *request) {                                              // ROUTE_SAVE
+        onSave(request);
+        request->send(200, F("text/plain"), F("Ulozeno"));
+    },
+    sendState,   // ROUTE_STATE
+    sendStats,   // ROUTE_STATS
+    sendHistory, // ROUTE_HISTORY
+    sendMetrics, // ROUTE_METRICS
+    nullptr,     // ROUTE_ASSET, StaticAssetHandler
+    nullptr,     // ROUTE_NOT_FOUND
+};
+RouteHandler routes(routeFunctions);
+
+// Called from setup() and again when Bluetooth provisioning ends, the handlers and the task are added once
+void startWebServer()
+{
+    static bool started = false;
+    if (started)
+        return;
+    started = true;
+    server.addHandler(&staticAssets);
+    livePush.begin(server);
+    server.addHandler(&routes);
+    server.onNotFound([](AsyncWebServerRequest *request) {
+        trackRequest(request, ROUTE_NOT_FOUND);
+        notFound(request);
+    });
+    server.begin();
+    tasks.add("async_tcp", xTaskGetHandle("async_tcp"));
+}
 
-    if (request->hasParam(F("thingspeakApi"), true))
+void sendStats(AsyncWebServerRequest *request)
+{
+    const static_asset_stats &assets = staticAssets.stats();
+    live_push_stats push = livePush.stats();
+    metricsCountAlloc(ALLOC_HTTP, 2048);
+    AsyncResponseStream *response = request->beginResponseStream(F("application/json"), 2048);
+    response->printf("{\"assets\":{\"files\":%u,\"requests\":%u,\"not_modified\":%u,\"bytes_served\":%u,"
+                     "\"bytes_saved\":%u},",
+                     (unsigned)staticAssets.count(), (unsigned)assets.requests, (unsigned)assets.not_modified,
+                     (unsigned)assets.bytes_served, (unsigned)assets.bytes_saved);
+    radio_stats radioStats = radio.stats();
+    response->printf("\"radio\":{\"packets_ok\":%u,\"packets_rejected\":%u,\"crc_errors\":%u,\"queue_overflows\":%u,"
+                     "\"max_queued\":%u,\"links\":[",
+                     (unsigned)radioStats.packets_ok, (unsigned)radioStats.packets_rejected, (unsigned)driver.rxBad(),
+                     (unsigned)radioStats.queue_overflows, (unsigned)radioStats.max_queued);
+    for (size_t i = 0; i < links.count(); i++)
     {
-        thingspeakApiKey = request->getParam(F("thingspeakApi"), true)->value().c_str();
-        preferences.putString("thingspeakApi", String(thingspeakApiKey));
+        const link_stats &link = links.at(i);
+        response->printf("%s{\"sensor\":%u,\"sequenced\":%s,\"received\":%u,\"lost\":%u,\"duplicates\":%u,"
+                         "\"reordered\":%u,\"restarts\":%u,\"loss_perc\":%.1f,\"quality\":%u,\"interval_ms\":%u,"
+                         "\"jitter_ms\":%u,\"age_s\":%u}",
+                         i == 0 ? "" : ",", link.sensor_id, link.sequenced ? "true" : "false",
+                         (unsigned)link.received, (unsigned)link.lost, (unsigned)link.duplicates,
+                         (unsigned)link.reordered, (unsigned)link.restarts, LinkMonitor::lossPercent(link),
+                         link.quality, (unsigned)link.interval_ms, (unsigned)link.jitter_ms,
+                         (unsigned)((millis() - link.last_arrival_ms) / 1000));
     }
-
-    if (request->hasParam(F("thingspeakChannel"), true))
+    response->printf("]},\"push\":{\"subscribers\":%u,\"frames_sent\":%u,\"frames_dropped\":%u,\"rejected\":%u},",
+                     (unsigned)push.subscribers, (unsigned)push.frames_sent, (unsigned)push.frames_dropped,
+                     (unsigned)push.rejected);
+    uploader_stats upload = thingspeak.stats();
+    response->printf("\"thingspeak\":{\"queued\":%u,\"rejected\":%u,\"uploaded\":%u,\"requests\":%u,"
+                     "\"batches\":%u,\"failures\":%u,\"dropped\":%u,\"backlog\":%u,\"consecutive_failures\":%u,"
+                     "\"backoff_ms\":%u,\"last_latency_ms\":%u,\"max_latency_ms\":%u,\"last_request_ms\":%u},",
+                     (unsigned)upload.queued, (unsigned)upload.rejected, (unsigned)upload.uploaded,
+                     (unsigned)upload.requests, (unsigned)upload.batches, (unsigned)upload.failures,
+                     (unsigned)upload.dropped, (unsigned)upload.backlog, (unsigned)upload.consecutive_failures,
+                     (unsigned)upload.backoff_ms, (unsigned)upload.last_latency_ms, (unsigned)upload.max_latency_ms,
+                     (unsigned)upload.last_request_ms);
+    notifier_stats notify = alertNotifier.stats();
+    uint32_t raised = 0, cleared = 0, suppressed = 0;
+    for (size_t i = 0; i < sensors.count(); i++)
     {
-        thingspeakChannel = atol(request->getParam(F("thingspeakChannel"), true)->value().c_str());
-        preferences.putUInt("thingspeakChann", thingspeakChannel);
+        raised += sensors.at(i).alerts.raised;
+        cleared += sensors.at(i).alerts.cleared;
+        suppressed += sensors.at(i).alerts.suppressed;
     }
-
-    if (request->hasParam(F("duckdnsDomain"), true))
+    response->printf("\"alerts\":{\"raised\":%u,\"cleared\":%u,\"suppressed\":%u,\"queued\":%u,\"rejected\":%u,"
+                     "\"delivered\":%u,\"failures\":%u,\"dropped\":%u,\"outbox\":%u,\"consecutive_failures\":%u,"
+                     "\"backoff_ms\":%u,\"last_latency_ms\":%u,\"last_request_ms\":%u},",
+                     (unsigned)raised, (unsigned)cleared, (unsigned)suppressed, (unsigned)notify.queued,
+                     (unsigned)notify.rejected, (unsigned)notify.delivered, (unsigned)notify.failures,
+                     (unsigned)notify.dropped, (unsigned)notify.outbox, (unsigned)notify.consecutive_failures,
+                     (unsigned)notify.backoff_ms, (unsigned)notify.last_latency_ms, (unsigned)notify.last_request_ms);
+    mqtt_stats broker = mqtt.stats();
+    response->printf("\"mqtt\":{\"connected\":%s,\"queued\":%u,\"rejected\":%u,\"published\":%u,\"acked\":%u,"
+                     "\"pending\":%u,\"spooled\":%u,\"spool_depth\":%u,\"spool_dropped\":%u,\"connects\":%u,"
+                     "\"connect_failures\":%u,\"disconnects\":%u,\"ack_timeouts\":%u,\"discovery\":%u,"
+                     "\"backoff_ms\":%u,\"last_ack_ms\":%u},",
+                     broker.connected ? "true" : "false", (unsigned)broker.queued, (unsigned)broker.rejected,
+                     (unsigned)broker.published, (unsigned)broker.acked, (unsigned)broker.pending,
+                     (unsigned)broker.spooled, (unsigned)broker.spool_depth, (unsigned)broker.spool_dropped,
+                     (unsigned)broker.connects, (unsigned)broker.connect_failures, (unsigned)broker.disconnects,
+                     (unsigned)broker.ack_timeouts, (unsigned)broker.discovery, (unsigned)broker.backoff_ms,
+                     (unsigned)broker.last_ack_ms);
+    response->print(F("\"sinks\":["));
+    const char *separator = "";
+    for (uint8_t slot = 0; slot < TELEMETRY_SINKS; slot++)
     {
-        duckdnsDomain = request->getParam(F("duckdnsDomain"), true)->value().c_str();
-        preferences.putString("duckdnsDomain", duckdnsDomain);
+        const TelemetrySink *sink = telemetry.sink(slot);
+        if (sink == nullptr)
+            continue;
+        sink_stats out = telemetry.stats(slot);
+        response->printf("%s{\"name\":\"%s\",\"format\":\"%s\",\"enabled\":%s,\"ready\":%s,\"offered\":%u,"
+                         "\"rejected\":%u,\"delivered\":%u,\"failures\":%u,\"dropped\":%u,\"backlog\":%u,"
+                         "\"backoff_ms\":%u,\"last_latency_ms\":%u}",
+                         separator, sink->name(), telemetryFormatName(sink->format()),
+                         telemetry.enabled() & (1 << slot) ? "true" : "false", sink->ready() ? "true" : "false",
+                         (unsigned)out.offered, (unsigned)out.rejected, (unsigned)out.delivered,
+                         (unsigned)out.failures, (unsigned)out.dropped, (unsigned)out.backlog,
+                         (unsigned)out.backoff_ms, (unsigned)out.last_latency_ms);
+        separator = ",";
     }
-
-    if (request->hasParam(F("duckdnsToken"), true))
+    response->print(F("],"));
+    config_stats store = settings.stats();
+    static const char *const sources[] = {"defaults", "loaded", "upgraded", "migrated", "reset"};
+    response->printf("\"config\":{\"source\":\"%s\",\"size\":%u,\"writes\":%u,\"lifetime_writes\":%u,"
+                     "\"commits\":%u,\"unchanged\":%u,\"coalesced\":%u,\"failures\":%u,\"dirty\":%s},",
+                     sources[store.source], (unsigned)store.size, (unsigned)store.writes,
+                     (unsigned)store.lifetime_writes, (unsigned)store.commits, (unsigned)store.unchanged,
+                     (unsigned)store.coalesced, (unsigned)store.failures, store.dirty ? "true" : "false");
+    response->print(F("\"history\":["));
+    for (size_t i = 0; i < sensors.count(); i++)
     {
-        duckdnsToken = request->getParam(F("duckdnsToken"), true)->value().c_str();
-        preferences.putString("duckdnsToken", duckdnsToken);
+        const tank_sensor &sensor = sensors.at(i);
+        if (sensor.history == nullptr)
+            continue;
+        history_stats hist = sensor.history->stats();
+        response->printf("%s{\"sensor\":%u,\"blocks\":%u,\"appended\":%u,\"rejected\":%u,\"blocks_written\":%u,"
+                         "\"checkpoints\":%u,\"write_errors\":%u,\"rollup_writes\":%u,\"queries\":%u,"
+                         "\"last_query_ms\":%u}",
+                         i == 0 ? "" : ",", sensor.id, (unsigned)sensor.history->blocks(), (unsigned)hist.appended,
+                         (unsigned)hist.rejected, (unsigned)hist.blocks_written, (unsigned)hist.checkpoints,
+                         (unsigned)hist.write_errors, (unsigned)hist.rollup_writes, (unsigned)hist.queries,
+                         (unsigned)hist.last_query_ms);
     }
-    preferences.end();
-    if (duckdnsDomain != "" && duckdnsToken != "")
-        EasyDDNS.client(duckdnsDomain, duckdnsToken);
+    request_arena_stats arena = ArenaLease::stats();
+    response->printf("],\"arena\":{\"leases\":%u,\"exhausted\":%u,\"in_use\":%u,\"high_water\":%u},",
+                     (unsigned)arena.leases, (unsigned)arena.exhausted, (unsigned)arena.in_use,
+                     (unsigned)arena.high_water);
+    response->print(F("\"tasks\":["));
+    for (size_t i = 0; i < tasks.count(); i++)
+        response->printf("%s{\"name\":\"%s\",\"stack_free\":%u}", i == 0 ? "" : ",", tasks.name(i),
+                         (unsigned)tasks.stackFree(i));
+    latency_histogram loopLatency = tasks.loopLatency();
+    response->printf("],\"loop\":{\"iterations\":%u,\"max_us\":%u,\"bucket_limits_ms\":[",
+                     (unsigned)loopLatency.count, (unsigned)loopLatency.max_us);
+    for (size_t i = 0; i + 1 < LATENCY_BUCKETS; i++)
+        response->printf("%s%u", i == 0 ? "" : ",", (unsigned)TaskMonitor::bucketLimitMs(i));
+    response->print(F("],\"buckets\":["));
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++)
+        response->printf("%s%u", i == 0 ? "" : ",", (unsigned)loopLatency.buckets[i]);
+    response->print(F("]}}"));
+    request->send(response);
+}
 
-    Serial.println(F("save executed"));
+// The loop task is the only writer of the state document, a save asks for it through settingsChanged
+void updateStateJson()
+{
+    stateJson.commit(writeStateJson(sensors, links, stateJson.begin(), stateJson.capacity()));
 }
 
-bool loadFromLittleFS(AsyncWebServerRequest *request, String path, String dataType)
+// Runs in the async_tcp task
+void sendState(AsyncWebServerRequest *request)
 {
-    //Serial.print("Requested page -> ");
-    //Serial.println(path);
-    if (LITTLEFS.exists(path + ".gz"))
+    AsyncWebServerResponse *response = nullptr;
+    uint32_t sequence = stateJson.sequence();
+    AsyncWebHeader *match = request->getHeader(F("If-None-Match"));
+    if (match != nullptr && stateJson.matches(match->value().c_str()))
     {
-        File dataFile = LITTLEFS.open(path + ".gz", "r");
-        if (!dataFile)
+        response = request->beginResponse(304);
+    }
+    else
+    {
+        // a copy of its own: the document is sent over many callbacks, the loop may rebuild it twice meanwhile
+        ArenaLease arena = ArenaLease::acquire(stateJson.length());
+        char *json = arena ? (char *)arena->allocate(arena->capacity(), 1) : nullptr;
+        size_t length = json != nullptr ? stateJson.read(json, arena->capacity(), sequence) : 0;
+        if (length == 0 && json != nullptr)
         {
-            notFound(request);
-            return false;
+            // it outgrew the arena in between, a tank was added
+            arena = ArenaLease::acquire(SNAPSHOT_BUFFER_SIZE);
+            json = arena ? (char *)arena->allocate(SNAPSHOT_BUFFER_SIZE, 1) : nullptr;
+            length = json != nullptr ? stateJson.read(json, SNAPSHOT_BUFFER_SIZE, sequence) : 0;
         }
+        if (json != nullptr)
+            response = request->beginResponse(
+                F("application/json"), length,
+                [arena, json, length](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                    size_t chunk = length - index < maxLen ? length - index : maxLen;
+                    memcpy(buffer, json + index, chunk);
+                    return chunk;
+                });
+    }
+    if (response == nullptr)
+    {
+        request->send(503);
+        return;
+    }
 
-        AsyncWebServerResponse *response = request->beginResponse(LITTLEFS, path, dataType);
-        //Serial.print("Real file path: ");
-        //Serial.println(path);
+    char etag[SNAPSHOT_ETAG_LEN];
+    SnapshotBuffer::etag(sequence, etag, sizeof(etag));
+    response->addHeader(F("ETag"), etag);
+    response->addHeader(F("Cache-Control"), F("no-cache"));
+    // the age of a reading is X-Uptime - measured_at, so the cached document stays valid
+    char uptime[12];
+    snprintf(uptime, sizeof(uptime), "%lu", millis() / 1000);
+    response->addHeader(F("X-Uptime"), uptime);
+    request->send(response);
+}
 
-        request->send(response);
+void recordHistory(tank_sensor &sensor)
+{
+    if (sensor.history == nullptr)
+        return;
 
-        dataFile.close();
-    }
-    else
+    history_sample sample;
+    sample.time = time(nullptr);
+    sample.level_mm = sensor.level * 10;
+    sample.temperature = round(sensor.temperature * 100);
+    sample.humidity = sensor.humidity > 0 ? round(sensor.humidity * 100) : 0;
+    sample.batt_mv = sensor.batt_voltage > 0 ? round(sensor.batt_voltage * 1000) : 0;
+    sensor.history->append(sample);
+}
+
+static uint32_t uintParam(AsyncWebServerRequest *request, const __FlashStringHelper *name, uint32_t fallback)
+{
+    if (!request->hasParam(name))
+        return fallback;
+    return strtoul(request->getParam(name)->value().c_str(), nullptr, 10);
+}
+
+void sendHistory(AsyncWebServerRequest *request)
+{
+    HistoryStore *history = requestSensor(request)->history;
+    if (history == nullptr)
     {
         notFound(request);
-        return false;
+        return;
     }
-    return true;
+
+    uint32_t to = uintParam(request, F("to"), time(nullptr));
+    uint32_t from = uintParam(request, F("from"), to > 86400 ? to - 86400 : 0);
+    // without an explicit step the range is split into points intervals, which lets long ranges use a rollup tier
+    uint32_t points = uintParam(request, F("points"), HISTORY_DEFAULT_POINTS);
+    uint32_t step = uintParam(request, F("step"), points > 0 && to > from ? (to - from) / points : 0);
+
+    // the query and its block live in the arena as long as the response that streams them
+    ArenaLease arena = ArenaLease::acquire();
+    HistoryQuery *query = arena ? arena->make<HistoryQuery>(*history, from, to, step, &*arena) : nullptr;
+    if (query == nullptr)
+    {
+        request->send(503);
+        return;
+    }
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+        F("application/json"), [arena, query](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return query->readJson(buffer, maxLen);
+        });
+    response->addHeader(F("Cache-Control"), F("no-cache"));
+    request->send(response);
 }
 
-void startWebServer()
+// Counts the request once its connection is closed, the response may still be streaming when the handler returns
+void trackRequest(AsyncWebServerRequest *request, uint8_t route)
 {
-    server.on("/css/style.css", HTTP_GET, [](AsyncWebServerRequest *request) {
-        loadFromLittleFS(request, "/css/style.css", "text/css");
-    });
-    server.on("/js/bootstrap.bundle.min.js", HTTP_GET, [](AsyncWebServerRequest *request) {
-        loadFromLittleFS(request, "/js/bootstrap.bundle.min.js", "text/javascript");
-    });
-    server.on("/css/roboto.css", HTTP_GET, [](AsyncWebServerRequest *request) {
-        loadFromLittleFS(request, "/css/roboto.css", "text/css");
-    });
-    server.on("/js/jquery-3.5.1.min.js", HTTP_GET, [](AsyncWebServerRequest *request) {
-        loadFromLittleFS(request, "/js/jquery-3.5.1.min.js", "text/javascript");
-    });
-    server.on("/webfonts/fa-solid-900.woff", HTTP_GET, [](AsyncWebServerRequest *request) {
-        loadFromLittleFS(request, "/webfonts/fa-solid-900.woff", "font/woff");
-    });
-    server.on("/webfonts/roboto_c9.ttf", HTTP_GET, [](AsyncWebServerRequest *request) {
-        loadFromLittleFS(request, "/webfonts/roboto_c9.ttf", "font/ttf");
-    });
-    server.on("/webfonts/roboto_xP.ttf", HTTP_GET, [](AsyncWebServerRequest *request) {
-        loadFromLittleFS(request, "/webfonts/roboto_xP.ttf", "font/ttf");
-    });
-    server.on("/css/bootstrap.min.css", HTTP_GET, [](AsyncWebServerRequest *request) {
-        loadFromLittleFS(request, "/css/bootstrap.min.css", "text/css");
-    });
-    server.on("/css/fontawesome.min.css", HTTP_GET, [](AsyncWebServerRequest *request) {
-        loadFromLittleFS(request, "/css/fontawesome.min.css", "text/css");
-    });
-    server.on("/css/solid.min.css", HTTP_GET, [](AsyncWebServerRequest *request) {
-        loadFromLittleFS(request, "/css/solid.min.css", "text/css");
-    });
-    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-        request->send(LITTLEFS, "/index.html", String(), false, processor);
-    });
-    server.on("/index.html", HTTP_GET, [](AsyncWebServerRequest *request) {
-        request->send(LITTLEFS, "/index.html", String(), false, processor);
-    });
-    server.on("/graphs.html", HTTP_GET, [](AsyncWebServerRequest *request) {
-        request->send(LITTLEFS, "/graphs.html", String(), false, processor);
-    });
-    server.on("/configuration.html", HTTP_GET, [](AsyncWebServerRequest *request) {
-        request->send(LITTLEFS, "/configuration.html", String(), false, processor);
-    });
+    uint32_t started = micros();
+    request->onDisconnect([route, started]() { metricsRequest(route, micros() - started); });
+}
 
-    server.on("/configuration.html", HTTP_POST, [](AsyncWebServerRequest *request) {
-        onSave(request);
-        request->send(200, F("text/plain"), F("Ulozeno"));
-    });
+void sendMetrics(AsyncWebServerRequest *request)
+{
+    metrics_snapshot snapshot;
+    uptime::calculateUptime();
+    snapshot.uptime_s = ((uptime::getDays() * 24 + uptime::getHours()) * 60 + uptime::getMinutes()) * 60 +
+                        uptime::getSeconds();
+    radio_stats radioStats = radio.stats();
+    snapshot.radio_ok = radioStats.packets_ok;
+    snapshot.radio_rejected = radioStats.packets_rejected;
+    snapshot.radio_crc_errors = driver.rxBad();
+    snapshot.radio_overflows = radioStats.queue_overflows;
+    snapshot.tasks = tasks.count();
+    for (size_t i = 0; i < tasks.count(); i++)
+    {
+        snapshot.task_names[i] = tasks.name(i);
+        snapshot.task_stack_free[i] = tasks.stackFree(i);
+    }
+    snapshot.loop = tasks.loopLatency();
 
-    server.onNotFound(notFound);
-    server.begin();
+    // streamed line by line, a full copy of the text would be a large allocation itself
+    ArenaLease arena = ArenaLease::acquire(sizeof(MetricsExport));
+    MetricsExport *metrics = arena ? arena->make<MetricsExport>(snapshot) : nullptr;
+    if (metrics == nullptr)
+    {
+        request->send(503);
+        return;
+    }
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+        F("text/plain; version=0.0.4"), [arena, metrics](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return metrics->readText(buffer, maxLen);
+        });
+    response->addHeader(F("Cache-Control"), F("no-cache"));
+    request->send(response);
+}
+
+void log(const char *text, bool reset)
+{
+    if (reset)
+    {
+        Serial.println(text);
+    }
+    else
+    {
+        Serial.print(text);
+    }
 }
 
-void log(String text, bool reset)
+void log(const __FlashStringHelper *text, bool reset)
 {
     if (reset)
     {
@@ -288,127 +613,302 @@ void clearPreferences()
     ESP.restart();
 }
 
-void getJimkaPreferences()
+// InfluxDB 2 takes the API token as "Authorization: Token ...", 1.x needs no header
+void configureInflux()
 {
-    preferences.begin("jimka", true);
-    hloubka = preferences.getUInt("hloubka", 200);
-    napust = preferences.getUInt("napust", 0);
-    thingspeakApiKey = preferences.getString("thingspeakApi", "");
-    thingspeakChannel = preferences.getUInt("thingspeakChann");
-    duckdnsToken = preferences.getString("duckdnsToken", "");
-    duckdnsDomain = preferences.getString("duckdnsDomain", "");
-    preferences.end();
+    const jimka_config &config = settings.get();
+    FixedString<HTTP_SINK_AUTH_LEN> authorization;
+    if (config.influx_token[0] != '\0')
+        authorization.appendf("Token %s", config.influx_token);
+    influx.configure(config.influx_url, authorization.c_str());
 }
 
-void isr()
+// A save of the configuration page, on the loop task that owns the live sensor state
+void applySavedSettings()
 {
-    t1.enable();
-    log(F("button pressed"));
-    clear_preferences_requested = true;
+    const jimka_config &config = settings.get();
+    for (size_t i = 0; i < sensors.count(); i++)
+    {
+        tank_sensor &sensor = sensors.at(i);
+        const tank_config *tank = ConfigStore::tank(config, sensor.id);
+        if (tank == nullptr)
+            continue;
+        sensor.depth = tank->depth;
+        sensor.inlet = tank->inlet;
+        sensor.alerts.rules = tank->alerts;
+        SensorRegistry::updateDerived(sensor);
+    }
+    applySettings();
+    if (config.duckdns_domain[0] != '\0' && config.duckdns_token[0] != '\0')
+        EasyDDNS.client(config.duckdns_domain, config.duckdns_token);
+    updateStateJson();
+}
+
+// Hands the settings to the tasks that use them
+void applySettings()
+{
+    const jimka_config &config = settings.get();
+    thingspeak.configure(config.thingspeak_channel, config.thingspeak_api);
+    alertNotifier.configure(config.alert_url);
+    mqtt.configure(config.mqtt_host, config.mqtt_port, config.mqtt_user, config.mqtt_password, bluetooth_name);
+    configureInflux();
+    readingHook.configure(config.webhook_url, "");
+    telemetry.setEnabled(config.sinks);
+}
+
+void getJimkaPreferences()
+{
+    if (!settings.begin())
+        Serial.println(F("Settings could not be stored"));
+    applySettings();
+
+    uint8_t ids[SENSOR_MAX];
+    size_t known = settings.get().tank_count;
+    for (size_t i = 0; i < known; i++)
+        ids[i] = settings.get().tanks[i].id;
+    // a fresh device shows the legacy sensor until the first reading says otherwise
+    if (known == 0)
+        ids[known++] = PACKET_LEGACY_SENSOR;
+    for (size_t i = 0; i < known; i++)
+        registerSensor(ids[i]);
 }
 
-String checkNoData(String string, String altNoDataText)
+tank_sensor *registerSensor(uint8_t id)
 {
-    if (!data_received)
+    size_t before = sensors.count();
+    tank_sensor *sensor = sensors.add(id);
+    if (sensor == nullptr || sensors.count() == before)
+        return sensor;
+
+    const tank_config *stored = ConfigStore::tank(settings.get(), id);
+    if (stored != nullptr)
     {
-        if (altNoDataText == "")
-        {
-            return String(F("cekam na data..."));
-        }
-        else
-        {
-            return altNoDataText;
-        }
+        sensor->depth = stored->depth;
+        sensor->inlet = stored->inlet;
+        sensor->trend.emptied_at = stored->emptied_at;
+        sensor->alerts.rules = stored->alerts;
     }
     else
     {
-        return string;
+        // a new tank goes into the settings with the defaults it starts with
+        settings.update([id](jimka_config &config) { ConfigStore::tank(config, id, true); });
     }
+    SensorRegistry::updateDerived(*sensor);
+
+    // the first tank gets most of the filesystem, the legacy sensor keeps the directory it always had
+    char dir[HISTORY_PATH_LEN];
+    if (id == PACKET_LEGACY_SENSOR)
+        snprintf(dir, sizeof(dir), "/history");
+    else
+        snprintf(dir, sizeof(dir), "/history/s%u", id);
+    const history_layout primary = HISTORY_PRIMARY_LAYOUT;
+    const history_layout secondary = HISTORY_SECONDARY_LAYOUT;
+    if (!LITTLEFS.exists("/history"))
+        LITTLEFS.mkdir("/history");
+    sensor->history = new HistoryStore(LITTLEFS, dir, before == 0 ? primary : secondary);
+    metricsCountAlloc(ALLOC_HISTORY, sizeof(HistoryStore));
+    if (!sensor->history->begin())
+        Serial.printf("History store of sensor %u could not be opened\n", id);
+    return sensor;
 }
 
-String processor(const String &var)
+// The sensor named by the "sensor" parameter, the first one otherwise
+tank_sensor *requestSensor(AsyncWebServerRequest *request, bool post)
 {
-    if (var == F("NAPUST"))
+    tank_sensor *sensor = nullptr;
+    if (request->hasParam(F("sensor"), post))
     {
-        return String(napust);
+        unsigned long id = strtoul(request->getParam(F("sensor"), post)->value().c_str(), nullptr, 10);
+        if (id <= 0xFF)
+            sensor = sensors.find(id);
     }
+    return sensor != nullptr ? sensor : &sensors.at(0);
+}
 
-    if (var == F("HLOUBKA"))
-    {
-        return String(hloubka);
-    }
+void isr()
+{
+    t1.enable();
+    log(F("button pressed"));
+    clear_preferences_requested = true;
+}
 
-    if (var == F("VOLT"))
-    {
-        return checkNoData(String(battVoltage));
-    }
+size_t resolveTemplateVar(uint8_t var, char *buf, size_t size)
+{
+    return dashboardValue(var, pageContext, buf, size);
+}
 
-    if (var == F("BATTPERCENT"))
+// The whole file in a malloc()ed buffer, nullptr when it is missing or could not be read
+uint8_t *readTemplate(const char *path, size_t &size)
+{
+    File file = LITTLEFS.open(path, "r");
+    if (!file)
     {
-        return checkNoData(String(battPerc), String(F("0")));
+        Serial.print(F("Template not found: "));
+        Serial.println(path);
+        return nullptr;
     }
 
-    if (var == F("HLADINA"))
+    size = file.size();
+    uint8_t *data = (uint8_t *)malloc(size);
+    metricsCountAlloc(ALLOC_TEMPLATES, size);
+    if (data == nullptr || file.read(data, size) != size)
     {
-        int hladina;
-        hladina = hloubka - distance - napust;
-        return checkNoData(String(hladina));
+        free(data);
+        file.close();
+        Serial.print(F("Template could not be read: "));
+        Serial.println(path);
+        return nullptr;
     }
+    file.close();
+    return data;
+}
 
-    if (var == F("PLNOSTPERC"))
-    {
-        int hladina;
-        hladina = hloubka - distance - napust;
-        float perc = ((float)hladina / (float)hloubka) * 100.00;
-        int perc2 = round(perc);
-        return checkNoData(String(perc2), String(F("0")));
-    }
+bool loadTemplate(PageTemplate &page, const char *path)
+{
+    size_t size;
+    uint8_t *text = readTemplate(path, size);
+    if (text == nullptr)
+        return false;
 
-    if (var == F("TEPLOTA"))
+    if (!page.parse((char *)text, size))
     {
-        return checkNoData(String(temperature));
+        Serial.print(F("Template has too many placeholders: "));
+        Serial.println(path);
+        return false;
     }
+    return true;
+}
 
-    if (var == F("VLHKOST"))
-    {
-        return checkNoData(String(humidity));
-    }
+bool loadTemplate(GzipTemplate &page, const char *path)
+{
+    size_t size;
+    uint8_t *data = readTemplate(path, size);
+    if (data == nullptr)
+        return false;
 
-    if (var == F("THINGSPEAKAPI"))
+    if (!page.parse(data, size))
     {
-        return thingspeakApiKey;
+        Serial.print(F("Compressed template is damaged: "));
+        Serial.println(path);
+        return false;
     }
+    return true;
+}
 
-    if (var == F("THINGSPEAKCHANNEL"))
-    {
-        return String(thingspeakChannel);
-    }
+// ctx keeps pointers into config, which has to stay unchanged until the page is resolved
+void fillDashboard(dashboard_context &ctx, const tank_sensor *sensor, const jimka_config &config)
+{
+    uptime::calculateUptime();
+    ctx.sensor = sensor;
+    ctx.links = &links;
+    ctx.thingspeak_api = config.thingspeak_api;
+    ctx.thingspeak_channel = config.thingspeak_channel;
+    ctx.duckdns_domain = config.duckdns_domain;
+    ctx.duckdns_token = config.duckdns_token;
+    ctx.alert_url = config.alert_url;
+    ctx.mqtt_host = config.mqtt_host;
+    ctx.mqtt_port = config.mqtt_port;
+    ctx.mqtt_user = config.mqtt_user;
+    ctx.sinks = config.sinks;
+    ctx.influx_url = config.influx_url;
+    ctx.influx_token = config.influx_token;
+    ctx.webhook_url = config.webhook_url;
+    ctx.uptime_s = ((uptime::getDays() * 24 + uptime::getHours()) * 60 + uptime::getMinutes()) * 60 +
+                   uptime::getSeconds();
+}
 
-    if (var == F("LASTMEASUREMENT"))
+void sendTemplate(AsyncWebServerRequest *request, const PageTemplate &page, const GzipTemplate &gzipPage)
+{
+    if (!page.loaded())
     {
-        uptime::calculateUptime();
-        return checkNoData(String(uptime::getMinutesRaw() - uptime_minutes_received),
-                           String(F("-")));
+        notFound(request);
+        return;
     }
 
-    if (var == F("UPTIME"))
+    // the values are taken now, the page text is copied into the send buffer of the connection as it drains;
+    // the loop may commit a change to the settings meanwhile, so the page shows a copy
+    settings.snapshot(pageSettings);
+    fillDashboard(pageContext, requestSensor(request), pageSettings);
+    AsyncWebHeader *encoding = request->getHeader(F("Accept-Encoding"));
+    AsyncWebServerResponse *response = nullptr;
+    if (gzipPage.loaded() && encoding != nullptr && strstr(encoding->value().c_str(), "gzip") != nullptr)
     {
-        return String(uptime_formatter::getUptime());
+        ArenaLease arena = ArenaLease::acquire(sizeof(GzipTemplateStream));
+        GzipTemplateStream *stream = arena ? arena->make<GzipTemplateStream>(gzipPage, resolveTemplateVar) : nullptr;
+        if (stream != nullptr)
+        {
+            response = request->beginResponse(F("text/html"), stream->length(),
+                                              [arena, stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                                                  return stream->read(buffer, maxLen);
+                                              });
+            response->addHeader(F("Content-Encoding"), F("gzip"));
+        }
     }
-
-    if (var == F("DUCKDNSDOMAIN"))
+    else
     {
-        return duckdnsDomain;
+        ArenaLease arena = ArenaLease::acquire(sizeof(TemplateStream));
+        TemplateStream *stream = arena ? arena->make<TemplateStream>(page, resolveTemplateVar) : nullptr;
+        if (stream != nullptr)
+        {
+            response = request->beginResponse(F("text/html"), stream->length(),
+                                              [arena, stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                                                  return stream->read(buffer, maxLen);
+                                              });
+        }
     }
-
-    if (var == F("DUCKDNSTOKEN"))
+    if (response == nullptr)
     {
-        return duckdnsToken;
+        request->send(503);
+        return;
     }
-    return String();
+    response->addHeader(F("Vary"), F("Accept-Encoding"));
+    request->send(response);
+}
+
+static void writeToSerial(void *ctx, const char *data, size_t len)
+{
+    Serial.write((const uint8_t *)data, len);
 }
 
-bool init_wifi(String ssid, String pass)
+void serialCommand()
+{
+    char line[16];
+    size_t length = Serial.readBytesUntil('\n', line, sizeof(line) - 1);
+    while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' '))
+        length--;
+    line[length] = '\0';
+
+    if (strcmp(line, "bench") == 0)
+        runBenchmarks(BENCH_JSON);
+    else if (strcmp(line, "bench csv") == 0)
+        runBenchmarks(BENCH_CSV);
+    else if (length > 0)
+        Serial.println(F("Commands: bench, bench csv"));
+}
+
+// Runs in the loop task while the server keeps serving, so the figures include that competition
+void runBenchmarks(bench_format format)
+{
+    if (sensors.count() == 0)
+        return;
+    dashboard_context ctx;
+    fillDashboard(ctx, &sensors.at(0), settings.get());
+
+    BenchReport report(format, writeToSerial, nullptr);
+    report.begin("esp32");
+    benchDecode(report);
+    benchRender(report, "index.html", indexPage, ctx);
+    benchRender(report, "configuration.html", configurationPage, ctx);
+    benchRender(report, "graphs.html", graphsPage, ctx);
+    benchGzipRender(report, "index.html", indexGzip, ctx);
+    benchConcurrentRender(report, "index.html", indexPage, ctx);
+    benchStateJson(report, sensors, links);
+    benchRoutes(report);
+    benchAssets(report, LITTLEFS);
+    report.end();
+}
+
+bool init_wifi(const char *ssid, const char *pass)
 {
     Serial.println(ssid);
     //Serial.println(pass);
@@ -416,7 +916,7 @@ bool init_wifi(String ssid, String pass)
     WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
 
     start_wifi_millis = millis();
-    WiFi.begin(ssid.c_str(), pass.c_str());
+    WiFi.begin(ssid, pass);
     WiFi.setHostname("jimka-esp32");
     log(F("\nConnecting: "));
     while (WiFi.status() != WL_CONNECTED)
@@ -430,7 +930,9 @@ bool init_wifi(String ssid, String pass)
             return false;
         }
     }
-    log(" success: " + WiFi.localIP().toString(), false);
+    log(F(" success: "), false);
+    Serial.print(WiFi.localIP());
+    configTzTime(TZ_INFO, "pool.ntp.org"); // history records need wall clock time
     delay(2000);
     start_mdns_service();
     add_mdns_services();
@@ -513,87 +1015,127 @@ void disconnect_bluetooth()
     bluetooth_disconnect = false;
 }
 
+// Handles the readings the radio task decoded since the last call
 bool receive433()
 {
-    // Set buffer to size of expected message
-    uint8_t buf[RH_ASK_MAX_MESSAGE_LEN];
-    uint8_t buflen = sizeof(buf);
-    // Check if received packet is correct size
-    if (driver.recv(buf, &buflen))
-    {
-        data_received = true;
-        uptime::calculateUptime();
-        uptime_minutes_received = uptime::getMinutesRaw();
-        int i;
-        String message;
-        for (i = 0; i < buflen; i++)
-        {
-            char c = (buf[i]);
-            message = message + c; // make a message from the received characters
-        }
-        String hum = getValue(message, ',', 0);
-        String temp = getValue(message, ',', 1);
-        String dist = getValue(message, ',', 2);
-        String batteryPercentage = getValue(message, ',', 3);
-        String batteryVoltage = getValue(message, ',', 4);
-
-        humidity = hum.toFloat();
-        temperature = temp.toFloat();
-        distance = dist.toInt();
-        battPerc = batteryPercentage.toInt();
-        battVoltage = batteryVoltage.toFloat();
-
-        // Message received with valid checksum
-        Serial.print(F("Vlhkost: "));
-        Serial.print(hum);
-        Serial.print(F(" %, Teplota: "));
-        Serial.print(temp);
-        Serial.println(F(" Celsius"));
-        Serial.print(F("Distance = "));
-        Serial.print(dist);
-        Serial.println(F(" cm"));
-        Serial.print(F("Batt percent: "));
-        Serial.print(batteryPercentage);
-        Serial.println(F("%"));
-        Serial.print(F("Batt voltage: "));
-        Serial.print(batteryVoltage);
-        Serial.println(F("V"));
-        return true;
-    }
-
-    return false;
-}
-
-void thingspeakSendData()
-{
-    if (thingspeakApiKey == "" || thingspeakChannel == 0)
-        return;
+    static uint32_t rejected = 0;
+    radio_stats stats = radio.stats();
+    if (stats.packets_rejected != rejected)
+    {
+        rejected = stats.packets_rejected;
+        Serial.print(F("Packet rejected: "));
+        Serial.println(packetStatusName((packet_status)stats.last_reject));
+    }
 
-    ThingSpeak.setField(1, humidity);
-    ThingSpeak.setField(2, temperature);
-    ThingSpeak.setField(3, (int)(hloubka - distance - napust));
-    ThingSpeak.setField(4, battVoltage);
-    char cstr[100];
-    thingspeakApiKey.toCharArray(cstr, 100);
-    ThingSpeak.writeFields(thingspeakChannel, cstr);
+    bool received = false;
+    radio_packet packet;
+    while (radio.pop(packet))
+        received |= handlePacket(packet);
+    return received;
 }
 
-String getValue(String data, char separator, int index)
+bool handlePacket(const radio_packet &packet)
 {
-    int found = 0;
-    int strIndex[] = {0, -1};
-    int maxIndex = data.length() - 1;
+    const sensor_reading &reading = packet.reading;
+    // a frame repeated by the sender (or the radio) carries nothing new, a late one is older than the reading
+    // already applied; the link statistics count both
+    link_event event = links.update(reading.sensor_id, reading.has_seq, reading.seq, packet.arrival_ms);
+    if (event == LINK_DUPLICATE || event == LINK_LATE)
+        return false;
 
-    for (int i = 0; i <= maxIndex && found <= index; i++)
+    tank_sensor *sensor = sensors.find(reading.sensor_id);
+    if (sensor == nullptr)
     {
-        if (data.charAt(i) == separator || i == maxIndex)
+        // only the first reading of a new sensor gets here
+        sensor = registerSensor(reading.sensor_id);
+        if (sensor == nullptr)
         {
-            found++;
-            strIndex[0] = strIndex[1] + 1;
-            strIndex[1] = (i == maxIndex) ? i + 1 : i;
+            Serial.print(F("Sensor table full, ignoring sensor "));
+            Serial.println(reading.sensor_id);
+            return false;
         }
     }
-    return found > index ? data.substring(strIndex[0], strIndex[1]) : "";
+    uptime::calculateUptime();
+    SensorRegistry::apply(*sensor, reading, packet.arrival_ms, uptime::getMinutesRaw());
+    if (trendUpdate(sensor->trend, time(nullptr), sensor->level, sensor->depth))
+    {
+        uint8_t id = sensor->id;
+        uint32_t emptiedAt = sensor->trend.emptied_at;
+        settings.update([id, emptiedAt](jimka_config &config) {
+            tank_config *tank = ConfigStore::tank(config, id, true);
+            if (tank != nullptr)
+                tank->emptied_at = emptiedAt;
+        });
+    }
+    // handed to the notifier and MQTT tasks, a full queue drops the event rather than wait for the network
+    alert_event events[ALERT_KINDS];
+    size_t count = alertReading(*sensor, packet.arrival_ms, events);
+    for (size_t i = 0; i < count; i++)
+    {
+        alertNotifier.enqueue(events[i]);
+        mqtt.publishAlert(events[i]);
+    }
+    // queued while Wi-Fi is down too, the sinks forward it once the connection is back
+    publishTelemetry(*sensor, packet.arrival_ms);
+    updateStateJson();
+    recordHistory(*sensor);
+
+    Serial.print(F("Sensor "));
+    Serial.print(sensor->id);
+    Serial.print(F(": Vlhkost: "));
+    Serial.print(sensor->humidity);
+    Serial.print(F(" %, Teplota: "));
+    Serial.print(sensor->temperature);
+    Serial.println(F(" Celsius"));
+    Serial.print(F("Distance = "));
+    Serial.print(sensor->distance);
+    Serial.println(F(" cm"));
+    Serial.print(F("Batt percent: "));
+    Serial.print(sensor->batt_perc);
+    Serial.println(F("%"));
+    Serial.print(F("Batt voltage: "));
+    Serial.print(sensor->batt_voltage);
+    Serial.println(F("V"));
+    return true;
+}
+
+// Sensors that went silent, once a minute from the loop
+void checkStaleSensors()
+{
+    static uint32_t lastCheck = 0;
+    if (millis() - lastCheck < 60000UL)
+        return;
+    lastCheck = millis();
+    uptime::calculateUptime();
+    for (size_t i = 0; i < sensors.count(); i++)
+    {
+        alert_event event;
+        if (alertStale(sensors.at(i), uptime::getMinutesRaw(), lastCheck, &event) > 0)
+        {
+            alertNotifier.enqueue(event);
+            mqtt.publishAlert(event);
+        }
+    }
+}
+
+// One reading to every enabled telemetry sink, each takes it into its own queue
+void publishTelemetry(const tank_sensor &sensor, uint32_t arrivalMs)
+{
+    time_t now = time(nullptr);
+    telemetry_reading reading;
+    reading.sensor_id = sensor.id;
+    reading.index = sensors.slotOf(sensor);
+    reading.time = clockIsSet(now) ? now : 0;
+    reading.queued_ms = arrivalMs;
+    reading.level = sensor.level;
+    reading.fill_perc = sensor.fill_perc;
+    reading.distance = sensor.distance;
+    reading.temperature = sensor.temperature;
+    reading.humidity = sensor.humidity;
+    reading.batt_perc = sensor.batt_perc;
+    reading.batt_voltage = sensor.batt_voltage;
+    reading.fill_rate = sensor.trend.rate;
+    telemetry.publish(reading);
 }
 
 void setup()
@@ -611,6 +1153,15 @@ void setup()
         return;
     }
 
+    Serial.print(F("Static assets: "));
+    Serial.println(staticAssets.scan());
+    loadTemplate(indexPage, "/index.html");
+    loadTemplate(graphsPage, "/graphs.html");
+    loadTemplate(configurationPage, "/configuration.html");
+    loadTemplate(indexGzip, "/index.html.gzt");
+    loadTemplate(graphsGzip, "/graphs.html.gzt");
+    loadTemplate(configurationGzip, "/configuration.html.gzt");
+
     attachInterrupt(PushButton, isr, RISING);
     delay(2000);
     if (clear_preferences_requested)
@@ -623,6 +1174,12 @@ void setup()
     String pref_pass = preferences.getString("pref_pass", "");
     preferences.end();
     getJimkaPreferences();
+    updateStateJson();
+
+    // started before Wi-Fi, readings that arrive while it connects wait in the queue
+    Serial.println("Before 433 Mhz init");
+    if (!radio.begin())
+        Serial.println(F("433 MHz init failed"));
 
     if (pref_ssid == "")
     {
@@ -633,7 +1190,7 @@ void setup()
     }
     else
     {
-        while (!init_wifi(pref_ssid, pref_pass))
+        while (!init_wifi(pref_ssid.c_str(), pref_pass.c_str()))
         {
             runner.execute();
             log(F("Could not connect to the selected WiFi network, waiting 10 seconds"));
@@ -643,23 +1200,41 @@ void setup()
         SerialBT.register_callback(callback_show_ip);
         startWebServer();
     }
-    Serial.println("Before 433 Mhz init");
-
-    if (!driver.init())
-        Serial.println(F("433 MHz init failed"));
-
-    ThingSpeak.begin(client); // Initialize ThingSpeak
+    if (!thingspeak.begin())
+        Serial.println(F("ThingSpeak uploader could not be started"));
+    if (!alertNotifier.begin())
+        Serial.println(F("Alert notifier could not be started"));
+    if (!mqtt.begin())
+        Serial.println(F("MQTT publisher could not be started"));
+    if (!influx.begin() || !readingHook.begin())
+        Serial.println(F("Telemetry sinks could not be started"));
+    telemetry.add(SINK_THINGSPEAK, thingspeak);
+    telemetry.add(SINK_MQTT, mqtt);
+    telemetry.add(SINK_INFLUX, influx);
+    telemetry.add(SINK_WEBHOOK, readingHook);
+    tasks.add("loop", xTaskGetCurrentTaskHandle());
+    tasks.add("radio", radio.task());
+    tasks.add("thingspeak", thingspeak.task());
+    tasks.add("alerts", alertNotifier.task());
+    tasks.add("mqtt", mqtt.task());
+    tasks.add("influx", influx.task());
+    tasks.add("webhook", readingHook.task());
     Serial.println("before easyDDNS");
     EasyDDNS.service(F("duckdns"));
-    if (duckdnsDomain != "" && duckdnsToken != "")
-        EasyDDNS.client(duckdnsDomain, duckdnsToken);
+    const jimka_config &config = settings.get();
+    if (config.duckdns_domain[0] != '\0' && config.duckdns_token[0] != '\0')
+        EasyDDNS.client(config.duckdns_domain, config.duckdns_token);
 
     Serial.println("setup done");
 }
 
 void loop()
 {
+    tasks.loopTick();
+    metricsSampleHeap();
     runner.execute();
+    if (Serial.available())
+        serialCommand();
     if (bluetooth_disconnect)
     {
         disconnect_bluetooth();
@@ -690,12 +1265,12 @@ void loop()
         preferences.putString("pref_ssid", client_wifi_ssid);
         preferences.putString("pref_pass", client_wifi_password);
         preferences.end();
-        if (init_wifi(client_wifi_ssid, client_wifi_password))
+        if (init_wifi(client_wifi_ssid.c_str(), client_wifi_password.c_str()))
         { // Connected to WiFi
             connected_string = "ESP32 IP: ";
             connected_string = connected_string + WiFi.localIP().toString();
             SerialBT.println(connected_string);
-            log(connected_string);
+            log(connected_string.c_str());
             bluetooth_disconnect = true;
         }
         else
@@ -713,12 +1288,28 @@ void loop()
     }
 
     bool r433 = receive433();
-    if (WiFi.localIP().toString() != "0.0.0.0")
+    if (settingsChanged)
     {
-        if (duckdnsDomain != "" && duckdnsToken != "")
-            EasyDDNS.update(10000, true);
+        settingsChanged = false;
+        applySavedSettings();
+        r433 = true;
+    }
+    if (r433)
+        livePush.publish();
+    checkStaleSensors();
+    livePush.service();
+    for (size_t i = 0; i < sensors.count(); i++)
+    {
+        if (sensors.at(i).history != nullptr)
+            sensors.at(i).history->service();
+    }
+    settings.service();
 
-        if (r433)
-            thingspeakSendData();
+    // compared as a number, formatting the address allocated a String on every pass
+    if ((uint32_t)WiFi.localIP() != 0)
+    {
+        const jimka_config &config = settings.get();
+        if (config.duckdns_domain[0] != '\0' && config.duckdns_token[0] != '\0')
+            EasyDDNS.update(10000, true);
     }
 }